@@ -80,7 +80,13 @@ void Application::run()
 
     while (_window)
     {
-        const Array<InputEvent>& inputEvents = Console::readInput();
+        const Array<InputEvent>& inputEvents = Console::readInput(IDLE_TIMEOUT);
+
+        if (inputEvents.empty())
+        {
+            onIdle();
+            continue;
+        }
 
         for (int i = 0; i < inputEvents.size(); ++i)
             if (inputEvents[i].eventType == INPUT_EVENT_TYPE_WINDOW)
@@ -143,6 +149,8 @@ void Application::createWindow(int width, int height)
     g_signal_connect(_drawingArea, "button-press-event", G_CALLBACK(buttonPressEventHandler), nullptr);
     g_signal_connect(_drawingArea, "key-press-event", G_CALLBACK(keyPressEventHandler), nullptr);
 
+    g_timeout_add(IDLE_TIMEOUT, idleEventHandler, nullptr);
+
     gtk_widget_set_events(_drawingArea,
         gtk_widget_get_events(_drawingArea) | GDK_BUTTON_PRESS_MASK | GDK_KEY_PRESS_MASK);
 
@@ -257,6 +265,21 @@ void Application::onInput(const Array<InputEvent>& inputEvents)
 {
 }
 
+void Application::onIdle()
+{
+}
+
+bool Application::inputPending() const
+{
+#if defined(GUI_MODE) && defined(PLATFORM_WINDOWS)
+    return HIWORD(GetQueueStatus(QS_INPUT)) != 0;
+#elif defined(GUI_MODE) && defined(PLATFORM_LINUX)
+    return gtk_events_pending();
+#else
+    return Console::inputPending();
+#endif
+}
+
 #ifdef GUI_MODE
 
 #if defined(PLATFORM_WINDOWS)
@@ -279,6 +302,11 @@ LRESULT CALLBACK Application::windowProc(HWND handle, UINT message, WPARAM wPara
         case WM_CREATE:
             _application->_window = reinterpret_cast<uintptr_t>(handle);
             _application->onCreate();
+            SetTimer(handle, 1, IDLE_TIMEOUT, nullptr);
+            return 0;
+
+        case WM_TIMER:
+            _application->onIdle();
             return 0;
 
         case WM_DESTROY:
@@ -548,6 +576,12 @@ gboolean Application::keyPressEventHandler(GtkWidget* widget, GdkEventKey* event
     return FALSE;
 }
 
+gboolean Application::idleEventHandler(gpointer data)
+{
+    _application->onIdle();
+    return TRUE;
+}
+
 #endif
 
 #endif
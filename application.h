@@ -48,6 +48,12 @@ protected:
     virtual void onPaint(uintptr_t context = 0);
     virtual void onResize(int width, int height);
     virtual void onInput(const Array<InputEvent>& inputEvents);
+    virtual void onIdle();
+
+    bool inputPending() const;
+
+protected:
+    static const int IDLE_TIMEOUT = 50;
 
 protected:
     Array<String> _args;
@@ -75,6 +81,7 @@ protected:
     static gboolean configureEventHandler(GtkWidget* widget, GdkEvent* event, gpointer data);
     static gboolean buttonPressEventHandler(GtkWidget* widget, GdkEventButton* event, gpointer data);
     static gboolean keyPressEventHandler(GtkWidget* widget, GdkEventKey* event, gpointer data);
+    static gboolean idleEventHandler(gpointer data);
 #endif
 
 #endif
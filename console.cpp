@@ -744,7 +744,21 @@ void Console::setCursorPosition(int line, int column)
 
 #endif
 
-const Array<InputEvent>& Console::readInput()
+bool Console::inputPending()
+{
+#ifdef PLATFORM_WINDOWS
+    HANDLE handle = GetStdHandle(STD_INPUT_HANDLE);
+    ASSERT(handle);
+
+    DWORD numInputRec = 0;
+    return GetNumberOfConsoleInputEvents(handle, &numInputRec) && numInputRec > 0;
+#else
+    struct pollfd fds = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&fds, 1, 0) > 0;
+#endif
+}
+
+const Array<InputEvent>& Console::readInput(int timeout)
 {
     _inputEvents.clear();
 
@@ -753,7 +767,7 @@ const Array<InputEvent>& Console::readInput()
     HANDLE handle = GetStdHandle(STD_INPUT_HANDLE);
     ASSERT(handle);
 
-    if (WaitForSingleObject(handle, INFINITE) == WAIT_OBJECT_0)
+    if (WaitForSingleObject(handle, timeout < 0 ? INFINITE : timeout) == WAIT_OBJECT_0)
     {
         DWORD numInputRec = 0;
         BOOL rc = GetNumberOfConsoleInputEvents(handle, &numInputRec);
@@ -927,6 +941,7 @@ const Array<InputEvent>& Console::readInput()
 #else
 
     bool gotChars = false;
+    int64_t deadline = timeout < 0 ? 0 : Timer::ticks() + timeout * 1000LL;
     _inputChars.clear();
 
     while (true)
@@ -956,6 +971,8 @@ const Array<InputEvent>& Console::readInput()
                 _inputEvents.addLast(InputEvent(windowEvent));
                 return _inputEvents;
             }
+            else if (timeout >= 0 && Timer::ticks() >= deadline)
+                return _inputEvents;
             else
                 usleep(10000);
         }
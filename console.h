@@ -191,7 +191,8 @@ public:
     static void showCursor(bool show);
     static void setCursorPosition(int line, int column);
 
-    static const Array<InputEvent>& readInput();
+    static const Array<InputEvent>& readInput(int timeout = -1);
+    static bool inputPending();
 
 protected:
     static ForegroundColor _defaultForeground;
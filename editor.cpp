@@ -1,14 +1,40 @@
 #include <editor.h>
 #include <console.h>
 
-const char_t* APPLICATION_NAME = STR("ev");
-
 #ifdef PLATFORM_WINDOWS
 const char_t* CONFIG_FILE_NAME = STR("ev.cfg");
+const char_t* GRAMMAR_FILE_NAME = STR("ev.grammars");
+const char_t* GRAMMAR_CACHE_NAME = STR("ev.grammars.cache");
+const char_t* VOCABULARY_FILE_NAME = STR("ev.vocabulary");
 #else
 const char_t* CONFIG_FILE_NAME = STR(".ev.cfg");
+const char_t* GRAMMAR_FILE_NAME = STR(".ev.grammars");
+const char_t* GRAMMAR_CACHE_NAME = STR(".ev.grammars.cache");
+const char_t* VOCABULARY_FILE_NAME = STR(".ev.vocabulary");
 #endif
 
+const char_t* FIND_RESULTS_NAME = STR("[find results]");
+const BackgroundColor SEARCH_MATCH_BACKGROUND = BACKGROUND_COLOR_YELLOW;
+const int REPLACE_PROGRESS_INTERVAL = 100;
+const int HIGHLIGHTING_CHECKPOINT_INTERVAL = 512;
+const int HIGHLIGHTING_CHUNK_SIZE = 16 * 1024 * 1024;
+const int HIGHLIGHTING_LOOKAHEAD = 4;
+const int HIGHLIGHTING_SLICE_SIZE = 64 * 1024;
+const int HIGHLIGHTING_FRAME_BUDGET = 10;
+const int BRACKET_SYNC_INTERVAL = 256;
+const int BRACKET_SCAN_CHUNK_SIZE = 256 * 1024;
+const int AUTOCOMPLETE_BATCH_SIZE = 16;
+const int AUTOCOMPLETE_NEARBY_LINES = 16;
+const int AUTOCOMPLETE_NEAR_LINES = 256;
+const int AUTOCOMPLETE_NEAR_LENGTH = 64 * 1024;
+const int AUTOCOMPLETE_COUNT_BITS = 24;
+const int AUTOCOMPLETE_MAX_WORD_LENGTH = 64;
+const int AUTOCOMPLETE_CHECKPOINT_INTERVAL = 64 * 1024;
+const int QUICK_OPEN_MAX_PATHS = 100;
+const int QUICK_OPEN_LINES = 10;
+const int QUICK_OPEN_TIMEOUT = 1000;
+const int FILENAME_COMPLETION_MAX_PATHS = 100;
+
 #ifdef GUI_MODE
 
 static Color GUI_BACKGROUND = 0xffffff;
@@ -120,196 +146,332 @@ ScreenCell::ScreenCell() :
 {
 }
 
+// SyntaxHighlighter
+
+static inline unichar_t asciiUnit(char_t unit)
+{
+    // code units of multibyte characters map to a value that matches no ASCII delimiter
+
+    return static_cast<unichar_t>(unit) < 0x80 ? static_cast<unichar_t>(unit) : 0x80;
+}
+
+static inline int findLineBreak(const char_t* chars, int pos, int end)
+{
+    // a line break is a single code unit, where code units are bytes long lines are scanned with memchr
+
+#ifdef CHAR_ENCODING_UTF8
+    const void* lineBreak = memchr(chars + pos, '\n', end - pos);
+    return lineBreak ? static_cast<int>(static_cast<const char_t*>(lineBreak) - chars) : end;
+#else
+    while (pos < end && chars[pos] != '\n')
+        ++pos;
+
+    return pos;
+#endif
+}
+
+static inline bool asciiIsWord(unichar_t ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static inline bool isNumberChar(unichar_t ch)
+{
+    return charIsDigit(ch) || ch == 'x' || ch == 'X' || ch == 'a' || ch == 'A' || ch == 'b' || ch == 'B' ||
+           ch == 'c' || ch == 'C' || ch == 'd' || ch == 'D' || ch == 'e' || ch == 'E' || ch == 'f' || ch == 'F' ||
+           ch == '.' || ch == '+' || ch == '-';
+}
+
+static inline int skipWord(const String& text, int pos)
+{
+    const char_t* chars = text.chars();
+    int len = text.length();
+
+    while (pos < len)
+    {
+        unichar_t ch = asciiUnit(chars[pos]);
+
+        if (ch != 0x80)
+        {
+            if (!asciiIsWord(ch))
+                break;
+            ++pos;
+        }
+        else if (charIsAlphaNum(text.charAt(pos)))
+            pos = text.charForward(pos);
+        else
+            break;
+    }
+
+    return pos;
+}
+
+static inline int charCount(const String& text, int begin, int end)
+{
+    int n = 0;
+
+    for (int p = begin; p < end; p = text.charForward(p))
+        ++n;
+
+    return n;
+}
+
+void SyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                       Array<HighlightSpan>& spans) const
+{
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
+
+    for (int p = begin; p < end; )
+    {
+        highlightChar(text, p, state);
+
+        int q = text.charForward(p);
+        appendSpan(spans, q - p, state.highlightingType);
+        p = q;
+    }
+}
+
+// KeywordTable
+
+struct Keyword
+{
+    const char* word;
+    HighlightingType highlightingType;
+};
+
+constexpr uint32_t keywordHash(const char* word, uint32_t hash)
+{
+    return *word ? keywordHash(word + 1, (hash ^ static_cast<uint8_t>(*word)) * 16777619u) : hash;
+}
+
+inline uint32_t keywordHash(const char_t* chars, int len, uint32_t hash)
+{
+    for (int i = 0; i < len; ++i)
+        hash = (hash ^ static_cast<uint32_t>(chars[i])) * 16777619u;
+
+    return hash;
+}
+
+constexpr int keywordSlot(uint32_t hash, int size)
+{
+    return static_cast<int>((hash ^ (hash >> 15)) & static_cast<uint32_t>(size - 1));
+}
+
+inline bool wordEquals(const char_t* chars, int len, const char* word)
+{
+    for (int i = 0; i < len; ++i)
+        if (chars[i] != static_cast<char_t>(word[i]) || !word[i])
+            return false;
+
+    return word[len] == 0;
+}
+
+template<int... _indices>
+struct IndexSequence
+{
+};
+
+template<typename _Left, typename _Right>
+struct ConcatIndexSequence;
+
+template<int... _left, int... _right>
+struct ConcatIndexSequence<IndexSequence<_left...>, IndexSequence<_right...>>
+{
+    typedef IndexSequence<_left..., static_cast<int>(sizeof...(_left)) + _right...> Type;
+};
+
+template<int _size>
+struct MakeIndexSequence
+{
+    typedef typename ConcatIndexSequence<typename MakeIndexSequence<_size / 2>::Type,
+                                         typename MakeIndexSequence<_size - _size / 2>::Type>::Type Type;
+};
+
+template<>
+struct MakeIndexSequence<0>
+{
+    typedef IndexSequence<> Type;
+};
+
+template<>
+struct MakeIndexSequence<1>
+{
+    typedef IndexSequence<0> Type;
+};
+
+template<int _size>
+class KeywordTable
+{
+public:
+    // slots are filled at compile time, the seed is chosen so that no two keywords share a slot
+
+    template<int _numKeywords, int... _slots>
+    constexpr KeywordTable(const Keyword (&keywords)[_numKeywords], uint32_t seed, IndexSequence<_slots...>) :
+        _keywords(keywords), _numKeywords(_numKeywords), _seed(seed),
+        _slots{ static_cast<int16_t>(findKeyword(keywords, _numKeywords, seed, _slots, 0))... }
+    {
+    }
+
+    constexpr bool perfect(int i = 0) const
+    {
+        return i == _numKeywords ||
+            (_slots[keywordSlot(keywordHash(_keywords[i].word, _seed), _size)] == i && perfect(i + 1));
+    }
+
+    HighlightingType find(const char_t* chars, int len) const
+    {
+        int i = _slots[keywordSlot(keywordHash(chars, len, _seed), _size)];
+
+        if (i >= 0 && wordEquals(chars, len, _keywords[i].word))
+            return _keywords[i].highlightingType;
+
+        return HIGHLIGHTING_TYPE_NONE;
+    }
+
+protected:
+    static constexpr int findKeyword(const Keyword* keywords, int numKeywords, uint32_t seed, int slot, int i)
+    {
+        return i == numKeywords ? -1 :
+            keywordSlot(keywordHash(keywords[i].word, seed), _size) == slot ? i :
+            findKeyword(keywords, numKeywords, seed, slot, i + 1);
+    }
+
+protected:
+    const Keyword* _keywords;
+    int _numKeywords;
+    uint32_t _seed;
+    int16_t _slots[_size];
+};
+
 // CppSyntaxHighlighter
 
-CppSyntaxHighlighter::CppSyntaxHighlighter() : SyntaxHighlighter(DOCUMENT_TYPE_CPP)
-{
-    _keywords.add(String(STR("alignas")));
-    _keywords.add(String(STR("alignof")));
-    _keywords.add(String(STR("and")));
-    _keywords.add(String(STR("and_eq")));
-    _keywords.add(String(STR("asm")));
-    _keywords.add(String(STR("atomic_cancel")));
-    _keywords.add(String(STR("atomic_commit")));
-    _keywords.add(String(STR("atomic_noexcept")));
-    _keywords.add(String(STR("bitand")));
-    _keywords.add(String(STR("bitor")));
-    _keywords.add(String(STR("break")));
-    _keywords.add(String(STR("case")));
-    _keywords.add(String(STR("catch")));
-    _keywords.add(String(STR("class")));
-    _keywords.add(String(STR("compl")));
-    _keywords.add(String(STR("concept")));
-    _keywords.add(String(STR("const_cast")));
-    _keywords.add(String(STR("continue")));
-    _keywords.add(String(STR("co_await")));
-    _keywords.add(String(STR("co_return")));
-    _keywords.add(String(STR("co_yield")));
-    _keywords.add(String(STR("decltype")));
-    _keywords.add(String(STR("default")));
-    _keywords.add(String(STR("delete")));
-    _keywords.add(String(STR("do")));
-    _keywords.add(String(STR("dynamic_cast")));
-    _keywords.add(String(STR("else")));
-    _keywords.add(String(STR("enum")));
-    _keywords.add(String(STR("explicit")));
-    _keywords.add(String(STR("export")));
-    _keywords.add(String(STR("extern")));
-    _keywords.add(String(STR("false")));
-    _keywords.add(String(STR("for")));
-    _keywords.add(String(STR("friend")));
-    _keywords.add(String(STR("goto")));
-    _keywords.add(String(STR("if")));
-    _keywords.add(String(STR("import")));
-    _keywords.add(String(STR("inline")));
-    _keywords.add(String(STR("module")));
-    _keywords.add(String(STR("mutable")));
-    _keywords.add(String(STR("namespace")));
-    _keywords.add(String(STR("new")));
-    _keywords.add(String(STR("noexcept")));
-    _keywords.add(String(STR("not")));
-    _keywords.add(String(STR("not_eq")));
-    _keywords.add(String(STR("nullptr")));
-    _keywords.add(String(STR("operator")));
-    _keywords.add(String(STR("or")));
-    _keywords.add(String(STR("or_eq")));
-    _keywords.add(String(STR("private")));
-    _keywords.add(String(STR("protected")));
-    _keywords.add(String(STR("public")));
-    _keywords.add(String(STR("register")));
-    _keywords.add(String(STR("reflexpr")));
-    _keywords.add(String(STR("reinterpret_cast")));
-    _keywords.add(String(STR("requires")));
-    _keywords.add(String(STR("return")));
-    _keywords.add(String(STR("sizeof")));
-    _keywords.add(String(STR("static")));
-    _keywords.add(String(STR("static_assert")));
-    _keywords.add(String(STR("static_cast")));
-    _keywords.add(String(STR("struct")));
-    _keywords.add(String(STR("switch")));
-    _keywords.add(String(STR("synchronized")));
-    _keywords.add(String(STR("template")));
-    _keywords.add(String(STR("this")));
-    _keywords.add(String(STR("thread_local")));
-    _keywords.add(String(STR("throw")));
-    _keywords.add(String(STR("true")));
-    _keywords.add(String(STR("try")));
-    _keywords.add(String(STR("typedef")));
-    _keywords.add(String(STR("typeid")));
-    _keywords.add(String(STR("typename")));
-    _keywords.add(String(STR("union")));
-    _keywords.add(String(STR("using")));
-    _keywords.add(String(STR("virtual")));
-    _keywords.add(String(STR("while")));
-    _keywords.add(String(STR("xor")));
-    _keywords.add(String(STR("xor_eq")));
-    _keywords.add(String(STR("override")));
-    _keywords.add(String(STR("final")));
-    _keywords.add(String(STR("transaction_safe")));
-    _keywords.add(String(STR("transaction_safe_dynamic")));
-    _keywords.add(String(STR("_Pragma")));
-
-    _types.add(String(STR("auto")));
-    _types.add(String(STR("bool")));
-    _types.add(String(STR("byte")));
-    _types.add(String(STR("char")));
-    _types.add(String(STR("char16_t")));
-    _types.add(String(STR("char32_t")));
-    _types.add(String(STR("const")));
-    _types.add(String(STR("constexpr")));
-    _types.add(String(STR("double")));
-    _types.add(String(STR("float")));
-    _types.add(String(STR("int")));
-    _types.add(String(STR("long")));
-    _types.add(String(STR("short")));
-    _types.add(String(STR("signed")));
-    _types.add(String(STR("unsigned")));
-    _types.add(String(STR("void")));
-    _types.add(String(STR("volatile")));
-    _types.add(String(STR("wchar_t")));
-    _types.add(String(STR("int8_t")));
-    _types.add(String(STR("int16_t")));
-    _types.add(String(STR("int32_t")));
-    _types.add(String(STR("int64_t")));
-    _types.add(String(STR("uint8_t")));
-    _types.add(String(STR("uint16_t")));
-    _types.add(String(STR("uint32_t")));
-    _types.add(String(STR("uint64_t")));
-    _types.add(String(STR("intptr_t")));
-    _types.add(String(STR("uintptr_t")));
-    _types.add(String(STR("intmax_t")));
-    _types.add(String(STR("uintmax_t")));
-    _types.add(String(STR("size_t")));
-    _types.add(String(STR("ptrdiff_t")));
-    _types.add(String(STR("nullptr_t")));
-    _types.add(String(STR("max_align_t")));
-    _types.add(String(STR("unichar_t")));
-    _types.add(String(STR("char_t")));
-    _types.add(String(STR("byte_t")));
-
-    _preprocessor.add(String(STR("if")));
-    _preprocessor.add(String(STR("elif")));
-    _preprocessor.add(String(STR("else")));
-    _preprocessor.add(String(STR("endif")));
-    _preprocessor.add(String(STR("defined")));
-    _preprocessor.add(String(STR("ifdef")));
-    _preprocessor.add(String(STR("ifndef")));
-    _preprocessor.add(String(STR("define")));
-    _preprocessor.add(String(STR("undef")));
-    _preprocessor.add(String(STR("include")));
-    _preprocessor.add(String(STR("line")));
-    _preprocessor.add(String(STR("error")));
-    _preprocessor.add(String(STR("pragma")));
-}
-
-void CppSyntaxHighlighter::highlightChar(const String& text, int pos)
-{
-    if (_highlightingState.charsRemaining > 0)
-    {
-        --_highlightingState.charsRemaining;
-        if (_highlightingState.charsRemaining > 0)
+static constexpr Keyword CPP_KEYWORDS[] = {
+    { "alignas", HIGHLIGHTING_TYPE_KEYWORD }, { "alignof", HIGHLIGHTING_TYPE_KEYWORD },
+    { "and", HIGHLIGHTING_TYPE_KEYWORD }, { "and_eq", HIGHLIGHTING_TYPE_KEYWORD },
+    { "asm", HIGHLIGHTING_TYPE_KEYWORD }, { "atomic_cancel", HIGHLIGHTING_TYPE_KEYWORD },
+    { "atomic_commit", HIGHLIGHTING_TYPE_KEYWORD }, { "atomic_noexcept", HIGHLIGHTING_TYPE_KEYWORD },
+    { "bitand", HIGHLIGHTING_TYPE_KEYWORD }, { "bitor", HIGHLIGHTING_TYPE_KEYWORD },
+    { "break", HIGHLIGHTING_TYPE_KEYWORD }, { "case", HIGHLIGHTING_TYPE_KEYWORD },
+    { "catch", HIGHLIGHTING_TYPE_KEYWORD }, { "class", HIGHLIGHTING_TYPE_KEYWORD },
+    { "compl", HIGHLIGHTING_TYPE_KEYWORD }, { "concept", HIGHLIGHTING_TYPE_KEYWORD },
+    { "const_cast", HIGHLIGHTING_TYPE_KEYWORD }, { "continue", HIGHLIGHTING_TYPE_KEYWORD },
+    { "co_await", HIGHLIGHTING_TYPE_KEYWORD }, { "co_return", HIGHLIGHTING_TYPE_KEYWORD },
+    { "co_yield", HIGHLIGHTING_TYPE_KEYWORD }, { "decltype", HIGHLIGHTING_TYPE_KEYWORD },
+    { "default", HIGHLIGHTING_TYPE_KEYWORD }, { "delete", HIGHLIGHTING_TYPE_KEYWORD },
+    { "do", HIGHLIGHTING_TYPE_KEYWORD }, { "dynamic_cast", HIGHLIGHTING_TYPE_KEYWORD },
+    { "else", HIGHLIGHTING_TYPE_KEYWORD }, { "enum", HIGHLIGHTING_TYPE_KEYWORD },
+    { "explicit", HIGHLIGHTING_TYPE_KEYWORD }, { "export", HIGHLIGHTING_TYPE_KEYWORD },
+    { "extern", HIGHLIGHTING_TYPE_KEYWORD }, { "false", HIGHLIGHTING_TYPE_KEYWORD },
+    { "for", HIGHLIGHTING_TYPE_KEYWORD }, { "friend", HIGHLIGHTING_TYPE_KEYWORD },
+    { "goto", HIGHLIGHTING_TYPE_KEYWORD }, { "if", HIGHLIGHTING_TYPE_KEYWORD },
+    { "import", HIGHLIGHTING_TYPE_KEYWORD }, { "inline", HIGHLIGHTING_TYPE_KEYWORD },
+    { "module", HIGHLIGHTING_TYPE_KEYWORD }, { "mutable", HIGHLIGHTING_TYPE_KEYWORD },
+    { "namespace", HIGHLIGHTING_TYPE_KEYWORD }, { "new", HIGHLIGHTING_TYPE_KEYWORD },
+    { "noexcept", HIGHLIGHTING_TYPE_KEYWORD }, { "not", HIGHLIGHTING_TYPE_KEYWORD },
+    { "not_eq", HIGHLIGHTING_TYPE_KEYWORD }, { "nullptr", HIGHLIGHTING_TYPE_KEYWORD },
+    { "operator", HIGHLIGHTING_TYPE_KEYWORD }, { "or", HIGHLIGHTING_TYPE_KEYWORD },
+    { "or_eq", HIGHLIGHTING_TYPE_KEYWORD }, { "private", HIGHLIGHTING_TYPE_KEYWORD },
+    { "protected", HIGHLIGHTING_TYPE_KEYWORD }, { "public", HIGHLIGHTING_TYPE_KEYWORD },
+    { "register", HIGHLIGHTING_TYPE_KEYWORD }, { "reflexpr", HIGHLIGHTING_TYPE_KEYWORD },
+    { "reinterpret_cast", HIGHLIGHTING_TYPE_KEYWORD }, { "requires", HIGHLIGHTING_TYPE_KEYWORD },
+    { "return", HIGHLIGHTING_TYPE_KEYWORD }, { "sizeof", HIGHLIGHTING_TYPE_KEYWORD },
+    { "static", HIGHLIGHTING_TYPE_KEYWORD }, { "static_assert", HIGHLIGHTING_TYPE_KEYWORD },
+    { "static_cast", HIGHLIGHTING_TYPE_KEYWORD }, { "struct", HIGHLIGHTING_TYPE_KEYWORD },
+    { "switch", HIGHLIGHTING_TYPE_KEYWORD }, { "synchronized", HIGHLIGHTING_TYPE_KEYWORD },
+    { "template", HIGHLIGHTING_TYPE_KEYWORD }, { "this", HIGHLIGHTING_TYPE_KEYWORD },
+    { "thread_local", HIGHLIGHTING_TYPE_KEYWORD }, { "throw", HIGHLIGHTING_TYPE_KEYWORD },
+    { "true", HIGHLIGHTING_TYPE_KEYWORD }, { "try", HIGHLIGHTING_TYPE_KEYWORD },
+    { "typedef", HIGHLIGHTING_TYPE_KEYWORD }, { "typeid", HIGHLIGHTING_TYPE_KEYWORD },
+    { "typename", HIGHLIGHTING_TYPE_KEYWORD }, { "union", HIGHLIGHTING_TYPE_KEYWORD },
+    { "using", HIGHLIGHTING_TYPE_KEYWORD }, { "virtual", HIGHLIGHTING_TYPE_KEYWORD },
+    { "while", HIGHLIGHTING_TYPE_KEYWORD }, { "xor", HIGHLIGHTING_TYPE_KEYWORD },
+    { "xor_eq", HIGHLIGHTING_TYPE_KEYWORD }, { "override", HIGHLIGHTING_TYPE_KEYWORD },
+    { "final", HIGHLIGHTING_TYPE_KEYWORD }, { "transaction_safe", HIGHLIGHTING_TYPE_KEYWORD },
+    { "transaction_safe_dynamic", HIGHLIGHTING_TYPE_KEYWORD }, { "_Pragma", HIGHLIGHTING_TYPE_KEYWORD },
+    { "auto", HIGHLIGHTING_TYPE_TYPE }, { "bool", HIGHLIGHTING_TYPE_TYPE }, { "byte", HIGHLIGHTING_TYPE_TYPE },
+    { "char", HIGHLIGHTING_TYPE_TYPE }, { "char16_t", HIGHLIGHTING_TYPE_TYPE },
+    { "char32_t", HIGHLIGHTING_TYPE_TYPE }, { "const", HIGHLIGHTING_TYPE_TYPE },
+    { "constexpr", HIGHLIGHTING_TYPE_TYPE }, { "double", HIGHLIGHTING_TYPE_TYPE },
+    { "float", HIGHLIGHTING_TYPE_TYPE }, { "int", HIGHLIGHTING_TYPE_TYPE }, { "long", HIGHLIGHTING_TYPE_TYPE },
+    { "short", HIGHLIGHTING_TYPE_TYPE }, { "signed", HIGHLIGHTING_TYPE_TYPE },
+    { "unsigned", HIGHLIGHTING_TYPE_TYPE }, { "void", HIGHLIGHTING_TYPE_TYPE },
+    { "volatile", HIGHLIGHTING_TYPE_TYPE }, { "wchar_t", HIGHLIGHTING_TYPE_TYPE },
+    { "int8_t", HIGHLIGHTING_TYPE_TYPE }, { "int16_t", HIGHLIGHTING_TYPE_TYPE },
+    { "int32_t", HIGHLIGHTING_TYPE_TYPE }, { "int64_t", HIGHLIGHTING_TYPE_TYPE },
+    { "uint8_t", HIGHLIGHTING_TYPE_TYPE }, { "uint16_t", HIGHLIGHTING_TYPE_TYPE },
+    { "uint32_t", HIGHLIGHTING_TYPE_TYPE }, { "uint64_t", HIGHLIGHTING_TYPE_TYPE },
+    { "intptr_t", HIGHLIGHTING_TYPE_TYPE }, { "uintptr_t", HIGHLIGHTING_TYPE_TYPE },
+    { "intmax_t", HIGHLIGHTING_TYPE_TYPE }, { "uintmax_t", HIGHLIGHTING_TYPE_TYPE },
+    { "size_t", HIGHLIGHTING_TYPE_TYPE }, { "ptrdiff_t", HIGHLIGHTING_TYPE_TYPE },
+    { "nullptr_t", HIGHLIGHTING_TYPE_TYPE }, { "max_align_t", HIGHLIGHTING_TYPE_TYPE },
+    { "unichar_t", HIGHLIGHTING_TYPE_TYPE }, { "char_t", HIGHLIGHTING_TYPE_TYPE },
+    { "byte_t", HIGHLIGHTING_TYPE_TYPE }
+};
+
+static constexpr KeywordTable<1024> CPP_KEYWORD_TABLE(CPP_KEYWORDS, 172, MakeIndexSequence<1024>::Type());
+static_assert(CPP_KEYWORD_TABLE.perfect(), "keywords collide, choose another seed");
+
+static constexpr Keyword CPP_PREPROCESSOR_KEYWORDS[] = {
+    { "if", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "elif", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "else", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "endif", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "defined", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "ifdef", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "ifndef", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "define", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "undef", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "include", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "line", HIGHLIGHTING_TYPE_PREPROCESSOR }, { "error", HIGHLIGHTING_TYPE_PREPROCESSOR },
+    { "pragma", HIGHLIGHTING_TYPE_PREPROCESSOR }
+};
+
+static constexpr KeywordTable<32> CPP_PREPROCESSOR_TABLE(CPP_PREPROCESSOR_KEYWORDS, 72, MakeIndexSequence<32>::Type());
+static_assert(CPP_PREPROCESSOR_TABLE.perfect(), "keywords collide, choose another seed");
+
+void CppSyntaxHighlighter::highlightChar(const String& text, int pos, HighlightingState& state) const
+{
+    if (state.charsRemaining > 0)
+    {
+        --state.charsRemaining;
+        if (state.charsRemaining > 0)
             return;
 
-        if (_highlightingState.reset)
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+        if (state.reset)
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
     }
 
     unichar_t ch = text.charAt(pos);
 
-    if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_STRING)
+    if (state.highlightingType == HIGHLIGHTING_TYPE_STRING)
     {
-        if (_highlightingState.prevCh == '\\')
-            _highlightingState.prevCh = 0;
-        else if (ch == _highlightingState.startCh)
+        if (state.prevCh == '\\')
+            state.prevCh = 0;
+        else if (ch == state.startCh)
         {
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
+            state.charsRemaining = 1;
+            state.reset = true;
         }
         else if (ch == '\\')
-            _highlightingState.prevCh = ch;
+            state.prevCh = ch;
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_NUMBER)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER)
     {
         if (!(charIsDigit(ch) || ch == 'x' || ch == 'X' || ch == 'a' || ch == 'A' || ch == 'b' || ch == 'B' ||
               ch == 'c' || ch == 'C' || ch == 'd' || ch == 'D' || ch == 'e' || ch == 'E' || ch == 'f' || ch == 'F' ||
               ch == '.' || ch == '+' || ch == '-'))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
         else
             return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
     {
         if (ch == '\n')
         {
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
+            state.charsRemaining = 1;
+            state.reset = true;
         }
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
     {
         if (ch == '*')
         {
@@ -319,40 +481,40 @@ void CppSyntaxHighlighter::highlightChar(const String& text, int pos)
             {
                 if (text.charAt(pos) == '/')
                 {
-                    _highlightingState.charsRemaining = 2;
-                    _highlightingState.reset = true;
+                    state.charsRemaining = 2;
+                    state.reset = true;
                 }
             }
         }
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_PREPROCESSOR)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_PREPROCESSOR)
     {
         if (ch == '\n')
         {
-            if (_highlightingState.prevCh != '\\')
+            if (state.prevCh != '\\')
             {
-                _highlightingState.charsRemaining = 1;
-                _highlightingState.reset = true;
+                state.charsRemaining = 1;
+                state.reset = true;
             }
 
-            _highlightingState.prevCh = 0;
+            state.prevCh = 0;
         }
         else if (ch == '\\')
-            _highlightingState.prevCh = ch;
+            state.prevCh = ch;
 
         return;
     }
 
     if (ch == '"' || ch == '\'')
     {
-        _highlightingState.startCh = ch;
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_STRING;
+        state.startCh = ch;
+        state.highlightingType = HIGHLIGHTING_TYPE_STRING;
     }
     else if (charIsDigit(ch))
     {
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
+        state.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
     }
     else if (charIsAlphaNum(ch) || ch == '_')
     {
@@ -367,16 +529,12 @@ void CppSyntaxHighlighter::highlightChar(const String& text, int pos)
                 break;
         } while (charIsAlphaNum(ch) || charIsDigit(ch) || ch == '_');
 
-        _highlightingState.word = text.substr(s, pos - s);
-        _highlightingState.charsRemaining = _highlightingState.word.charLength();
-        _highlightingState.reset = true;
+        state.charsRemaining = charCount(text, s, pos);
+        state.reset = true;
+        state.highlightingType = CPP_KEYWORD_TABLE.find(text.chars() + s, pos - s);
 
-        if (_keywords.contains(_highlightingState.word))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_KEYWORD;
-        else if (_types.contains(_highlightingState.word))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TYPE;
-        else
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_IDENT;
+        if (state.highlightingType == HIGHLIGHTING_TYPE_NONE)
+            state.highlightingType = HIGHLIGHTING_TYPE_IDENT;
     }
     else if (ch == '/')
     {
@@ -388,12 +546,12 @@ void CppSyntaxHighlighter::highlightChar(const String& text, int pos)
 
             if (ch == '*')
             {
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
-                _highlightingState.charsRemaining = 2;
-                _highlightingState.reset = false;
+                state.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
+                state.charsRemaining = 2;
+                state.reset = false;
             }
             else if (ch == '/')
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+                state.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
         }
     }
     else if (ch == '#')
@@ -414,97 +572,313 @@ void CppSyntaxHighlighter::highlightChar(const String& text, int pos)
                     break;
             }
 
-            _highlightingState.word = text.substr(q, pos - q);
+            const char_t* word = text.chars() + q;
 
-            if (_preprocessor.contains(_highlightingState.word))
+            if (CPP_PREPROCESSOR_TABLE.find(word, pos - q) != HIGHLIGHTING_TYPE_NONE)
             {
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_PREPROCESSOR;
+                state.highlightingType = HIGHLIGHTING_TYPE_PREPROCESSOR;
 
-                if (_highlightingState.word == STR("else") || _highlightingState.word == STR("endif"))
+                if (wordEquals(word, pos - q, "else") || wordEquals(word, pos - q, "endif"))
                 {
-                    _highlightingState.charsRemaining = _highlightingState.word.charLength() + 1;
-                    _highlightingState.reset = true;
+                    state.charsRemaining = pos - q + 1;
+                    state.reset = true;
                 }
             }
         }
     }
 }
 
-ShellSyntaxHighlighter::ShellSyntaxHighlighter() : SyntaxHighlighter(DOCUMENT_TYPE_SHELL)
+void CppSyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                          Array<HighlightSpan>& spans) const
 {
-    _keywords.add(String(STR("case")));
-    _keywords.add(String(STR("do")));
-    _keywords.add(String(STR("done")));
-    _keywords.add(String(STR("elif")));
-    _keywords.add(String(STR("else")));
-    _keywords.add(String(STR("esac")));
-    _keywords.add(String(STR("fi")));
-    _keywords.add(String(STR("for")));
-    _keywords.add(String(STR("function")));
-    _keywords.add(String(STR("if")));
-    _keywords.add(String(STR("in")));
-    _keywords.add(String(STR("select")));
-    _keywords.add(String(STR("then")));
-    _keywords.add(String(STR("time")));
-    _keywords.add(String(STR("until")));
-    _keywords.add(String(STR("while")));
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
+
+    // same state machine as highlightChar, but runs of characters that cannot change the state are skipped
+    // by code units in one go, delimiters are ASCII so multibyte characters are never split
+
+    const char_t* chars = text.chars();
+    int len = text.length();
+    int p = begin;
+
+    while (p < end)
+    {
+        int start = p;
+
+        if (state.charsRemaining > 1)
+        {
+            do
+            {
+                p = text.charForward(p);
+                --state.charsRemaining;
+            } while (state.charsRemaining > 1 && p < end);
+
+            appendSpan(spans, p - start, state.highlightingType);
+            continue;
+        }
+
+        if (state.charsRemaining == 1)
+        {
+            state.charsRemaining = 0;
+            if (state.reset)
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+        }
+
+        unichar_t ch = asciiUnit(chars[p]);
+        if (ch == 0x80)
+            ch = text.charAt(p);
+
+        if (state.highlightingType == HIGHLIGHTING_TYPE_STRING)
+        {
+            char_t startCh = static_cast<char_t>(state.startCh);
+
+            if (state.prevCh == '\\')
+            {
+                state.prevCh = 0;
+                p = text.charForward(p);
+            }
+            else if (ch == state.startCh)
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else if (ch == '\\')
+            {
+                state.prevCh = ch;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != startCh && chars[p] != '\\')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER && isNumberChar(ch))
+        {
+            do
+                ++p;
+            while (p < end && isNumberChar(asciiUnit(chars[p])));
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+        {
+            if (ch == '\n')
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '\n')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
+        {
+            if (ch == '*')
+            {
+                if (p + 1 < len && chars[p + 1] == '/')
+                {
+                    state.charsRemaining = 2;
+                    state.reset = true;
+                }
+
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '*')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_PREPROCESSOR)
+        {
+            if (ch == '\n')
+            {
+                if (state.prevCh != '\\')
+                {
+                    state.charsRemaining = 1;
+                    state.reset = true;
+                }
+
+                state.prevCh = 0;
+                ++p;
+            }
+            else if (ch == '\\')
+            {
+                state.prevCh = ch;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '\n' && chars[p] != '\\')
+                    ++p;
+            }
+        }
+        else
+        {
+            if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER)
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+
+            if (ch == '"' || ch == '\'')
+            {
+                state.startCh = ch;
+                state.highlightingType = HIGHLIGHTING_TYPE_STRING;
+                ++p;
+            }
+            else if (charIsDigit(ch))
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
+                ++p;
+            }
+            else if (charIsAlphaNum(ch) || ch == '_')
+            {
+                int q = skipWord(text, text.charForward(p));
+
+                state.reset = true;
+                state.highlightingType = CPP_KEYWORD_TABLE.find(chars + p, q - p);
+
+                if (state.highlightingType == HIGHLIGHTING_TYPE_NONE)
+                    state.highlightingType = HIGHLIGHTING_TYPE_IDENT;
+
+                if (q <= end)
+                {
+                    state.charsRemaining = 1;
+                    p = q;
+                }
+                else
+                {
+                    state.charsRemaining = charCount(text, p, q);
+                    p = text.charForward(p);
+                }
+            }
+            else if (ch == '/')
+            {
+                if (p + 1 < len)
+                {
+                    if (chars[p + 1] == '*')
+                    {
+                        state.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
+                        state.charsRemaining = 2;
+                        state.reset = false;
+                    }
+                    else if (chars[p + 1] == '/')
+                        state.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+                }
+
+                ++p;
+            }
+            else if (ch == '#')
+            {
+                int q = p + 1;
+
+                while (q < len && charIsAlpha(text.charAt(q)))
+                    q = text.charForward(q);
+
+                if (CPP_PREPROCESSOR_TABLE.find(chars + p + 1, q - p - 1) != HIGHLIGHTING_TYPE_NONE)
+                {
+                    state.highlightingType = HIGHLIGHTING_TYPE_PREPROCESSOR;
+
+                    if (wordEquals(chars + p + 1, q - p - 1, "else") || wordEquals(chars + p + 1, q - p - 1, "endif"))
+                    {
+                        state.charsRemaining = q - p;
+                        state.reset = true;
+                    }
+                }
+
+                ++p;
+            }
+            else
+            {
+                p = text.charForward(p);
+
+                while (p < end)
+                {
+                    ch = asciiUnit(chars[p]);
+
+                    if (ch == 0x80 || ch == '"' || ch == '\'' || asciiIsWord(ch) || ch == '/' || ch == '#')
+                        break;
+
+                    ++p;
+                }
+            }
+        }
+
+        appendSpan(spans, p - start, state.highlightingType);
+    }
 }
 
-void ShellSyntaxHighlighter::highlightChar(const String& text, int pos)
+// ShellSyntaxHighlighter
+
+static constexpr Keyword SHELL_KEYWORDS[] = {
+    { "case", HIGHLIGHTING_TYPE_KEYWORD }, { "do", HIGHLIGHTING_TYPE_KEYWORD },
+    { "done", HIGHLIGHTING_TYPE_KEYWORD }, { "elif", HIGHLIGHTING_TYPE_KEYWORD },
+    { "else", HIGHLIGHTING_TYPE_KEYWORD }, { "esac", HIGHLIGHTING_TYPE_KEYWORD },
+    { "fi", HIGHLIGHTING_TYPE_KEYWORD }, { "for", HIGHLIGHTING_TYPE_KEYWORD },
+    { "function", HIGHLIGHTING_TYPE_KEYWORD }, { "if", HIGHLIGHTING_TYPE_KEYWORD },
+    { "in", HIGHLIGHTING_TYPE_KEYWORD }, { "select", HIGHLIGHTING_TYPE_KEYWORD },
+    { "then", HIGHLIGHTING_TYPE_KEYWORD }, { "time", HIGHLIGHTING_TYPE_KEYWORD },
+    { "until", HIGHLIGHTING_TYPE_KEYWORD }, { "while", HIGHLIGHTING_TYPE_KEYWORD }
+};
+
+static constexpr KeywordTable<32> SHELL_KEYWORD_TABLE(SHELL_KEYWORDS, 90, MakeIndexSequence<32>::Type());
+static_assert(SHELL_KEYWORD_TABLE.perfect(), "keywords collide, choose another seed");
+
+void ShellSyntaxHighlighter::highlightChar(const String& text, int pos, HighlightingState& state) const
 {
-    if (_highlightingState.charsRemaining > 0)
+    if (state.charsRemaining > 0)
     {
-        --_highlightingState.charsRemaining;
-        if (_highlightingState.charsRemaining > 0)
+        --state.charsRemaining;
+        if (state.charsRemaining > 0)
             return;
 
-        if (_highlightingState.reset)
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+        if (state.reset)
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
     }
 
     unichar_t ch = text.charAt(pos);
 
-    if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_STRING)
+    if (state.highlightingType == HIGHLIGHTING_TYPE_STRING)
     {
-        if (_highlightingState.prevCh == '\\')
-            _highlightingState.prevCh = 0;
-        else if (ch == _highlightingState.startCh)
+        if (state.prevCh == '\\')
+            state.prevCh = 0;
+        else if (ch == state.startCh)
         {
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
+            state.charsRemaining = 1;
+            state.reset = true;
         }
         else if (ch == '\\')
-            _highlightingState.prevCh = ch;
+            state.prevCh = ch;
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_NUMBER)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER)
     {
         if (!(charIsDigit(ch) || ch == 'x' || ch == 'X' || ch == 'a' || ch == 'A' || ch == 'b' || ch == 'B' ||
               ch == 'c' || ch == 'C' || ch == 'd' || ch == 'D' || ch == 'e' || ch == 'E' || ch == 'f' || ch == 'F' ||
               ch == '.' || ch == '+' || ch == '-'))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
         else
             return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
     {
         if (ch == '\n')
         {
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
+            state.charsRemaining = 1;
+            state.reset = true;
         }
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_VARIABLE_REF)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_VARIABLE_REF)
     {
-        if (_highlightingState.startCh == '{')
+        if (state.startCh == '{')
         {
             if (ch == '}')
             {
-                _highlightingState.charsRemaining = 1;
-                _highlightingState.reset = true;
+                state.charsRemaining = 1;
+                state.reset = true;
             }
 
             return;
@@ -513,7 +887,7 @@ void ShellSyntaxHighlighter::highlightChar(const String& text, int pos)
         {
             if (!(charIsAlphaNum(ch) || charIsDigit(ch) || ch == '_' || ch == '*' ||
                     ch == '@' || ch == '#' || ch == '?' || ch == '-' || ch == '$' || ch == '!'))
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
             else
                 return;
         }
@@ -521,12 +895,12 @@ void ShellSyntaxHighlighter::highlightChar(const String& text, int pos)
 
     if (ch == '"' || ch == '\'')
     {
-        _highlightingState.startCh = ch;
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_STRING;
+        state.startCh = ch;
+        state.highlightingType = HIGHLIGHTING_TYPE_STRING;
     }
     else if (charIsDigit(ch))
     {
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
+        state.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
     }
     else if (charIsAlphaNum(ch) || ch == '_')
     {
@@ -541,23 +915,22 @@ void ShellSyntaxHighlighter::highlightChar(const String& text, int pos)
                 break;
         } while (charIsAlphaNum(ch) || charIsDigit(ch) || ch == '_');
 
-        _highlightingState.word = text.substr(s, pos - s);
-        _highlightingState.charsRemaining = _highlightingState.word.charLength();
-        _highlightingState.reset = true;
+        state.charsRemaining = charCount(text, s, pos);
+        state.reset = true;
 
-        if (_keywords.contains(_highlightingState.word))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_KEYWORD;
+        if (SHELL_KEYWORD_TABLE.find(text.chars() + s, pos - s) != HIGHLIGHTING_TYPE_NONE)
+            state.highlightingType = HIGHLIGHTING_TYPE_KEYWORD;
         else
         {
             if (pos < text.length() && ch == '=')
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_VARIABLE;
+                state.highlightingType = HIGHLIGHTING_TYPE_VARIABLE;
             else
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
         }
     }
     else if (ch == '#')
     {
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+        state.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
     }
     else if (ch == '$')
     {
@@ -566,110 +939,306 @@ void ShellSyntaxHighlighter::highlightChar(const String& text, int pos)
         if (pos < text.length())
         {
             ch = text.charAt(pos);
-            _highlightingState.startCh = ch == '{' ? ch : 0;
+            state.startCh = ch == '{' ? ch : 0;
         }
 
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_VARIABLE_REF;
+        state.highlightingType = HIGHLIGHTING_TYPE_VARIABLE_REF;
     }
 }
 
-// XmlSyntaxHighlighter
-
-void XmlSyntaxHighlighter::highlightChar(const String& text, int pos)
+static inline bool isVariableChar(unichar_t ch)
 {
-    if (_highlightingState.charsRemaining > 0)
-    {
-        --_highlightingState.charsRemaining;
-        if (_highlightingState.charsRemaining > 0)
-            return;
+    return charIsAlphaNum(ch) || charIsDigit(ch) || ch == '_' || ch == '*' ||
+           ch == '@' || ch == '#' || ch == '?' || ch == '-' || ch == '$' || ch == '!';
+}
 
-        if (_highlightingState.reset)
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_NONE;
-    }
+void ShellSyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                            Array<HighlightSpan>& spans) const
+{
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
 
-    unichar_t ch = text.charAt(pos);
+    const char_t* chars = text.chars();
+    int len = text.length();
+    int p = begin;
 
-    if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_TAG)
+    while (p < end)
     {
-        if (ch == '>')
-        {
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
-        }
-        else if (charIsSpace(ch))
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+        int start = p;
 
-        return;
-    }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE)
-    {
-        if (ch == '=')
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL;
-        else if (ch == '>')
+        if (state.charsRemaining > 1)
         {
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
-            _highlightingState.charsRemaining = 1;
-            _highlightingState.reset = true;
-        }
-        else if (ch == '/')
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
+            do
+            {
+                p = text.charForward(p);
+                --state.charsRemaining;
+            } while (state.charsRemaining > 1 && p < end);
 
-        return;
-    }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL)
-    {
-        if (ch == '\'' || ch == '"')
-        {
-            _highlightingState.startCh = ch;
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+            appendSpan(spans, p - start, state.highlightingType);
+            continue;
         }
-        else if (!charIsSpace(ch))
+
+        if (state.charsRemaining == 1)
         {
-            _highlightingState.startCh = 0;
-            _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+            state.charsRemaining = 0;
+            if (state.reset)
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
         }
 
-        return;
-    }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE)
-    {
-        if (_highlightingState.prevCh != 0)
+        unichar_t ch = asciiUnit(chars[p]);
+        if (ch == 0x80)
+            ch = text.charAt(p);
+
+        if (state.highlightingType == HIGHLIGHTING_TYPE_STRING)
         {
-            _highlightingState.prevCh = 0;
+            char_t startCh = static_cast<char_t>(state.startCh);
 
-            if (ch == '>')
+            if (state.prevCh == '\\')
             {
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
-                _highlightingState.charsRemaining = 1;
-                _highlightingState.reset = true;
+                state.prevCh = 0;
+                p = text.charForward(p);
             }
-            else if (ch == '/')
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
+            else if (ch == state.startCh)
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else if (ch == '\\')
+            {
+                state.prevCh = ch;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != startCh && chars[p] != '\\')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER && isNumberChar(ch))
+        {
+            do
+                ++p;
+            while (p < end && isNumberChar(asciiUnit(chars[p])));
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+        {
+            if (ch == '\n')
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '\n')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_VARIABLE_REF && state.startCh == '{')
+        {
+            if (ch == '}')
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '}')
+                    ++p;
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_VARIABLE_REF && isVariableChar(ch))
+        {
+            p = text.charForward(p);
+
+            while (p < end)
+            {
+                ch = asciiUnit(chars[p]);
+
+                if (ch != 0x80)
+                {
+                    if (!isVariableChar(ch))
+                        break;
+                    ++p;
+                }
+                else if (charIsAlphaNum(text.charAt(p)))
+                    p = text.charForward(p);
+                else
+                    break;
+            }
+        }
+        else
+        {
+            if (state.highlightingType == HIGHLIGHTING_TYPE_NUMBER ||
+                state.highlightingType == HIGHLIGHTING_TYPE_VARIABLE_REF)
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+
+            if (ch == '"' || ch == '\'')
+            {
+                state.startCh = ch;
+                state.highlightingType = HIGHLIGHTING_TYPE_STRING;
+                ++p;
+            }
+            else if (charIsDigit(ch))
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_NUMBER;
+                ++p;
+            }
+            else if (charIsAlphaNum(ch) || ch == '_')
+            {
+                int q = skipWord(text, text.charForward(p));
+
+                state.reset = true;
+
+                if (SHELL_KEYWORD_TABLE.find(chars + p, q - p) != HIGHLIGHTING_TYPE_NONE)
+                    state.highlightingType = HIGHLIGHTING_TYPE_KEYWORD;
+                else if (q < len && chars[q] == '=')
+                    state.highlightingType = HIGHLIGHTING_TYPE_VARIABLE;
+                else
+                    state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+
+                if (q <= end)
+                {
+                    state.charsRemaining = 1;
+                    p = q;
+                }
+                else
+                {
+                    state.charsRemaining = charCount(text, p, q);
+                    p = text.charForward(p);
+                }
+            }
+            else if (ch == '#')
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+                ++p;
+            }
+            else if (ch == '$')
+            {
+                if (p + 1 < len)
+                    state.startCh = chars[p + 1] == '{' ? '{' : 0;
+
+                state.highlightingType = HIGHLIGHTING_TYPE_VARIABLE_REF;
+                ++p;
+            }
+            else
+            {
+                p = text.charForward(p);
+
+                while (p < end)
+                {
+                    ch = asciiUnit(chars[p]);
+
+                    if (ch == 0x80 || ch == '"' || ch == '\'' || asciiIsWord(ch) || ch == '#' || ch == '$')
+                        break;
+
+                    ++p;
+                }
+            }
+        }
+
+        appendSpan(spans, p - start, state.highlightingType);
+    }
+}
+
+// XmlSyntaxHighlighter
+
+void XmlSyntaxHighlighter::highlightChar(const String& text, int pos, HighlightingState& state) const
+{
+    if (state.charsRemaining > 0)
+    {
+        --state.charsRemaining;
+        if (state.charsRemaining > 0)
+            return;
+
+        if (state.reset)
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+    }
+
+    unichar_t ch = text.charAt(pos);
+
+    if (state.highlightingType == HIGHLIGHTING_TYPE_TAG)
+    {
+        if (ch == '>')
+        {
+            state.charsRemaining = 1;
+            state.reset = true;
+        }
+        else if (charIsSpace(ch))
+            state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+
+        return;
+    }
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE)
+    {
+        if (ch == '=')
+            state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL;
+        else if (ch == '>')
+        {
+            state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+            state.charsRemaining = 1;
+            state.reset = true;
+        }
+        else if (ch == '/')
+            state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+
+        return;
+    }
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL)
+    {
+        if (ch == '\'' || ch == '"')
+        {
+            state.startCh = ch;
+            state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+        }
+        else if (!charIsSpace(ch))
+        {
+            state.startCh = 0;
+            state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+        }
+
+        return;
+    }
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE)
+    {
+        if (state.prevCh != 0)
+        {
+            state.prevCh = 0;
+
+            if (ch == '>')
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                state.charsRemaining = 1;
+                state.reset = true;
+            }
+            else if (ch == '/')
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
             else
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
         }
-        else if (_highlightingState.startCh != 0)
+        else if (state.startCh != 0)
         {
-            if (ch == _highlightingState.startCh)
-                _highlightingState.prevCh = 1;
+            if (ch == state.startCh)
+                state.prevCh = 1;
         }
-        else if (_highlightingState.startCh == 0)
+        else if (state.startCh == 0)
         {
             if (ch == '>')
             {
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
-                _highlightingState.charsRemaining = 1;
-                _highlightingState.reset = true;
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                state.charsRemaining = 1;
+                state.reset = true;
             }
             else if (ch == '/')
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
             else if (charIsSpace(ch))
-                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
         }
 
         return;
     }
-    else if (_highlightingState.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
+    else if (state.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
     {
         if (ch == '-')
         {
@@ -685,8 +1254,8 @@ void XmlSyntaxHighlighter::highlightChar(const String& text, int pos)
                     {
                         if (text.charAt(pos) == '>')
                         {
-                            _highlightingState.charsRemaining = 3;
-                            _highlightingState.reset = true;
+                            state.charsRemaining = 3;
+                            state.reset = true;
                         }
                     }
                 }
@@ -716,7 +1285,7 @@ void XmlSyntaxHighlighter::highlightChar(const String& text, int pos)
                         {
                             if (text.charAt(pos) == '-')
                             {
-                                _highlightingState.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
+                                state.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
                                 return;
                             }
                         }
@@ -725,906 +1294,4264 @@ void XmlSyntaxHighlighter::highlightChar(const String& text, int pos)
             }
         }
 
-        _highlightingState.highlightingType = HIGHLIGHTING_TYPE_TAG;
+        state.highlightingType = HIGHLIGHTING_TYPE_TAG;
     }
 }
 
-// Document
-
-Document::Document(Editor* editor) : _editor(editor)
+void XmlSyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                          Array<HighlightSpan>& spans) const
 {
-    clear();
-    setDimensions(1, 1, 1, 1);
-}
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
 
-bool Document::moveForward()
-{
-    if (_position < _text.length())
+    const char_t* chars = text.chars();
+    int len = text.length();
+    int p = begin;
+
+    while (p < end)
     {
-        int p = _text.charForward(_position);
-        setPositionLineColumn(p);
+        int start = p;
 
-        if (!_selectionMode)
-            _selection = -1;
+        if (state.charsRemaining > 1)
+        {
+            do
+            {
+                p = text.charForward(p);
+                --state.charsRemaining;
+            } while (state.charsRemaining > 1 && p < end);
 
-        return true;
-    }
+            appendSpan(spans, p - start, state.highlightingType);
+            continue;
+        }
 
-    return false;
-}
+        if (state.charsRemaining == 1)
+        {
+            state.charsRemaining = 0;
+            if (state.reset)
+                state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+        }
 
-bool Document::moveBack()
-{
-    if (_position > 0)
-    {
-        int p = _text.charBack(_position);
-        setPositionLineColumn(p);
+        unichar_t ch = asciiUnit(chars[p]);
+        if (ch == 0x80)
+            ch = text.charAt(p);
 
-        if (!_selectionMode)
-            _selection = -1;
+        if (state.highlightingType == HIGHLIGHTING_TYPE_TAG)
+        {
+            if (ch == '>')
+            {
+                state.charsRemaining = 1;
+                state.reset = true;
+                ++p;
+            }
+            else if (charIsSpace(ch))
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+                p = text.charForward(p);
+            }
+            else
+            {
+                p = text.charForward(p);
 
-        return true;
-    }
+                while (p < end)
+                {
+                    ch = asciiUnit(chars[p]);
+                    if (ch == 0x80 || ch == '>' || charIsSpace(ch))
+                        break;
+                    ++p;
+                }
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE)
+        {
+            if (ch == '=')
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL;
+            else if (ch == '>')
+            {
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                state.charsRemaining = 1;
+                state.reset = true;
+            }
+            else if (ch == '/')
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+            else
+            {
+                while (p < end && chars[p] != '=' && chars[p] != '>' && chars[p] != '/')
+                    ++p;
 
-    return false;
-}
+                appendSpan(spans, p - start, state.highlightingType);
+                continue;
+            }
 
-bool Document::moveWordForward()
-{
-    int p = findWordForward(_position);
+            ++p;
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_EQUAL)
+        {
+            if (ch == '\'' || ch == '"')
+            {
+                state.startCh = ch;
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+            }
+            else if (!charIsSpace(ch))
+            {
+                state.startCh = 0;
+                state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+            }
 
-    if (p > _position)
-    {
-        setPositionLineColumn(p);
+            p = text.charForward(p);
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE)
+        {
+            if (state.prevCh != 0)
+            {
+                state.prevCh = 0;
 
-        if (!_selectionMode)
-            _selection = -1;
+                if (ch == '>')
+                {
+                    state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                    state.charsRemaining = 1;
+                    state.reset = true;
+                }
+                else if (ch == '/')
+                    state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                else
+                    state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
 
-        return true;
-    }
-    else
-        return false;
-}
+                p = text.charForward(p);
+            }
+            else if (state.startCh != 0)
+            {
+                char_t startCh = static_cast<char_t>(state.startCh);
 
-bool Document::moveWordBack()
-{
-    int p = findWordBack(_position);
+                if (ch == state.startCh)
+                {
+                    state.prevCh = 1;
+                    ++p;
+                }
+                else
+                {
+                    while (p < end && chars[p] != startCh)
+                        ++p;
+                }
+            }
+            else
+            {
+                if (ch == '>')
+                {
+                    state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                    state.charsRemaining = 1;
+                    state.reset = true;
+                    ++p;
+                }
+                else if (ch == '/')
+                {
+                    state.highlightingType = HIGHLIGHTING_TYPE_TAG;
+                    ++p;
+                }
+                else if (charIsSpace(ch))
+                {
+                    state.highlightingType = HIGHLIGHTING_TYPE_ATTRIBUTE;
+                    p = text.charForward(p);
+                }
+                else
+                {
+                    p = text.charForward(p);
 
-    if (p < _position)
-    {
-        setPositionLineColumn(p);
+                    while (p < end)
+                    {
+                        ch = asciiUnit(chars[p]);
+                        if (ch == 0x80 || ch == '>' || ch == '/' || charIsSpace(ch))
+                            break;
+                        ++p;
+                    }
+                }
+            }
+        }
+        else if (state.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT)
+        {
+            if (ch == '-')
+            {
+                if (p + 2 < len && chars[p + 1] == '-' && chars[p + 2] == '>')
+                {
+                    state.charsRemaining = 3;
+                    state.reset = true;
+                }
 
-        if (!_selectionMode)
-            _selection = -1;
+                ++p;
+            }
+            else
+            {
+                while (p < end && chars[p] != '-')
+                    ++p;
+            }
+        }
+        else if (ch == '<')
+        {
+            if (p + 3 < len && chars[p + 1] == '!' && chars[p + 2] == '-' && chars[p + 3] == '-')
+                state.highlightingType = HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
+            else
+                state.highlightingType = HIGHLIGHTING_TYPE_TAG;
 
-        return true;
+            ++p;
+        }
+        else
+        {
+            while (p < end && chars[p] != '<')
+                ++p;
+        }
+
+        appendSpan(spans, p - start, state.highlightingType);
     }
-    else
-        return false;
 }
 
-bool Document::moveCharsForward()
+// Grammar
+
+const char GRAMMAR_CACHE_MAGIC[4] = { 'E', 'V', 'G', 'R' };
+const uint32_t GRAMMAR_CACHE_VERSION = 1;
+
+const uint8_t GRAMMAR_ACTION_WORD_START = 1;
+const uint8_t GRAMMAR_ACTION_WORD = 2;
+const uint8_t GRAMMAR_ACTION_NUMBER = 4;
+const uint8_t GRAMMAR_ACTION_REGION = 8;
+const uint8_t GRAMMAR_ACTION_VARIABLE = 16;
+const uint8_t GRAMMAR_NO_REGION = 0xff;
+
+// grammars are lines of name=value pairs, each grammar starts with its name,
+// keywords are ASCII words and delimiters are up to four ASCII characters
+
+const char_t* BUILTIN_GRAMMARS = STR(
+    "name=python\n"
+    "keywords=and as assert async await break class continue def del elif else except finally for from global if\n"
+    "keywords=import in is lambda nonlocal not or pass raise return try while with yield False None True\n"
+    "types=bool bytearray bytes complex dict float frozenset int list object range set str tuple type\n"
+    "line_comment=#\n"
+    "multiline_string=\"\"\" \"\"\" \\\n"
+    "multiline_string=''' ''' \\\n"
+    "string=\" \" \\\n"
+    "string=' ' \\\n"
+    "numbers=true\n"
+    "\n"
+    "name=javascript\n"
+    "keywords=async await break case catch class const continue debugger default delete do else export extends\n"
+    "keywords=finally for function if import in instanceof let new of return static super switch this throw try\n"
+    "keywords=typeof var void while with yield false null true undefined NaN Infinity\n"
+    "types=Array ArrayBuffer BigInt Boolean Date Error Function JSON Map Math Number Object Promise Proxy Reflect\n"
+    "types=RegExp Set String Symbol WeakMap WeakSet\n"
+    "line_comment=//\n"
+    "block_comment=/* */\n"
+    "string=\" \" \\\n"
+    "string=' ' \\\n"
+    "multiline_string=` ` \\\n"
+    "numbers=true\n"
+    "\n"
+    "name=powershell\n"
+    "ignore_case=true\n"
+    "word_chars=-\n"
+    "keywords=begin break catch class continue data do dynamicparam else elseif end enum exit filter finally for\n"
+    "keywords=foreach function if in param process return switch throw trap try until using while\n"
+    "types=array bool byte char datetime decimal double hashtable int long object string void\n"
+    "line_comment=#\n"
+    "block_comment=<# #>\n"
+    "multiline_string=@\" \"@ `\n"
+    "multiline_string=@' '@\n"
+    "multiline_string=\" \" `\n"
+    "multiline_string=' '\n"
+    "variable=$\n"
+    "numbers=true\n"
+    "\n"
+    "name=batch\n"
+    "ignore_case=true\n"
+    "keywords=call cd chdir cls copy defined del dir do echo else endlocal equ erase errorlevel exist exit for geq\n"
+    "keywords=goto gtr if in leq lss md mkdir move neq not off on pause popd pushd rd ren rename rmdir set setlocal\n"
+    "keywords=shift start title type\n"
+    "comment_keywords=rem\n"
+    "line_comment=::\n"
+    "string=\" \"\n"
+    "variable=% %\n"
+    "numbers=true\n");
+
+struct GrammarName
 {
-    int p = findCharsForward(_position);
+    const char_t* name;
+    DocumentType documentType;
+};
 
-    if (p > _position)
-    {
-        setPositionLineColumn(p);
-
-        if (!_selectionMode)
-            _selection = -1;
+static const GrammarName GRAMMAR_NAMES[] = {
+    { STR("batch"), DOCUMENT_TYPE_BATCH },
+    { STR("powershell"), DOCUMENT_TYPE_POWERSHELL },
+    { STR("html"), DOCUMENT_TYPE_HTML },
+    { STR("python"), DOCUMENT_TYPE_PYTHON },
+    { STR("javascript"), DOCUMENT_TYPE_JAVASCRIPT }
+};
 
-        return true;
-    }
-    else
-        return false;
-}
+struct GrammarCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t grammarSize;
+    uint32_t sourceHash;
+    uint32_t numGrammars;
+};
 
-bool Document::moveCharsBack()
+static void splitGrammarValue(const String& value, Array<String>& tokens)
 {
-    int p = findCharsBack(_position);
+    tokens.clear();
+    const char_t* chars = value.chars();
+    int pos = 0;
 
-    if (p < _position)
+    while (pos < value.length())
     {
-        setPositionLineColumn(p);
+        while (pos < value.length() && (chars[pos] == ' ' || chars[pos] == '\t'))
+            ++pos;
 
-        if (!_selectionMode)
-            _selection = -1;
+        int start = pos;
 
-        return true;
+        while (pos < value.length() && chars[pos] != ' ' && chars[pos] != '\t')
+            ++pos;
+
+        if (pos > start)
+            tokens.addLast(value.substr(start, pos - start));
     }
-    else
-        return false;
 }
 
-bool Document::moveToStart()
+static uint8_t grammarChar(const String& token)
 {
-    if (_position > 0)
-    {
-        _position = 0;
-        _line = _column = _preferredColumn = 1;
-
-        if (!_selectionMode)
-            _selection = -1;
-
-        return true;
-    }
+    if (token.length() != 1 || static_cast<unichar_t>(token.chars()[0]) >= 0x80)
+        throw Exception(STR("invalid grammar character"));
 
-    return false;
+    return static_cast<uint8_t>(token.chars()[0]);
 }
 
-bool Document::moveToEnd()
+static void setDelimiter(const String& token, char* delimiter, uint8_t& length)
 {
-    if (_position < _text.length())
-    {
-        int p = _text.length();
-        setPositionLineColumn(p);
+    if (token.length() > GRAMMAR_MAX_DELIMITER_LENGTH)
+        throw Exception(STR("invalid grammar delimiter"));
 
-        if (!_selectionMode)
-            _selection = -1;
+    for (int i = 0; i < token.length(); ++i)
+    {
+        if (static_cast<unichar_t>(token.chars()[i]) >= 0x80)
+            throw Exception(STR("invalid grammar delimiter"));
 
-        return true;
+        delimiter[i] = static_cast<char>(token.chars()[i]);
     }
 
-    return false;
+    length = static_cast<uint8_t>(token.length());
 }
 
-bool Document::moveToLineStart()
+static void addGrammarRegion(Grammar& grammar, const Array<String>& tokens, HighlightingType highlightingType,
+                             bool multiline)
 {
-    int start = findLineStart(_position);
+    if (grammar.numRegions == GRAMMAR_MAX_REGIONS - 1)
+        throw Exception(STR("too many grammar delimiters"));
 
-    unichar_t ch;
-    int end = start;
+    GrammarRegion& region = grammar.regions[grammar.numRegions++];
+    region.highlightingType = static_cast<uint8_t>(highlightingType);
+    region.multiline = multiline;
 
-    ch = _text.charAt(end);
-    while (ch == ' ' || ch == '\t')
-    {
-        end = _text.charForward(end);
-        ch = _text.charAt(end);
-    }
+    if (tokens.empty())
+        throw Exception(STR("invalid grammar delimiter"));
 
-    int p = _position == start || _position > end ? end : start;
+    setDelimiter(tokens[0], region.start, region.startLength);
 
-    if (p != _position)
-    {
-        setPositionLineColumn(p);
+    if (region.startLength == 0)
+        throw Exception(STR("invalid grammar delimiter"));
 
-        if (!_selectionMode)
-            _selection = -1;
+    if (tokens.size() > 1)
+        setDelimiter(tokens[1], region.end, region.endLength);
 
-        return true;
-    }
+    if (tokens.size() > 2)
+    {
+        region.escape = grammarChar(tokens[2]);
 
-    return false;
+        if (region.endLength > 0 && region.escape == static_cast<uint8_t>(region.end[0]))
+            throw Exception(STR("invalid grammar escape character"));
+    }
 }
 
-bool Document::moveToLineEnd()
+static bool fillKeywordSlots(Grammar& grammar, uint32_t seed, int numSlots)
 {
-    int p = findLineEnd(_position);
+    for (int i = 0; i < numSlots; ++i)
+        grammar.slots[i] = -1;
 
-    if (p > _position)
+    for (int i = 0; i < grammar.numKeywords; ++i)
     {
-        setPositionLineColumn(p);
+        int slot = keywordSlot(keywordHash(grammar.keywordChars + grammar.keywords[i].offset, seed), numSlots);
 
-        if (!_selectionMode)
-            _selection = -1;
+        if (grammar.slots[slot] >= 0)
+            return false;
 
-        return true;
+        grammar.slots[slot] = static_cast<int16_t>(i);
     }
-    else
-        return false;
-}
-
-bool Document::moveLines(int lines)
-{
-    int line = _line + lines;
-    if (line < 1)
-        line = 1;
-
-    return moveToLine(line);
-}
-
-bool Document::movePage(bool down)
-{
-    int lines = _height - 1;
-    if (lines < 1)
-        lines = 1;
 
-    return moveLines(down ? lines : -lines);
+    grammar.seed = seed;
+    grammar.numSlots = numSlots;
+    return true;
 }
 
-bool Document::moveToLine(int line)
+static void finishGrammar(Grammar& grammar, const Array<String>& keywords, const Array<HighlightingType>& types,
+                          const String& wordChars, bool numbers)
 {
-    ASSERT(line > 0);
-
-    int prev = _position;
-    lineColumnToPosition(_position, _line, _column, line, _preferredColumn, _position, _line, _column);
+    // character actions outside of delimited regions
 
-    if (_position != prev)
+    for (int ch = 0; ch < 128; ++ch)
     {
-        if (!_selectionMode)
-            _selection = -1;
-
-        return true;
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_')
+            grammar.actions[ch] = GRAMMAR_ACTION_WORD_START | GRAMMAR_ACTION_WORD;
+        else if (ch >= '0' && ch <= '9')
+            grammar.actions[ch] = GRAMMAR_ACTION_WORD | (numbers ? GRAMMAR_ACTION_NUMBER : GRAMMAR_ACTION_WORD_START);
     }
-    else
-        return false;
-}
 
-bool Document::moveToLineColumn(int line, int column)
-{
-    ASSERT(line > 0 && column > 0);
+    for (int i = 0; i < wordChars.length(); ++i)
+        if (static_cast<unichar_t>(wordChars.chars()[i]) < 0x80)
+            grammar.actions[static_cast<int>(wordChars.chars()[i])] |= GRAMMAR_ACTION_WORD;
 
-    int prev = _position;
-    lineColumnToPosition(_position, _line, _column, line, column, _position, _line, _column);
+    if (grammar.variablePrefix)
+        grammar.actions[grammar.variablePrefix] |= GRAMMAR_ACTION_VARIABLE;
 
-    _preferredColumn = _column;
+    // regions are grouped by their first character, longer delimiters are tried first
 
-    if (_position != prev)
+    for (int i = 1; i < grammar.numRegions; ++i)
     {
-        if (!_selectionMode)
-            _selection = -1;
+        GrammarRegion region = grammar.regions[i];
+        int j = i;
 
-        return true;
+        while (j > 0 && (grammar.regions[j - 1].start[0] > region.start[0] ||
+               (grammar.regions[j - 1].start[0] == region.start[0] &&
+                grammar.regions[j - 1].startLength < region.startLength)))
+        {
+            grammar.regions[j] = grammar.regions[j - 1];
+            --j;
+        }
+
+        grammar.regions[j] = region;
     }
-    else
-        return false;
-}
 
-void Document::insertNewLine()
-{
-    int p = _position, q = p;
-    unichar_t ch = '\n';
+    memset(grammar.firstRegion, GRAMMAR_NO_REGION, sizeof(grammar.firstRegion));
 
-    while (p > 0 && (ch == ' ' || ch == '\t' || ch == '\n'))
+    for (int i = grammar.numRegions - 1; i >= 0; --i)
     {
-        p = _text.charBack(p);
-        ch = _text.charAt(p);
+        uint8_t ch = static_cast<uint8_t>(grammar.regions[i].start[0]);
+        grammar.firstRegion[ch] = static_cast<uint8_t>(i);
+        grammar.actions[ch] |= GRAMMAR_ACTION_REGION;
     }
 
-    p = findLineStart(p);
-    _indent.assign('\n');
+    // comment keywords open a line comment that has no delimiter of its own
 
-    ch = _text.charAt(p);
-    while (ch == ' ' || ch == '\t')
-    {
-        _indent += ch;
-        p = _text.charForward(p);
-        ch = _text.charAt(p);
-    }
+    grammar.commentRegion = GRAMMAR_NO_REGION;
 
-    ch = _text.charAt(q);
-    while (ch == ' ' || ch == '\t')
+    for (int i = 0; i < types.size(); ++i)
     {
-        q = _text.charForward(q);
-        ch = _text.charAt(q);
+        if (types[i] == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+        {
+            grammar.commentRegion = static_cast<uint8_t>(grammar.numRegions);
+            grammar.regions[grammar.numRegions++].highlightingType = HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+            break;
+        }
     }
 
-    _text.replace(_position, _indent, q - _position);
-    setPositionLineColumn(_position + _indent.length());
+    // region scans stop only where the region can end or escape
 
-    _modified = true;
-    _selectionMode = false;
-    _selection = -1;
-}
+    for (int i = 0; i < grammar.numRegions; ++i)
+    {
+        const GrammarRegion& region = grammar.regions[i];
 
-void Document::insertChar(unichar_t ch, bool afterIdent)
-{
-    ASSERT(ch != 0);
+        if (region.endLength > 0)
+            grammar.stops[i][static_cast<uint8_t>(region.end[0])] = 1;
+        if (region.escape)
+            grammar.stops[i][region.escape] = 1;
+        if (!region.multiline)
+            grammar.stops[i]['\n'] = 1;
+    }
 
-    int p = _position;
+    // keywords are hashed into a perfect table, the seed is searched for once and then cached
 
-    if (afterIdent)
+    int chars = 0;
+
+    for (int i = 0; i < keywords.size(); ++i)
     {
-        while (charIsWord(_text.charAt(p)))
-            p = _text.charForward(p);
-    }
+        String keyword = keywords[i];
 
-    _text.insert(p, ch);
-    p = _text.charForward(p);
-    setPositionLineColumn(p);
+        if (grammar.ignoreCase)
+            keyword.toLower();
 
-    _modified = true;
-    _selectionMode = false;
-    _selection = -1;
-}
+        if (keyword.length() > 255)
+            throw Exception(STR("invalid grammar keyword"));
 
-bool Document::deleteCharForward()
-{
-    if (_position < _text.length())
-    {
-        _text.erase(_position, _text.charForward(_position) - _position);
+        for (int j = 0; j < keyword.length(); ++j)
+            if (static_cast<unichar_t>(keyword.chars()[j]) >= 0x80)
+                throw Exception(STR("invalid grammar keyword"));
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+        bool duplicate = false;
 
-        return true;
-    }
+        for (int j = 0; j < grammar.numKeywords && !duplicate; ++j)
+            duplicate = wordEquals(keyword.chars(), keyword.length(), grammar.keywordChars + grammar.keywords[j].offset);
 
-    return false;
-}
+        if (duplicate)
+            continue;
 
-bool Document::deleteCharBack()
-{
-    if (_position > 0)
-    {
-        int p = _text.charBack(_position);
-        int prev = _position;
+        if (grammar.numKeywords == GRAMMAR_MAX_KEYWORDS || chars + keyword.length() + 1 > GRAMMAR_MAX_KEYWORD_CHARS)
+            throw Exception(STR("too many grammar keywords"));
 
-        setPositionLineColumn(p);
-        _text.erase(_position, prev - _position);
+        GrammarKeyword& entry = grammar.keywords[grammar.numKeywords++];
+        entry.offset = static_cast<uint16_t>(chars);
+        entry.length = static_cast<uint8_t>(keyword.length());
+        entry.highlightingType = static_cast<uint8_t>(types[i]);
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+        for (int j = 0; j < keyword.length(); ++j)
+            grammar.keywordChars[chars++] = static_cast<char>(keyword.chars()[j]);
 
-        return true;
+        grammar.keywordChars[chars++] = 0;
+
+        if (keyword.length() > grammar.maxKeywordLength)
+            grammar.maxKeywordLength = keyword.length();
     }
 
-    return false;
+    for (int numSlots = 16; numSlots <= GRAMMAR_MAX_SLOTS; numSlots *= 2)
+        if (numSlots >= grammar.numKeywords * 4)
+            for (uint32_t seed = 1; seed <= 4096; ++seed)
+                if (fillKeywordSlots(grammar, seed, numSlots))
+                    return;
+
+    throw Exception(STR("grammar keywords collide"));
 }
 
-bool Document::deleteWordForward()
+static void compileGrammars(const String& source, Array<Grammar>& grammars)
 {
-    int p = findWordForward(_position);
+    grammars.clear();
 
-    if (p > _position)
+    Grammar* grammar = nullptr;
+    Array<String> keywords, tokens;
+    Array<HighlightingType> types;
+    String wordChars;
+    bool numbers = false;
+    int pos = 0;
+
+    while (pos <= source.length())
     {
-        _text.erase(_position, p - _position);
+        int end = source.find('\n', true, pos);
+        if (end == INVALID_POSITION)
+            end = source.length();
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+        String line = source.substr(pos, end - pos);
+        pos = end + 1;
+        line.trim();
 
-        return true;
-    }
+        int p = line.find('=', true, 0);
 
-    return false;
-}
+        if (line.empty() || line.startsWith(STR("#")) || p == INVALID_POSITION)
+            continue;
 
-bool Document::deleteWordBack()
-{
-    int p = findWordBack(_position);
+        String name = line.substr(0, p);
+        String value = line.substr(p + 1);
+        name.trim();
+        value.trim();
+        splitGrammarValue(value, tokens);
 
-    if (p < _position)
-    {
-        int prev = _position;
+        if (name == STR("name"))
+        {
+            if (grammar)
+                finishGrammar(*grammar, keywords, types, wordChars, numbers);
 
-        setPositionLineColumn(p);
-        _text.erase(_position, prev - _position);
+            DocumentType documentType = DOCUMENT_TYPE_TEXT;
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+            for (const GrammarName& grammarName : GRAMMAR_NAMES)
+                if (value == grammarName.name)
+                    documentType = grammarName.documentType;
 
-        return true;
-    }
+            if (documentType == DOCUMENT_TYPE_TEXT)
+                throw Exception(STR("unknown grammar name"));
 
-    return false;
-}
+            // a later definition of the same language replaces the earlier one
 
-bool Document::deleteCharsForward()
-{
-    int p = findCharsForward(_position);
+            grammar = nullptr;
 
-    if (p > _position)
-    {
-        _text.erase(_position, p - _position);
+            for (int i = 0; i < grammars.size(); ++i)
+                if (grammars[i].documentType == documentType)
+                    grammar = &grammars[i];
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+            if (!grammar)
+            {
+                grammars.addLast(Grammar());
+                grammar = &grammars.last();
+            }
 
-        return true;
+            memset(grammar, 0, sizeof(Grammar));
+            grammar->documentType = documentType;
+
+            keywords.clear();
+            types.clear();
+            wordChars.clear();
+            numbers = false;
+        }
+        else if (!grammar)
+            throw Exception(STR("grammar name expected"));
+        else if (name == STR("keywords") || name == STR("types") || name == STR("comment_keywords"))
+        {
+            HighlightingType highlightingType = name == STR("keywords") ? HIGHLIGHTING_TYPE_KEYWORD :
+                name == STR("types") ? HIGHLIGHTING_TYPE_TYPE : HIGHLIGHTING_TYPE_SINGLELINE_COMMENT;
+
+            for (int i = 0; i < tokens.size(); ++i)
+            {
+                keywords.addLast(tokens[i]);
+                types.addLast(highlightingType);
+            }
+        }
+        else if (name == STR("ignore_case"))
+            grammar->ignoreCase = value.compare(STR("true"), false) == 0;
+        else if (name == STR("numbers"))
+            numbers = value.compare(STR("true"), false) == 0;
+        else if (name == STR("word_chars"))
+            wordChars += value;
+        else if (name == STR("variable"))
+        {
+            if (tokens.empty() || tokens.size() > 2)
+                throw Exception(STR("invalid grammar variable"));
+
+            grammar->variablePrefix = grammarChar(tokens[0]);
+            grammar->variableSuffix = tokens.size() > 1 ? grammarChar(tokens[1]) : 0;
+        }
+        else if (name == STR("line_comment"))
+            addGrammarRegion(*grammar, tokens, HIGHLIGHTING_TYPE_SINGLELINE_COMMENT, false);
+        else if (name == STR("block_comment"))
+            addGrammarRegion(*grammar, tokens, HIGHLIGHTING_TYPE_MULTILINE_COMMENT, true);
+        else if (name == STR("string"))
+            addGrammarRegion(*grammar, tokens, HIGHLIGHTING_TYPE_STRING, false);
+        else if (name == STR("multiline_string"))
+            addGrammarRegion(*grammar, tokens, HIGHLIGHTING_TYPE_STRING, true);
+        else
+            throw Exception(STR("unknown grammar rule"));
     }
 
-    return false;
+    if (grammar)
+        finishGrammar(*grammar, keywords, types, wordChars, numbers);
 }
 
-bool Document::deleteCharsBack()
+static bool readGrammarCache(const String& filename, uint32_t sourceHash, Array<Grammar>& grammars)
 {
-    int p = findCharsBack(_position);
+    grammars.clear();
 
-    if (p < _position)
+    try
     {
-        int prev = _position;
+        File file;
+        GrammarCacheHeader header;
 
-        setPositionLineColumn(p);
-        _text.erase(_position, prev - _position);
+        if (!file.open(filename) || file.size() < static_cast<int64_t>(sizeof(header)))
+            return false;
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+        file.read(sizeof(header), &header);
 
-        return true;
-    }
+        if (memcmp(header.magic, GRAMMAR_CACHE_MAGIC, sizeof(GRAMMAR_CACHE_MAGIC)) != 0 ||
+            header.version != GRAMMAR_CACHE_VERSION || header.grammarSize != sizeof(Grammar) ||
+            header.sourceHash != sourceHash ||
+            file.size() != static_cast<int64_t>(sizeof(header) + header.numGrammars * sizeof(Grammar)))
+            return false;
 
-    return false;
-}
+        for (uint32_t i = 0; i < header.numGrammars; ++i)
+        {
+            grammars.addLast(Grammar());
+            file.read(sizeof(Grammar), &grammars.last());
+        }
+    }
+    catch (Exception&)
+    {
+        grammars.clear();
+        return false;
+    }
 
-void Document::indentLines()
-{
-    changeLines(&Document::indentLine);
+    return true;
 }
 
-void Document::unindentLines()
+static void writeGrammarCache(const String& filename, uint32_t sourceHash, const Array<Grammar>& grammars)
 {
-    changeLines(&Document::unindentLine);
+    GrammarCacheHeader header;
+    memcpy(header.magic, GRAMMAR_CACHE_MAGIC, sizeof(GRAMMAR_CACHE_MAGIC));
+    header.version = GRAMMAR_CACHE_VERSION;
+    header.grammarSize = sizeof(Grammar);
+    header.sourceHash = sourceHash;
+    header.numGrammars = grammars.size();
+
+    File file(filename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+    file.write(sizeof(header), &header);
+
+    for (int i = 0; i < grammars.size(); ++i)
+        file.write(sizeof(Grammar), &grammars[i]);
 }
 
-void Document::commentLines()
-{
-    changeLines(&Document::commentLine);
-}
+// GrammarSyntaxHighlighter
 
-void Document::uncommentLines()
+static inline bool matchDelimiter(const char_t* chars, int len, int pos, const char* delimiter, int length)
 {
-    changeLines(&Document::uncommentLine);
+    if (pos + length > len)
+        return false;
+
+    for (int i = 0; i < length; ++i)
+        if (chars[pos + i] != static_cast<char_t>(delimiter[i]))
+            return false;
+
+    return true;
 }
 
-void Document::markSelection()
+void GrammarSyntaxHighlighter::highlightChar(const String& text, int pos, HighlightingState& state) const
 {
-    _selectionMode = true;
-    _selection = _position;
+    Array<HighlightSpan> spans;
+    highlightRange(text, pos, text.charForward(pos), state, spans);
+
+    if (!spans.empty())
+        state.highlightingType = spans.last().highlightingType;
 }
 
-String Document::copyDeleteText(bool copy)
+void GrammarSyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                              Array<HighlightSpan>& spans) const
 {
-    int start, end;
-    bool lastLine = false;
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
 
-    if (_selection < 0)
-    {
-        start = findLineStart(_position);
-        end = findLineEnd(_position);
-        if (_text.charAt(end) == '\n')
-            end = _text.charForward(end);
-        else
-            lastLine = true;
-    }
-    else
+    // startCh holds the current region plus one, charsRemaining counts the code units
+    // of a token that continues past the end of the previous range
+
+    const Grammar& grammar = _grammar;
+    const char_t* chars = text.chars();
+    int len = text.length();
+    int p = begin;
+
+    if (state.charsRemaining > 0 && p < end)
     {
-        if (_selection < _position)
-        {
-            start = _selection;
-            end = _position;
-        }
-        else
+        int n = state.charsRemaining < end - p ? state.charsRemaining : end - p;
+        appendSpan(spans, n, state.highlightingType);
+        p += n;
+        state.charsRemaining -= n;
+
+        if (state.charsRemaining == 0 && state.reset)
         {
-            start = _position;
-            end = _selection;
+            state.highlightingType = HIGHLIGHTING_TYPE_NONE;
+            state.reset = false;
         }
     }
 
-    if (start < end)
+    while (p < end)
     {
-        String text = _text.substr(start, end - start);
-        if (lastLine)
-            text += '\n';
-
-        if (!copy)
+        if (state.startCh)
         {
-            if (_selection < 0)
+            int index = state.startCh - 1;
+            const GrammarRegion& region = grammar.regions[index];
+            const uint8_t* stops = grammar.stops[index];
+            HighlightingType highlightingType = static_cast<HighlightingType>(region.highlightingType);
+            int q = p;
+
+            while (q < end && (asciiUnit(chars[q]) == 0x80 || !stops[asciiUnit(chars[q])]))
+                ++q;
+
+            if (q > p)
             {
-                _text.erase(start, end - start);
-                lineColumnToPosition(start, _line, 1, _line, _preferredColumn, _position, _line, _column);
+                appendSpan(spans, q - p, highlightingType);
+                p = q;
+
+                if (p == end)
+                    break;
+            }
+
+            unichar_t ch = asciiUnit(chars[p]);
+
+            if (region.escape && ch == region.escape)
+                p = appendToken(state, spans, p, p + 1 < len ? text.charForward(p + 1) : p + 1, end,
+                                highlightingType, false);
+            else if (region.endLength > 0 && matchDelimiter(chars, len, p, region.end, region.endLength))
+            {
+                state.startCh = 0;
+                p = appendToken(state, spans, p, p + region.endLength, end, highlightingType, true);
+            }
+            else if (ch == '\n' && !region.multiline)
+            {
+                state.startCh = 0;
+                p = appendToken(state, spans, p, p + 1, end, highlightingType, true);
             }
             else
+                p = appendToken(state, spans, p, p + 1, end, highlightingType, false);
+
+            continue;
+        }
+
+        unichar_t ch = asciiUnit(chars[p]);
+        uint8_t action = ch != 0x80 ? grammar.actions[ch] : 0;
+
+        if (action & GRAMMAR_ACTION_REGION)
+        {
+            int index = grammar.firstRegion[ch];
+
+            while (index < grammar.numRegions && static_cast<unichar_t>(grammar.regions[index].start[0]) == ch &&
+                   !matchDelimiter(chars, len, p, grammar.regions[index].start, grammar.regions[index].startLength))
+                ++index;
+
+            if (index < grammar.numRegions && static_cast<unichar_t>(grammar.regions[index].start[0]) == ch)
             {
-                setPositionLineColumn(start);
-                _text.erase(start, end - start);
+                const GrammarRegion& region = grammar.regions[index];
+                state.startCh = index + 1;
+                p = appendToken(state, spans, p, p + region.startLength, end,
+                                static_cast<HighlightingType>(region.highlightingType), false);
+                continue;
             }
+        }
+
+        if (action & GRAMMAR_ACTION_VARIABLE)
+        {
+            int q = scanWord(text, p + 1);
+
+            if (q > p + 1)
+            {
+                if (grammar.variableSuffix && q < len && chars[q] == grammar.variableSuffix)
+                    ++q;
 
-            _modified = true;
+                p = appendToken(state, spans, p, q, end, HIGHLIGHTING_TYPE_VARIABLE_REF, true);
+                continue;
+            }
         }
 
-        _selectionMode = false;
-        _selection = -1;
-        return text;
-    }
+        if (action & GRAMMAR_ACTION_NUMBER)
+        {
+            int q = p + 1;
 
-    _selectionMode = false;
-    _selection = -1;
-    return String();
-}
+            while (q < len && (chars[q] == '.' || asciiIsWord(asciiUnit(chars[q]))))
+                ++q;
 
-void Document::pasteText(const String& text)
-{
-    ASSERT(!text.empty());
+            p = appendToken(state, spans, p, q, end, HIGHLIGHTING_TYPE_NUMBER, true);
+        }
+        else if ((action & GRAMMAR_ACTION_WORD_START) || (ch == 0x80 && charIsAlpha(text.charAt(p))))
+        {
+            int q = scanWord(text, p);
+            HighlightingType highlightingType = findKeyword(chars + p, q - p);
 
-    if (text.charAt(text.charBack(text.length())) == '\n')
-    {
-        int start = findLineStart(_position);
-        _selection = start;
-        setPositionLineColumn(start);
-        _text.insert(start, text);
-        setPositionLineColumn(start + text.length());
-    }
-    else
-    {
-        _text.insert(_position, text);
-        _selection = _position;
-        setPositionLineColumn(_position + text.length());
-    }
+            if (highlightingType == HIGHLIGHTING_TYPE_SINGLELINE_COMMENT)
+            {
+                state.startCh = grammar.commentRegion + 1;
+                p = appendToken(state, spans, p, q, end, highlightingType, false);
+            }
+            else
+                p = appendToken(state, spans, p, q, end,
+                                highlightingType != HIGHLIGHTING_TYPE_NONE ? highlightingType : HIGHLIGHTING_TYPE_IDENT,
+                                true);
+        }
+        else if (ch == 0x80)
+            p = appendToken(state, spans, p, text.charForward(p), end, HIGHLIGHTING_TYPE_NONE, true);
+        else
+        {
+            int q = p + 1;
 
-    _modified = true;
-    _selectionMode = false;
-}
+            while (q < end && asciiUnit(chars[q]) != 0x80 && grammar.actions[asciiUnit(chars[q])] == 0)
+                ++q;
 
-bool Document::toggleSelectionStart()
-{
-    if (_selection >= 0 && _position != _selection)
-    {
-        int p = _position;
-        setPositionLineColumn(_selection);
-        _selection = p;
-        return true;
+            appendSpan(spans, q - p, HIGHLIGHTING_TYPE_NONE);
+            p = q;
+        }
     }
-
-    return false;
 }
 
-String Document::currentWord() const
+int GrammarSyntaxHighlighter::scanWord(const String& text, int pos) const
 {
-    int start = _position;
+    const char_t* chars = text.chars();
+    int len = text.length();
 
-    if (charIsWord(_text.charAt(start)))
+    while (pos < len)
     {
-        while (start > 0)
-        {
-            int p = _text.charBack(start);
-            if (!charIsWord(_text.charAt(p)))
-                break;
-            start = p;
-        }
+        unichar_t ch = asciiUnit(chars[pos]);
 
-        int end = _text.charForward(_position);
-        while (end < _text.length())
+        if (ch != 0x80)
         {
-            if (!charIsWord(_text.charAt(end)))
+            if (!(_grammar.actions[ch] & GRAMMAR_ACTION_WORD))
                 break;
-            end = _text.charForward(end);
+            ++pos;
         }
-
-        return _text.substr(start, end - start);
+        else if (charIsAlphaNum(text.charAt(pos)))
+            pos = text.charForward(pos);
+        else
+            break;
     }
 
-    return String();
+    return pos;
 }
 
-String Document::autocompletePrefix() const
+HighlightingType GrammarSyntaxHighlighter::findKeyword(const char_t* chars, int len) const
 {
-    int p = _position;
+    if (_grammar.numKeywords == 0 || len > _grammar.maxKeywordLength)
+        return HIGHLIGHTING_TYPE_NONE;
 
-    while (p > 0)
+    char_t lower[256];
+
+    if (_grammar.ignoreCase)
     {
-        int q = _text.charBack(p);
-        if (!charIsWord(_text.charAt(q)))
-            break;
-        p = q;
+        for (int i = 0; i < len; ++i)
+            lower[i] = chars[i] >= 'A' && chars[i] <= 'Z' ? chars[i] - 'A' + 'a' : chars[i];
+
+        chars = lower;
     }
 
-    return _text.substr(p, _position - p);
+    int i = _grammar.slots[keywordSlot(keywordHash(chars, len, _grammar.seed), _grammar.numSlots)];
+
+    if (i >= 0 && wordEquals(chars, len, _grammar.keywordChars + _grammar.keywords[i].offset))
+        return static_cast<HighlightingType>(_grammar.keywords[i].highlightingType);
+
+    return HIGHLIGHTING_TYPE_NONE;
 }
 
-void Document::completeWord(const char_t* suffix)
+int GrammarSyntaxHighlighter::appendToken(HighlightingState& state, Array<HighlightSpan>& spans, int pos, int tokenEnd,
+                                          int end, HighlightingType highlightingType, bool reset) const
 {
-    int end = _position;
-    while (end < _text.length())
+    // a token past the end of the range is finished by the next call
+
+    if (tokenEnd > end)
     {
-        if (!charIsWord(_text.charAt(end)))
-            break;
-        end = _text.charForward(end);
+        appendSpan(spans, end - pos, highlightingType);
+        state.highlightingType = highlightingType;
+        state.charsRemaining = tokenEnd - end;
+        state.reset = reset;
+        return end;
     }
 
-    _text.replace(_position, suffix, end - _position);
-
-    _modified = true;
-    _selectionMode = false;
-    _selection = -1;
+    appendSpan(spans, tokenEnd - pos, highlightingType);
+    state.highlightingType = reset ? HIGHLIGHTING_TYPE_NONE : highlightingType;
+    return tokenEnd;
 }
 
-bool Document::find(const String& searchStr, bool caseSesitive, bool next)
-{
-    ASSERT(!searchStr.empty());
-
-    int p = findPosition(_position, searchStr, caseSesitive, next);
+// HighlightTask
 
-    if (p != INVALID_POSITION && p != _position)
+class HighlightTask : public Task
+{
+public:
+    HighlightTask(BackgroundHighlighter& highlighter) : _highlighter(highlighter)
     {
-        setPositionLineColumn(p);
-
-        if (!_selectionMode)
-            _selection = -1;
+    }
 
-        return true;
+    void run() override
+    {
+        _highlighter.highlight();
     }
 
-    return false;
-}
+protected:
+    BackgroundHighlighter& _highlighter;
+};
 
-bool Document::replace(const String& searchStr, const String& replaceStr, bool caseSesitive)
+static bool highlightSlices(const SyntaxHighlighter* syntaxHighlighter, const String& text, int begin, int end,
+                            HighlightingState& state, Array<HighlightSpan>& spans, const TaskGroup& group)
 {
-    ASSERT(!searchStr.empty());
+    // long lines are lexed in slices, so that cancelling a job never waits for a whole line,
+    // slices end at ASCII code units, which always start a character
 
-    int p = findPosition(_position, searchStr, caseSesitive, false);
+    const char_t* chars = text.chars();
 
-    if (p == _position)
+    while (end - begin > HIGHLIGHTING_SLICE_SIZE)
     {
-        _text.replace(p, replaceStr, searchStr.length());
-        p += replaceStr.length();
+        int sliceEnd = begin + HIGHLIGHTING_SLICE_SIZE;
 
-        int q = findPosition(p, searchStr, caseSesitive, false);
-        if (q != INVALID_POSITION)
-            p = q;
-
-        setPositionLineColumn(p);
+        while (sliceEnd < end && asciiUnit(chars[sliceEnd]) == 0x80)
+            ++sliceEnd;
 
-        _modified = true;
-        _selectionMode = false;
-        _selection = -1;
+        syntaxHighlighter->highlightRange(text, begin, sliceEnd, state, spans);
+        begin = sliceEnd;
 
-        return true;
+        if (group.cancelled())
+            return false;
     }
 
-    return false;
+    syntaxHighlighter->highlightRange(text, begin, end, state, spans);
+    return true;
 }
 
-bool Document::replaceAll(const String& searchStr, const String& replaceStr, bool caseSesitive)
-{
-    ASSERT(!searchStr.empty());
-
-    _text.replaceString(searchStr, replaceStr, caseSesitive);
-    lineColumnToPosition(0, 1, 1, _line, _column, _position, _line, _column);
+// BackgroundHighlighter
 
-    _modified = true;
-    _selectionMode = false;
-    _selection = -1;
-    _topPosition = -1;
+BackgroundHighlighter::BackgroundHighlighter(ThreadPool& threadPool) :
+    _threadPool(threadPool), _syntaxHighlighter(nullptr), _windowStart(0), _windowEnd(0), _start(0), _atEnd(false),
+    _line(1), _firstCheckpoint(0), _publishStart(0), _repairing(false), _damagedEnd(0),
+    _convergedPosition(INVALID_POSITION), _done(0)
+{
+}
 
-    return true;
+BackgroundHighlighter::~BackgroundHighlighter()
+{
+    cancel();
 }
 
-void Document::open(const String& filename)
+void BackgroundHighlighter::start(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+                                  int windowStart, int windowEnd, int line, const HighlightingState& state,
+                                  int firstCheckpoint, int publishStart)
 {
-    ASSERT(!filename.empty());
+    ASSERT(syntaxHighlighter);
+    ASSERT(start >= 0 && start <= end && end <= text.length());
+    ASSERT(windowStart >= 0 && windowStart <= windowEnd);
+    ASSERT(line > 0 && firstCheckpoint >= 0);
+
+    cancel();
+
+    // only the part of the text being lexed is copied, so that the document can be edited meanwhile
+
+    _syntaxHighlighter = syntaxHighlighter;
+    _windowStart = windowStart;
+    _windowEnd = windowEnd;
+    copyText(text, start, end);
+    _start = start;
+    _atEnd = end == text.length();
+    _line = line;
+    _state = state;
+    _firstCheckpoint = firstCheckpoint;
+    _publishStart = publishStart;
+    _repairing = false;
+
+    _threadPool.submit(createUnique<HighlightTask>(*this), &_group);
+}
 
-    clear();
-    _filename = filename;
+void BackgroundHighlighter::repair(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+                                   int windowStart, int windowEnd, const HighlightingState& state, int damagedEnd,
+                                   Array<HighlightingCheckpoint>&& lineStates)
+{
+    ASSERT(syntaxHighlighter);
+    ASSERT(start >= 0 && start <= end && end <= text.length());
+    ASSERT(windowStart >= 0 && windowStart <= windowEnd);
+
+    cancel();
+
+    // lines are lexed from the damaged one until a line past the damage starts in its old state
+
+    _syntaxHighlighter = syntaxHighlighter;
+    _windowStart = windowStart;
+    _windowEnd = windowEnd;
+    copyText(text, start, end);
+    _start = start;
+    _atEnd = end == text.length();
+    _line = 1;
+    _state = state;
+    _firstCheckpoint = 0;
+    _publishStart = start;
+    _repairing = true;
+    _damagedEnd = damagedEnd;
+    _lineStates = static_cast<Array<HighlightingCheckpoint>&&>(lineStates);
+
+    _threadPool.submit(createUnique<HighlightTask>(*this), &_group);
+}
 
-    File file;
+void BackgroundHighlighter::cancel()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    _done.store(0);
+    _checkpoints.clear();
+    _lines.clear();
+    _convergedPosition = INVALID_POSITION;
+}
 
-    if (file.open(filename))
-    {
-        _text.assign(Unicode::bytesToString(file.read(), _encoding, _bom, _crLf));
-        _modified = false;
-        determineDocumentType(file.isExecutable());
-    }
-    else
-        determineDocumentType(false);
+bool BackgroundHighlighter::wait(int timeout)
+{
+    return _group.wait(timeout) && done();
 }
 
-void Document::save()
+void BackgroundHighlighter::copyText(const String& text, int start, int end)
 {
-    ASSERT(!_filename.empty());
+    // of a line longer than the window only the window is copied, so that the copy made between keystrokes
+    // stays small whatever the length of the lines, the window starts and ends at ASCII code units
 
-    if (_editor->trimWhitespace())
-        trimTrailingWhitespace();
+    const char_t* chars = text.chars();
+    int copied = start;
 
-    File file(_filename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
-    file.write(Unicode::stringToBytes(_text, _encoding, _bom, _crLf));
+    _text.clear();
+    _text.ensureCapacity(end - start + 1);
+    _cuts.clear();
 
-    _modified = false;
-    _selectionMode = false;
-    _selection = -1;
+    for (int p = start; p < end; ++p)
+    {
+        int q = findLineBreak(chars, p, end);
+
+        if (q - p > _windowEnd - _windowStart)
+        {
+            int head = _windowStart < q - p ? _windowStart : q - p;
+            int tail = _windowEnd < q - p ? _windowEnd : q - p;
+
+            while (head < q - p && asciiUnit(chars[p + head]) == 0x80)
+                ++head;
+
+            while (tail < q - p && asciiUnit(chars[p + tail]) == 0x80)
+                ++tail;
+
+            _text.append(chars + copied, p - copied);
+            _cuts.addLast({ _text.length(), head, q - p - tail });
+            _text.append(chars + p + head, tail - head);
+            copied = q;
+        }
+
+        p = q;
+    }
+
+    _text.append(chars + copied, end - copied);
 }
 
-void Document::clear()
+void BackgroundHighlighter::highlight()
 {
-    _text.ensureCapacity(1);
-    _text.clear();
+    // checkpoint k is at line (k + 1) * interval + 1, lines are published from publish start on,
+    // positions in the text are those of the document less the parts of cut lines skipped before them
 
-    _position = 0;
-    _modified = true;
+    HighlightingState state = _state;
 
-    _filename.clear();
-    _documentType = DOCUMENT_TYPE_TEXT;
-    _encoding = TEXT_ENCODING_UTF8;
-    _bom = false;
-    _crLf = CRLF;
+    const char_t* chars = _text.chars();
+    int len = _text.length();
+    int p = 0, line = _line, lineState = 0, cut = 0, skipped = 0;
 
-    _line = _column = 1;
-    _preferredColumn = 1;
+    HighlightedLine highlightedLine;
+    highlightedLine.position = _start;
+    highlightedLine.stale = false;
+    highlightedLine.state = state;
+    Array<HighlightSpan> skippedSpans;
 
-    _top = _left = 1;
-    _topPosition = 0;
+    while (p < len)
+    {
+        int lineStart = p, q = findLineBreak(chars, p, len);
 
-    _selectionMode = false;
-    _selection = -1;
+        if (q == len)
+        {
+            if (!highlightLine(lineStart, q, q, state, highlightedLine.position >= _publishStart ?
+                               highlightedLine.spans : skippedSpans, cut, skipped))
+                return;
+
+            break;
+        }
+
+        p = q + 1;
+
+        if (highlightedLine.position >= _publishStart)
+        {
+            if (!highlightLine(lineStart, q, p, state, highlightedLine.spans, cut, skipped))
+                return;
+
+            _lines.addLast(static_cast<HighlightedLine&&>(highlightedLine));
+        }
+        else
+        {
+            if (!highlightLine(lineStart, q, p, state, skippedSpans, cut, skipped))
+                return;
+
+            skippedSpans.clear();
+        }
+
+        if (_group.cancelled())
+            return;
+
+        highlightedLine.position = _start + skipped + p;
+        highlightedLine.spans.clear();
+        highlightedLine.state = state;
+
+        if (_repairing)
+        {
+            // the text after the damage is unchanged, so the rest of the lines are lexed as before
+
+            if (highlightedLine.position < _damagedEnd)
+                continue;
+
+            while (lineState < _lineStates.size() && _lineStates[lineState].position < highlightedLine.position)
+                ++lineState;
+
+            if (lineState < _lineStates.size() && _lineStates[lineState].position == highlightedLine.position &&
+                _lineStates[lineState].state == state)
+            {
+                _convergedPosition = highlightedLine.position;
+                break;
+            }
+        }
+        else if (++line % HIGHLIGHTING_CHECKPOINT_INTERVAL == 1 &&
+            line / HIGHLIGHTING_CHECKPOINT_INTERVAL == _firstCheckpoint + _checkpoints.size() + 1)
+        {
+            HighlightingCheckpoint checkpoint;
+            checkpoint.position = highlightedLine.position;
+            checkpoint.state = state;
+            _checkpoints.addLast(static_cast<HighlightingCheckpoint&&>(checkpoint));
+        }
+    }
+
+    // the last line of the document has no line break
+
+    if (_atEnd && highlightedLine.position >= _publishStart && _convergedPosition == INVALID_POSITION)
+        _lines.addLast(static_cast<HighlightedLine&&>(highlightedLine));
+
+    _text = String();
+    _lineStates.clear();
+    _done.store(1);
 }
 
-void Document::trimTrailingWhitespace()
+bool BackgroundHighlighter::highlightLine(int begin, int lineEnd, int end, HighlightingState& state,
+                                          Array<HighlightSpan>& spans, int& cut, int& skipped)
 {
-    String trimmed;
-    int p = 0, start = 0, whitespace = 0;
+    // the skipped parts of a cut line are drawn plain, its window is lexed in the state the line starts in
 
-    while (true)
+    if (cut < _cuts.size() && _cuts[cut].offset == begin)
     {
-        unichar_t ch = _text.charAt(p);
+        const HighlightingCut& highlightingCut = _cuts[cut++];
 
-        if (ch == '\n' || ch == 0)
+        if (highlightingCut.head > 0)
+            spans.addLast({ highlightingCut.head, HIGHLIGHTING_TYPE_NONE });
+
+        if (!highlightSlices(_syntaxHighlighter, _text, begin, lineEnd, state, spans, _group))
+            return false;
+
+        if (highlightingCut.tail > 0)
+            spans.addLast({ highlightingCut.tail, HIGHLIGHTING_TYPE_NONE });
+
+        skipped += highlightingCut.head + highlightingCut.tail;
+        begin = lineEnd;
+    }
+
+    return highlightSlices(_syntaxHighlighter, _text, begin, end, state, spans, _group);
+}
+
+// BracketScanTask
+
+class BracketScanTask : public Task
+{
+public:
+    BracketScanTask(BracketScanner& scanner) : _scanner(scanner)
+    {
+    }
+
+    void run() override
+    {
+        _scanner.scan();
+    }
+
+protected:
+    BracketScanner& _scanner;
+};
+
+static bool isBracket(char_t ch)
+{
+    return ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == '{' || ch == '}';
+}
+
+static int bracketDepth(char_t ch)
+{
+    return ch == '(' || ch == '[' || ch == '{' ? 1 : -1;
+}
+
+static char_t matchingBracket(char_t ch)
+{
+    switch (ch)
+    {
+    case '(':
+        return ')';
+    case ')':
+        return '(';
+    case '[':
+        return ']';
+    case ']':
+        return '[';
+    case '{':
+        return '}';
+    default:
+        return '{';
+    }
+}
+
+enum DeclarationWord
+{
+    DECLARATION_WORD_NONE,
+    DECLARATION_WORD_NAMESPACE,
+    DECLARATION_WORD_CLASS,
+    DECLARATION_WORD_ENUM,
+    DECLARATION_WORD_OPERATOR,
+    DECLARATION_WORD_FINAL,
+    DECLARATION_WORD_CONTROL,
+    DECLARATION_WORD_SPECIFIER
+};
+
+static DeclarationWord declarationWord(const char_t* chars, int len)
+{
+    // words that start declarations, or statements and specifiers with parentheses that are not functions
+
+    switch (chars[0])
+    {
+    case '_':
+        if (wordEquals(chars, len, "__attribute__") || wordEquals(chars, len, "__declspec"))
+            return DECLARATION_WORD_SPECIFIER;
+        break;
+    case 'a':
+        if (wordEquals(chars, len, "alignas") || wordEquals(chars, len, "alignof"))
+            return DECLARATION_WORD_SPECIFIER;
+        break;
+    case 'c':
+        if (wordEquals(chars, len, "class"))
+            return DECLARATION_WORD_CLASS;
+        if (wordEquals(chars, len, "catch") || wordEquals(chars, len, "case"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 'd':
+        if (wordEquals(chars, len, "decltype"))
+            return DECLARATION_WORD_SPECIFIER;
+        if (wordEquals(chars, len, "do"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 'e':
+        if (wordEquals(chars, len, "enum"))
+            return DECLARATION_WORD_ENUM;
+        if (wordEquals(chars, len, "else"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 'f':
+        if (wordEquals(chars, len, "final"))
+            return DECLARATION_WORD_FINAL;
+        if (wordEquals(chars, len, "for"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 'i':
+        if (wordEquals(chars, len, "if"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 'n':
+        if (wordEquals(chars, len, "namespace"))
+            return DECLARATION_WORD_NAMESPACE;
+        if (wordEquals(chars, len, "noexcept"))
+            return DECLARATION_WORD_SPECIFIER;
+        break;
+    case 'o':
+        if (wordEquals(chars, len, "operator"))
+            return DECLARATION_WORD_OPERATOR;
+        break;
+    case 'r':
+        if (wordEquals(chars, len, "return"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    case 's':
+        if (wordEquals(chars, len, "struct"))
+            return DECLARATION_WORD_CLASS;
+        if (wordEquals(chars, len, "switch"))
+            return DECLARATION_WORD_CONTROL;
+        if (wordEquals(chars, len, "sizeof") || wordEquals(chars, len, "static_assert"))
+            return DECLARATION_WORD_SPECIFIER;
+        break;
+    case 't':
+        if (wordEquals(chars, len, "throw"))
+            return DECLARATION_WORD_SPECIFIER;
+        break;
+    case 'u':
+        if (wordEquals(chars, len, "union"))
+            return DECLARATION_WORD_CLASS;
+        break;
+    case 'w':
+        if (wordEquals(chars, len, "while"))
+            return DECLARATION_WORD_CONTROL;
+        break;
+    }
+
+    return DECLARATION_WORD_NONE;
+}
+
+// BracketScanner
+
+BracketScanner::BracketScanner(ThreadPool& threadPool) :
+    _threadPool(threadPool), _syntaxHighlighter(nullptr), _start(0), _end(0), _atEnd(false),
+    _damagedEnd(0), _converged(false), _symbols(false), _declaration(), _done(0)
+{
+}
+
+BracketScanner::~BracketScanner()
+{
+    cancel();
+}
+
+void BracketScanner::start(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+                           const HighlightingState& state, int damagedEnd,
+                           Array<HighlightingCheckpoint>&& oldSyncPoints)
+{
+    ASSERT(start >= 0 && start <= end && end <= text.length());
+
+    cancel();
+
+    // lines are lexed from start until a line past the damage starts in the state of an old sync point
+
+    _syntaxHighlighter = syntaxHighlighter;
+    _text = text.substr(start, end - start);
+    _start = start;
+    _end = end;
+    _atEnd = end == text.length();
+    _state = state;
+    _damagedEnd = damagedEnd;
+    _oldSyncPoints = static_cast<Array<HighlightingCheckpoint>&&>(oldSyncPoints);
+    _symbols = syntaxHighlighter && syntaxHighlighter->documentType() == DOCUMENT_TYPE_CPP;
+    _declaration = Declaration();
+
+    _threadPool.submit(createUnique<BracketScanTask>(*this), &_group);
+}
+
+void BracketScanner::cancel()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    _done.store(0);
+    _converged = false;
+    _brackets.clear();
+    _syncPoints.clear();
+}
+
+void BracketScanner::wait()
+{
+    _group.wait();
+}
+
+void BracketScanner::scan()
+{
+    // without a syntax highlighter every bracket is code and the state never changes
+
+    HighlightingState state = _state;
+
+    const char_t* chars = _text.chars();
+    int len = _text.length();
+    int p = 0, line = 0, oldSyncPoint = 0;
+    Array<HighlightSpan> spans;
+
+    while (p < len)
+    {
+        int q = p;
+
+        while (q < len && chars[q] != '\n')
+            ++q;
+
+        if (q < len)
+            ++q;
+
+        if (_syntaxHighlighter)
         {
-            if (whitespace)
+            spans.clear();
+
+            if (!highlightSlices(_syntaxHighlighter, _text, p, q, state, spans, _group))
+                return;
+
+            for (int i = 0; i < spans.size(); ++i)
             {
-                trimmed.append(_text.chars() + start, whitespace - start);
-                start = p;
-                whitespace = 0;
+                HighlightingType highlightingType = spans[i].highlightingType;
+
+                if (highlightingType != HIGHLIGHTING_TYPE_STRING &&
+                    highlightingType != HIGHLIGHTING_TYPE_SINGLELINE_COMMENT &&
+                    highlightingType != HIGHLIGHTING_TYPE_MULTILINE_COMMENT &&
+                    highlightingType != HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE)
+                {
+                    if (_symbols && highlightingType != HIGHLIGHTING_TYPE_PREPROCESSOR)
+                        scanCode(p, p + spans[i].length);
+                    else
+                        addBrackets(p, p + spans[i].length);
+                }
+
+                p += spans[i].length;
             }
         }
-        else if (ch == ' ' || ch == '\t')
+        else
+            addBrackets(p, q);
+
+        p = q;
+
+        if (_group.cancelled())
+            return;
+
+        if (p == len && _atEnd)
+            break;
+
+        // scans start and stop only between declarations, so that their symbols are found whole
+
+        int position = _start + p;
+        bool statementStart = !_symbols || _declaration.tokens == 0;
+
+        if (position >= _damagedEnd && statementStart)
         {
-            if (!whitespace)
-                whitespace = p;
+            while (oldSyncPoint < _oldSyncPoints.size() && _oldSyncPoints[oldSyncPoint].position < position)
+                ++oldSyncPoint;
+
+            if (oldSyncPoint < _oldSyncPoints.size() && _oldSyncPoints[oldSyncPoint].position == position &&
+                _oldSyncPoints[oldSyncPoint].state == state)
+            {
+                _end = position;
+                _converged = true;
+                break;
+            }
         }
-        else
-            whitespace = 0;
 
-        if (p < _text.length())
-            p = _text.charForward(p);
-        else
+        // the state at the end of an unfinished scan is where the next one starts,
+        // one ending inside a declaration is cut back to its last sync point or discarded without one
+
+        if (p == len && !statementStart)
         {
-            trimmed.append(_text.chars() + start, p - start);
-            break;
+            _end = _syncPoints.empty() ? _start : _syncPoints.last().position;
+
+            while (!_brackets.empty() && _brackets.last().position >= _end)
+                _brackets.removeLast();
+        }
+        else if (p == len || (++line >= BRACKET_SYNC_INTERVAL && statementStart))
+        {
+            _syncPoints.addLast({ position, state });
+            line = 0;
         }
     }
 
-    swap(trimmed, _text);
+    _text = String();
+    _oldSyncPoints.clear();
+    _done.store(1);
+}
 
-    lineColumnToPosition(0, 1, 1, _line, _column, _position, _line, _column);
+void BracketScanner::addBrackets(int begin, int end)
+{
+    const char_t* chars = _text.chars();
 
-    _modified = true;
-    _selectionMode = false;
-    _selection = -1;
-    _topPosition = -1;
+    for (int i = begin; i < end; ++i)
+        if (isBracket(chars[i]))
+            _brackets.addLast({ _start + i, chars[i] });
 }
 
-void Document::setDimensions(int x, int y, int width, int height)
+void BracketScanner::scanCode(int begin, int end)
 {
-    ASSERT(x > 0 && y > 0);
-    ASSERT(width > 0 && height > 0);
+    const char_t* chars = _text.chars();
+    int i = begin;
 
-    _x = x;
-    _y = y;
-    _width = width;
-    _height = height;
+    while (i < end)
+    {
+        unichar_t ch = asciiUnit(chars[i]);
+
+        if (ch == 0x80 || asciiIsWord(ch))
+        {
+            int j = i + 1;
+
+            while (j < end && (asciiUnit(chars[j]) == 0x80 || asciiIsWord(asciiUnit(chars[j]))))
+                ++j;
+
+            scanWord(i, j);
+            i = j;
+        }
+        else if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+            ++i;
+        else
+            i += scanPunctuation(i, end);
+    }
 }
 
-void Document::draw(int screenWidth, Buffer<ScreenCell>& screen, bool unicodeLimit16)
+void BracketScanner::scanWord(int begin, int end)
 {
-    ASSERT(screenWidth > 0);
+    // the last qualified name before a parenthesis names a function,
+    // the last one after a namespace or class keyword names those
 
-    int l;
-    bool highlightFromStart = true;
+    Declaration& declaration = _declaration;
+    const char_t* chars = _text.chars() + begin;
+    int len = end - begin;
+    int position = _start + begin;
 
-    if (_line < _top)
-        lineColumnToPosition(_position, _line, _column, _line, 1, _topPosition, _top, l);
-    else if (_line >= _top + _height)
-        lineColumnToPosition(_position, _line, _column, _line - _height + 1, 1, _topPosition, _top, l);
-    else if (_topPosition < 0)
-        lineColumnToPosition(_position, _line, _column, _top, 1, _topPosition, _top, l);
-    else
-        highlightFromStart = false;
+    ++declaration.tokens;
 
-    if (_column < _left)
-        _left = _column;
-    else if (_column >= _left + _width)
-        _left = _column - _width + 1;
+    if (declaration.parenDepth > 0 || declaration.angleDepth > 0 || charIsDigit(chars[0]))
+    {
+        declaration.prevToken = '0';
+        declaration.scope = false;
+        return;
+    }
 
-    ASSERT(_position >= 0 && _position <= _text.length());
-    ASSERT(_line > 0 && _column > 0);
-    ASSERT(_preferredColumn > 0);
-    ASSERT(_top > 0 && _left > 0);
-    ASSERT(_topPosition >= 0 && _topPosition <= _text.length());
-    ASSERT(_x > 0 && _y > 0);
-    ASSERT(_width > 0 && _height > 0);
+    DeclarationWord word = declaration.operatorName ? DECLARATION_WORD_NONE : declarationWord(chars, len);
 
-    int p = _topPosition;
-    int len = _left + _width - 1;
+    if (declaration.operatorName)
+        declaration.nameEnd = position + len;
+    else if (word == DECLARATION_WORD_NAMESPACE || word == DECLARATION_WORD_CLASS)
+    {
+        if (declaration.symbolType == SYMBOL_TYPE_NONE)
+            declaration.symbolType = word == DECLARATION_WORD_NAMESPACE ? SYMBOL_TYPE_NAMESPACE : SYMBOL_TYPE_CLASS;
+    }
+    else if (word == DECLARATION_WORD_ENUM || word == DECLARATION_WORD_CONTROL)
+        declaration.excluded = true;
+    else if (word == DECLARATION_WORD_OPERATOR)
+    {
+        declaration.operatorName = true;
 
-    const ForegroundColor brightBackgroundColors[] = {
-        defaultForeground(), FOREGROUND_COLOR_YELLOW, FOREGROUND_COLOR_RED, defaultForeground(),
-        FOREGROUND_COLOR_BLUE, FOREGROUND_COLOR_CYAN,FOREGROUND_COLOR_BRIGHT_BLACK, FOREGROUND_COLOR_BRIGHT_BLACK,
-        FOREGROUND_COLOR_MAGENTA, FOREGROUND_COLOR_CYAN, FOREGROUND_COLOR_MAGENTA, FOREGROUND_COLOR_BLUE,
-        FOREGROUND_COLOR_CYAN, defaultForeground(), FOREGROUND_COLOR_YELLOW
-    };
+        if (!declaration.scope)
+            declaration.nameStart = position;
+
+        declaration.nameEnd = position + len;
+    }
+    else if (word == DECLARATION_WORD_NONE)
+    {
+        bool qualified = declaration.scope && declaration.symbolEnd > declaration.symbolStart &&
+                         declaration.symbolEnd == declaration.nameEnd;
+
+        if (!declaration.scope)
+            declaration.nameStart = declaration.prevToken == '~' ? declaration.prevTokenPosition : position;
+
+        declaration.nameEnd = position + len;
+
+        if (declaration.symbolType != SYMBOL_TYPE_NONE && !declaration.baseClause)
+        {
+            if (!declaration.scope)
+                declaration.symbolStart = declaration.nameStart;
+
+            if (!declaration.scope || qualified)
+                declaration.symbolEnd = declaration.nameEnd;
+        }
+    }
+
+    declaration.word = static_cast<uint8_t>(word);
+    declaration.scope = false;
+    declaration.prevToken = 'a';
+    declaration.prevTokenPosition = position;
+}
+
+int BracketScanner::scanPunctuation(int pos, int end)
+{
+    Declaration& declaration = _declaration;
+    const char_t* chars = _text.chars();
+    char_t ch = chars[pos];
+    int position = _start + pos;
+    int len = 1;
+
+    if (isBracket(ch))
+        _brackets.addLast({ position, ch });
+
+    ++declaration.tokens;
+
+    if (ch == ':' && pos + 1 < end && chars[pos + 1] == ':')
+    {
+        declaration.scope = declaration.nameEnd > declaration.nameStart &&
+                            (declaration.prevToken == 'a' || declaration.prevToken == '>');
+        declaration.prevToken = ch;
+        declaration.prevTokenPosition = position;
+        return 2;
+    }
+
+    if (declaration.parenDepth > 0)
+    {
+        if (ch == '(' || ch == '[')
+            ++declaration.parenDepth;
+        else if (ch == ')' || ch == ']')
+            --declaration.parenDepth;
+    }
+    else if (declaration.operatorName && ch == '(' && declaration.word == DECLARATION_WORD_OPERATOR &&
+             declaration.prevToken == 'a' && pos + 1 < end && chars[pos + 1] == ')')
+    {
+        _brackets.addLast({ position + 1, ')' });
+        declaration.nameEnd = position + 2;
+        len = 2;
+    }
+    else if (declaration.operatorName && ch != '(' && ch != '{' && ch != ';')
+    {
+        if (ch == '[' && pos + 1 < end && chars[pos + 1] == ']')
+        {
+            _brackets.addLast({ position + 1, ']' });
+            len = 2;
+        }
+
+        declaration.nameEnd = position + len;
+    }
+    else if (declaration.angleDepth > 0 && ch != '{' && ch != '}' && ch != ';')
+    {
+        if (ch == '<')
+            ++declaration.angleDepth;
+        else if (ch == '>')
+            --declaration.angleDepth;
+        else if (ch == '(' || ch == '[')
+            ++declaration.parenDepth;
+    }
+    else
+    {
+        switch (ch)
+        {
+        case '(':
+            if (!declaration.functionFound && (declaration.operatorName ||
+                (declaration.prevToken == 'a' && declaration.word == DECLARATION_WORD_NONE)))
+            {
+                declaration.functionFound = true;
+                declaration.functionStart = declaration.nameStart;
+                declaration.functionEnd = declaration.nameEnd;
+                declaration.operatorName = false;
+            }
+
+            ++declaration.parenDepth;
+            break;
+        case '[':
+            ++declaration.parenDepth;
+            break;
+        case '<':
+            if (declaration.prevToken == 'a' && declaration.word == DECLARATION_WORD_NONE)
+                ++declaration.angleDepth;
+            break;
+        case '=':
+            declaration.assigned = true;
+            break;
+        case ':':
+            // a label or access specifier ends like a statement, otherwise a base class or initializer list follows
+
+            if (declaration.tokens == 2 && declaration.prevToken == 'a')
+            {
+                declaration = Declaration();
+                return len;
+            }
+
+            if (declaration.functionFound)
+                declaration.initList = true;
+            else
+                declaration.baseClause = true;
+            break;
+        case '{':
+            // braces of member initializers belong to the function
+
+            if (declaration.initBraces > 0 ||
+                (declaration.initList && (declaration.prevToken == 'a' || declaration.prevToken == '>')))
+                ++declaration.initBraces;
+            else
+            {
+                Bracket& bracket = _brackets.last();
+
+                if (!declaration.assigned && !declaration.excluded)
+                {
+                    if (declaration.functionFound)
+                    {
+                        bracket.symbolType = SYMBOL_TYPE_FUNCTION;
+                        bracket.nameOffset = position - declaration.functionStart;
+                        bracket.nameLength = declaration.functionEnd - declaration.functionStart;
+                    }
+                    else if (declaration.symbolEnd > declaration.symbolStart)
+                    {
+                        bracket.symbolType = declaration.symbolType;
+                        bracket.nameOffset = position - declaration.symbolStart;
+                        bracket.nameLength = declaration.symbolEnd - declaration.symbolStart;
+                    }
+                }
+
+                declaration = Declaration();
+                return len;
+            }
+            break;
+        case '}':
+            if (declaration.initBraces > 0)
+                --declaration.initBraces;
+            else
+            {
+                declaration = Declaration();
+                return len;
+            }
+            break;
+        case ';':
+            if (declaration.initBraces == 0)
+            {
+                declaration = Declaration();
+                return len;
+            }
+            break;
+        }
+    }
+
+    declaration.scope = declaration.scope && ch == '~';
+    declaration.prevToken = ch;
+    declaration.prevTokenPosition = position;
+    return len;
+}
+
+// BracketIndex
+
+BracketIndex::BracketIndex() :
+    _enabled(false), _root(-1), _seed(2463534242), _damagedStart(-1), _damagedEnd(-1),
+    _scanChunkSize(BRACKET_SCAN_CHUNK_SIZE)
+{
+}
+
+void BracketIndex::enable(int textLength)
+{
+    if (!_enabled)
+    {
+        _enabled = true;
+        reset(textLength);
+    }
+}
+
+void BracketIndex::disable()
+{
+    reset(0);
+    _enabled = false;
+    _damagedStart = _damagedEnd = -1;
+}
+
+void BracketIndex::reset(int textLength)
+{
+    _nodes.clear();
+    _freeNodes.clear();
+    _root = -1;
+    _syncPoints.clear();
+
+    if (_enabled)
+    {
+        _damagedStart = 0;
+        _damagedEnd = textLength;
+    }
+}
+
+void BracketIndex::textChanged(int pos, int end, int delta)
+{
+    if (!_enabled)
+        return;
+
+    // brackets in the removed text are gone and the ones after it are moved,
+    // sync points after the edit are kept as old states for the scan to converge on,
+    // except for the ones a deletion would move onto the edit position, where a scan can start
+
+    int removedEnd = end - delta;
+    replace(pos, removedEnd, delta, Array<Bracket>());
+
+    int j = 0;
+
+    for (int i = 0; i < _syncPoints.size(); ++i)
+    {
+        HighlightingCheckpoint syncPoint = _syncPoints[i];
+
+        if (syncPoint.position >= pos && syncPoint.position <= removedEnd && removedEnd > pos)
+            continue;
+
+        if (syncPoint.position > pos)
+            syncPoint.position += delta;
+
+        _syncPoints[j++] = syncPoint;
+    }
+
+    while (_syncPoints.size() > j)
+        _syncPoints.removeLast();
+
+    if (_damagedStart < 0)
+    {
+        _damagedStart = pos;
+        _damagedEnd = end;
+    }
+    else
+    {
+        if (_damagedEnd > pos)
+            _damagedEnd = _damagedEnd < removedEnd ? pos : _damagedEnd + delta;
+
+        _damagedStart = pos < _damagedStart ? pos : _damagedStart;
+        _damagedEnd = end > _damagedEnd ? end : _damagedEnd;
+    }
+}
+
+void BracketIndex::startScan(BracketScanner& scanner, const SyntaxHighlighter* syntaxHighlighter, const String& text)
+{
+    ASSERT(_enabled && _damagedStart >= 0);
+
+    // a scan starts at the last sync point before the damage and lexes at most a chunk past it,
+    // the old sync points in between are where it can stop early
+
+    int first = lowerBoundSyncPoint(_damagedStart + 1) - 1;
+    int start = first >= 0 ? _syncPoints[first].position : 0;
+    HighlightingState state = first >= 0 ? _syncPoints[first].state : HighlightingState();
+
+    int last = lowerBoundSyncPoint(_damagedEnd + _scanChunkSize);
+    int end = last < _syncPoints.size() ? _syncPoints[last].position : text.length();
+
+    Array<HighlightingCheckpoint> oldSyncPoints;
+
+    for (int i = lowerBoundSyncPoint(_damagedEnd); i < _syncPoints.size() && i <= last; ++i)
+        oldSyncPoints.addLast(_syncPoints[i]);
+
+    scanner.start(syntaxHighlighter, text, start, end, state, _damagedEnd,
+                  static_cast<Array<HighlightingCheckpoint>&&>(oldSyncPoints));
+}
+
+void BracketIndex::finishScan(BracketScanner& scanner, int textLength)
+{
+    ASSERT(_enabled && scanner.done());
+
+    int start = scanner.scanStart(), end = scanner.scanEnd();
+
+    // a chunk inside a single declaration is scanned again with a larger one
+
+    if (end == start && end < textLength)
+    {
+        _scanChunkSize *= 2;
+        return;
+    }
+
+    _scanChunkSize = BRACKET_SCAN_CHUNK_SIZE;
+    replace(start, end, 0, scanner.brackets());
+
+    // sync points of the scanned text replace the old ones, an unfinished scan replaces the one at its end
+
+    Array<HighlightingCheckpoint> syncPoints;
+    syncPoints.ensureCapacity(_syncPoints.size() + scanner.syncPoints().size());
+    int i = 0;
+
+    while (i < _syncPoints.size() && _syncPoints[i].position <= start)
+        syncPoints.addLast(_syncPoints[i++]);
+
+    for (int j = 0; j < scanner.syncPoints().size(); ++j)
+        syncPoints.addLast(scanner.syncPoints()[j]);
+
+    while (i < _syncPoints.size() && (_syncPoints[i].position < end ||
+           (_syncPoints[i].position == end && !scanner.converged())))
+        ++i;
+
+    while (i < _syncPoints.size())
+        syncPoints.addLast(_syncPoints[i++]);
+
+    swap(_syncPoints, syncPoints);
+
+    // a scan cut back to a declaration boundary may end before the damage does
+
+    if (scanner.converged() || end == textLength)
+        _damagedStart = _damagedEnd = -1;
+    else
+    {
+        _damagedStart = end;
+        _damagedEnd = end > _damagedEnd ? end : _damagedEnd;
+    }
+}
+
+int BracketIndex::find(int pos) const
+{
+    // index of the first bracket at or after pos
+
+    int node = _root, index = 0, base = 0, result = size();
+
+    while (node >= 0)
+    {
+        const BracketNode& n = _nodes[node];
+        int position = base + nodeSpan(n.left) + n.gap;
+
+        if (position >= pos)
+        {
+            result = index + nodeSize(n.left);
+            node = n.left;
+        }
+        else
+        {
+            index += nodeSize(n.left) + 1;
+            base = position;
+            node = n.right;
+        }
+    }
+
+    return result;
+}
+
+Bracket BracketIndex::at(int index) const
+{
+    ASSERT(index >= 0 && index < size());
+
+    int node = _root, base = 0;
+
+    for (;;)
+    {
+        const BracketNode& n = _nodes[node];
+        int leftSize = nodeSize(n.left);
+
+        if (index < leftSize)
+            node = n.left;
+        else
+        {
+            base += nodeSpan(n.left) + n.gap;
+
+            if (index == leftSize)
+                return { base, n.ch, n.symbolType, n.nameOffset, n.nameLength };
+
+            index -= leftSize + 1;
+            node = n.right;
+        }
+    }
+}
+
+int BracketIndex::findMatch(int index) const
+{
+    // depth after a bracket is the number of open brackets up to and including it minus the closed ones,
+    // an open bracket is closed by the first bracket after it that brings the depth below its own,
+    // a closing one is opened right after the last bracket before it at its depth
+
+    Bracket bracket = at(index);
+    int depth = depthAt(index);
+    int match;
+
+    if (bracketDepth(bracket.ch) > 0)
+        match = firstAtMost(_root, 0, 0, index + 1, depth - 1);
+    else
+    {
+        match = lastAtMost(_root, 0, 0, index - 1, depth);
+
+        if (match < 0 && depth < 0)
+            return -1;
+
+        ++match;
+
+        if (match >= index)
+            return -1;
+    }
+
+    if (match < 0 || at(match).ch != matchingBracket(bracket.ch))
+        return -1;
+
+    return match;
+}
+
+int BracketIndex::findEnclosing(int pos) const
+{
+    // the enclosing bracket is opened right after the last bracket before pos with a lower depth
+
+    int index = find(pos);
+    int depth = index > 0 ? depthAt(index - 1) : 0;
+    int enclosing = lastAtMost(_root, 0, 0, index - 1, depth - 1);
+
+    if (enclosing < 0 && depth < 1)
+        return -1;
+
+    ++enclosing;
+    return enclosing < index ? enclosing : -1;
+}
+
+int BracketIndex::findSymbol(int index, int symbolTypes, bool forward) const
+{
+    // first bracket from index on or last one up to it that opens a symbol of the given types
+
+    return forward ? firstSymbol(_root, 0, index, symbolTypes) : lastSymbol(_root, 0, index, symbolTypes);
+}
+
+uint32_t BracketIndex::random()
+{
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    return _seed;
+}
+
+void BracketIndex::update(int node)
+{
+    // span is the sum of gaps, min depth is the lowest depth after any bracket of the subtree,
+    // symbol types are the types of all symbols in it
+
+    BracketNode& n = _nodes[node];
+    int depth = bracketDepth(n.ch);
+
+    n.size = 1;
+    n.span = n.gap;
+    n.depth = depth;
+    n.minDepth = depth;
+    n.symbolTypes = n.symbolType;
+
+    if (n.left >= 0)
+    {
+        const BracketNode& left = _nodes[n.left];
+        n.size += left.size;
+        n.span += left.span;
+        n.symbolTypes |= left.symbolTypes;
+        n.minDepth = left.minDepth < left.depth + depth ? left.minDepth : left.depth + depth;
+        n.depth += left.depth;
+    }
+
+    if (n.right >= 0)
+    {
+        const BracketNode& right = _nodes[n.right];
+        n.size += right.size;
+        n.span += right.span;
+        n.symbolTypes |= right.symbolTypes;
+        n.minDepth = n.minDepth < n.depth + right.minDepth ? n.minDepth : n.depth + right.minDepth;
+        n.depth += right.depth;
+    }
+}
+
+int BracketIndex::merge(int left, int right)
+{
+    // a root is picked with probability proportional to subtree size, which keeps the tree balanced
+
+    if (left < 0)
+        return right;
+
+    if (right < 0)
+        return left;
+
+    if (random() % static_cast<uint32_t>(_nodes[left].size + _nodes[right].size) <
+        static_cast<uint32_t>(_nodes[left].size))
+    {
+        int node = merge(_nodes[left].right, right);
+        _nodes[left].right = node;
+        update(left);
+        return left;
+    }
+    else
+    {
+        int node = merge(left, _nodes[right].left);
+        _nodes[right].left = node;
+        update(right);
+        return right;
+    }
+}
+
+void BracketIndex::split(int node, int pos, int base, int& left, int& right)
+{
+    // brackets before pos go left, base is the position the first gap of the subtree counts from
+
+    if (node < 0)
+    {
+        left = right = -1;
+        return;
+    }
+
+    BracketNode& n = _nodes[node];
+    int position = base + nodeSpan(n.left) + n.gap;
+
+    if (position < pos)
+    {
+        split(n.right, pos, position, n.right, right);
+        left = node;
+    }
+    else
+    {
+        split(n.left, pos, base, left, n.left);
+        right = node;
+    }
+
+    update(node);
+}
+
+int BracketIndex::build(const Array<Bracket>& brackets, int begin, int end, int base)
+{
+    if (begin == end)
+        return -1;
+
+    int mid = (begin + end) / 2;
+    int node;
+
+    if (_freeNodes.empty())
+    {
+        node = _nodes.size();
+        _nodes.addLast(BracketNode());
+    }
+    else
+    {
+        node = _freeNodes.last();
+        _freeNodes.removeLast();
+    }
+
+    int left = build(brackets, begin, mid, base);
+    int right = build(brackets, mid + 1, end, base);
+
+    BracketNode& n = _nodes[node];
+    n.left = left;
+    n.right = right;
+    n.gap = brackets[mid].position - (mid > 0 ? brackets[mid - 1].position : base);
+    n.ch = brackets[mid].ch;
+    n.symbolType = brackets[mid].symbolType;
+    n.nameOffset = brackets[mid].nameOffset;
+    n.nameLength = brackets[mid].nameLength;
+    update(node);
+
+    return node;
+}
+
+void BracketIndex::freeNodes(int node)
+{
+    if (node >= 0)
+    {
+        freeNodes(_nodes[node].left);
+        freeNodes(_nodes[node].right);
+        _freeNodes.addLast(node);
+    }
+}
+
+void BracketIndex::replace(int start, int end, int delta, const Array<Bracket>& brackets)
+{
+    // brackets in [start, end) are replaced, the ones after end are moved by delta
+
+    int left, middle, right;
+    split(_root, start, 0, left, middle);
+
+    int leftSpan = nodeSpan(left);
+    split(middle, end, leftSpan, middle, right);
+
+    int middleSpan = nodeSpan(middle);
+    freeNodes(middle);
+
+    middle = build(brackets, 0, brackets.size(), leftSpan);
+
+    // the first gap on the right now counts from the last new bracket
+
+    int shift = middleSpan + delta - nodeSpan(middle);
+
+    for (int node = right; node >= 0; node = _nodes[node].left)
+    {
+        _nodes[node].span += shift;
+
+        if (_nodes[node].left < 0)
+            _nodes[node].gap += shift;
+    }
+
+    _root = merge(merge(left, middle), right);
+}
+
+int BracketIndex::depthAt(int index) const
+{
+    ASSERT(index >= 0 && index < size());
+
+    int node = _root, depth = 0;
+
+    for (;;)
+    {
+        const BracketNode& n = _nodes[node];
+        int leftSize = nodeSize(n.left);
+
+        if (index < leftSize)
+            node = n.left;
+        else
+        {
+            depth += nodeDepth(n.left) + bracketDepth(n.ch);
+
+            if (index == leftSize)
+                return depth;
+
+            index -= leftSize + 1;
+            node = n.right;
+        }
+    }
+}
+
+int BracketIndex::firstAtMost(int node, int index, int depth, int lo, int target) const
+{
+    // first bracket from lo on with depth at most target, index and depth are those before the subtree
+
+    if (node < 0)
+        return -1;
+
+    const BracketNode& n = _nodes[node];
+
+    if (index + n.size <= lo || depth + n.minDepth > target)
+        return -1;
+
+    int result = firstAtMost(n.left, index, depth, lo, target);
+
+    if (result >= 0)
+        return result;
+
+    int current = index + nodeSize(n.left);
+    int currentDepth = depth + nodeDepth(n.left) + bracketDepth(n.ch);
+
+    if (current >= lo && currentDepth <= target)
+        return current;
+
+    return firstAtMost(n.right, current + 1, currentDepth, lo, target);
+}
+
+int BracketIndex::lastAtMost(int node, int index, int depth, int hi, int target) const
+{
+    // last bracket up to hi with depth at most target
+
+    if (node < 0)
+        return -1;
+
+    const BracketNode& n = _nodes[node];
+
+    if (index > hi || depth + n.minDepth > target)
+        return -1;
+
+    int current = index + nodeSize(n.left);
+    int currentDepth = depth + nodeDepth(n.left) + bracketDepth(n.ch);
+    int result = lastAtMost(n.right, current + 1, currentDepth, hi, target);
+
+    if (result >= 0)
+        return result;
+
+    if (current <= hi && currentDepth <= target)
+        return current;
+
+    return lastAtMost(n.left, index, depth, hi, target);
+}
+
+int BracketIndex::firstSymbol(int node, int index, int lo, int symbolTypes) const
+{
+    // first bracket from lo on with a symbol of the given types, index is the one before the subtree
+
+    if (node < 0)
+        return -1;
+
+    const BracketNode& n = _nodes[node];
+
+    if (index + n.size <= lo || !(n.symbolTypes & symbolTypes))
+        return -1;
+
+    int result = firstSymbol(n.left, index, lo, symbolTypes);
+
+    if (result >= 0)
+        return result;
+
+    int current = index + nodeSize(n.left);
+
+    if (current >= lo && (n.symbolType & symbolTypes))
+        return current;
+
+    return firstSymbol(n.right, current + 1, lo, symbolTypes);
+}
+
+int BracketIndex::lastSymbol(int node, int index, int hi, int symbolTypes) const
+{
+    // last bracket up to hi with a symbol of the given types
+
+    if (node < 0)
+        return -1;
+
+    const BracketNode& n = _nodes[node];
+
+    if (index > hi || !(n.symbolTypes & symbolTypes))
+        return -1;
+
+    int current = index + nodeSize(n.left);
+    int result = lastSymbol(n.right, current + 1, hi, symbolTypes);
+
+    if (result >= 0)
+        return result;
+
+    if (current <= hi && (n.symbolType & symbolTypes))
+        return current;
+
+    return lastSymbol(n.left, index, hi, symbolTypes);
+}
+
+int BracketIndex::lowerBoundSyncPoint(int pos) const
+{
+    int low = 0, high = _syncPoints.size();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (_syncPoints[mid].position < pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+// WordFilter
+
+bool WordFilter::skipped(const char_t* chars, int len) const
+{
+    ASSERT(chars && len > 0);
+
+    return skipped(HIGHLIGHTING_TYPE_NUMBER) && (len > AUTOCOMPLETE_MAX_WORD_LENGTH || charIsDigit(chars[0]));
+}
+
+// WordIndex
+
+void WordIndex::countWords(StringPool& words, const WordFilter& filter, const String& text, int begin, int end,
+                           HighlightingState& state, int delta)
+{
+    ASSERT(begin >= 0 && begin <= end && end <= text.length());
+
+    // words are interned in the pool shared by all documents, so counting an existing word allocates nothing,
+    // the text is lexed from the given state only to leave out the words in the skipped tokens
+
+    int start = INVALID_POSITION;
+    int p;
+
+    for (p = begin; p < end; p = text.charForward(p))
+    {
+        if (filter.syntaxHighlighter)
+            filter.syntaxHighlighter->highlightChar(text, p, state);
+
+        if (charIsWord(text.charAt(p)) && !filter.skipped(state.highlightingType))
+        {
+            if (start == INVALID_POSITION)
+                start = p;
+        }
+        else if (start != INVALID_POSITION)
+        {
+            addCount(words, filter, text.chars() + start, p - start, delta);
+            start = INVALID_POSITION;
+        }
+    }
+
+    if (start != INVALID_POSITION)
+        addCount(words, filter, text.chars() + start, p - start, delta);
+}
+
+void WordIndex::recountTail(StringPool& words, const WordFilter& filter, const String& text, int begin,
+                            HighlightingState& oldState, HighlightingState& newState,
+                            Array<HighlightingCheckpoint>& checkpoints)
+{
+    ASSERT(filter.syntaxHighlighter && begin >= 0 && begin <= text.length());
+
+    // the text after a change that ends in another state, like an opened comment, is tokenized differently,
+    // it is lexed in both states side by side taking out the old words and adding the new ones
+    // until the states meet between words, after that the words are the same, and so are the checkpoints,
+    // the ones before take the new state or are dropped when it is inside a token
+
+    int oldStart = INVALID_POSITION, newStart = INVALID_POSITION;
+    int checkpoint = 0;
+    int p;
+
+    while (checkpoint < checkpoints.size() && checkpoints[checkpoint].position < begin)
+        ++checkpoint;
+
+    for (p = begin; p < text.length(); p = text.charForward(p))
+    {
+        if (oldStart == INVALID_POSITION && newStart == INVALID_POSITION && oldState == newState)
+            return;
+
+        if (checkpoint < checkpoints.size() && checkpoints[checkpoint].position == p)
+        {
+            if (newState.charsRemaining == 0)
+                checkpoints[checkpoint++].state = newState;
+            else
+                checkpoints.remove(checkpoint);
+        }
+
+        bool word = charIsWord(text.charAt(p));
+
+        filter.syntaxHighlighter->highlightChar(text, p, oldState);
+        filter.syntaxHighlighter->highlightChar(text, p, newState);
+
+        if (word && !filter.skipped(oldState.highlightingType))
+        {
+            if (oldStart == INVALID_POSITION)
+                oldStart = p;
+        }
+        else if (oldStart != INVALID_POSITION)
+        {
+            addCount(words, filter, text.chars() + oldStart, p - oldStart, -1);
+            oldStart = INVALID_POSITION;
+        }
+
+        if (word && !filter.skipped(newState.highlightingType))
+        {
+            if (newStart == INVALID_POSITION)
+                newStart = p;
+        }
+        else if (newStart != INVALID_POSITION)
+        {
+            addCount(words, filter, text.chars() + newStart, p - newStart, 1);
+            newStart = INVALID_POSITION;
+        }
+    }
+
+    if (oldStart != INVALID_POSITION)
+        addCount(words, filter, text.chars() + oldStart, p - oldStart, -1);
+
+    if (newStart != INVALID_POSITION)
+        addCount(words, filter, text.chars() + newStart, p - newStart, 1);
+}
+
+void WordIndex::recount(StringPool& words, const WordFilter& filter, const String& text,
+                        Array<HighlightingCheckpoint>& checkpoints)
+{
+    for (int i = 0; i < _counts.numSlots(); ++i)
+    {
+        const WordSlot& slot = _counts.slot(i);
+
+        if (slot.word >= 0)
+            _changes.addCount(slot.word, -slot.count);
+    }
+
+    _counts.clear();
+    checkpoints.clear();
+
+    HighlightingState state;
+
+    if (!filter.syntaxHighlighter)
+    {
+        countWords(words, filter, text, 0, text.length(), state, 1);
+        return;
+    }
+
+    // the whole text is counted from the highlighted spans, which skip the runs of characters
+    // that can't change the state, a slice at a time to keep the spans short, the states between slices
+    // are kept as checkpoints for lexing the words of later edits
+
+    const char_t* chars = text.chars();
+    Array<HighlightSpan> spans;
+    int start = INVALID_POSITION;
+    int next = AUTOCOMPLETE_CHECKPOINT_INTERVAL;
+    int p = 0;
+
+    while (p < text.length())
+    {
+        int sliceEnd = text.length() - p > HIGHLIGHTING_SLICE_SIZE ? p + HIGHLIGHTING_SLICE_SIZE : text.length();
+
+        while (sliceEnd < text.length() && asciiUnit(chars[sliceEnd]) == 0x80)
+            ++sliceEnd;
+
+        spans.clear();
+        filter.syntaxHighlighter->highlightRange(text, p, sliceEnd, state, spans);
+
+        if (sliceEnd >= next && sliceEnd < text.length() && state.charsRemaining == 0)
+        {
+            checkpoints.addLast({ sliceEnd, state });
+            next = sliceEnd + AUTOCOMPLETE_CHECKPOINT_INTERVAL;
+        }
+
+        for (int i = 0; i < spans.size(); ++i)
+        {
+            int end = p + spans[i].length;
+
+            if (filter.skipped(spans[i].highlightingType))
+            {
+                if (start != INVALID_POSITION)
+                    addCount(words, filter, chars + start, p - start, 1);
+
+                start = INVALID_POSITION;
+                p = end;
+                continue;
+            }
+
+            while (p < end)
+            {
+                int q = skipWord(text, p);
+
+                if (q > p)
+                {
+                    if (start == INVALID_POSITION)
+                        start = p;
+
+                    p = q < end ? q : end;
+                }
+                else
+                {
+                    if (start != INVALID_POSITION)
+                    {
+                        addCount(words, filter, chars + start, p - start, 1);
+                        start = INVALID_POSITION;
+                    }
+
+                    p = text.charForward(p);
+                }
+            }
+        }
+    }
+
+    if (start != INVALID_POSITION)
+        addCount(words, filter, chars + start, p - start, 1);
+}
+
+void WordIndex::clearChanges()
+{
+    _changes.clear();
+}
+
+void WordIndex::addCount(StringPool& words, const WordFilter& filter, const char_t* chars, int len, int delta)
+{
+    if (filter.skipped(chars, len))
+        return;
+
+    int word = delta > 0 ? words.add(chars, len) : words.find(chars, len);
+
+    if (word >= 0)
+    {
+        _counts.addCount(word, delta);
+        _changes.addCount(word, delta);
+    }
+}
+
+// Document
+
+Document::Document(Editor* editor) :
+    _editor(editor), _version(0), _changedStart(-1), _documentType(DOCUMENT_TYPE_TEXT), _verifiedCheckpoints(0),
+    _highlightedLength(0), _visibleStart(0), _visibleEnd(0), _windowStart(0), _windowEnd(INT_MAX),
+    _highlightingNeeded(false), _damagedStart(-1), _damagedEnd(-1), _wordsPosition(-1), _wordsEnd(-1),
+    _matchesStart(-1), _matchesEnd(-1)
+{
+    clear();
+    setDimensions(1, 1, 1, 1);
+}
+
+bool Document::moveForward()
+{
+    if (_position < _text.length())
+    {
+        int p = _text.charForward(_position);
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::moveBack()
+{
+    if (_position > 0)
+    {
+        int p = _text.charBack(_position);
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::moveWordForward()
+{
+    int p = findWordForward(_position);
+
+    if (p > _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveWordBack()
+{
+    int p = findWordBack(_position);
+
+    if (p < _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveCharsForward()
+{
+    int p = findCharsForward(_position);
+
+    if (p > _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveCharsBack()
+{
+    int p = findCharsBack(_position);
+
+    if (p < _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveToStart()
+{
+    if (_position > 0)
+    {
+        _position = 0;
+        _line = _column = _preferredColumn = 1;
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::moveToEnd()
+{
+    if (_position < _text.length())
+    {
+        int p = _text.length();
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::moveToLineStart()
+{
+    int start = findLineStart(_position);
+
+    unichar_t ch;
+    int end = start;
+
+    ch = _text.charAt(end);
+    while (ch == ' ' || ch == '\t')
+    {
+        end = _text.charForward(end);
+        ch = _text.charAt(end);
+    }
+
+    int p = _position == start || _position > end ? end : start;
+
+    if (p != _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::moveToLineEnd()
+{
+    int p = findLineEnd(_position);
+
+    if (p > _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveLines(int lines)
+{
+    int line = _line + lines;
+    if (line < 1)
+        line = 1;
+
+    return moveToLine(line);
+}
+
+bool Document::movePage(bool down)
+{
+    int lines = _height - 1;
+    if (lines < 1)
+        lines = 1;
+
+    return moveLines(down ? lines : -lines);
+}
+
+bool Document::moveToLine(int line)
+{
+    ASSERT(line > 0);
+
+    int prev = _position;
+    lineColumnToPosition(_position, _line, _column, line, _preferredColumn, _position, _line, _column);
+
+    if (_position != prev)
+    {
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveToLineColumn(int line, int column)
+{
+    ASSERT(line > 0 && column > 0);
+
+    int prev = _position;
+    lineColumnToPosition(_position, _line, _column, line, column, _position, _line, _column);
+
+    _preferredColumn = _column;
+
+    if (_position != prev)
+    {
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+    else
+        return false;
+}
+
+bool Document::moveToMatchingBracket()
+{
+    // the bracket at the cursor is matched first, then the one before it
+
+    int index = _brackets.find(_position);
+
+    if (index == _brackets.size() || _brackets.at(index).position != _position)
+    {
+        if (index == 0 || _brackets.at(index - 1).position != _position - 1)
+            return false;
+
+        --index;
+    }
+
+    return moveToBracketAt(_brackets.findMatch(index));
+}
+
+bool Document::moveToNextBracket()
+{
+    int index = _brackets.find(_position + 1);
+    return moveToBracketAt(index < _brackets.size() ? index : -1);
+}
+
+bool Document::moveToPrevBracket()
+{
+    return moveToBracketAt(_brackets.find(_position) - 1);
+}
+
+bool Document::moveToEnclosingBracket()
+{
+    return moveToBracketAt(_brackets.findEnclosing(_position));
+}
+
+bool Document::moveToNextFunction()
+{
+    // functions are found by their bodies, the cursor moves to their names
+
+    int index = _brackets.findSymbol(_brackets.find(_position + 1), SYMBOL_TYPE_FUNCTION, true);
+
+    if (index >= 0)
+    {
+        Bracket bracket = _brackets.at(index);
+
+        if (bracket.position - bracket.nameOffset <= _position)
+            index = _brackets.findSymbol(index + 1, SYMBOL_TYPE_FUNCTION, true);
+    }
+
+    return moveToSymbolAt(index);
+}
+
+bool Document::moveToPrevFunction()
+{
+    int index = _brackets.findSymbol(_brackets.find(_position), SYMBOL_TYPE_FUNCTION, true);
+
+    if (index >= 0)
+    {
+        Bracket bracket = _brackets.at(index);
+
+        if (bracket.position - bracket.nameOffset < _position)
+            return moveToSymbolAt(index);
+    }
+
+    return moveToSymbolAt(_brackets.findSymbol(_brackets.find(_position) - 1, SYMBOL_TYPE_FUNCTION, false));
+}
+
+bool Document::moveToSymbol(const String& name)
+{
+    // symbols match by name or by the last part of their qualified name,
+    // the first one after the cursor is picked, wrapping around at the end
+
+    ASSERT(!name.empty());
+    int first = -1;
+
+    for (int index = _brackets.findSymbol(0, SYMBOL_TYPE_ANY, true); index >= 0;
+         index = _brackets.findSymbol(index + 1, SYMBOL_TYPE_ANY, true))
+    {
+        Bracket bracket = _brackets.at(index);
+        int pos = bracket.position - bracket.nameOffset;
+
+        if (bracket.nameLength < name.length())
+            continue;
+
+        String symbol = _text.substr(pos, bracket.nameLength);
+        int prefixLength = symbol.length() - name.length();
+
+        if (!symbol.endsWith(name) || (prefixLength > 0 && (prefixLength < 2 || symbol.charAt(prefixLength - 1) != ':')))
+            continue;
+
+        if (pos > _position)
+            return moveToSymbolAt(index);
+
+        if (first < 0)
+            first = index;
+    }
+
+    return moveToSymbolAt(first);
+}
+
+void Document::insertNewLine()
+{
+    int p = _position, q = p;
+    unichar_t ch = '\n';
+
+    while (p > 0 && (ch == ' ' || ch == '\t' || ch == '\n'))
+    {
+        p = _text.charBack(p);
+        ch = _text.charAt(p);
+    }
+
+    p = findLineStart(p);
+    _indent.assign('\n');
+
+    ch = _text.charAt(p);
+    while (ch == ' ' || ch == '\t')
+    {
+        _indent += ch;
+        p = _text.charForward(p);
+        ch = _text.charAt(p);
+    }
+
+    ch = _text.charAt(q);
+    while (ch == ' ' || ch == '\t')
+    {
+        q = _text.charForward(q);
+        ch = _text.charAt(q);
+    }
+
+    textChanging(_position, q);
+    _text.replace(_position, _indent, q - _position);
+    textChanged(_position, _position + _indent.length());
+    setPositionLineColumn(_position + _indent.length());
+
+    _selectionMode = false;
+    _selection = -1;
+}
+
+void Document::insertChar(unichar_t ch, bool afterIdent)
+{
+    ASSERT(ch != 0);
+
+    int p = _position;
+
+    if (afterIdent)
+    {
+        while (charIsWord(_text.charAt(p)))
+            p = _text.charForward(p);
+    }
+
+    textChanging(p, p);
+    _text.insert(p, ch);
+    textChanged(p, _text.charForward(p));
+    p = _text.charForward(p);
+    setPositionLineColumn(p);
+
+    _selectionMode = false;
+    _selection = -1;
+}
+
+bool Document::deleteCharForward()
+{
+    if (_position < _text.length())
+    {
+        textChanging(_position, _text.charForward(_position));
+        _text.erase(_position, _text.charForward(_position) - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::deleteCharBack()
+{
+    if (_position > 0)
+    {
+        int p = _text.charBack(_position);
+        int prev = _position;
+
+        setPositionLineColumn(p);
+        textChanging(_position, prev);
+        _text.erase(_position, prev - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::deleteWordForward()
+{
+    int p = findWordForward(_position);
+
+    if (p > _position)
+    {
+        textChanging(_position, p);
+        _text.erase(_position, p - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::deleteWordBack()
+{
+    int p = findWordBack(_position);
+
+    if (p < _position)
+    {
+        int prev = _position;
+
+        setPositionLineColumn(p);
+        textChanging(_position, prev);
+        _text.erase(_position, prev - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::deleteCharsForward()
+{
+    int p = findCharsForward(_position);
+
+    if (p > _position)
+    {
+        textChanging(_position, p);
+        _text.erase(_position, p - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::deleteCharsBack()
+{
+    int p = findCharsBack(_position);
+
+    if (p < _position)
+    {
+        int prev = _position;
+
+        setPositionLineColumn(p);
+        textChanging(_position, prev);
+        _text.erase(_position, prev - _position);
+        textChanged(_position, _position);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+void Document::indentLines()
+{
+    changeLines(&Document::indentLine);
+}
+
+void Document::unindentLines()
+{
+    changeLines(&Document::unindentLine);
+}
+
+void Document::commentLines()
+{
+    changeLines(&Document::commentLine);
+}
+
+void Document::uncommentLines()
+{
+    changeLines(&Document::uncommentLine);
+}
+
+void Document::markSelection()
+{
+    _selectionMode = true;
+    _selection = _position;
+}
+
+String Document::copyDeleteText(bool copy)
+{
+    int start, end;
+    bool lastLine = false;
+
+    if (_selection < 0)
+    {
+        start = findLineStart(_position);
+        end = findLineEnd(_position);
+        if (_text.charAt(end) == '\n')
+            end = _text.charForward(end);
+        else
+            lastLine = true;
+    }
+    else
+    {
+        if (_selection < _position)
+        {
+            start = _selection;
+            end = _position;
+        }
+        else
+        {
+            start = _position;
+            end = _selection;
+        }
+    }
+
+    if (start < end)
+    {
+        String text = _text.substr(start, end - start);
+        if (lastLine)
+            text += '\n';
+
+        if (!copy)
+        {
+            textChanging(start, end);
+
+            if (_selection < 0)
+            {
+                _text.erase(start, end - start);
+                lineColumnToPosition(start, _line, 1, _line, _preferredColumn, _position, _line, _column);
+            }
+            else
+            {
+                setPositionLineColumn(start);
+                _text.erase(start, end - start);
+            }
+
+            textChanged(start, start);
+        }
+
+        _selectionMode = false;
+        _selection = -1;
+        return text;
+    }
+
+    _selectionMode = false;
+    _selection = -1;
+    return String();
+}
+
+void Document::pasteText(const String& text)
+{
+    ASSERT(!text.empty());
+
+    if (text.charAt(text.charBack(text.length())) == '\n')
+    {
+        int start = findLineStart(_position);
+        _selection = start;
+        setPositionLineColumn(start);
+        textChanging(start, start);
+        _text.insert(start, text);
+        textChanged(start, start + text.length());
+        setPositionLineColumn(start + text.length());
+    }
+    else
+    {
+        textChanging(_position, _position);
+        _text.insert(_position, text);
+        textChanged(_position, _position + text.length());
+        _selection = _position;
+        setPositionLineColumn(_position + text.length());
+    }
+    _selectionMode = false;
+}
+
+void Document::appendText(const String& text)
+{
+    bool modified = _modified;
+
+    textChanging(_text.length(), _text.length());
+    _text.append(text);
+    textChanged(_text.length() - text.length(), _text.length());
+
+    _modified = modified;
+}
+
+bool Document::toggleSelectionStart()
+{
+    if (_selection >= 0 && _position != _selection)
+    {
+        int p = _position;
+        setPositionLineColumn(_selection);
+        _selection = p;
+        return true;
+    }
+
+    return false;
+}
+
+String Document::currentWord() const
+{
+    int start = _position;
+
+    if (charIsWord(_text.charAt(start)))
+    {
+        while (start > 0)
+        {
+            int p = _text.charBack(start);
+            if (!charIsWord(_text.charAt(p)))
+                break;
+            start = p;
+        }
+
+        int end = _text.charForward(_position);
+        while (end < _text.length())
+        {
+            if (!charIsWord(_text.charAt(end)))
+                break;
+            end = _text.charForward(end);
+        }
+
+        return _text.substr(start, end - start);
+    }
+
+    return String();
+}
+
+String Document::currentLine() const
+{
+    int start = findLineStart(_position);
+    return _text.substr(start, findLineEnd(_position) - start);
+}
+
+String Document::autocompletePrefix() const
+{
+    int p = _position;
+
+    while (p > 0)
+    {
+        int q = _text.charBack(p);
+        if (!charIsWord(_text.charAt(q)))
+            break;
+        p = q;
+    }
+
+    return _text.substr(p, _position - p);
+}
+
+int Document::wordCount(int word) const
+{
+    ASSERT(word >= 0);
+
+    // the word being completed at the cursor is not counted, otherwise the suggestion shown
+    // would count more than the others just because it was put there
+
+    const StringPool& words = _editor->wordPool();
+    int start = findWordStart(_position), len = findWordEnd(_position) - start;
+
+    bool atCursor = words.length(word) == len &&
+        memcmp(words.chars(word), _text.chars() + start, len * sizeof(char_t)) == 0;
+
+    return _words.counts().count(word) - (atCursor ? 1 : 0);
+}
+
+void Document::findNearWords(const String& prefix, int lines, int maxLength, Array<NearWord>& words) const
+{
+    ASSERT(lines >= 0 && maxLength >= 0);
+
+    // the words with the prefix in the lines around the cursor and how many lines away they are, except for
+    // the word at the cursor, which is the one being completed, very long lines are looked into only as far
+    // as the given length, a line break is a single code unit that is never part of another character
+
+    const StringPool& pool = _editor->wordPool();
+    const char_t* chars = _text.chars();
+    int low = _position > maxLength ? _position - maxLength : 0;
+    int high = _text.length() - _position > maxLength ? _position + maxLength : _text.length();
+    int begin = _position, end = _position, line = 0;
+
+    while (begin > low && (chars[begin - 1] != '\n' || line < lines))
+    {
+        if (chars[--begin] == '\n')
+            ++line;
+    }
+
+    for (int n = 0; end < high && (chars[end] != '\n' || ++n <= lines); )
+        ++end;
+
+    // the limits can be inside characters and are moved to their starts
+
+    if (begin == low && begin < _position)
+        begin = _text.charBack(begin + 1);
+
+    if (end == high && end > _position && end < _text.length())
+        end = _text.charBack(end + 1);
+
+    begin = findWordStart(begin);
+    end = findWordEnd(end);
+    line = -line;
+
+    for (int p = begin; p < end; )
+    {
+        int start = p;
+        p = skipWord(_text, p);
+
+        if (p == start)
+        {
+            if (chars[p] == '\n')
+                ++line;
+
+            p = asciiUnit(chars[p]) != 0x80 ? p + 1 : _text.charForward(p);
+        }
+        else if ((start > _position || p < _position) && p - start >= prefix.length() &&
+                 memcmp(chars + start, prefix.chars(), prefix.length() * sizeof(char_t)) == 0)
+        {
+            int word = pool.find(chars + start, p - start);
+
+            // words left out of the counts, like the ones in comments, are not suggested either
+
+            if (word >= 0 && _words.counts().count(word) > 0)
+                words.addLast({ word, line < 0 ? -line : line });
+        }
+    }
+}
+
+void Document::completeWord(const char_t* suffix, bool moveToEnd)
+{
+    int end = _position;
+    while (end < _text.length())
+    {
+        if (!charIsWord(_text.charAt(end)))
+            break;
+        end = _text.charForward(end);
+    }
+
+    int len = _text.length();
+    textChanging(_position, end);
+    _text.replace(_position, suffix, end - _position);
+
+    textChanged(_position, end + _text.length() - len);
+
+    if (moveToEnd)
+        setPositionLineColumn(end + _text.length() - len);
+
+    _selectionMode = false;
+    _selection = -1;
+}
+
+bool Document::find(const String& searchStr, bool caseSesitive, bool next)
+{
+    ASSERT(!searchStr.empty());
+
+    int p = findPosition(_position, searchStr, caseSesitive, next);
+
+    if (p != INVALID_POSITION && p != _position)
+    {
+        setPositionLineColumn(p);
+
+        if (!_selectionMode)
+            _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::replace(const String& searchStr, const String& replaceStr, bool caseSesitive)
+{
+    ASSERT(!searchStr.empty());
+
+    int p = findPosition(_position, searchStr, caseSesitive, false);
+
+    if (p == _position)
+    {
+        textChanging(p, p + searchStr.length());
+        _text.replace(p, replaceStr, searchStr.length());
+        textChanged(p, p + replaceStr.length());
+        p += replaceStr.length();
+
+        int q = findPosition(p, searchStr, caseSesitive, false);
+        if (q != INVALID_POSITION)
+            p = q;
+
+        setPositionLineColumn(p);
+
+        _selectionMode = false;
+        _selection = -1;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool Document::replaceAll(const String& searchStr, const String& replaceStr, bool caseSesitive)
+{
+    ASSERT(!searchStr.empty());
+
+    _text.replaceString(searchStr, replaceStr, caseSesitive);
+    lineColumnToPosition(0, 1, 1, _line, _column, _position, _line, _column);
+
+    textChanged(0);
+    _selectionMode = false;
+    _selection = -1;
+    _topPosition = -1;
+
+    return true;
+}
+
+void Document::replaceText(String& text)
+{
+    swap(_text, text);
+    lineColumnToPosition(0, 1, 1, _line, _column, _position, _line, _column);
+
+    textChanged(0);
+    _selectionMode = false;
+    _selection = -1;
+    _topPosition = -1;
+}
+
+void Document::open(const String& filename)
+{
+    ASSERT(!filename.empty());
+
+    clear();
+    _filename = filename;
+
+    File file;
+
+    if (file.open(filename))
+    {
+        _text.assign(Unicode::bytesToString(file.read(), _encoding, _bom, _crLf));
+        _modified = false;
+        determineDocumentType(file.isExecutable());
+
+        _words.recount(_editor->wordPool(), _editor->wordFilter(_documentType), _text, _wordsCheckpoints);
+        _wordsPosition = -1;
+    }
+    else
+        determineDocumentType(false);
+}
+
+void Document::save()
+{
+    ASSERT(!_filename.empty());
+
+    if (_editor->trimWhitespace())
+        trimTrailingWhitespace();
+
+    File file(_filename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+    file.write(Unicode::stringToBytes(_text, _encoding, _bom, _crLf));
+
+    _modified = false;
+    _selectionMode = false;
+    _selection = -1;
+}
+
+void Document::clear()
+{
+    _text.ensureCapacity(1);
+    _text.clear();
+
+    _position = 0;
+    textChanged(0);
+    _highlightedLines.clear();
+    _damagedStart = _damagedEnd = -1;
+    _brackets.disable();
+
+    _filename.clear();
+    _documentType = DOCUMENT_TYPE_TEXT;
+    _encoding = TEXT_ENCODING_UTF8;
+    _bom = false;
+    _crLf = CRLF;
+
+    _line = _column = 1;
+    _preferredColumn = 1;
+
+    _top = _left = 1;
+    _topPosition = 0;
+
+    _selectionMode = false;
+    _selection = -1;
+}
+
+void Document::trimTrailingWhitespace()
+{
+    String trimmed;
+    int p = 0, start = 0, whitespace = 0;
+
+    while (true)
+    {
+        unichar_t ch = _text.charAt(p);
+
+        if (ch == '\n' || ch == 0)
+        {
+            if (whitespace)
+            {
+                trimmed.append(_text.chars() + start, whitespace - start);
+                start = p;
+                whitespace = 0;
+            }
+        }
+        else if (ch == ' ' || ch == '\t')
+        {
+            if (!whitespace)
+                whitespace = p;
+        }
+        else
+            whitespace = 0;
+
+        if (p < _text.length())
+            p = _text.charForward(p);
+        else
+        {
+            trimmed.append(_text.chars() + start, p - start);
+            break;
+        }
+    }
+
+    swap(trimmed, _text);
+
+    lineColumnToPosition(0, 1, 1, _line, _column, _position, _line, _column);
+
+    textChanged(0);
+    _selectionMode = false;
+    _selection = -1;
+    _topPosition = -1;
+}
+
+void Document::setDimensions(int x, int y, int width, int height)
+{
+    ASSERT(x > 0 && y > 0);
+    ASSERT(width > 0 && height > 0);
+
+    _x = x;
+    _y = y;
+    _width = width;
+    _height = height;
+
+    _matchesStart = -1;
+}
+
+void Document::draw(int screenWidth, Buffer<ScreenCell>& screen, bool unicodeLimit16,
+                    const String& searchStr, bool caseSensitive)
+{
+    ASSERT(screenWidth > 0);
+
+    int l;
+
+    if (_line < _top)
+        lineColumnToPosition(_position, _line, _column, _line, 1, _topPosition, _top, l);
+    else if (_line >= _top + _height)
+        lineColumnToPosition(_position, _line, _column, _line - _height + 1, 1, _topPosition, _top, l);
+    else if (_topPosition < 0)
+        lineColumnToPosition(_position, _line, _column, _top, 1, _topPosition, _top, l);
+
+    if (_column < _left)
+        _left = _column;
+    else if (_column >= _left + _width)
+        _left = _column - _width + 1;
+
+    ASSERT(_position >= 0 && _position <= _text.length());
+    ASSERT(_line > 0 && _column > 0);
+    ASSERT(_preferredColumn > 0);
+    ASSERT(_top > 0 && _left > 0);
+    ASSERT(_topPosition >= 0 && _topPosition <= _text.length());
+    ASSERT(_x > 0 && _y > 0);
+    ASSERT(_width > 0 && _height > 0);
+
+    int p = _topPosition;
+    int len = _left + _width - 1;
+
+    if (!searchStr.empty() && (_matchesStart != _topPosition || _matchesSearchStr != searchStr ||
+                               _matchesCaseSensitive != caseSensitive))
+        findVisibleMatches(searchStr, caseSensitive);
+
+    int numMatches = searchStr.empty() ? 0 : _matches.size();
+    int m = 0;
+
+    const ForegroundColor brightBackgroundColors[] = {
+        defaultForeground(), FOREGROUND_COLOR_YELLOW, FOREGROUND_COLOR_RED, defaultForeground(),
+        FOREGROUND_COLOR_BLUE, FOREGROUND_COLOR_CYAN,FOREGROUND_COLOR_BRIGHT_BLACK, FOREGROUND_COLOR_BRIGHT_BLACK,
+        FOREGROUND_COLOR_MAGENTA, FOREGROUND_COLOR_CYAN, FOREGROUND_COLOR_MAGENTA, FOREGROUND_COLOR_BLUE,
+        FOREGROUND_COLOR_CYAN, defaultForeground(), FOREGROUND_COLOR_YELLOW
+    };
+
+    const ForegroundColor darkBackgroundColors[] = {
+        defaultForeground(), FOREGROUND_COLOR_BRIGHT_YELLOW, FOREGROUND_COLOR_BRIGHT_RED, defaultForeground(),
+        FOREGROUND_COLOR_BRIGHT_GREEN, FOREGROUND_COLOR_BRIGHT_CYAN, FOREGROUND_COLOR_WHITE, FOREGROUND_COLOR_WHITE,
+        FOREGROUND_COLOR_BRIGHT_MAGENTA, FOREGROUND_COLOR_BRIGHT_CYAN, FOREGROUND_COLOR_BRIGHT_MAGENTA, FOREGROUND_COLOR_BRIGHT_GREEN,
+        FOREGROUND_COLOR_BRIGHT_CYAN, defaultForeground(), FOREGROUND_COLOR_BRIGHT_YELLOW
+    };
+
+    const ForegroundColor* colors = _editor->brightBackground() ? brightBackgroundColors : darkBackgroundColors;
+
+    // spans come from the background highlighter, lines it has not lexed yet are drawn plain
+
+    bool highlighting = _editor->syntaxHighlighter(_documentType) != nullptr;
+    int numLines = highlighting ? _highlightedLines.size() : 0;
+    int low = 0, high = numLines - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (_highlightedLines[middle].position < _topPosition)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    int n = low;
+    _highlightingNeeded = highlighting && (n == numLines || (_topPosition > 0 && n == 0));
+    bool endOfText = false;
+    int visibleStart = INT_MAX, visibleEnd = 0;
+    const char_t* chars = _text.chars();
+
+    for (int j = 1; j <= _height; ++j)
+    {
+        int q = (_y + j - 2) * screenWidth + _x - 1;
+        int lineStart = p;
+        unichar_t ch = 0;
+        bool eol = false, match = false;
+
+        while (n < numLines && _highlightedLines[n].position < p)
+            ++n;
+
+        const HighlightedLine* highlightedLine = n < numLines && _highlightedLines[n].position == p ?
+            &_highlightedLines[n] : nullptr;
+
+        if (highlighting && !endOfText && (!highlightedLine || highlightedLine->stale))
+            _highlightingNeeded = true;
+
+        int s = 0, spanEnd = p;
+        HighlightingType highlightingType = HIGHLIGHTING_TYPE_NONE;
+
+        for (int i = 1; i <= len || !eol; ++i)
+        {
+            // the rest of a line past the right edge is skipped without decoding it,
+            // and past its end the columns left of the viewport are skipped at once
+
+            if (i > len && !eol)
+            {
+                p = findLineEnd(p);
+                highlightedLine = nullptr;
+            }
+            else if (eol && i < _left)
+                i = _left;
+
+            if (!eol)
+            {
+                // ASCII characters left of the viewport are stepped over without decoding them
+
+                if (i < _left)
+                {
+                    unichar_t unit = asciiUnit(chars[p]);
+
+                    if (unit != 0x80 && unit != '\t' && unit != '\n' && unit != 0)
+                    {
+                        ++p;
+                        continue;
+                    }
+                }
+
+                if (i == _left && p - lineStart < visibleStart)
+                    visibleStart = p - lineStart;
+
+                while (m < numMatches && _matches[m] + searchStr.length() <= p)
+                    ++m;
+
+                match = m < numMatches && _matches[m] <= p;
+
+                if (highlightedLine)
+                {
+                    while (p >= spanEnd && s < highlightedLine->spans.size())
+                        spanEnd += highlightedLine->spans[s++].length;
+
+                    highlightingType = p < spanEnd ? highlightedLine->spans[s - 1].highlightingType :
+                                                     HIGHLIGHTING_TYPE_NONE;
+                }
+
+                ch = _text.charAt(p);
+
+                if (ch == '\t')
+                {
+                    ch = ' ';
+                    if (i == ((i - 1) / _editor->indentSize() + 1) * _editor->indentSize())
+                        p = _text.charForward(p);
+                }
+                else if (!ch || ch == '\n')
+                {
+                    eol = true;
+                    match = false;
+
+                    if (ch == '\n')
+                        p = _text.charForward(p);
+                    else
+                        endOfText = true;
+
+#ifdef PLATFORM_WINDOWS
+                    ch = ' ';
+#else
+                    ch = 0;
+#endif
+                }
+                else
+                    p = _text.charForward(p);
+            }
+
+            if (i >= _left && i <= len)
+            {
+                if (!eol && p - lineStart > visibleEnd)
+                    visibleEnd = p - lineStart;
+
+                screen[q].ch = unicodeLimit16 && ch > 0xffff ? '?' : ch;
+
+                int color = match ? defaultForeground() : colors[highlightingType];
+
+#if defined(PLATFORM_WINDOWS) && !defined(GUI_MODE)
+                screen[q].color = (match ? SEARCH_MATCH_BACKGROUND : defaultBackground()) | color;
+#else
+                screen[q].color = match ? (SEARCH_MATCH_BACKGROUND << 8) | color : color;
+#endif
+
+                ++q;
+            }
+        }
+    }
+
+    // lexing ahead is requested when the viewport reaches the last lexed line,
+    // and lexing of cut lines when their drawn columns leave the window they were lexed in
+
+    if (highlighting && !endOfText && (numLines == 0 || _highlightedLines.last().position < p))
+        _highlightingNeeded = true;
+
+    if (visibleStart < visibleEnd)
+    {
+        _visibleStart = visibleStart;
+        _visibleEnd = visibleEnd;
+
+        if (highlighting && (visibleStart < _windowStart || visibleEnd > _windowEnd))
+            _highlightingNeeded = true;
+    }
+}
+
+void Document::startHighlighting(BackgroundHighlighter& highlighter)
+{
+    const SyntaxHighlighter* syntaxHighlighter = _editor->syntaxHighlighter(_documentType);
+    ASSERT(syntaxHighlighter);
+
+    // spans are published for a page above the top line and two pages below the viewport
+
+    int publishStart = _topPosition;
+
+    for (int i = 0; i < _height && publishStart > 0; ++i)
+        publishStart = findPreviousLine(publishStart);
+
+    int end = _topPosition;
+
+    for (int i = 0; i < 3 * _height && end < _text.length(); ++i)
+    {
+        end = findNextLine(end);
+        if (end == INVALID_POSITION)
+            end = _text.length();
+    }
+
+    // lines longer than the window are lexed only around the columns drawn last
+
+    int windowStart = _visibleStart > HIGHLIGHTING_SLICE_SIZE ? _visibleStart - HIGHLIGHTING_SLICE_SIZE : 0;
+    int windowEnd = _visibleEnd + HIGHLIGHTING_SLICE_SIZE;
+
+    // after an edit only the damaged lines are lexed again, starting in the state of the first of them,
+    // unless the lines were cut in another window
+
+    if (_damagedStart >= 0)
+    {
+        int start = findLineStart(_damagedStart);
+        int i = lowerBoundLine(start);
+
+        if (i < _highlightedLines.size() && _highlightedLines[i].position == start && start < end &&
+            (_windowEnd == INT_MAX || (_windowStart == windowStart && _windowEnd == windowEnd)))
+        {
+            Array<HighlightingCheckpoint> lineStates;
+
+            for (int j = i + 1; j < _highlightedLines.size(); ++j)
+                if (_highlightedLines[j].position >= _damagedEnd)
+                    lineStates.addLast({ _highlightedLines[j].position, _highlightedLines[j].state });
+
+            highlighter.repair(syntaxHighlighter, _text, start, end, windowStart, windowEnd,
+                               _highlightedLines[i].state, _damagedEnd,
+                               static_cast<Array<HighlightingCheckpoint>&&>(lineStates));
+            return;
+        }
+    }
+
+    // checkpoints after an edit that no repair has confirmed are made again
+
+    while (_checkpoints.size() > _verifiedCheckpoints)
+        _checkpoints.removeLast();
+
+    // lexing resumes from the last checkpoint, checkpoint k is at line (k + 1) * interval + 1
+
+    int low = 0, high = _checkpoints.size() - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (_checkpoints[middle].position <= publishStart)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    int start = 0, line = 1;
+    HighlightingState state;
+
+    if (high >= 0)
+    {
+        start = _checkpoints[high].position;
+        line = (high + 1) * HIGHLIGHTING_CHECKPOINT_INTERVAL + 1;
+        state = _checkpoints[high].state;
+    }
+
+    // far from the last checkpoint the text is lexed in chunks, each long enough to add a checkpoint
+
+    if (end - start > HIGHLIGHTING_CHUNK_SIZE)
+    {
+        int chunkEnd = findLineStart(start + HIGHLIGHTING_CHUNK_SIZE);
+        int numLines = 0;
+
+        for (int p = start; p < chunkEnd; ++p)
+            if (_text.chars()[p] == '\n')
+                ++numLines;
+
+        if (numLines >= HIGHLIGHTING_CHECKPOINT_INTERVAL)
+            end = chunkEnd;
+    }
+
+    highlighter.start(syntaxHighlighter, _text, start, end, windowStart, windowEnd, line, state,
+                      _checkpoints.size(), publishStart);
+}
+
+void Document::finishHighlighting(BackgroundHighlighter& highlighter)
+{
+    ASSERT(highlighter.done());
+
+    if (highlighter.syntaxHighlighter() != _editor->syntaxHighlighter(_documentType))
+        return;
+
+    if (highlighter.repairing())
+    {
+        finishRepair(highlighter);
+        return;
+    }
+
+    _damagedStart = _damagedEnd = -1;
+
+    Array<HighlightingCheckpoint>& checkpoints = highlighter.checkpoints();
+
+    if (highlighter.firstCheckpoint() <= _checkpoints.size())
+    {
+        for (int i = _checkpoints.size() - highlighter.firstCheckpoint(); i < checkpoints.size(); ++i)
+            _checkpoints.addLast(static_cast<HighlightingCheckpoint&&>(checkpoints[i]));
+    }
+
+    _verifiedCheckpoints = _checkpoints.size();
+
+    if (!highlighter.lines().empty())
+    {
+        swap(_highlightedLines, highlighter.lines());
+        _highlightedLength = _text.length();
+        _windowStart = highlighter.linesCut() ? highlighter.windowStart() : 0;
+        _windowEnd = highlighter.linesCut() ? highlighter.windowEnd() : INT_MAX;
+    }
+}
+
+void Document::finishRepair(BackgroundHighlighter& highlighter)
+{
+    Array<HighlightedLine>& lines = highlighter.lines();
+    int converged = highlighter.convergedPosition();
+
+    if (lines.empty())
+        return;
+
+    int start = lines.first().position;
+    int first = lowerBoundLine(start);
+    int last = first + 1;
+
+    while (converged >= 0 && last < _highlightedLines.size() && _highlightedLines[last].position < converged)
+        ++last;
+
+    if (converged < 0 || last == _highlightedLines.size())
+        last = _highlightedLines.size();
+
+    // lines from the converged one on have the spans they had before the edit
+
+    Array<HighlightedLine> highlightedLines;
+    highlightedLines.ensureCapacity(first + lines.size() + _highlightedLines.size() - last);
+
+    for (int i = 0; i < first; ++i)
+        highlightedLines.addLast(static_cast<HighlightedLine&&>(_highlightedLines[i]));
+
+    for (int i = 0; i < lines.size(); ++i)
+        highlightedLines.addLast(static_cast<HighlightedLine&&>(lines[i]));
+
+    for (int i = last; i < _highlightedLines.size(); ++i)
+    {
+        _highlightedLines[i].stale = false;
+        highlightedLines.addLast(static_cast<HighlightedLine&&>(_highlightedLines[i]));
+    }
+
+    swap(_highlightedLines, highlightedLines);
+
+    if (highlighter.linesCut())
+    {
+        _windowStart = highlighter.windowStart();
+        _windowEnd = highlighter.windowEnd();
+    }
+
+    // checkpoints past the damage are confirmed if the lines before them were not added or removed
+    // and the repair reached a line in its old state before them, otherwise they are dropped
+
+    int i = 0;
+
+    while (i < _checkpoints.size() && _checkpoints[i].position <= start)
+        ++i;
+
+    if (converged < 0 || last - first != lines.size() ||
+        (i < _checkpoints.size() && _checkpoints[i].position < converged))
+    {
+        while (_checkpoints.size() > i)
+            _checkpoints.removeLast();
+    }
+
+    _verifiedCheckpoints = _checkpoints.size();
+    _damagedStart = _damagedEnd = -1;
+}
+
+int Document::lowerBoundLine(int pos) const
+{
+    // index of the first highlighted line that starts at pos or after it
+
+    int low = 0, high = _highlightedLines.size();
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+
+        if (_highlightedLines[middle].position < pos)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+HighlightingState Document::wordsState(const WordFilter& filter, int& pos)
+{
+    ASSERT(pos >= 0 && pos <= _text.length());
+
+    HighlightingState state;
+
+    if (!filter.syntaxHighlighter)
+        return state;
+
+    // the text is lexed from the nearest state known before the position, where the words of the last edit
+    // started or at a checkpoint, the highlighting checkpoints can't be used as the highlighter
+    // skips characters that don't change what it shows and its state may differ on the way
+
+    int low = 0, high = _wordsCheckpoints.size() - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (_wordsCheckpoints[middle].position <= pos)
+            low = middle + 1;
+        else
+            high = middle - 1;
+    }
+
+    int start = 0;
+
+    if (high >= 0)
+    {
+        start = _wordsCheckpoints[high].position;
+        state = _wordsCheckpoints[high].state;
+    }
+
+    // checkpoints are added on the way where the known ones are farther apart than the interval,
+    // past the last one or in a long text pasted between two of them
+
+    int index = high + 1;
+    int last = index < _wordsCheckpoints.size() ?
+        _wordsCheckpoints[index].position - AUTOCOMPLETE_CHECKPOINT_INTERVAL : INT_MAX;
+
+    if (_wordsPosition > start && _wordsPosition <= pos)
+    {
+        start = _wordsPosition;
+        state = _wordsState;
+    }
+
+    // a token can be scanned ahead, like a number or a word with dashes, so the position is moved back
+    // to the start of the token it is in, the known states are all taken between tokens
+
+    int next = (high >= 0 ? _wordsCheckpoints[high].position : 0) + AUTOCOMPLETE_CHECKPOINT_INTERVAL;
+    int tokenStart = start;
+    HighlightingState tokenState = state;
+
+    for (int p = start; p < pos; p = _text.charForward(p))
+    {
+        if (state.charsRemaining == 0)
+        {
+            if (p >= next && p <= last)
+            {
+                _wordsCheckpoints.insert(index++, { p, state });
+                next = p + AUTOCOMPLETE_CHECKPOINT_INTERVAL;
+            }
+
+            tokenStart = p;
+            tokenState = state;
+        }
+
+        filter.syntaxHighlighter->highlightChar(_text, p, state);
+    }
+
+    if (state.charsRemaining > 0)
+    {
+        pos = tokenStart;
+        state = tokenState;
+    }
+
+    return state;
+}
+
+void Document::textChanging(int pos, int end)
+{
+    ASSERT(pos >= 0 && pos <= end && end <= _text.length());
+
+    // words never span the edges of the changed text widened to whole words, so the words
+    // in it are taken out of the counts before the change and put back after it, the few characters
+    // before the first word are taken too, as lexing them can look at the delimiter or the word after them,
+    // and so is the token the first of them is in
+
+    WordFilter filter = _editor->wordFilter(_documentType);
+    int start = findWordStart(pos);
+
+    for (int i = 0; i < HIGHLIGHTING_LOOKAHEAD && start > 0; ++i)
+        start = _text.charBack(start);
+
+    start = findWordStart(start);
+    HighlightingState state = wordsState(filter, start);
+
+    while (findWordStart(start) < start)
+    {
+        start = findWordStart(start);
+        state = wordsState(filter, start);
+    }
+
+    _wordsPosition = start;
+    _wordsEnd = findWordEnd(end);
+    _wordsState = state;
+    _wordsEndState = state;
+
+    // checkpoints in the changed words are dropped, the ones after them are moved with the text after the change
+
+    for (int i = _wordsCheckpoints.size() - 1; i >= 0 && _wordsCheckpoints[i].position > start; --i)
+        if (_wordsCheckpoints[i].position < _wordsEnd)
+            _wordsCheckpoints.remove(i);
+
+    _words.countWords(_editor->wordPool(), filter, _text, start, _wordsEnd, _wordsEndState, -1);
+}
+
+void Document::textChanged(int pos, int end)
+{
+    _modified = true;
+    ++_version;
+
+    if (_changedStart < 0 || pos < _changedStart)
+        _changedStart = pos;
+
+    // end is where the inserted text ends, the text after it is the text that followed the removed part,
+    // without end the whole text is new and its words are counted again
+
+    ASSERT(end >= 0 || pos == 0);
+
+    WordFilter filter = _editor->wordFilter(_documentType);
+
+    if (end < 0)
+    {
+        end = _text.length();
+        _words.recount(_editor->wordPool(), filter, _text, _wordsCheckpoints);
+        _wordsPosition = -1;
+    }
+    else
+    {
+        // the text before the changed words is the same, and so is the state they start in,
+        // the text after them is the same too, and so are the states at the checkpoints in it
+        // unless the changed words end in another state
+
+        ASSERT(_wordsPosition >= 0 && _wordsPosition <= pos);
+
+        HighlightingState state = _wordsState;
+        int wordsEnd = findWordEnd(end);
+
+        _words.countWords(_editor->wordPool(), filter, _text, _wordsPosition, wordsEnd, state, 1);
+
+        for (int i = _wordsCheckpoints.size() - 1; i >= 0 && _wordsCheckpoints[i].position > _wordsPosition; --i)
+            _wordsCheckpoints[i].position += wordsEnd - _wordsEnd;
+
+        if (!(state == _wordsEndState))
+            _words.recountTail(_editor->wordPool(), filter, _text, wordsEnd, _wordsEndState, state,
+                               _wordsCheckpoints);
+    }
+
+    int delta = _text.length() - _highlightedLength;
+    int removedEnd = end - delta;
+    _highlightedLength = _text.length();
+
+    // highlighting state at a line start depends only on the text before it, so checkpoints
+    // in the removed text and at its end are dropped and the ones after it are moved, these keep
+    // their old state unverified until the repair of the edited lines confirms it
+
+    for (int i = 0; i < _checkpoints.size(); ++i)
+    {
+        if (_checkpoints[i].position > pos)
+        {
+            if (_verifiedCheckpoints > i)
+                _verifiedCheckpoints = i;
+
+            if (_checkpoints[i].position <= removedEnd)
+            {
+                while (_checkpoints.size() > i)
+                    _checkpoints.removeLast();
+                break;
+            }
+
+            _checkpoints[i].position += delta;
+        }
+    }
+
+    // lines from the edited one on keep their spans until they are lexed again or their old state is confirmed,
+    // lines in the removed text are gone
+
+    for (int i = _highlightedLines.size() - 1; i >= 0; --i)
+    {
+        HighlightedLine& highlightedLine = _highlightedLines[i];
+
+        if (highlightedLine.position > pos && highlightedLine.position < removedEnd)
+        {
+            _highlightedLines.remove(i);
+            continue;
+        }
+
+        highlightedLine.stale = true;
+
+        if (highlightedLine.position <= pos)
+            break;
+
+        highlightedLine.position += delta;
+    }
+
+    if (_damagedStart < 0)
+    {
+        _damagedStart = pos;
+        _damagedEnd = end;
+    }
+    else
+    {
+        if (_damagedEnd > pos)
+            _damagedEnd = _damagedEnd < removedEnd ? pos : _damagedEnd + delta;
+
+        _damagedStart = pos < _damagedStart ? pos : _damagedStart;
+        _damagedEnd = end > _damagedEnd ? end : _damagedEnd;
+    }
+
+    _brackets.textChanged(pos, end, delta);
+
+    // edits past the visible text and the length of a match cannot change visible matches
+
+    if (_matchesStart >= 0 && pos < _matchesEnd + _matchesSearchStr.length())
+        _matchesStart = -1;
+}
+
+void Document::indexBrackets()
+{
+    _brackets.enable(_text.length());
+}
+
+void Document::startBracketScan(BracketScanner& scanner, const SyntaxHighlighter* syntaxHighlighter)
+{
+    _brackets.startScan(scanner, syntaxHighlighter, _text);
+}
+
+void Document::finishBracketScan(BracketScanner& scanner)
+{
+    _brackets.finishScan(scanner, _text.length());
+}
 
-    const ForegroundColor darkBackgroundColors[] = {
-        defaultForeground(), FOREGROUND_COLOR_BRIGHT_YELLOW, FOREGROUND_COLOR_BRIGHT_RED, defaultForeground(),
-        FOREGROUND_COLOR_BRIGHT_GREEN, FOREGROUND_COLOR_BRIGHT_CYAN, FOREGROUND_COLOR_WHITE, FOREGROUND_COLOR_WHITE,
-        FOREGROUND_COLOR_BRIGHT_MAGENTA, FOREGROUND_COLOR_BRIGHT_CYAN, FOREGROUND_COLOR_BRIGHT_MAGENTA, FOREGROUND_COLOR_BRIGHT_GREEN,
-        FOREGROUND_COLOR_BRIGHT_CYAN, defaultForeground(), FOREGROUND_COLOR_BRIGHT_YELLOW
-    };
+bool Document::moveToBracketAt(int index)
+{
+    if (index < 0)
+        return false;
 
-    SyntaxHighlighter* syntaxHighlighter = _editor->syntaxHighlighter(_documentType);
-    const ForegroundColor* colors = _editor->brightBackground() ? brightBackgroundColors : darkBackgroundColors;
+    setPositionLineColumn(_brackets.at(index).position);
 
-    if (syntaxHighlighter)
-    {
-        if (highlightFromStart)
-        {
-            p = 0;
-            syntaxHighlighter->highlightingState() = HighlightingState();
+    if (!_selectionMode)
+        _selection = -1;
 
-            while (p < _topPosition)
-            {
-                syntaxHighlighter->highlightChar(_text, p);
-                p = _text.charForward(p);
-            }
+    return true;
+}
 
-            _highlightingState = syntaxHighlighter->highlightingState();
-        }
-        else
-            syntaxHighlighter->highlightingState() = _highlightingState;
-    }
+bool Document::moveToSymbolAt(int index)
+{
+    if (index < 0)
+        return false;
 
-    for (int j = 1; j <= _height; ++j)
-    {
-        int q = (_y + j - 2) * screenWidth + _x - 1;
-        unichar_t ch = 0;
-        bool eol = false;
+    Bracket bracket = _brackets.at(index);
+    setPositionLineColumn(bracket.position - bracket.nameOffset);
 
-        for (int i = 1; i <= len || !eol; ++i)
-        {
-            if (!eol)
-            {
-                ch = _text.charAt(p);
-                if (syntaxHighlighter)
-                    syntaxHighlighter->highlightChar(_text, p);
+    if (!_selectionMode)
+        _selection = -1;
 
-                if (ch == '\t')
-                {
-                    ch = ' ';
-                    if (i == ((i - 1) / _editor->indentSize() + 1) * _editor->indentSize())
-                        p = _text.charForward(p);
-                }
-                else if (!ch || ch == '\n')
-                {
-                    eol = true;
-                    if (ch == '\n')
-                        p = _text.charForward(p);
+    return true;
+}
 
-#ifdef PLATFORM_WINDOWS
-                    ch = ' ';
-#else
-                    ch = 0;
-#endif
-                }
-                else
-                    p = _text.charForward(p);
-            }
+void Document::findVisibleMatches(const String& searchStr, bool caseSensitive)
+{
+    ASSERT(!searchStr.empty());
+    ASSERT(_topPosition >= 0 && _topPosition <= _text.length());
 
-            if (i >= _left && i <= len)
-            {
-                screen[q].ch = unicodeLimit16 && ch > 0xffff ? '?' : ch;
+    int end = _topPosition;
 
-#if defined(PLATFORM_WINDOWS) && !defined(GUI_MODE)
-                if (syntaxHighlighter)
-                    screen[q].color =
-                        defaultBackground() | colors[syntaxHighlighter->highlightingState().highlightingType];
-                else
-                    screen[q].color = defaultBackground() | defaultForeground();
-#else
-                if (syntaxHighlighter)
-                    screen[q].color = colors[syntaxHighlighter->highlightingState().highlightingType];
-                else
-                    screen[q].color = defaultForeground();
-#endif
+    for (int i = 0; i < _height && end < _text.length(); ++i)
+    {
+        end = findLineEnd(end);
+        if (end < _text.length())
+            end = _text.charForward(end);
+    }
 
-                ++q;
-            }
-        }
+    int len = searchStr.length();
+    _matches.clear();
+
+    // overlapping matches are highlighted too, the same ones the match counter counts
+
+    for (int p = _topPosition; p < end && p + len <= _text.length(); ++p)
+    {
+        if ((caseSensitive ? strCompareLen(_text.chars() + p, searchStr.chars(), len) :
+                             strCompareLenNoCase(_text.chars() + p, searchStr.chars(), len)) == 0)
+            _matches.addLast(p);
     }
+
+    _matchesStart = _topPosition;
+    _matchesEnd = end;
+    _matchesSearchStr = searchStr;
+    _matchesCaseSensitive = caseSensitive;
 }
 
 void Document::setPositionLineColumn(int pos)
@@ -1734,13 +5661,12 @@ int Document::findLineStart(int pos) const
 {
     ASSERT(pos >= 0 && pos <= _text.length());
 
-    while (pos > 0)
-    {
-        int p = _text.charBack(pos);
-        if (_text.charAt(p) == '\n')
-            break;
-        pos = p;
-    }
+    // a line break is a single code unit that is never part of another character
+
+    const char_t* chars = _text.chars();
+
+    while (pos > 0 && chars[pos - 1] != '\n')
+        --pos;
 
     return pos;
 }
@@ -1749,14 +5675,7 @@ int Document::findLineEnd(int pos) const
 {
     ASSERT(pos >= 0 && pos <= _text.length());
 
-    while (pos < _text.length())
-    {
-        if (_text.charAt(pos) == '\n')
-            break;
-        pos = _text.charForward(pos);
-    }
-
-    return pos;
+    return findLineBreak(_text.chars(), pos, _text.length());
 }
 
 int Document::findNextLine(int pos) const
@@ -1786,6 +5705,27 @@ int Document::findPreviousLine(int pos) const
         return INVALID_POSITION;
 }
 
+int Document::findWordStart(int pos) const
+{
+    while (pos > 0)
+    {
+        int p = _text.charBack(pos);
+        if (!charIsWord(_text.charAt(p)))
+            break;
+        pos = p;
+    }
+
+    return pos;
+}
+
+int Document::findWordEnd(int pos) const
+{
+    while (pos < _text.length() && charIsWord(_text.charAt(pos)))
+        pos = _text.charForward(pos);
+
+    return pos;
+}
+
 int Document::findWordForward(int pos) const
 {
     int p = _position;
@@ -1927,8 +5867,9 @@ void Document::changeLines(int (Document::*lineOp)(int))
         int start = findLineStart(_position), p = _position;
         setPositionLineColumn(start);
 
+        textChanging(start, findLineEnd(p));
         setPositionLineColumn((this->*lineOp)(p));
-        _modified = true;
+        textChanged(start, findLineEnd(start));
     }
     else
     {
@@ -1959,6 +5900,7 @@ void Document::changeLines(int (Document::*lineOp)(int))
             if (start < p)
             {
                 setPositionLineColumn(start);
+                textChanging(start, findLineEnd(p));
 
                 do
                 {
@@ -1982,7 +5924,7 @@ void Document::changeLines(int (Document::*lineOp)(int))
                 }
 
                 _topPosition = -1;
-                _modified = true;
+                textChanged(start, end);
             }
         }
 
@@ -2100,38 +6042,148 @@ int Document::uncommentLine(int pos)
 
 void Document::determineDocumentType(bool fileExecutable)
 {
-    if (_filename.endsWith(STR(".c")) || _filename.endsWith(STR(".h")) || _filename.endsWith(STR(".cpp")) ||
-            _filename.endsWith(STR(".hpp")) || _filename.endsWith(STR(".cc")))
-        _documentType = DOCUMENT_TYPE_CPP;
-    else if (_filename.endsWith(STR(".sh")) || _filename.endsWith(STR(".ksh")))
-        _documentType = DOCUMENT_TYPE_SHELL;
-    else if (_filename.endsWith(STR(".bat")) || _filename.endsWith(STR(".cmd")))
-        _documentType = DOCUMENT_TYPE_BATCH;
-    else if (_filename.endsWith(STR(".ps1")))
-        _documentType = DOCUMENT_TYPE_POWERSHELL;
-    else if (_filename.endsWith(STR(".xml")) || _filename.endsWith(STR(".xsd")) || _filename.endsWith(STR(".htm")) ||
-             _filename.endsWith(STR(".html")) || _text.startsWith(STR("<?xml")))
+    _checkpoints.clear();
+    _verifiedCheckpoints = 0;
+    _highlightedLines.clear();
+    _damagedStart = _damagedEnd = -1;
+    _brackets.reset(_text.length());
+
+    _documentType = filenameDocumentType(_filename);
+
+    if (_documentType == DOCUMENT_TYPE_TEXT && _text.startsWith(STR("<?xml")))
         _documentType = DOCUMENT_TYPE_XML;
-    else if (_filename.endsWith(STR(".py")))
-        _documentType = DOCUMENT_TYPE_PYTHON;
-    else if (_filename.endsWith(STR(".js")))
-        _documentType = DOCUMENT_TYPE_JAVASCRIPT;
+    else if (_documentType == DOCUMENT_TYPE_TEXT && fileExecutable)
+        _documentType = DOCUMENT_TYPE_SHELL;
+}
+
+DocumentType Document::filenameDocumentType(const String& filename)
+{
+    if (filename.endsWith(STR(".c")) || filename.endsWith(STR(".h")) || filename.endsWith(STR(".cpp")) ||
+            filename.endsWith(STR(".hpp")) || filename.endsWith(STR(".cc")))
+        return DOCUMENT_TYPE_CPP;
+    else if (filename.endsWith(STR(".sh")) || filename.endsWith(STR(".ksh")))
+        return DOCUMENT_TYPE_SHELL;
+    else if (filename.endsWith(STR(".bat")) || filename.endsWith(STR(".cmd")))
+        return DOCUMENT_TYPE_BATCH;
+    else if (filename.endsWith(STR(".ps1")))
+        return DOCUMENT_TYPE_POWERSHELL;
+    else if (filename.endsWith(STR(".xml")) || filename.endsWith(STR(".xsd")) || filename.endsWith(STR(".htm")) ||
+             filename.endsWith(STR(".html")))
+        return DOCUMENT_TYPE_XML;
+    else if (filename.endsWith(STR(".py")))
+        return DOCUMENT_TYPE_PYTHON;
+    else if (filename.endsWith(STR(".js")))
+        return DOCUMENT_TYPE_JAVASCRIPT;
     else
-        _documentType = DOCUMENT_TYPE_TEXT;
+        return DOCUMENT_TYPE_TEXT;
+}
 
-    if (_documentType == DOCUMENT_TYPE_TEXT && fileExecutable)
-        _documentType = DOCUMENT_TYPE_SHELL;
+// SourceWordIndex
+
+SourceWordIndex::~SourceWordIndex()
+{
+    close();
+}
+
+void SourceWordIndex::open(const String& directory, const Array<String>& ignoredDirectories,
+                           const Array<const SyntaxHighlighter*>& syntaxHighlighters, uint32_t skippedTypes)
+{
+    close();
+
+    // highlighters are indexed by document type and shared with the tasks, they keep no lexer state
+
+    _syntaxHighlighters = syntaxHighlighters;
+    ProjectWordIndex::open(directory, ignoredDirectories, skippedTypes);
+}
+
+void SourceWordIndex::countWords(const WordFilter& filter, const String& text, Map<String, int>& counts)
+{
+    ASSERT(filter.syntaxHighlighter);
+
+    // words are taken only from the tokens the filter keeps, the skipped tokens end a word
+
+    HighlightingState state;
+    Array<HighlightSpan> spans;
+    filter.syntaxHighlighter->highlightRange(text, 0, text.length(), state, spans);
+
+    int start = INVALID_POSITION;
+    int p = 0;
+
+    for (int i = 0; i < spans.size(); ++i)
+    {
+        int end = p + spans[i].length;
+
+        if (filter.skipped(spans[i].highlightingType))
+        {
+            if (start != INVALID_POSITION && !filter.skipped(text.chars() + start, p - start))
+                counts[text.substr(start, p - start)] += 1;
+
+            start = INVALID_POSITION;
+            p = end;
+            continue;
+        }
+
+        while (p < end)
+        {
+            int q = skipWord(text, p);
+
+            if (q > p)
+            {
+                if (start == INVALID_POSITION)
+                    start = p;
+
+                p = q < end ? q : end;
+            }
+            else
+            {
+                if (start != INVALID_POSITION && !filter.skipped(text.chars() + start, p - start))
+                    counts[text.substr(start, p - start)] += 1;
+
+                start = INVALID_POSITION;
+                p = text.charForward(p);
+            }
+        }
+    }
+
+    if (start != INVALID_POSITION && !filter.skipped(text.chars() + start, p - start))
+        counts[text.substr(start, p - start)] += 1;
+}
+
+bool SourceWordIndex::indexed(const String& name) const
+{
+    // only the files that have a highlighter to tokenize them are indexed
+
+    DocumentType documentType = Document::filenameDocumentType(name);
+    return documentType < _syntaxHighlighters.size() && _syntaxHighlighters[documentType];
+}
+
+void SourceWordIndex::countWords(const String& name, const String& text, Map<String, int>& counts) const
+{
+    WordFilter filter;
+    filter.syntaxHighlighter = _syntaxHighlighters[Document::filenameDocumentType(name)];
+    filter.skippedTypes = _skippedTypes;
+
+    countWords(filter, text, counts);
 }
 
 // Editor
 
 Editor::Editor(const Array<String>& args) :
-    Application(args, STR("ev")), _commandLine(Document(this), nullptr, nullptr), _document(nullptr), _lastDocument(nullptr),
+    Application(args, STR("ev")), _document(nullptr), _lastDocument(nullptr),
     _recordingMacro(false), _width(120), _height(60), _cursorLine(0), _cursorColumn(0),
     _charWidth(1), _charHeight(1), _offsetX(0), _offsetY(0),
     _caseSesitive(true), _recentLocation(nullptr),
-    _currentSuggestion(INVALID_POSITION)
+    _moreSuggestions(false), _unsortedStart(0), _unsortedEnd(0),
+    _currentSuggestion(INVALID_POSITION), _grammarsLoaded(false), _findingInFiles(false),
+    _pathCommand(0), _currentPath(INVALID_POSITION), _pathsVersion(-1), _pathLines(0),
+    _countedDocument(nullptr), _countedVersion(0), _matchCountShown(false),
+    _highlightedDocument(nullptr), _highlightedVersion(0), _scannedDocument(nullptr), _scannedVersion(0),
+    _commandLine(Document(this), nullptr, nullptr)
 {
+    _ignoredDirectories.addLast(STR("bin"));
+    _ignoredDirectories.addLast(STR("obj"));
+    _ignoredDirectories.addLast(STR("node_modules"));
+
 #ifdef PLATFORM_WINDOWS
     _unicodeLimit16 = true;
 #else
@@ -2140,22 +6192,71 @@ Editor::Editor(const Array<String>& args) :
 #endif
 }
 
-SyntaxHighlighter* Editor::syntaxHighlighter(DocumentType documentType)
+const SyntaxHighlighter* Editor::syntaxHighlighter(DocumentType documentType)
 {
+    // highlighters are stateless, so one per document type is shared by all documents and jobs
+
     for (auto node = _syntaxHighlighters.first(); node; node = node->next)
         if (node->value->documentType() == documentType)
             return node->value.ptr();
 
+    Unique<SyntaxHighlighter> syntaxHighlighter = createSyntaxHighlighter(documentType);
+
+    if (syntaxHighlighter.empty())
+        return nullptr;
+
+    _syntaxHighlighters.addLast(static_cast<Unique<SyntaxHighlighter>&&>(syntaxHighlighter));
+    return _syntaxHighlighters.last()->value.ptr();
+}
+
+WordFilter Editor::wordFilter(DocumentType documentType)
+{
+    // with nothing to skip the text isn't lexed at all
+
+    WordFilter filter;
+
+    if (_autocompleteSkippedTypes != 0)
+        filter.syntaxHighlighter = syntaxHighlighter(documentType);
+
+    filter.skippedTypes = _autocompleteSkippedTypes;
+
+    return filter;
+}
+
+Unique<SyntaxHighlighter> Editor::createSyntaxHighlighter(DocumentType documentType)
+{
     if (documentType == DOCUMENT_TYPE_CPP)
-        _syntaxHighlighters.addLast(createUnique<CppSyntaxHighlighter>());
+        return createUnique<CppSyntaxHighlighter>();
     else if (documentType == DOCUMENT_TYPE_SHELL)
-        _syntaxHighlighters.addLast(createUnique<ShellSyntaxHighlighter>());
+        return createUnique<ShellSyntaxHighlighter>();
     else if (documentType == DOCUMENT_TYPE_XML)
-        _syntaxHighlighters.addLast(createUnique<XmlSyntaxHighlighter>());
-    else
-        return nullptr;
+        return createUnique<XmlSyntaxHighlighter>();
 
-    return _syntaxHighlighters.last()->value.ptr();
+    if (!_grammarsLoaded)
+        loadGrammars();
+
+    for (int i = 0; i < _grammars.size(); ++i)
+        if (_grammars[i].documentType == documentType)
+            return createUnique<GrammarSyntaxHighlighter>(_grammars[i]);
+
+    return Unique<SyntaxHighlighter>();
+}
+
+ThreadPool& Editor::threadPool()
+{
+    if (_threadPool.empty())
+        _threadPool.create();
+
+    return *_threadPool;
+}
+
+ListNode<Document>* Editor::findDocument(const String& filename)
+{
+    for (auto doc = _documents.first(); doc; doc = doc->next)
+        if (doc->value.filename() == filename)
+            return doc;
+
+    return nullptr;
 }
 
 void Editor::newDocument(const String& filename)
@@ -2183,7 +6284,7 @@ void Editor::openDocument(const String& filename)
         _documents.addLast(doc);
         _document = _documents.last();
 
-        findUniqueWords();
+        updateUniqueWords();
     }
     catch (Exception& ex)
     {
@@ -2198,14 +6299,19 @@ void Editor::saveDocument()
         try
         {
             if (_document->value.modified())
+            {
                 _document->value.save();
+
+                if (!_trigramIndex.empty())
+                    _trigramIndex->updateFile(_document->value.filename());
+            }
         }
         catch (Exception& ex)
         {
             _message = ex.message();
         }
 
-        findUniqueWords();
+        updateUniqueWords();
     }
 }
 
@@ -2216,7 +6322,12 @@ void Editor::saveAllDocuments()
         try
         {
             if (doc->value.modified())
+            {
                 doc->value.save();
+
+                if (!_trigramIndex.empty())
+                    _trigramIndex->updateFile(doc->value.filename());
+            }
         }
         catch (Exception& ex)
         {
@@ -2224,7 +6335,7 @@ void Editor::saveAllDocuments()
         }
     }
 
-    findUniqueWords();
+    updateUniqueWords();
 }
 
 void Editor::closeDocument()
@@ -2232,15 +6343,41 @@ void Editor::closeDocument()
     if (_document)
     {
         auto doc = _document->next;
+
+        if (_countedDocument == _document)
+            _countedDocument = nullptr;
+
+        if (_highlightedDocument == _document)
+        {
+            _backgroundHighlighter->cancel();
+            _highlightedDocument = nullptr;
+        }
+
+        if (_scannedDocument == _document)
+        {
+            _bracketScanner->cancel();
+            _scannedDocument = nullptr;
+        }
+
+        // the words of the document are taken out of the index once its last changes are in
+
+        updateUniqueWords();
+        mergeUniqueWords(_document->value.wordCounts(), -1);
+
         _documents.remove(_document);
         _document = doc;
-
-        findUniqueWords();
     }
 }
 
 bool Editor::start()
 {
+    // settings are read before the documents are opened, as they decide which of their words are counted
+
+    readConfigFile(Environment::getUserDirectory() +
+        Environment::DIRECTORY_SEPARATOR + CONFIG_FILE_NAME);
+
+    readConfigFile(CONFIG_FILE_NAME);
+
     for (int i = 1; i < _args.size(); ++i)
     {
         if (_args[i] == STR("--version"))
@@ -2266,10 +6403,30 @@ bool Editor::start()
 
     _document = _documents.first();
 
-    readConfigFile(Environment::getUserDirectory() +
-        Environment::DIRECTORY_SEPARATOR + CONFIG_FILE_NAME);
+    // the words of the past sessions are searched in the mapped file, so they are there right away
 
-    readConfigFile(CONFIG_FILE_NAME);
+    if (_autocompleteHistorySize > 0)
+        _vocabulary.open(Environment::getUserDirectory() +
+            Environment::DIRECTORY_SEPARATOR + VOCABULARY_FILE_NAME);
+
+    if (_findIndex)
+    {
+        _trigramIndex.create(threadPool());
+        _trigramIndex->open(String(), _ignoredDirectories);
+    }
+
+    if (_autocompleteIndex)
+    {
+        // the index tokenizes files on the thread pool, so the highlighters are created here beforehand
+
+        Array<const SyntaxHighlighter*> syntaxHighlighters;
+
+        for (int i = DOCUMENT_TYPE_TEXT; i <= DOCUMENT_TYPE_JAVASCRIPT; ++i)
+            syntaxHighlighters.addLast(syntaxHighlighter(static_cast<DocumentType>(i)));
+
+        _projectWordIndex.create(threadPool());
+        _projectWordIndex->open(String(), _ignoredDirectories, syntaxHighlighters, _autocompleteSkippedTypes);
+    }
 
     return true;
 }
@@ -2307,6 +6464,21 @@ void Editor::onCreate()
 
 void Editor::onDestroy()
 {
+    if (!_trigramIndex.empty())
+        _trigramIndex->close();
+
+    if (!_projectWordIndex.empty())
+        _projectWordIndex->close();
+
+    if (!_pathIndex.empty())
+        _pathIndex->close();
+
+    if (_autocompleteHistorySize > 0)
+    {
+        updateUniqueWords();
+        _vocabulary.save(_uniqueWords, _autocompleteHistorySize);
+    }
+
 #ifdef GUI_MODE
     _graphics.reset();
 #else
@@ -2530,6 +6702,30 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
                     {
                         modified = update = doc.deleteCharsBack();
                     }
+                    else if (keyEvent.ch == 'j')
+                    {
+                        update = moveToBracket(&Document::moveToMatchingBracket);
+                    }
+                    else if (keyEvent.ch == 'u')
+                    {
+                        update = moveToBracket(&Document::moveToEnclosingBracket);
+                    }
+                    else if (keyEvent.ch == '(')
+                    {
+                        update = moveToBracket(&Document::moveToPrevBracket);
+                    }
+                    else if (keyEvent.ch == ')')
+                    {
+                        update = moveToBracket(&Document::moveToNextBracket);
+                    }
+                    else if (keyEvent.ch == '{')
+                    {
+                        update = moveToBracket(&Document::moveToPrevFunction);
+                    }
+                    else if (keyEvent.ch == '}')
+                    {
+                        update = moveToBracket(&Document::moveToNextFunction);
+                    }
                     else if (keyEvent.ch == ',')
                     {
                         auto doc = _document->prev ? _document->prev : _documents.last();
@@ -2560,9 +6756,14 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
                         doc.uncommentLines();
                         modified = update = true;
                     }
+                    else if (keyEvent.ch == 'l')
+                    {
+                        if (completeCommonPart())
+                            modified = update = true;
+                    }
                     else if (keyEvent.ch == '\'')
                     {
-                        findUniqueWords();
+                        updateUniqueWords();
                         updateScreen(true);
                     }
                     else if (keyEvent.ch >= '0' && keyEvent.ch <= '9')
@@ -2628,6 +6829,10 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
                     showCommandLine();
                     update = true;
                 }
+                else if (keyEvent.key == KEY_F4)
+                {
+                    update = goToLocation();
+                }
                 else if (keyEvent.key == KEY_F5)
                 {
                     executeProjectCommand(_buildCommand);
@@ -2740,22 +6945,27 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
                 }
                 else if (keyEvent.key == KEY_TAB)
                 {
-                    if (keyEvent.shift)
-                    {
-                        if (completeWord(-1))
-                            autocomplete = true;
-                        else
-                            doc.unindentLines();
-                    }
+                    if (_document == &_commandLine && completeCommand(keyEvent.shift ? -1 : 1))
+                        update = true;
                     else
                     {
-                        if (completeWord(1))
-                            autocomplete = true;
+                        if (keyEvent.shift)
+                        {
+                            if (completeWord(-1))
+                                autocomplete = true;
+                            else
+                                doc.unindentLines();
+                        }
                         else
-                            doc.indentLines();
-                    }
+                        {
+                            if (completeWord(1))
+                                autocomplete = true;
+                            else
+                                doc.indentLines();
+                        }
 
-                    modified = update = true;
+                        modified = update = true;
+                    }
                 }
                 else if (keyEvent.key == KEY_ESC)
                 {
@@ -2785,7 +6995,7 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
                         else
                         {
                             doc.insertChar(keyEvent.ch, true);
-                            _uniqueWords[_suggestions[_currentSuggestion].word] = INT_MAX;
+                            _uniqueWords.accept(_suggestions[_currentSuggestion].word);
                             _currentSuggestion = INVALID_POSITION;
                         }
                     }
@@ -2848,6 +7058,8 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
     {
         if (_currentSuggestion != INVALID_POSITION && !autocomplete)
             _currentSuggestion = INVALID_POSITION;
+
+        updateMatchedPaths();
         updateScreen(redrawAll);
     }
 
@@ -2855,6 +7067,22 @@ void Editor::onInput(const Array<InputEvent>& inputEvents)
         updateRecentLocations();
 }
 
+void Editor::onIdle()
+{
+    if (_findingInFiles)
+        updateFindResults();
+
+    updateMatchCount();
+    updateBrackets();
+    loadProjectWords();
+
+    if (_document == &_commandLine && updateMatchedPaths())
+        updateScreen(false);
+
+    if (_highlightedDocument && _backgroundHighlighter->done())
+        updateScreen(false);
+}
+
 void Editor::measureCharSize()
 {
 #ifdef GUI_MODE
@@ -2914,17 +7142,35 @@ void Editor::drawBlockCursor(bool on)
 
     Rect rect = rectFromLineCol(_cursorColumn - 1, _cursorLine - 1, _cursorColumn, _cursorLine);
 
+    if (on)
+    {
+        _graphics->setAntialias(false);
+        _graphics->fillRectangle(rect, GUI_CURSOR_COLOR);
+        _graphics->setAntialias(true);
+
+        _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, GUI_BACKGROUND);
+    }
+    else
+        drawText(rect, _screen[i].color);
+#endif
+}
+
+#ifdef GUI_MODE
+void Editor::drawText(const Rect& rect, int color)
+{
+    // the high byte of a cell color is an optional background color
+
     _graphics->setAntialias(false);
-    _graphics->fillRectangle(rect, on ? GUI_CURSOR_COLOR : GUI_BACKGROUND);
+    _graphics->fillRectangle(rect, color >> 8 ? rgbColors[color >> 8] : GUI_BACKGROUND);
     _graphics->setAntialias(true);
 
-    _graphics->drawText(_guiFontName, _guiFontSize, _output, rect,
-        on ? GUI_BACKGROUND : rgbColors[_screen[i].color]);
-#endif
+    _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, rgbColors[color & 0xff]);
 }
+#endif
 
 void Editor::updateScreen(bool redrawAll)
 {
+    int64_t frameStart = Timer::ticks();
     int line, col;
 
     _prevScreen = _screen;
@@ -2937,7 +7183,28 @@ void Editor::updateScreen(bool redrawAll)
             updateStatusLine();
 
         Document& doc = _document->value;
-        doc.draw(_width, _screen, _unicodeLimit16);
+        updateHighlighting();
+        drawDocument();
+        startHighlighting();
+
+        // lexing that finishes within the frame budget is drawn right away, so that a keystroke does not show
+        // stale colours for an idle timeout, otherwise lines are drawn plain or stale until the job is finished
+        // when idle, with more input pending the frame is drawn at once and typing never waits
+
+        int timeout = HIGHLIGHTING_FRAME_BUDGET - static_cast<int>((Timer::ticks() - frameStart) / 1000);
+
+        if (_highlightedDocument == _document && timeout > 0 && !inputPending() &&
+                _backgroundHighlighter->wait(timeout))
+        {
+            updateHighlighting();
+            drawDocument();
+            startHighlighting();
+        }
+
+        if (_document == &_commandLine)
+            drawMatchedPaths();
+        else
+            _pathLines = 0;
 
         line = doc.line() - doc.top() + doc.y();
         col = doc.column() - doc.left() + doc.x();
@@ -3010,8 +7277,7 @@ void Editor::updateScreen(bool redrawAll)
                 {
                     if (color >= 0)
                     {
-                        Rect rect = rectFromLineCol(ii, j, i - jw, j + 1);
-                        _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, rgbColors[color]);
+                        drawText(rectFromLineCol(ii, j, i - jw, j + 1), color);
 
                         _output.clear();
                         ii = i - jw;
@@ -3023,8 +7289,7 @@ void Editor::updateScreen(bool redrawAll)
                 _output += _screen[i].ch;
             }
 
-            Rect rect = rectFromLineCol(ii, j, _width, j + 1);
-            _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, rgbColors[color]);
+            drawText(rectFromLineCol(ii, j, _width, j + 1), color);
         }
 #else
 
@@ -3050,7 +7315,11 @@ void Editor::updateScreen(bool redrawAll)
                 if (color != _screen[i].color)
                 {
                     color = _screen[i].color;
-                    _output.appendFormat(STR("\x1b[0;%dm"), color);
+
+                    if (color >> 8)
+                        _output.appendFormat(STR("\x1b[0;%d;%dm"), color & 0xff, color >> 8);
+                    else
+                        _output.appendFormat(STR("\x1b[0;%dm"), color);
                 }
 
                 if (_screen[i].ch)
@@ -3097,8 +7366,7 @@ void Editor::updateScreen(bool redrawAll)
                     {
                         if (color >= 0)
                         {
-                            Rect rect = rectFromLineCol(ii, j, i - jw, j + 1);
-                            _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, rgbColors[color]);
+                            drawText(rectFromLineCol(ii, j, i - jw, j + 1), color);
 
                             _output.clear();
                             ii = i - jw;
@@ -3110,8 +7378,7 @@ void Editor::updateScreen(bool redrawAll)
                     _output += _screen[i].ch;
                 }
 
-                rect = rectFromLineCol(ii, j, end - jw + 1, j + 1);
-                _graphics->drawText(_guiFontName, _guiFontSize, _output, rect, rgbColors[color]);
+                drawText(rectFromLineCol(ii, j, end - jw + 1, j + 1), color);
 #else
 
 #ifdef PLATFORM_WINDOWS
@@ -3132,7 +7399,11 @@ void Editor::updateScreen(bool redrawAll)
                     if (color != _screen[i].color)
                     {
                         color = _screen[i].color;
-                        _output.appendFormat(STR("\x1b[0;%dm"), color);
+
+                        if (color >> 8)
+                            _output.appendFormat(STR("\x1b[0;%d;%dm"), color & 0xff, color >> 8);
+                        else
+                            _output.appendFormat(STR("\x1b[0;%dm"), color);
                     }
 
                     if (_screen[i].ch)
@@ -3220,6 +7491,18 @@ void Editor::updateStatusLine()
 
         int percent = doc.text().length() == 0 ? 100 : doc.position() * 100 / doc.text().length();
 
+        if (_countedDocument == _document && _countedVersion == doc.version() && !_matchCounter.empty() &&
+            _matchCounter->done() && _matchCounter->searchStr() == _searchStr &&
+            _matchCounter->caseSensitive() == _caseSesitive)
+        {
+            int index = _matchCounter->matchIndex(doc.position());
+
+            if (index >= 0)
+                _status.appendFormat(STR("  match %d of %d"), index + 1, _matchCounter->numMatches());
+            else
+                _status.appendFormat(STR("  %d matches"), _matchCounter->numMatches());
+        }
+
         _status += doc.encoding() == TEXT_ENCODING_UTF8 ? STR("  UTF-8") : STR("  UTF-16");
         _status += doc.crlf() ? STR("  CRLF") : STR("  LF");
         _status.appendFormat(STR("  %d, %d  %d%%"), doc.line(), doc.column(), percent);
@@ -3255,6 +7538,9 @@ void Editor::showCommandLine()
         _lastDocument = _document;
         _document = &_commandLine;
         _commandLine.value.clear();
+
+        if (!_pathIndex.empty())
+            _pathIndex->refresh();
     }
 }
 
@@ -3303,6 +7589,7 @@ bool Editor::executeCommand(const String& command)
     if (ch == 'f')
     {
         _caseSesitive = true;
+        bool inFiles = false;
 
         while (true)
         {
@@ -3311,6 +7598,8 @@ bool Editor::executeCommand(const String& command)
 
             if (ch == 'i')
                 _caseSesitive = false;
+            else if (ch == 'f')
+                inFiles = true;
             else if (ch == ' ')
                 break;
             else
@@ -3321,7 +7610,11 @@ bool Editor::executeCommand(const String& command)
         if (p < command.length())
         {
             _searchStr = command.substr(p);
-            _document->value.find(_searchStr, _caseSesitive, false);
+
+            if (inFiles)
+                findInFiles(_searchStr, _caseSesitive);
+            else if (_document)
+                _document->value.find(_searchStr, _caseSesitive, false);
         }
         else
             throw Exception(STR("invalid command"));
@@ -3330,6 +7623,7 @@ bool Editor::executeCommand(const String& command)
     {
         _caseSesitive = true;
         unichar_t replaceScope = 0;
+        bool countOnly = false;
 
         while (true)
         {
@@ -3340,6 +7634,8 @@ bool Editor::executeCommand(const String& command)
                 _caseSesitive = false;
             else if (ch == 'd' || ch == 'a')
                 replaceScope = ch;
+            else if (ch == 'n')
+                countOnly = true;
             else if (ch == 0)
                 throw Exception(STR("invalid command"));
             else
@@ -3361,15 +7657,10 @@ bool Editor::executeCommand(const String& command)
                 _replaceStr = command.substr(q + 1);
             }
 
-            if (replaceScope == 'd')
-            {
+            if (countOnly || replaceScope == 'a')
+                replaceInAllDocuments(countOnly);
+            else if (replaceScope == 'd')
                 _document->value.replaceAll(_searchStr, _replaceStr, _caseSesitive);
-            }
-            else if (replaceScope == 'a')
-            {
-                for (auto doc = _documents.first(); doc; doc = doc->next)
-                    doc->value.replaceAll(_searchStr, _replaceStr, _caseSesitive);
-            }
             else
                 _document->value.find(_searchStr, _caseSesitive, false);
         }
@@ -3392,6 +7683,27 @@ bool Editor::executeCommand(const String& command)
         else
             throw Exception(STR("invalid command"));
     }
+    else if (ch == 'j')
+    {
+        p = command.charForward(p);
+        String name;
+
+        if (command.charAt(p) == ' ')
+            name = command.substr(command.charForward(p));
+        else if (p < command.length())
+            throw Exception(STR("invalid command"));
+
+        if (name.empty())
+            name = _document->value.currentWord();
+
+        if (name.empty())
+            throw Exception(STR("invalid symbol name"));
+
+        waitForBrackets();
+
+        if (!_document->value.moveToSymbol(name))
+            throw Exception(STR("symbol not found"));
+    }
     else if (ch == 'n')
     {
         p = command.charForward(p);
@@ -3424,27 +7736,405 @@ bool Editor::executeCommand(const String& command)
         else
             throw Exception(STR("invalid command"));
     }
+    else if (ch == 'p')
+    {
+        p = command.charForward(p);
+        if (command.charAt(p) == ' ')
+        {
+            p = command.charForward(p);
+            String filename = command.substr(p);
+
+            if (filename.empty())
+                throw Exception(STR("invalid filename"));
+
+            // a path picked with Tab is opened as it is, anything else opens the best match
+
+            if (!File::exists(filename))
+            {
+                openPathIndex();
+
+                if (!_pathIndex->ready())
+                    _pathIndex->wait(QUICK_OPEN_TIMEOUT);
+
+                Array<String> paths;
+                _pathIndex->findPaths(filename, 1, paths);
+
+                if (paths.empty())
+                    throw Exception(STR("no matching files"));
+
+                filename = paths[0];
+            }
+
+            openDocument(filename);
+        }
+        else
+            throw Exception(STR("invalid command"));
+    }
     else
         throw Exception(STR("invalid command"));
 
-    return true;
-}
+    return true;
+}
+
+void Editor::executeProjectCommand(const String& command)
+{
+    saveAllDocuments();
+
+#ifndef GUI_MODE
+    Console::setLineMode(true);
+    Console::setColor(defaultForeground(), defaultBackground());
+    Console::clear();
+#endif
+
+    Environment::executeCommand(command);
+
+#ifndef GUI_MODE
+    Console::setLineMode(false);
+#endif
+}
+
+void Editor::showFindResults()
+{
+    if (_findingInFiles)
+    {
+        _fileSearch->cancel();
+        _findingInFiles = false;
+    }
+
+    auto results = findDocument(FIND_RESULTS_NAME);
+
+    if (results)
+    {
+        _document = results;
+        _document->value.clear();
+        _document->value.filename(FIND_RESULTS_NAME);
+    }
+    else
+        newDocument(FIND_RESULTS_NAME);
+
+    _document->value.modified(false);
+}
+
+void Editor::findInFiles(const String& searchStr, bool caseSensitive)
+{
+    ASSERT(!searchStr.empty());
+
+    showFindResults();
+
+    if (_fileSearch.empty())
+        _fileSearch.create(threadPool());
+
+    // the index narrows the search to files containing all trigrams of the search string
+
+    Array<String> candidates;
+
+    if (!_trigramIndex.empty() && _trigramIndex->findCandidates(searchStr, candidates))
+        _fileSearch->start(candidates, searchStr, caseSensitive);
+    else
+        _fileSearch->start(String(), searchStr, caseSensitive, _ignoredDirectories);
+    _findingInFiles = true;
+}
+
+void Editor::updateFindResults()
+{
+    // check if search is still running before taking matches so that the last ones are not missed
+
+    bool running = _fileSearch->running();
+    auto results = findDocument(FIND_RESULTS_NAME);
+
+    if (!results)
+    {
+        _fileSearch->cancel();
+        _findingInFiles = false;
+        return;
+    }
+
+    Array<SearchMatch> matches;
+    bool update = _fileSearch->takeMatches(matches);
+
+    if (update)
+    {
+        String text;
+
+        for (int i = 0; i < matches.size(); ++i)
+        {
+            text += matches[i].filename;
+            text.appendFormat(STR(":%d:%d: "), matches[i].line, matches[i].column);
+            text += matches[i].text;
+            text += '\n';
+        }
+
+        results->value.appendText(text);
+    }
+
+    if (!running)
+    {
+        _findingInFiles = false;
+        _message = String::format(STR("%d matches in %d files"), _fileSearch->numMatches(), _fileSearch->numFiles());
+        update = true;
+    }
+
+    if (update)
+        updateScreen(false);
+}
+
+void Editor::replaceInAllDocuments(bool countOnly)
+{
+    ASSERT(!_searchStr.empty());
+
+    // texts are read by worker threads while the UI thread waits, so documents cannot change meanwhile
+
+    Array<ListNode<Document>*> documents;
+    Array<const String*> texts;
+
+    for (auto doc = _documents.first(); doc; doc = doc->next)
+    {
+        if (doc->value.filename() != FIND_RESULTS_NAME)
+        {
+            documents.addLast(doc);
+            texts.addLast(&doc->value.text());
+        }
+    }
+
+    TextReplace replace(threadPool());
+    replace.start(texts, _searchStr, _replaceStr, _caseSesitive, countOnly);
+
+    while (!replace.wait(REPLACE_PROGRESS_INTERVAL))
+    {
+        _message = String::format(countOnly ? STR("counting matches: %d of %d documents") :
+                                              STR("replacing matches: %d of %d documents"),
+                                  documents.size() - replace.pending(), documents.size());
+        updateScreen(false);
+    }
+
+    Array<ReplaceResult>& results = replace.results();
+    int numMatches = 0, numDocuments = 0;
+
+    for (int i = 0; i < results.size(); ++i)
+    {
+        if (results[i].numMatches > 0)
+        {
+            numMatches += results[i].numMatches;
+            ++numDocuments;
+        }
+    }
+
+    if (countOnly)
+    {
+        String text;
+
+        for (int i = 0; i < results.size(); ++i)
+        {
+            if (results[i].numMatches > 0)
+            {
+                text += documents[i]->value.filename();
+                text.appendFormat(STR(":%d:%d: %d matches\n"), results[i].line, results[i].column,
+                                  results[i].numMatches);
+            }
+        }
+
+        showFindResults();
+        _document->value.appendText(text);
+
+        _message = String::format(STR("%d matches in %d documents"), numMatches, numDocuments);
+    }
+    else
+    {
+        for (int i = 0; i < results.size(); ++i)
+            if (results[i].numMatches > 0)
+                documents[i]->value.replaceText(results[i].text);
+
+        _message = String::format(STR("%d matches replaced in %d documents"), numMatches, numDocuments);
+    }
+}
+
+void Editor::updateMatchCount()
+{
+    // counting goes on only when input is idle, a chunk of the document at a time, and after an edit
+    // it resumes from the changed text
+
+    if (!_document || _document == &_commandLine || _searchStr.empty())
+        return;
+
+    Document& doc = _document->value;
+
+    if (_matchCounter.empty())
+        _matchCounter.create(threadPool());
+
+    if (_countedDocument != _document ||
+        _matchCounter->searchStr() != _searchStr || _matchCounter->caseSensitive() != _caseSesitive)
+    {
+        _matchCounter->start(_searchStr, _caseSesitive);
+        _countedDocument = _document;
+        _countedVersion = doc.version();
+        _matchCountShown = false;
+        doc.clearChangedStart();
+    }
+    else if (_countedVersion != doc.version())
+    {
+        _matchCounter->textChanged(doc.changedStart() >= 0 ? doc.changedStart() : 0);
+        _countedVersion = doc.version();
+        _matchCountShown = false;
+        doc.clearChangedStart();
+    }
+
+    _matchCounter->count(doc.text());
+
+    if (_matchCounter->done() && !_matchCountShown)
+    {
+        _matchCountShown = true;
+        updateScreen(false);
+    }
+}
+
+void Editor::updateHighlighting()
+{
+    // spans of a finished job are published only if the document has not changed since it started
+
+    if (_highlightedDocument && _backgroundHighlighter->done())
+    {
+        Document& doc = _highlightedDocument->value;
+
+        if (_highlightedVersion == doc.version())
+            doc.finishHighlighting(*_backgroundHighlighter);
+
+        _highlightedDocument = nullptr;
+    }
+}
+
+void Editor::startHighlighting()
+{
+    // lexing runs on the thread pool, so drawing and typing never wait for it
+
+    Document& doc = _document->value;
+
+    if (!doc.highlightingNeeded() || (_highlightedDocument == _document && _highlightedVersion == doc.version()))
+        return;
+
+    if (_backgroundHighlighter.empty())
+        _backgroundHighlighter.create(threadPool());
+
+    doc.startHighlighting(*_backgroundHighlighter);
+    _highlightedDocument = _document;
+    _highlightedVersion = doc.version();
+}
+
+void Editor::drawDocument()
+{
+    Document& doc = _document->value;
+
+    if (_document == &_commandLine)
+        doc.draw(_width, _screen, _unicodeLimit16);
+    else
+        doc.draw(_width, _screen, _unicodeLimit16, _searchStr, _caseSesitive);
+}
+
+void Editor::updateBrackets()
+{
+    // brackets of a finished scan are kept only if the document has not changed since it started,
+    // the next scan starts only when input is idle
+
+    if (_scannedDocument)
+    {
+        if (!_bracketScanner->done())
+            return;
+
+        Document& doc = _scannedDocument->value;
+
+        if (_scannedVersion == doc.version())
+            doc.finishBracketScan(*_bracketScanner);
+
+        _scannedDocument = nullptr;
+    }
+
+    if (!_document || !_document->value.bracketScanNeeded())
+        return;
+
+    Document& doc = _document->value;
+
+    if (_bracketScanner.empty())
+        _bracketScanner.create(threadPool());
+
+    doc.startBracketScan(*_bracketScanner, syntaxHighlighter(doc.documentType()));
+    _scannedDocument = _document;
+    _scannedVersion = doc.version();
+}
+
+void Editor::waitForBrackets()
+{
+    // bracket and symbol motions wait for the index to catch up with the last edit
+
+    _document->value.indexBrackets();
+
+    do
+    {
+        if (_scannedDocument)
+            _bracketScanner->wait();
+
+        updateBrackets();
+    }
+    while (_scannedDocument);
+}
+
+bool Editor::moveToBracket(bool (Document::*move)())
+{
+    waitForBrackets();
+    return (_document->value.*move)();
+}
+
+bool Editor::goToLocation()
+{
+    // location is the current line in filename:line[:column] format produced by find in files and compilers
+
+    String text = _document->value.currentLine();
+    int p = 0;
+
+    while ((p = text.find(':', true, p)) != INVALID_POSITION)
+    {
+        int q = p + 1, line = 0, column = 0;
+
+        while (charIsDigit(text.charAt(q)))
+            line = line * 10 + text.charAt(q++) - '0';
+
+        if (p > 0 && line > 0)
+        {
+            if (text.charAt(q) == ':')
+            {
+                ++q;
+                while (charIsDigit(text.charAt(q)))
+                    column = column * 10 + text.charAt(q++) - '0';
+            }
+
+            String filename = text.substr(0, p);
+            filename.trim();
 
-void Editor::executeProjectCommand(const String& command)
-{
-    saveAllDocuments();
+            auto doc = findDocument(filename);
 
-#ifndef GUI_MODE
-    Console::setLineMode(true);
-    Console::setColor(defaultForeground(), defaultBackground());
-    Console::clear();
-#endif
+            if (doc)
+                _document = doc;
+            else
+            {
+                openDocument(filename);
 
-    Environment::executeCommand(command);
+                if (!findDocument(filename))
+                    return true;
+            }
 
-#ifndef GUI_MODE
-    Console::setLineMode(false);
-#endif
+            Document& document = _document->value;
+            document.moveToLine(line);
+
+            while (--column > 0)
+                if (!document.moveForward())
+                    break;
+
+            return true;
+        }
+
+        ++p;
+    }
+
+    _message = STR("no location on current line");
+    return true;
 }
 
 void Editor::updateRecentLocations()
@@ -3523,60 +8213,197 @@ bool Editor::moveToPrevRecentLocation()
     return false;
 }
 
-void Editor::findUniqueWords()
+void Editor::mergeUniqueWords(const WordCounts& words, int sign)
+{
+    for (int i = 0; i < words.numSlots(); ++i)
+    {
+        const WordSlot& slot = words.slot(i);
+
+        if (slot.word >= 0)
+            _uniqueWords.addCount(_wordPool.chars(slot.word), _wordPool.length(slot.word), sign * slot.count);
+    }
+}
+
+void Editor::updateUniqueWords()
 {
-    Map<String, int> words;
+    // documents keep their word counts up to date as they are edited, only the changes are merged
 
     for (auto doc = _documents.first(); doc; doc = doc->next)
     {
-        const String& text = doc->value.text();
-        String word;
+        mergeUniqueWords(doc->value.wordChanges(), 1);
+        doc->value.clearWordChanges();
+    }
+}
 
-        for (int p = 0; p < text.length(); p = text.charForward(p))
-        {
-            unichar_t ch = text.charAt(p);
+void Editor::loadProjectWords()
+{
+    // the project words replace the index once they are loaded and the open documents are counted on top
 
-            if (charIsWord(ch))
-                word += ch;
-            else if (!word.empty())
-            {
-                ++words[word];
-                word.clear();
-            }
+    SuggestionIndex words;
+
+    if (_projectWordIndex.empty() || !_projectWordIndex->takeWords(words))
+        return;
+
+    _projectWordIndex.reset();
+    _uniqueWords = static_cast<SuggestionIndex&&>(words);
+
+    for (auto doc = _documents.first(); doc; doc = doc->next)
+    {
+        mergeUniqueWords(doc->value.wordCounts(), 1);
+        doc->value.clearWordChanges();
+    }
+}
+
+static int findNearWord(const Array<NearWord>& nearWords, int word)
+{
+    int low = 0, high = nearWords.size();
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (nearWords[mid].word < word)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low < nearWords.size() && nearWords[low].word == word ? low : -1;
+}
+
+void Editor::prepareSuggestions(const String& prefix, int maxSuggestions)
+{
+    ASSERT(!prefix.empty());
+
+    _suggestions.clear();
+
+    // getting to the last suggestions needs all of them, but only the ones cycled through are put in order
+
+    if (maxSuggestions == INT_MAX)
+    {
+        _uniqueWords.findWords(prefix, _suggestions);
+        _moreSuggestions = false;
+    }
+    else
+        _moreSuggestions = _uniqueWords.findSuggestions(prefix, maxSuggestions, _suggestions);
+
+    // the counts of the past sessions add to the ones of this session, and their words
+    // that are not in this session come from the vocabulary file
+
+    for (int i = 0; i < _suggestions.size(); ++i)
+    {
+        int& rank = _suggestions[i].rank;
+
+        if (rank < INT_MAX)
+        {
+            int count = _vocabulary.count(_suggestions[i].word);
+            rank = rank < INT_MAX - 1 - count ? rank + count : INT_MAX - 1;
         }
+    }
+
+    Array<AutocompleteSuggestion> pastWords;
+
+    if (_vocabulary.findSuggestions(prefix, maxSuggestions, pastWords))
+        _moreSuggestions = true;
+
+    for (int i = 0; i < pastWords.size(); ++i)
+    {
+        if (_uniqueWords.count(pastWords[i].word) == 0)
+            _suggestions.addLast(static_cast<AutocompleteSuggestion&&>(pastWords[i]));
+    }
+
+    // words near the cursor go before the others whatever their counts, so the ones not found
+    // are taken from the lines around it, together with how near they are
+
+    Array<NearWord> nearWords;
+    _document->value.findNearWords(prefix, AUTOCOMPLETE_NEAR_LINES, AUTOCOMPLETE_NEAR_LENGTH, nearWords);
+    nearWords.sort();
+
+    int numWords = 0;
+
+    for (int i = 0; i < nearWords.size(); ++i)
+    {
+        if (numWords == 0 || nearWords[i].word != nearWords[numWords - 1].word)
+            nearWords[numWords++] = nearWords[i];
+    }
+
+    while (nearWords.size() > numWords)
+        nearWords.removeLast();
+
+    Array<bool> found(nearWords.size(), false);
+
+    for (int i = 0; i < _suggestions.size(); ++i)
+    {
+        AutocompleteSuggestion& suggestion = _suggestions[i];
+        int word = _wordPool.find(suggestion.word);
+
+        int j = findNearWord(nearWords, word);
+
+        if (j >= 0)
+            found[j] = true;
 
-        if (!word.empty())
-            ++words[word];
+        suggestion.rank = rankSuggestion(word, suggestion.rank, j >= 0 ? nearWords[j].distance : INT_MAX);
     }
 
-    auto it = _uniqueWords.constIterator();
-    while (it.moveNext())
+    for (int i = 0; i < nearWords.size(); ++i)
     {
-        if (it.value().value == INT_MAX)
+        if (!found[i])
         {
-            int* value = words.find(it.value().key);
-            if (value)
-                *value = INT_MAX;
+            int word = nearWords[i].word;
+            int rank = rankSuggestion(word, 0, nearWords[i].distance);
+
+            _suggestions.addLast(AutocompleteSuggestion(_wordPool.str(word), rank));
         }
     }
 
-    swap(words, _uniqueWords);
+    _unsortedStart = 0;
+    _unsortedEnd = _suggestions.size();
 }
 
-void Editor::prepareSuggestions(const String& prefix)
+int Editor::rankSuggestion(int word, int rank, int distance)
 {
-    ASSERT(!prefix.empty());
+    if (rank == INT_MAX)
+        return rank;
 
-    _suggestions.clear();
+    // accepted words stay first, then come the words near the cursor, the nearer ones
+    // and then the ones more frequent in the document first, and then the rest by their counts
+
+    int maxCount = (1 << AUTOCOMPLETE_COUNT_BITS) - 1;
+
+    if (distance <= AUTOCOMPLETE_NEAR_LINES)
+    {
+        int count = _document->value.wordCount(word);
+        int tier = distance <= AUTOCOMPLETE_NEARBY_LINES ? 2 : 1;
+
+        return tier << AUTOCOMPLETE_COUNT_BITS | (count < maxCount ? count : maxCount);
+    }
 
-    auto it = _uniqueWords.constIterator();
-    while (it.moveNext())
+    return rank < maxCount ? rank : maxCount;
+}
+
+void Editor::sortSuggestions(int index)
+{
+    if (index < _unsortedStart || index >= _unsortedEnd)
+        return;
+
+    // the suggestions are sorted a batch at a time from the end that cycling reached
+
+    if (index - _unsortedStart < _unsortedEnd - index)
     {
-        if (it.value().key.startsWith(prefix))
-            _suggestions.addLast(AutocompleteSuggestion(it.value().key, it.value().value));
+        int end = index + AUTOCOMPLETE_BATCH_SIZE < _unsortedEnd ? index + AUTOCOMPLETE_BATCH_SIZE : _unsortedEnd;
+
+        _suggestions.select(_unsortedStart, _unsortedEnd, end);
+        _suggestions.sort(_unsortedStart, end);
+        _unsortedStart = end;
     }
+    else
+    {
+        int start = index - AUTOCOMPLETE_BATCH_SIZE > _unsortedStart ? index - AUTOCOMPLETE_BATCH_SIZE : _unsortedStart;
 
-    _suggestions.sort();
+        _suggestions.select(_unsortedStart, _unsortedEnd, start);
+        _suggestions.sort(start, _unsortedEnd);
+        _unsortedEnd = start;
+    }
 }
 
 bool Editor::completeWord(int next)
@@ -3585,13 +8412,22 @@ bool Editor::completeWord(int next)
 
     if (prefix.length() > 0)
     {
+        // suggestions are found a batch at a time, going back from the first one needs them all
+
         if (_currentSuggestion == INVALID_POSITION)
-            prepareSuggestions(prefix);
+            prepareSuggestions(prefix, next >= 0 ? AUTOCOMPLETE_BATCH_SIZE : INT_MAX);
         else if (!_suggestions[_currentSuggestion].word.startsWith(prefix))
         {
-            prepareSuggestions(prefix);
+            prepareSuggestions(prefix, next >= 0 ? AUTOCOMPLETE_BATCH_SIZE : INT_MAX);
             _currentSuggestion = INVALID_POSITION;
         }
+        else if (_moreSuggestions)
+        {
+            if (next > 0 && _currentSuggestion == _suggestions.size() - 1)
+                prepareSuggestions(prefix, _suggestions.size() * 2);
+            else if (next < 0 && _currentSuggestion == 0)
+                prepareSuggestions(prefix, INT_MAX);
+        }
 
         if (_suggestions.size() > 0)
         {
@@ -3607,6 +8443,8 @@ bool Editor::completeWord(int next)
                     _currentSuggestion = _currentSuggestion > 0 ? _currentSuggestion - 1 : last;
             }
 
+            sortSuggestions(_currentSuggestion);
+
             _document->value.completeWord(_suggestions[_currentSuggestion].word.chars() + prefix.length());
         }
 
@@ -3616,6 +8454,208 @@ bool Editor::completeWord(int next)
     return false;
 }
 
+bool Editor::completeCommonPart()
+{
+    String prefix = _document->value.autocompletePrefix();
+
+    if (prefix.length() > 0)
+    {
+        String completion = _uniqueWords.findCommonCompletion(prefix);
+        String pastCompletion;
+
+        if (_vocabulary.findCommonCompletion(prefix, pastCompletion))
+        {
+            if (_uniqueWords.containsPrefix(prefix))
+            {
+                int len = 0;
+
+                while (len < completion.length() && len < pastCompletion.length() &&
+                       completion.charAt(len) == pastCompletion.charAt(len))
+                    len = completion.charForward(len);
+
+                completion = completion.substr(0, len);
+            }
+            else
+                completion = pastCompletion;
+        }
+
+        _document->value.completeWord(completion.chars(), true);
+        _currentSuggestion = INVALID_POSITION;
+        return true;
+    }
+
+    return false;
+}
+
+void Editor::openPathIndex()
+{
+    // the project tree is scanned on first use, later changes are picked up when the command line is shown
+
+    if (_pathIndex.empty())
+    {
+        _pathIndex.create(threadPool());
+        _pathIndex->open(String(), _ignoredDirectories);
+    }
+}
+
+bool Editor::updateMatchedPaths()
+{
+    unichar_t command = 0;
+    String argument;
+
+    if (_document == &_commandLine)
+    {
+        const String& text = _commandLine.value.text();
+
+        if (text.startsWith(STR("p ")) || text.startsWith(STR("o ")) || text.startsWith(STR("n ")))
+        {
+            command = text.charAt(0);
+            argument = text.substr(2);
+        }
+    }
+
+    // a path put on the command line by Tab keeps the list it was picked from
+
+    bool cycling = command == _pathCommand && _currentPath >= 0 && argument == _matchedPaths[_currentPath];
+
+    if (command == 'p' && !argument.empty())
+    {
+        // paths matching the quick open pattern are looked up as it is typed and again whenever the index
+        // changes, so paths found by a running scan stream in
+
+        openPathIndex();
+        int version = _pathIndex->version();
+
+        if ((cycling || (command == _pathCommand && argument == _pathPattern)) && version == _pathsVersion)
+            return false;
+
+        if (!cycling)
+            _pathPattern = argument;
+
+        _pathIndex->findPaths(_pathPattern, QUICK_OPEN_MAX_PATHS, _matchedPaths);
+        _pathCommand = command;
+        _pathsVersion = version;
+        _currentPath = cycling ? _matchedPaths.find(argument) : INVALID_POSITION;
+        return true;
+    }
+
+    // file name completions are listed by Tab and kept only while they are cycled through
+
+    if (_pathCommand == 0 || (command != 'p' && command == _pathCommand && (cycling || argument == _pathPattern)))
+        return false;
+
+    _matchedPaths.clear();
+    _pathPattern.clear();
+    _pathCommand = 0;
+    _currentPath = INVALID_POSITION;
+    return true;
+}
+
+void Editor::drawMatchedPaths()
+{
+    // the best match is listed right above the command line, the list scrolls to the current one
+
+    int numLines = _matchedPaths.size();
+
+    if (numLines > QUICK_OPEN_LINES)
+        numLines = QUICK_OPEN_LINES;
+
+    if (numLines > _height - 1)
+        numLines = _height - 1;
+
+    // rows of a longer list drawn before are restored from the document underneath
+
+    if (_pathLines > numLines)
+    {
+        if (_lastDocument)
+            _lastDocument->value.draw(_width, _screen, _unicodeLimit16, _searchStr, _caseSesitive);
+        else
+        {
+            for (int p = (_height - 1 - _pathLines) * _width; p < (_height - 1) * _width; ++p)
+                _screen[p] = ScreenCell();
+        }
+    }
+
+    int first = _currentPath >= numLines ? _currentPath - numLines + 1 : 0;
+
+    for (int i = 0; i < numLines; ++i)
+    {
+        const String& path = _matchedPaths[first + i];
+        int p = (_height - 2 - i) * _width, end = p + _width;
+
+#if defined(PLATFORM_WINDOWS) && !defined(GUI_MODE)
+        int color = (first + i == _currentPath ? SEARCH_MATCH_BACKGROUND : defaultBackground()) | defaultForeground();
+#else
+        int color = first + i == _currentPath ? (SEARCH_MATCH_BACKGROUND << 8) | defaultForeground() : defaultForeground();
+#endif
+
+        for (int j = 0; j < path.length() && p < end; j = path.charForward(j))
+        {
+            unichar_t ch = path.charAt(j);
+            _screen[p].ch = _unicodeLimit16 && ch > 0xffff ? '?' : ch;
+            _screen[p++].color = color;
+        }
+
+        while (p < end)
+        {
+            _screen[p].ch = ' ';
+            _screen[p++].color = color;
+        }
+    }
+
+    _pathLines = numLines;
+}
+
+bool Editor::completeCommand(int next)
+{
+    ASSERT(_document == &_commandLine);
+
+    String command = _commandLine.value.text().substr(0, 2);
+
+    if (command == STR("p "))
+        updateMatchedPaths();
+    else if (command == STR("o ") || command == STR("n "))
+    {
+        String argument = _commandLine.value.text().substr(2);
+        bool cycling = command.charAt(0) == _pathCommand && _currentPath >= 0 &&
+            argument == _matchedPaths[_currentPath];
+
+        // the next Tab enters a directory that is the only completion, directories listed before
+        // are not read again while they are unchanged
+
+        if (cycling && _matchedPaths.size() == 1 && argument.endsWith(String(Environment::DIRECTORY_SEPARATOR)))
+            cycling = false;
+
+        if (!cycling)
+        {
+            _directoryCache.findCompletions(argument, FILENAME_COMPLETION_MAX_PATHS, _matchedPaths);
+            _pathPattern = argument;
+            _pathCommand = command.charAt(0);
+            _currentPath = INVALID_POSITION;
+        }
+    }
+    else
+        return false;
+
+    if (_matchedPaths.size() > 0)
+    {
+        int last = _matchedPaths.size() - 1;
+
+        if (_currentPath == INVALID_POSITION)
+            _currentPath = next >= 0 ? 0 : last;
+        else if (next > 0)
+            _currentPath = _currentPath < last ? _currentPath + 1 : 0;
+        else if (next < 0)
+            _currentPath = _currentPath > 0 ? _currentPath - 1 : last;
+
+        _commandLine.value.clear();
+        _commandLine.value.appendText(command + _matchedPaths[_currentPath]);
+        _commandLine.value.moveToLineEnd();
+    }
+
+    return true;
+}
+
 void Editor::copyToClipboard(const String& text)
 {
 #ifdef PLATFORM_WINDOWS
@@ -3675,6 +8715,26 @@ void Editor::pasteFromClipboard(String& text)
 #endif
 }
 
+static void splitList(const String& value, Array<String>& items)
+{
+    int start = 0;
+
+    while (start < value.length())
+    {
+        int end = value.find(',', true, start);
+        if (end == INVALID_POSITION)
+            end = value.length();
+
+        String item = value.substr(start, end - start);
+        item.trim();
+
+        if (!item.empty())
+            items.addLast(item);
+
+        start = end + 1;
+    }
+}
+
 void Editor::readConfigFile(const String& filename)
 {
     File file;
@@ -3710,6 +8770,12 @@ void Editor::readConfigFile(const String& filename)
                     _brightBackground = value.compare(STR("true"), false) == 0;
                 else if (name == STR("trim_shitespace"))
                     _trimWhitespace = value.compare(STR("true"), false) == 0;
+                else if (name == STR("find_index"))
+                    _findIndex = value.compare(STR("true"), false) == 0;
+                else if (name == STR("autocomplete_index"))
+                    _autocompleteIndex = value.compare(STR("true"), false) == 0;
+                else if (name == STR("autocomplete_history_size"))
+                    _autocompleteHistorySize = value.toInt();
                 else if (name == STR("indent_size"))
                     _indentSize = value.toInt();
                 else if (name == STR("gui_columns"))
@@ -3726,19 +8792,80 @@ void Editor::readConfigFile(const String& filename)
                     _runCommand = value;
                 else if (name == STR("clean_command"))
                     _cleanCommand = value;
+                else if (name == STR("find_ignored_directories"))
+                {
+                    _ignoredDirectories.clear();
+                    splitList(value, _ignoredDirectories);
+                }
+                else if (name == STR("autocomplete_skip"))
+                {
+                    Array<String> items;
+                    splitList(value, items);
+
+                    _autocompleteSkippedTypes = 0;
+
+                    for (int i = 0; i < items.size(); ++i)
+                    {
+                        if (items[i] == STR("comments"))
+                            _autocompleteSkippedTypes |= 1u << HIGHLIGHTING_TYPE_SINGLELINE_COMMENT |
+                                1u << HIGHLIGHTING_TYPE_MULTILINE_COMMENT;
+                        else if (items[i] == STR("strings"))
+                            _autocompleteSkippedTypes |= 1u << HIGHLIGHTING_TYPE_STRING |
+                                1u << HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+                        else if (items[i] == STR("numbers"))
+                            _autocompleteSkippedTypes |= 1u << HIGHLIGHTING_TYPE_NUMBER;
+                        else if (items[i] == STR("preprocessor"))
+                            _autocompleteSkippedTypes |= 1u << HIGHLIGHTING_TYPE_PREPROCESSOR;
+                    }
+                }
             }
         }
     }
 }
 
-void run(const Array<String>& args)
+void Editor::loadGrammars()
 {
-#if defined(PLATFORM_LINUX) && defined(GUI_MODE)
-    Application app(args);
-#else
-    Editor app(args);
-#endif
+    // grammars from the user directory extend or replace the built-in ones,
+    // compiled tables are cached until the sources change
+
+    _grammarsLoaded = true;
+
+    String directory = Environment::getUserDirectory() + Environment::DIRECTORY_SEPARATOR;
+    String source = BUILTIN_GRAMMARS;
+    File file;
+
+    if (file.open(directory + GRAMMAR_FILE_NAME))
+    {
+        TextEncoding encoding;
+        bool bom, crLf;
+
+        source += STR("\n");
+        source += Unicode::bytesToString(file.read(), encoding, bom, crLf);
+    }
+
+    uint32_t sourceHash = keywordHash(source.chars(), source.length(), GRAMMAR_CACHE_VERSION);
 
-    if (app.start())
-        app.run();
+    if (readGrammarCache(directory + GRAMMAR_CACHE_NAME, sourceHash, _grammars))
+        return;
+
+    try
+    {
+        compileGrammars(source, _grammars);
+    }
+    catch (Exception& ex)
+    {
+        _message = ex.message();
+
+        source = BUILTIN_GRAMMARS;
+        sourceHash = keywordHash(source.chars(), source.length(), GRAMMAR_CACHE_VERSION);
+        compileGrammars(source, _grammars);
+    }
+
+    try
+    {
+        writeGrammarCache(directory + GRAMMAR_CACHE_NAME, sourceHash, _grammars);
+    }
+    catch (Exception&)
+    {
+    }
 }
@@ -4,6 +4,8 @@
 #include <foundation.h>
 #include <application.h>
 #include <file.h>
+#include <thread.h>
+#include <search.h>
 
 #ifdef GUI_MODE
 #include <graphics.h>
@@ -68,11 +70,56 @@ struct HighlightingState
     int charsRemaining = 0;
     bool reset = false;
     unichar_t startCh = 0, prevCh = 0;
-    String word;
+
+    friend bool operator==(const HighlightingState& left, const HighlightingState& right)
+    {
+        return left.highlightingType == right.highlightingType && left.charsRemaining == right.charsRemaining &&
+               left.reset == right.reset && left.startCh == right.startCh && left.prevCh == right.prevCh;
+    }
+};
+
+// HighlightingCheckpoint
+
+struct HighlightingCheckpoint
+{
+    int position;
+    HighlightingState state;
+};
+
+// HighlightingCut
+
+// a line too long to be lexed whole is lexed only around the visible columns
+
+struct HighlightingCut
+{
+    int offset;
+    int head;
+    int tail;
+};
+
+// HighlightSpan
+
+struct HighlightSpan
+{
+    int length;
+    HighlightingType highlightingType;
+};
+
+// HighlightedLine
+
+struct HighlightedLine
+{
+    int position;
+    bool stale;
+    HighlightingState state;
+    Array<HighlightSpan> spans;
 };
 
 // SyntaxHighlighter
 
+// highlighters keep only the immutable language tables and get the lexer state passed in,
+// so that one highlighter can lex any number of documents at the same time
+
 class SyntaxHighlighter
 {
 public:
@@ -89,21 +136,21 @@ public:
         return _documentType;
     }
 
-    const HighlightingState& highlightingState() const
-    {
-        return _highlightingState;
-    }
+    virtual void highlightChar(const String& text, int pos, HighlightingState& state) const = 0;
+    virtual void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                                Array<HighlightSpan>& spans) const;
 
-    HighlightingState& highlightingState()
+protected:
+    static void appendSpan(Array<HighlightSpan>& spans, int length, HighlightingType highlightingType)
     {
-        return _highlightingState;
+        if (!spans.empty() && spans.last().highlightingType == highlightingType)
+            spans.last().length += length;
+        else
+            spans.addLast({ length, highlightingType });
     }
 
-    virtual void highlightChar(const String& text, int pos) = 0;
-
 protected:
     DocumentType _documentType;
-    HighlightingState _highlightingState;
 };
 
 // CppSyntaxHighlighter
@@ -111,13 +158,13 @@ protected:
 class CppSyntaxHighlighter : public SyntaxHighlighter
 {
 public:
-    CppSyntaxHighlighter();
-    void highlightChar(const String& text, int pos) override;
+    CppSyntaxHighlighter() : SyntaxHighlighter(DOCUMENT_TYPE_CPP)
+    {
+    }
 
-protected:
-    Set<String> _keywords;
-    Set<String> _types;
-    Set<String> _preprocessor;
+    void highlightChar(const String& text, int pos, HighlightingState& state) const override;
+    void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                        Array<HighlightSpan>& spans) const override;
 };
 
 // ShellSyntaxHighlighter
@@ -125,11 +172,13 @@ protected:
 class ShellSyntaxHighlighter : public SyntaxHighlighter
 {
 public:
-    ShellSyntaxHighlighter();
-    void highlightChar(const String& text, int pos) override;
+    ShellSyntaxHighlighter() : SyntaxHighlighter(DOCUMENT_TYPE_SHELL)
+    {
+    }
 
-protected:
-    Set<String> _keywords;
+    void highlightChar(const String& text, int pos, HighlightingState& state) const override;
+    void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                        Array<HighlightSpan>& spans) const override;
 };
 
 // XmlSyntaxHighlighter
@@ -141,7 +190,458 @@ public:
     {
     }
 
-    void highlightChar(const String& text, int pos) override;
+    void highlightChar(const String& text, int pos, HighlightingState& state) const override;
+    void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                        Array<HighlightSpan>& spans) const override;
+};
+
+// Grammar
+
+const int GRAMMAR_MAX_REGIONS = 16;
+const int GRAMMAR_MAX_DELIMITER_LENGTH = 4;
+const int GRAMMAR_MAX_KEYWORDS = 512;
+const int GRAMMAR_MAX_KEYWORD_CHARS = 4096;
+const int GRAMMAR_MAX_SLOTS = 4096;
+
+struct GrammarRegion
+{
+    uint8_t highlightingType;
+    uint8_t escape;
+    uint8_t multiline;
+    uint8_t startLength, endLength;
+    char start[GRAMMAR_MAX_DELIMITER_LENGTH], end[GRAMMAR_MAX_DELIMITER_LENGTH];
+};
+
+struct GrammarKeyword
+{
+    uint16_t offset;
+    uint8_t length;
+    uint8_t highlightingType;
+};
+
+// compiled grammar, plain data so that it can be cached on disk as is
+
+struct Grammar
+{
+    int32_t documentType;
+    uint8_t ignoreCase;
+    uint8_t variablePrefix, variableSuffix;
+    uint8_t commentRegion;
+    uint8_t actions[128];
+    uint8_t firstRegion[128];
+    uint8_t stops[GRAMMAR_MAX_REGIONS][128];
+    int32_t numRegions;
+    GrammarRegion regions[GRAMMAR_MAX_REGIONS];
+    uint32_t seed;
+    int32_t numSlots;
+    int32_t numKeywords;
+    int32_t maxKeywordLength;
+    int16_t slots[GRAMMAR_MAX_SLOTS];
+    GrammarKeyword keywords[GRAMMAR_MAX_KEYWORDS];
+    char keywordChars[GRAMMAR_MAX_KEYWORD_CHARS];
+};
+
+// GrammarSyntaxHighlighter
+
+class GrammarSyntaxHighlighter : public SyntaxHighlighter
+{
+public:
+    GrammarSyntaxHighlighter(const Grammar& grammar) :
+        SyntaxHighlighter(static_cast<DocumentType>(grammar.documentType)), _grammar(grammar)
+    {
+    }
+
+    void highlightChar(const String& text, int pos, HighlightingState& state) const override;
+    void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                        Array<HighlightSpan>& spans) const override;
+
+protected:
+    int scanWord(const String& text, int pos) const;
+    HighlightingType findKeyword(const char_t* chars, int len) const;
+    int appendToken(HighlightingState& state, Array<HighlightSpan>& spans, int pos, int tokenEnd, int end,
+                    HighlightingType highlightingType, bool reset) const;
+
+protected:
+    const Grammar& _grammar;
+};
+
+// BackgroundHighlighter
+
+class BackgroundHighlighter
+{
+public:
+    BackgroundHighlighter(ThreadPool& threadPool);
+
+    BackgroundHighlighter(const BackgroundHighlighter&) = delete;
+    BackgroundHighlighter& operator=(const BackgroundHighlighter&) = delete;
+
+    ~BackgroundHighlighter();
+
+    bool done() const
+    {
+        return _done.load() != 0;
+    }
+
+    const SyntaxHighlighter* syntaxHighlighter() const
+    {
+        return _syntaxHighlighter;
+    }
+
+    int firstCheckpoint() const
+    {
+        return _firstCheckpoint;
+    }
+
+    bool repairing() const
+    {
+        return _repairing;
+    }
+
+    int convergedPosition() const
+    {
+        ASSERT(done());
+        return _convergedPosition;
+    }
+
+    Array<HighlightingCheckpoint>& checkpoints()
+    {
+        ASSERT(done());
+        return _checkpoints;
+    }
+
+    Array<HighlightedLine>& lines()
+    {
+        ASSERT(done());
+        return _lines;
+    }
+
+    bool linesCut() const
+    {
+        ASSERT(done());
+        return !_cuts.empty();
+    }
+
+    int windowStart() const
+    {
+        return _windowStart;
+    }
+
+    int windowEnd() const
+    {
+        return _windowEnd;
+    }
+
+    void start(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+               int windowStart, int windowEnd, int line, const HighlightingState& state, int firstCheckpoint,
+               int publishStart);
+    void repair(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+                int windowStart, int windowEnd, const HighlightingState& state, int damagedEnd,
+                Array<HighlightingCheckpoint>&& lineStates);
+    void cancel();
+    bool wait(int timeout);
+
+protected:
+    friend class HighlightTask;
+
+    void copyText(const String& text, int start, int end);
+    void highlight();
+    bool highlightLine(int begin, int lineEnd, int end, HighlightingState& state, Array<HighlightSpan>& spans,
+                       int& cut, int& skipped);
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    const SyntaxHighlighter* _syntaxHighlighter;
+    String _text;
+    Array<HighlightingCut> _cuts;
+    int _windowStart, _windowEnd;
+    int _start;
+    bool _atEnd;
+    int _line;
+    HighlightingState _state;
+    int _firstCheckpoint;
+    int _publishStart;
+    bool _repairing;
+    int _damagedEnd;
+    int _convergedPosition;
+    Array<HighlightingCheckpoint> _lineStates;
+
+    Array<HighlightingCheckpoint> _checkpoints;
+    Array<HighlightedLine> _lines;
+    Atomic<int> _done;
+};
+
+// Bracket
+
+enum SymbolType
+{
+    SYMBOL_TYPE_NONE = 0,
+    SYMBOL_TYPE_NAMESPACE = 1,
+    SYMBOL_TYPE_CLASS = 2,
+    SYMBOL_TYPE_FUNCTION = 4,
+    SYMBOL_TYPE_ANY = 7
+};
+
+struct Bracket
+{
+    int position;
+    char_t ch;
+    uint8_t symbolType;
+    int nameOffset, nameLength;
+};
+
+// Declaration
+
+struct Declaration
+{
+    int tokens;
+    int parenDepth, angleDepth, initBraces;
+    char_t prevToken;
+    int prevTokenPosition;
+    uint8_t word;
+    uint8_t symbolType;
+    int nameStart, nameEnd;
+    int symbolStart, symbolEnd;
+    int functionStart, functionEnd;
+    bool scope, operatorName, functionFound, initList, baseClause, assigned, excluded;
+};
+
+// BracketScanner
+
+class BracketScanner
+{
+public:
+    BracketScanner(ThreadPool& threadPool);
+
+    BracketScanner(const BracketScanner&) = delete;
+    BracketScanner& operator=(const BracketScanner&) = delete;
+
+    ~BracketScanner();
+
+    bool done() const
+    {
+        return _done.load() != 0;
+    }
+
+    int scanStart() const
+    {
+        return _start;
+    }
+
+    int scanEnd() const
+    {
+        ASSERT(done());
+        return _end;
+    }
+
+    bool converged() const
+    {
+        ASSERT(done());
+        return _converged;
+    }
+
+    Array<Bracket>& brackets()
+    {
+        ASSERT(done());
+        return _brackets;
+    }
+
+    Array<HighlightingCheckpoint>& syncPoints()
+    {
+        ASSERT(done());
+        return _syncPoints;
+    }
+
+    void start(const SyntaxHighlighter* syntaxHighlighter, const String& text, int start, int end,
+               const HighlightingState& state, int damagedEnd, Array<HighlightingCheckpoint>&& oldSyncPoints);
+    void cancel();
+    void wait();
+
+protected:
+    friend class BracketScanTask;
+
+    void scan();
+    void addBrackets(int begin, int end);
+    void scanCode(int begin, int end);
+    void scanWord(int begin, int end);
+    int scanPunctuation(int pos, int end);
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    const SyntaxHighlighter* _syntaxHighlighter;
+    String _text;
+    int _start, _end;
+    bool _atEnd;
+    HighlightingState _state;
+    int _damagedEnd;
+    bool _converged;
+    Array<HighlightingCheckpoint> _oldSyncPoints;
+    bool _symbols;
+    Declaration _declaration;
+
+    Array<Bracket> _brackets;
+    Array<HighlightingCheckpoint> _syncPoints;
+    Atomic<int> _done;
+};
+
+// BracketNode
+
+struct BracketNode
+{
+    int left, right;
+    int size;
+    int gap, span;
+    int depth, minDepth;
+    int nameOffset, nameLength;
+    char_t ch;
+    uint8_t symbolType, symbolTypes;
+};
+
+// BracketIndex
+
+class BracketIndex
+{
+public:
+    BracketIndex();
+
+    bool enabled() const
+    {
+        return _enabled;
+    }
+
+    bool scanNeeded() const
+    {
+        return _damagedStart >= 0;
+    }
+
+    int size() const
+    {
+        return nodeSize(_root);
+    }
+
+    void enable(int textLength);
+    void disable();
+    void reset(int textLength);
+    void textChanged(int pos, int end, int delta);
+    void startScan(BracketScanner& scanner, const SyntaxHighlighter* syntaxHighlighter, const String& text);
+    void finishScan(BracketScanner& scanner, int textLength);
+
+    int find(int pos) const;
+    Bracket at(int index) const;
+    int findMatch(int index) const;
+    int findEnclosing(int pos) const;
+    int findSymbol(int index, int symbolTypes, bool forward) const;
+
+protected:
+    int nodeSize(int node) const
+    {
+        return node >= 0 ? _nodes[node].size : 0;
+    }
+
+    int nodeSpan(int node) const
+    {
+        return node >= 0 ? _nodes[node].span : 0;
+    }
+
+    int nodeDepth(int node) const
+    {
+        return node >= 0 ? _nodes[node].depth : 0;
+    }
+
+    uint32_t random();
+    void update(int node);
+    int merge(int left, int right);
+    void split(int node, int pos, int base, int& left, int& right);
+    int build(const Array<Bracket>& brackets, int begin, int end, int base);
+    void freeNodes(int node);
+    void replace(int start, int end, int delta, const Array<Bracket>& brackets);
+
+    int depthAt(int index) const;
+    int firstAtMost(int node, int index, int depth, int lo, int target) const;
+    int lastAtMost(int node, int index, int depth, int hi, int target) const;
+    int firstSymbol(int node, int index, int lo, int symbolTypes) const;
+    int lastSymbol(int node, int index, int hi, int symbolTypes) const;
+    int lowerBoundSyncPoint(int pos) const;
+
+protected:
+    bool _enabled;
+    Array<BracketNode> _nodes;
+    Array<int> _freeNodes;
+    int _root;
+    uint32_t _seed;
+
+    Array<HighlightingCheckpoint> _syncPoints;
+    int _damagedStart, _damagedEnd;
+    int _scanChunkSize;
+};
+
+// WordFilter
+
+// which words autocomplete takes, words in tokens of the skipped highlighting types are left out,
+// with numbers skipped so are the words starting with a digit and very long ones like hashes and encoded data
+
+struct WordFilter
+{
+    const SyntaxHighlighter* syntaxHighlighter = nullptr;
+    uint32_t skippedTypes = 0;
+
+    bool skipped(HighlightingType highlightingType) const
+    {
+        return (skippedTypes & 1u << highlightingType) != 0;
+    }
+
+    bool skipped(const char_t* chars, int len) const;
+};
+
+// WordIndex
+
+// word counts of a document, together with their changes since the autocomplete index last took them,
+// so that keeping that index up to date costs only as much as the edits did
+
+class WordIndex
+{
+public:
+    const WordCounts& counts() const
+    {
+        return _counts;
+    }
+
+    const WordCounts& changes() const
+    {
+        return _changes;
+    }
+
+    void countWords(StringPool& words, const WordFilter& filter, const String& text, int begin, int end,
+                    HighlightingState& state, int delta);
+    void recountTail(StringPool& words, const WordFilter& filter, const String& text, int begin,
+                     HighlightingState& oldState, HighlightingState& newState,
+                     Array<HighlightingCheckpoint>& checkpoints);
+    void recount(StringPool& words, const WordFilter& filter, const String& text,
+                 Array<HighlightingCheckpoint>& checkpoints);
+    void clearChanges();
+
+protected:
+    void addCount(StringPool& words, const WordFilter& filter, const char_t* chars, int len, int delta);
+
+protected:
+    WordCounts _counts;
+    WordCounts _changes;
+};
+
+// NearWord
+
+struct NearWord
+{
+    int word;
+    int distance;
+
+    friend bool operator<(const NearWord& left, const NearWord& right)
+    {
+        return left.word < right.word || (left.word == right.word && left.distance < right.distance);
+    }
 };
 
 // Document
@@ -163,11 +663,31 @@ public:
         return _position;
     }
 
+    int version() const
+    {
+        return _version;
+    }
+
+    int changedStart() const
+    {
+        return _changedStart;
+    }
+
+    void clearChangedStart()
+    {
+        _changedStart = -1;
+    }
+
     bool modified() const
     {
         return _modified;
     }
 
+    void modified(bool modified)
+    {
+        _modified = modified;
+    }
+
     void filename(const String& filename)
     {
         ASSERT(!filename.empty());
@@ -180,6 +700,11 @@ public:
         return _filename;
     }
 
+    DocumentType documentType() const
+    {
+        return _documentType;
+    }
+
     TextEncoding encoding() const
     {
         return _encoding;
@@ -255,6 +780,14 @@ public:
     bool moveToLine(int line);
     bool moveToLineColumn(int line, int column);
 
+    bool moveToMatchingBracket();
+    bool moveToNextBracket();
+    bool moveToPrevBracket();
+    bool moveToEnclosingBracket();
+    bool moveToNextFunction();
+    bool moveToPrevFunction();
+    bool moveToSymbol(const String& name);
+
     void insertNewLine();
     void insertChar(unichar_t ch, bool afterIdent = false);
 
@@ -275,15 +808,18 @@ public:
     void markSelection();
     String copyDeleteText(bool copy);
     void pasteText(const String& text);
+    void appendText(const String& text);
     bool toggleSelectionStart();
 
     String currentWord() const;
+    String currentLine() const;
     String autocompletePrefix() const;
-    void completeWord(const char_t* suffix);
+    void completeWord(const char_t* suffix, bool moveToEnd = false);
 
     bool find(const String& searchStr, bool caseSesitive, bool next);
     bool replace(const String& searchStr, const String& replaceStr, bool caseSesitive);
     bool replaceAll(const String& searchStr, const String& replaceStr, bool caseSesitive);
+    void replaceText(String& text);
 
     void open(const String& filename);
     void save();
@@ -291,9 +827,56 @@ public:
     void trimTrailingWhitespace();
 
     void setDimensions(int x, int y, int width, int height);
-    void draw(int screenWidth, Buffer<ScreenCell>& screen, bool unicodeLimit16);
+    void draw(int screenWidth, Buffer<ScreenCell>& screen, bool unicodeLimit16,
+              const String& searchStr = String(), bool caseSensitive = true);
+
+    bool highlightingNeeded() const
+    {
+        return _highlightingNeeded;
+    }
+
+    void startHighlighting(BackgroundHighlighter& highlighter);
+    void finishHighlighting(BackgroundHighlighter& highlighter);
+
+    bool bracketScanNeeded() const
+    {
+        return _brackets.scanNeeded();
+    }
+
+    void indexBrackets();
+    void startBracketScan(BracketScanner& scanner, const SyntaxHighlighter* syntaxHighlighter);
+    void finishBracketScan(BracketScanner& scanner);
+
+    const WordCounts& wordCounts() const
+    {
+        return _words.counts();
+    }
+
+    const WordCounts& wordChanges() const
+    {
+        return _words.changes();
+    }
+
+    void clearWordChanges()
+    {
+        _words.clearChanges();
+    }
+
+    int wordCount(int word) const;
+    void findNearWords(const String& prefix, int lines, int maxLength, Array<NearWord>& words) const;
+
+    static DocumentType filenameDocumentType(const String& filename);
 
 protected:
+    bool moveToBracketAt(int index);
+    bool moveToSymbolAt(int index);
+    void finishRepair(BackgroundHighlighter& highlighter);
+    int lowerBoundLine(int pos) const;
+    HighlightingState wordsState(const WordFilter& filter, int& pos);
+    void textChanging(int pos, int end);
+    void textChanged(int pos, int end = -1);
+    void findVisibleMatches(const String& searchStr, bool caseSensitive);
+
     void setPositionLineColumn(int pos);
     void positionToLineColumn(int startPos, int startLine, int startColumn, int newPos, int& line, int& column);
 
@@ -305,6 +888,8 @@ protected:
     int findNextLine(int pos) const;
     int findPreviousLine(int pos) const;
 
+    int findWordStart(int pos) const;
+    int findWordEnd(int pos) const;
     int findWordForward(int pos) const;
     int findWordBack(int pos) const;
     int findCharsForward(int pos) const;
@@ -327,6 +912,8 @@ protected:
     String _text;
     int _position;
     bool _modified;
+    int _version;
+    int _changedStart;
 
     String _filename;
     DocumentType _documentType;
@@ -347,7 +934,24 @@ protected:
     bool _selectionMode;
 
     String _indent;
-    HighlightingState _highlightingState;
+    Array<HighlightingCheckpoint> _checkpoints;
+    int _verifiedCheckpoints;
+    Array<HighlightedLine> _highlightedLines;
+    int _highlightedLength;
+    int _visibleStart, _visibleEnd;
+    int _windowStart, _windowEnd;
+    bool _highlightingNeeded;
+    int _damagedStart, _damagedEnd;
+    BracketIndex _brackets;
+    WordIndex _words;
+    Array<HighlightingCheckpoint> _wordsCheckpoints;
+    int _wordsPosition, _wordsEnd;
+    HighlightingState _wordsState, _wordsEndState;
+
+    Array<int> _matches;
+    int _matchesStart, _matchesEnd;
+    String _matchesSearchStr;
+    bool _matchesCaseSensitive;
 };
 
 // RecentLocation
@@ -362,32 +966,30 @@ struct RecentLocation
     }
 };
 
-// AutocompleteSuggestion
+// SourceWordIndex
 
-struct AutocompleteSuggestion
-{
-    String word;
-    int rank;
+// words of the project files that have a syntax highlighter, taken from the tokens autocomplete keeps
 
-    AutocompleteSuggestion(const String& word, int rank) : word(word), rank(rank)
+class SourceWordIndex : public ProjectWordIndex
+{
+public:
+    SourceWordIndex(ThreadPool& threadPool) : ProjectWordIndex(threadPool)
     {
     }
 
-    friend void swap(AutocompleteSuggestion& left, AutocompleteSuggestion& right)
-    {
-        swap(left.word, right.word);
-        swap(left.rank, right.rank);
-    }
+    ~SourceWordIndex();
 
-    friend bool operator<(const AutocompleteSuggestion& left, const AutocompleteSuggestion& right)
-    {
-        if (left.rank > right.rank)
-            return true;
-        else if (left.rank == right.rank)
-            return left.word > right.word;
-        else
-            return false;
-    }
+    void open(const String& directory, const Array<String>& ignoredDirectories,
+              const Array<const SyntaxHighlighter*>& syntaxHighlighters, uint32_t skippedTypes);
+
+    static void countWords(const WordFilter& filter, const String& text, Map<String, int>& counts);
+
+protected:
+    bool indexed(const String& name) const override;
+    void countWords(const String& name, const String& text, Map<String, int>& counts) const override;
+
+protected:
+    Array<const SyntaxHighlighter*> _syntaxHighlighters;
 };
 
 // Editor
@@ -414,8 +1016,17 @@ public:
         return _indentSize;
     }
 
-    SyntaxHighlighter* syntaxHighlighter(DocumentType documentType);
+    StringPool& wordPool()
+    {
+        return _wordPool;
+    }
+
+    const SyntaxHighlighter* syntaxHighlighter(DocumentType documentType);
+    Unique<SyntaxHighlighter> createSyntaxHighlighter(DocumentType documentType);
+    WordFilter wordFilter(DocumentType documentType);
+    ThreadPool& threadPool();
 
+    ListNode<Document>* findDocument(const String& filename);
     void newDocument(const String& filename);
     void openDocument(const String& filename);
     void saveDocument();
@@ -430,6 +1041,7 @@ protected:
     void onPaint(uintptr_t context) override;
     void onResize(int width, int height) override;
     void onInput(const Array<InputEvent>& inputEvents) override;
+    void onIdle() override;
 
     void measureCharSize();
     void computeWidthHeight();
@@ -437,6 +1049,7 @@ protected:
 
 #ifdef GUI_MODE
     Rect rectFromLineCol(int left, int top, int right, int bottom);
+    void drawText(const Rect& rect, int color);
 #endif
 
     void drawBlockCursor(bool on);
@@ -447,22 +1060,45 @@ protected:
     bool executeCommand(const String& command);
     void executeProjectCommand(const String& command);
 
+    void showFindResults();
+    void findInFiles(const String& searchStr, bool caseSensitive);
+    void replaceInAllDocuments(bool countOnly);
+    void updateFindResults();
+    bool goToLocation();
+    void updateMatchCount();
+    void updateHighlighting();
+    void startHighlighting();
+    void drawDocument();
+    void updateBrackets();
+    void waitForBrackets();
+    bool moveToBracket(bool (Document::*move)());
+
     void updateRecentLocations();
     bool moveToNextRecentLocation();
     bool moveToPrevRecentLocation();
 
-    void findUniqueWords();
-    void prepareSuggestions(const String& prefix);
+    void mergeUniqueWords(const WordCounts& words, int sign);
+    void updateUniqueWords();
+    void loadProjectWords();
+    void prepareSuggestions(const String& prefix, int maxSuggestions);
+    int rankSuggestion(int word, int rank, int distance);
+    void sortSuggestions(int index);
     bool completeWord(int next);
+    bool completeCommonPart();
+
+    void openPathIndex();
+    bool updateMatchedPaths();
+    void drawMatchedPaths();
+    bool completeCommand(int next);
 
     void copyToClipboard(const String& text);
     void pasteFromClipboard(String& text);
 
     void readConfigFile(const String& filename);
+    void loadGrammars();
 
 protected:
     List<Document> _documents;
-    ListNode<Document> _commandLine;
     ListNode<Document>* _document;
     ListNode<Document>* _lastDocument;
 
@@ -492,14 +1128,54 @@ protected:
     List<RecentLocation> _recentLocations;
     ListNode<RecentLocation>* _recentLocation;
 
-    Map<String, int> _uniqueWords;
+    StringPool _wordPool;
+    SuggestionIndex _uniqueWords;
     Array<AutocompleteSuggestion> _suggestions;
+    bool _moreSuggestions;
+    int _unsortedStart, _unsortedEnd;
     int _currentSuggestion;
 
+    Array<Grammar> _grammars;
+    bool _grammarsLoaded;
     List<Unique<SyntaxHighlighter>> _syntaxHighlighters;
 
+    Unique<ThreadPool> _threadPool;
+    Unique<FileSearch> _fileSearch;
+    bool _findingInFiles;
+    Array<String> _ignoredDirectories;
+    Unique<TrigramIndex> _trigramIndex;
+    Unique<SourceWordIndex> _projectWordIndex;
+    Vocabulary _vocabulary;
+    Unique<PathIndex> _pathIndex;
+    DirectoryCache _directoryCache;
+    Array<String> _matchedPaths;
+    String _pathPattern;
+    unichar_t _pathCommand;
+    int _currentPath;
+    int _pathsVersion;
+    int _pathLines;
+
+    Unique<MatchCounter> _matchCounter;
+    ListNode<Document>* _countedDocument;
+    int _countedVersion;
+    bool _matchCountShown;
+
+    Unique<BackgroundHighlighter> _backgroundHighlighter;
+    ListNode<Document>* _highlightedDocument;
+    int _highlightedVersion;
+
+    Unique<BracketScanner> _bracketScanner;
+    ListNode<Document>* _scannedDocument;
+    int _scannedVersion;
+
     bool _brightBackground = true;
     bool _trimWhitespace = true;
+    bool _findIndex = false;
+    bool _autocompleteIndex = false;
+    uint32_t _autocompleteSkippedTypes = 1u << HIGHLIGHTING_TYPE_STRING | 1u << HIGHLIGHTING_TYPE_NUMBER |
+        1u << HIGHLIGHTING_TYPE_SINGLELINE_COMMENT | 1u << HIGHLIGHTING_TYPE_MULTILINE_COMMENT |
+        1u << HIGHLIGHTING_TYPE_ATTRIBUTE_VALUE;
+    int _autocompleteHistorySize = 50000;
     int _indentSize = 4;
     float _guiFontSize = 13;
     String _guiFontName = STR("Lucida Console");
@@ -513,6 +1189,10 @@ protected:
     String _runCommand = STR("make run; echo 'Press ENTER to continue...'; read");
     String _cleanCommand = STR("make clean; echo 'Press ENTER to continue...'; read");
 #endif
+
+    // a document takes its word filter from the editor, so the command line is made after everything else
+
+    ListNode<Document> _commandLine;
 };
 
 #endif
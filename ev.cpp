@@ -0,0 +1,15 @@
+#include <editor.h>
+
+const char_t* APPLICATION_NAME = STR("ev");
+
+void run(const Array<String>& args)
+{
+#if defined(PLATFORM_LINUX) && defined(GUI_MODE)
+    Application app(args);
+#else
+    Editor app(args);
+#endif
+
+    if (app.start())
+        app.run();
+}
@@ -1,5 +1,22 @@
 #include <file.h>
 
+#ifndef PLATFORM_WINDOWS
+#include <sys/mman.h>
+#include <dirent.h>
+#endif
+
+#ifdef PLATFORM_WINDOWS
+
+static int64_t fileTimeToTime(const FILETIME& fileTime)
+{
+    // FILETIME counts 100 ns intervals since 1601, convert to seconds since 1970
+
+    int64_t time = (static_cast<int64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime;
+    return (time - 116444736000000000LL) / 10000000LL;
+}
+
+#endif
+
 // File
 
 File::File() : _handle(INVALID_HANDLE_VALUE)
@@ -288,3 +305,209 @@ void File::remove(const String& filename)
 #endif
         throw Exception(STR("failed to delete file"));
 }
+
+void File::rename(const String& oldFilename, const String& newFilename)
+{
+    // an existing file is replaced, on UNIX a process that has it open or mapped keeps the old contents,
+    // on Windows the replace fails while any process has it mapped
+
+#ifdef PLATFORM_WINDOWS
+    BOOL rc = MoveFileEx(reinterpret_cast<LPCTSTR>(oldFilename.chars()),
+                         reinterpret_cast<LPCTSTR>(newFilename.chars()), MOVEFILE_REPLACE_EXISTING);
+    if (!rc)
+#else
+    int rc = ::rename(oldFilename.chars(), newFilename.chars());
+    if (rc != 0)
+#endif
+        throw Exception(STR("failed to rename file"));
+}
+
+int64_t File::modificationTime(const String& filename)
+{
+#ifdef PLATFORM_WINDOWS
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesEx(reinterpret_cast<LPCTSTR>(filename.chars()), GetFileExInfoStandard, &data))
+        throw Exception(STR("failed to get file attributes"));
+
+    return fileTimeToTime(data.ftLastWriteTime);
+#else
+    struct stat st;
+
+    if (stat(filename.chars(), &st) != 0)
+        throw Exception(STR("failed to get file attributes"));
+
+    return st.st_mtime;
+#endif
+}
+
+// MappedFile
+
+MappedFile::MappedFile() : _open(false), _size(0), _data(nullptr)
+{
+#ifdef PLATFORM_WINDOWS
+    _mapping = nullptr;
+#endif
+}
+
+MappedFile::MappedFile(const String& filename) : _open(false), _size(0), _data(nullptr)
+{
+#ifdef PLATFORM_WINDOWS
+    _mapping = nullptr;
+#endif
+
+    if (!open(filename))
+        throw Exception(STR("failed to map file"));
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const String& filename)
+{
+    if (_open)
+        throw Exception(STR("file already open"));
+
+    File file;
+
+    if (!file.open(filename))
+        return false;
+
+    _size = file.size();
+
+    // empty files cannot be mapped, they are represented by null data
+
+    if (_size > 0)
+    {
+#ifdef PLATFORM_WINDOWS
+        _mapping = CreateFileMapping(file._handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_mapping)
+            return false;
+
+        _data = reinterpret_cast<const byte_t*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!_data)
+        {
+            CloseHandle(_mapping);
+            _mapping = nullptr;
+            return false;
+        }
+#else
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, file._handle, 0);
+        if (data == MAP_FAILED)
+            return false;
+
+        _data = reinterpret_cast<const byte_t*>(data);
+#endif
+    }
+
+    _open = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (_data)
+    {
+#ifdef PLATFORM_WINDOWS
+        BOOL rc = UnmapViewOfFile(_data);
+        ASSERT(rc);
+        rc = CloseHandle(_mapping);
+        ASSERT(rc);
+        _mapping = nullptr;
+#else
+        int rc = munmap(const_cast<byte_t*>(_data), _size);
+        ASSERT(rc == 0);
+#endif
+    }
+
+    _open = false;
+    _size = 0;
+    _data = nullptr;
+}
+
+// Directory
+
+bool Directory::exists(const String& path)
+{
+#ifdef PLATFORM_WINDOWS
+    DWORD attributes = GetFileAttributes(reinterpret_cast<LPCTSTR>(path.chars()));
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat st;
+    return stat(path.chars(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+Array<DirectoryEntry> Directory::list(const String& path)
+{
+    Array<DirectoryEntry> entries;
+    DirectoryEntry entry;
+
+#ifdef PLATFORM_WINDOWS
+    WIN32_FIND_DATA data;
+    HANDLE handle = FindFirstFile(reinterpret_cast<LPCTSTR>((path + STR("\\*")).chars()), &data);
+
+    if (handle == INVALID_HANDLE_VALUE)
+        throw Exception(STR("failed to list directory"));
+
+    do
+    {
+        entry.name = reinterpret_cast<const char_t*>(data.cFileName);
+
+        if (entry.name == STR(".") || entry.name == STR(".."))
+            continue;
+
+        entry.directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        entry.link = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+        entry.size = (static_cast<int64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        entry.modificationTime = fileTimeToTime(data.ftLastWriteTime);
+
+        entries.addLast(entry);
+    }
+    while (FindNextFile(handle, &data));
+
+    FindClose(handle);
+#else
+    DIR* dir = opendir(path.chars());
+
+    if (!dir)
+        throw Exception(STR("failed to list directory"));
+
+    struct dirent* ent;
+    struct stat st;
+    String filename;
+
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        entry.name = ent->d_name;
+
+        if (entry.name == STR(".") || entry.name == STR(".."))
+            continue;
+
+        filename = path;
+        if (!filename.endsWith(STR("/")))
+            filename += STR("/");
+        filename += entry.name;
+
+        if (lstat(filename.chars(), &st) != 0)
+            continue;
+
+        entry.link = S_ISLNK(st.st_mode);
+
+        if (entry.link && stat(filename.chars(), &st) != 0)
+            continue;
+
+        entry.directory = S_ISDIR(st.st_mode);
+        entry.size = st.st_size;
+        entry.modificationTime = st.st_mtime;
+
+        entries.addLast(entry);
+    }
+
+    closedir(dir);
+#endif
+
+    return entries;
+}
@@ -28,6 +28,9 @@ enum FilePosition
 
 class File
 {
+public:
+    friend class MappedFile;
+
 public:
     File();
     File(const String& filename, int openMode = FILE_MODE_READ);
@@ -55,6 +58,8 @@ public:
 public:
     static bool exists(const String& filename);
     static void remove(const String& filename);
+    static void rename(const String& oldFilename, const String& newFilename);
+    static int64_t modificationTime(const String& filename);
 
 protected:
 #ifdef PLATFORM_WINDOWS
@@ -64,4 +69,62 @@ protected:
 #endif
 };
 
+// MappedFile
+
+class MappedFile
+{
+public:
+    MappedFile();
+    MappedFile(const String& filename);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    bool isOpen() const
+    {
+        return _open;
+    }
+
+    int64_t size() const
+    {
+        return _size;
+    }
+
+    const byte_t* data() const
+    {
+        return _data;
+    }
+
+    bool open(const String& filename);
+    void close();
+
+protected:
+    bool _open;
+    int64_t _size;
+    const byte_t* _data;
+#ifdef PLATFORM_WINDOWS
+    HANDLE _mapping;
+#endif
+};
+
+// Directory
+
+struct DirectoryEntry
+{
+    String name;
+    bool directory;
+    bool link;
+    int64_t size;
+    int64_t modificationTime;
+};
+
+class Directory
+{
+public:
+    static bool exists(const String& path);
+    static Array<DirectoryEntry> list(const String& path);
+};
+
 #endif
@@ -2107,3 +2107,108 @@ ByteBuffer Unicode::stringToBytes(const String& str, TextEncoding encoding, bool
     ASSERT(bytes.size() == len);
     return bytes;
 }
+
+// StringPool
+
+const int STRING_POOL_BLOCK_SIZE = 64 * 1024;
+
+StringPool::StringPool() : _blockUsed(0)
+{
+}
+
+int StringPool::find(const char_t* chars, int len) const
+{
+    ASSERT(chars ? len >= 0 : len == 0);
+
+    if (_slots.empty())
+        return -1;
+
+    return _slots[findSlot(chars, len, hashChars(chars, len))];
+}
+
+int StringPool::add(const char_t* chars, int len)
+{
+    ASSERT(chars ? len >= 0 : len == 0);
+
+    // the table is kept at most half full so that probe sequences stay short
+
+    if ((_strings.size() + 1) * 2 > _slots.size())
+        rehash(_slots.empty() ? 64 : _slots.size() * 2);
+
+    uint32_t hash = hashChars(chars, len);
+    int slot = findSlot(chars, len, hash);
+
+    if (_slots[slot] >= 0)
+        return _slots[slot];
+
+    // a string that does not fit into the last block starts a new one, long strings get a block of their own
+
+    if (_blocks.empty() || _blockUsed + len > _blocks.last().size())
+    {
+        _blocks.addLast(Buffer<char_t>(len > STRING_POOL_BLOCK_SIZE ? len : STRING_POOL_BLOCK_SIZE));
+        _blockUsed = 0;
+    }
+
+    char_t* dest = _blocks.last().values() + _blockUsed;
+    memcpy(dest, chars, len * sizeof(char_t));
+    _blockUsed += len;
+
+    _slots[slot] = _strings.size();
+    _strings.addLast({ dest, len, hash });
+
+    return _strings.size() - 1;
+}
+
+void StringPool::clear()
+{
+    _blocks.clear();
+    _blockUsed = 0;
+    _strings.clear();
+    _slots.clear();
+}
+
+uint32_t StringPool::hashChars(const char_t* chars, int len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (int i = 0; i < len; ++i)
+        hash = (hash ^ static_cast<uint32_t>(chars[i])) * 16777619u;
+
+    return hash;
+}
+
+int StringPool::findSlot(const char_t* chars, int len, uint32_t hash) const
+{
+    int mask = _slots.size() - 1;
+
+    for (int slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        int id = _slots[slot];
+
+        if (id < 0)
+            return slot;
+
+        const PooledString& str = _strings[id];
+
+        if (str.hash == hash && str.length == len && memcmp(str.chars, chars, len * sizeof(char_t)) == 0)
+            return slot;
+    }
+}
+
+void StringPool::rehash(int numSlots)
+{
+    ASSERT(numSlots > 0 && (numSlots & (numSlots - 1)) == 0);
+
+    _slots.assign(numSlots, -1);
+    int mask = numSlots - 1;
+
+    for (int id = 0; id < _strings.size(); ++id)
+    {
+        int slot = _strings[id].hash & mask;
+
+        while (_slots[slot] >= 0)
+            slot = (slot + 1) & mask;
+
+        _slots[slot] = id;
+    }
+}
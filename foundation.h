@@ -2261,6 +2261,43 @@ public:
             quicksort(0, _size - 1);
     }
 
+    void sort(int start, int end)
+    {
+        ASSERT(start >= 0 && start <= end && end <= _size);
+
+        if (end - start > 1)
+            quicksort(start, end - 1);
+    }
+
+    void select(int start, int end, int n)
+    {
+        ASSERT(start >= 0 && start <= n && n <= end && end <= _size);
+
+        // the value that belongs at n if the range were sorted is moved there, with no greater values
+        // before it and no smaller ones after it, the middle value is the pivot so that ordered input is fast
+
+        int low = start, high = end - 1;
+
+        while (low < high && n <= high)
+        {
+            swap(_values[low], _values[low + (high - low) / 2]);
+            int p = partition(low, high);
+
+            if (n <= p)
+                high = p;
+            else
+                low = p + 1;
+        }
+    }
+
+    void partialSort(int n)
+    {
+        ASSERT(n >= 0 && n <= _size);
+
+        select(0, _size, n);
+        sort(0, n);
+    }
+
     void clear()
     {
         Memory::destructArray(_size, _values);
@@ -3495,12 +3532,15 @@ public:
 
     bool contains(const _Type& value) const
     {
-        auto& bucket = getBucket(value);
-
-        for (auto node = bucket.first(); node; node = node->next)
+        if (!_values.empty())
         {
-            if (node->value == value)
-                return true;
+            auto& bucket = getBucket(value);
+
+            for (auto node = bucket.first(); node; node = node->next)
+            {
+                if (node->value == value)
+                    return true;
+            }
         }
 
         return false;
@@ -3566,15 +3606,18 @@ public:
 
     bool remove(const _Type& value)
     {
-        auto& bucket = getBucket(value);
-
-        for (auto node = bucket.first(); node; node = node->next)
+        if (!_values.empty())
         {
-            if (node->value == value)
+            auto& bucket = getBucket(value);
+
+            for (auto node = bucket.first(); node; node = node->next)
             {
-                bucket.remove(node);
-                --_size;
-                return true;
+                if (node->value == value)
+                {
+                    bucket.remove(node);
+                    --_size;
+                    return true;
+                }
             }
         }
 
@@ -3631,4 +3674,82 @@ protected:
     float _maxLoadFactor;
 };
 
+// PooledString
+
+struct PooledString
+{
+    const char_t* chars;
+    int length;
+    uint32_t hash;
+};
+
+// StringPool
+
+// strings are copied into large blocks once and numbered with 32-bit ids, the lookup table is open addressed
+// and holds only ids, so finding a string allocates nothing and touches no list nodes, strings are never removed
+
+class StringPool
+{
+public:
+    StringPool();
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    int size() const
+    {
+        return _strings.size();
+    }
+
+    bool empty() const
+    {
+        return _strings.empty();
+    }
+
+    const char_t* chars(int id) const
+    {
+        ASSERT(id >= 0 && id < _strings.size());
+        return _strings[id].chars;
+    }
+
+    int length(int id) const
+    {
+        ASSERT(id >= 0 && id < _strings.size());
+        return _strings[id].length;
+    }
+
+    String str(int id) const
+    {
+        ASSERT(id >= 0 && id < _strings.size());
+        return String(_strings[id].chars, _strings[id].length);
+    }
+
+    int find(const char_t* chars, int len) const;
+
+    int find(const String& str) const
+    {
+        return find(str.chars(), str.length());
+    }
+
+    int add(const char_t* chars, int len);
+
+    int add(const String& str)
+    {
+        return add(str.chars(), str.length());
+    }
+
+    void clear();
+
+protected:
+    static uint32_t hashChars(const char_t* chars, int len);
+    int findSlot(const char_t* chars, int len, uint32_t hash) const;
+    void rehash(int numSlots);
+
+protected:
+    Array<Buffer<char_t>> _blocks;
+    int _blockUsed;
+    Array<PooledString> _strings;
+    Array<int> _slots;
+};
+
 #endif
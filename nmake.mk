@@ -16,21 +16,22 @@ COMPILER_FLAGS = /O1
 !if "$(TARGET)" == "test"
 BIN = $(BIN)\$(TARGET)
 EXE = $(BIN)\test.exe
-OBJS = $(BIN)\test.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\input.obj $(BIN)\console.obj $(BIN)\main.obj
+OBJS = $(BIN)\test.obj $(BIN)\editor.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\thread.obj \
+	$(BIN)\search.obj $(BIN)\application.obj $(BIN)\input.obj $(BIN)\console.obj $(BIN)\main.obj
 LIBS = user32.lib ole32.lib
 !else if "$(TARGET)" == "gui"
 COMPILER_FLAGS = $(COMPILER_FLAGS) /DGUI_MODE
 LIBS = user32.lib ole32.lib dwrite.lib d2d1.lib windowscodecs.lib
 BIN = $(BIN)\$(TARGET)
 EXE = $(BIN)\ev.exe
-OBJS = $(BIN)\editor.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\application.obj \
-	$(BIN)\input.obj $(BIN)\console.obj $(BIN)\graphics.obj $(BIN)\main.obj $(BIN)\editor.res
+OBJS = $(BIN)\ev.obj $(BIN)\editor.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\thread.obj $(BIN)\search.obj \
+	$(BIN)\application.obj $(BIN)\input.obj $(BIN)\console.obj $(BIN)\graphics.obj $(BIN)\main.obj $(BIN)\editor.res
 !else
 COMPILER_FLAGS = $(COMPILER_FLAGS)
 LIBS = user32.lib ole32.lib
 EXE = $(BIN)\ev.exe
-OBJS = $(BIN)\editor.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\application.obj \
-	$(BIN)\input.obj $(BIN)\console.obj $(BIN)\main.obj
+OBJS = $(BIN)\ev.obj $(BIN)\editor.obj $(BIN)\foundation.obj $(BIN)\file.obj $(BIN)\thread.obj $(BIN)\search.obj \
+	$(BIN)\application.obj $(BIN)\input.obj $(BIN)\console.obj $(BIN)\main.obj
 !endif
 
 build: $(BIN) $(EXE)
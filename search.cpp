@@ -0,0 +1,3852 @@
+#include <search.h>
+
+#ifdef PLATFORM_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+const int BINARY_CHECK_SIZE = 8192;
+const int MAX_FILES_PER_TASK = 16;
+const int MAX_MATCH_TEXT_LENGTH = 256;
+const int MATCH_COUNT_CHUNK_SIZE = 4 * 1024 * 1024;
+
+const int PATH_MATCH_SCORE = 16;
+const int PATH_CONSECUTIVE_BONUS = 8;
+const int PATH_SEPARATOR_BONUS = 12;
+const int PATH_BOUNDARY_BONUS = 8;
+const int PATH_NAME_BONUS = 32;
+const int PATH_MAX_GAP_PENALTY = 8;
+
+static inline byte_t foldByte(byte_t ch)
+{
+    return ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+}
+
+static inline uint32_t unsignedUnit(char_t unit)
+{
+    return static_cast<uint32_t>(unit) & (static_cast<uint32_t>(-1) >> (32 - 8 * sizeof(char_t)));
+}
+
+static inline bool continuationUnit(char_t unit)
+{
+#ifdef CHAR_ENCODING_UTF8
+    return (unsignedUnit(unit) & 0xc0) == 0x80;
+#else
+    return (unsignedUnit(unit) & 0xfc00) == 0xdc00;
+#endif
+}
+
+bool ignoreDirectory(const String& name, const Array<String>& ignoredDirectories)
+{
+    if (name.startsWith(STR(".")))
+        return true;
+
+    for (int i = 0; i < ignoredDirectories.size(); ++i)
+        if (name == ignoredDirectories[i])
+            return true;
+
+    return false;
+}
+
+String joinPath(const String& path, const String& name)
+{
+    if (path.empty())
+        return name;
+
+    String result = path;
+
+#ifdef PLATFORM_WINDOWS
+    if (!result.endsWith(STR("\\")) && !result.endsWith(STR("/")))
+        result += STR("\\");
+#else
+    if (!result.endsWith(STR("/")))
+        result += STR("/");
+#endif
+
+    result += name;
+    return result;
+}
+
+ByteBuffer stringToUtf8(const String& str)
+{
+#ifdef CHAR_ENCODING_UTF8
+    return ByteBuffer(str.length(), reinterpret_cast<const byte_t*>(str.chars()));
+#else
+    return Unicode::stringToBytes(str, TEXT_ENCODING_UTF8, false, false);
+#endif
+}
+
+// DirectorySearchTask
+
+class DirectorySearchTask : public Task
+{
+public:
+    DirectorySearchTask(FileSearch& search, const String& path) : _search(search), _path(path)
+    {
+    }
+
+    void run() override
+    {
+        _search.searchDirectory(_path);
+    }
+
+protected:
+    FileSearch& _search;
+    String _path;
+};
+
+// FileSearchTask
+
+class FileSearchTask : public Task
+{
+public:
+    FileSearchTask(FileSearch& search, Array<String>&& filenames) :
+        _search(search), _filenames(static_cast<Array<String>&&>(filenames))
+    {
+    }
+
+    void run() override
+    {
+        _search.searchFiles(_filenames);
+    }
+
+protected:
+    FileSearch& _search;
+    Array<String> _filenames;
+};
+
+// TextReplaceTask
+
+class TextReplaceTask : public Task
+{
+public:
+    TextReplaceTask(TextReplace& replace, const String& text, ReplaceResult& result) :
+        _replace(replace), _text(text), _result(result)
+    {
+    }
+
+    void run() override
+    {
+        TextReplace::replaceAll(_text, _replace._searchStr, _replace._replaceStr, _replace._caseSensitive,
+                                _replace._countOnly, _result);
+    }
+
+protected:
+    TextReplace& _replace;
+    const String& _text;
+    ReplaceResult& _result;
+};
+
+// FileSearch
+
+FileSearch::FileSearch(ThreadPool& threadPool) :
+    _threadPool(threadPool), _caseSensitive(true), _numFiles(0), _numMatches(0)
+{
+}
+
+FileSearch::~FileSearch()
+{
+    cancel();
+}
+
+void FileSearch::start(const String& directory, const String& searchStr, bool caseSensitive,
+                       const Array<String>& ignoredDirectories)
+{
+    _ignoredDirectories = ignoredDirectories;
+    prepare(searchStr, caseSensitive);
+
+    _threadPool.submit(createUnique<DirectorySearchTask>(*this, directory), &_group);
+}
+
+void FileSearch::start(const Array<String>& filenames, const String& searchStr, bool caseSensitive)
+{
+    prepare(searchStr, caseSensitive);
+
+    for (int i = 0; i < filenames.size(); i += MAX_FILES_PER_TASK)
+    {
+        int n = filenames.size() - i < MAX_FILES_PER_TASK ? filenames.size() - i : MAX_FILES_PER_TASK;
+        _threadPool.submit(createUnique<FileSearchTask>(*this, Array<String>(n, filenames.values() + i)), &_group);
+    }
+}
+
+void FileSearch::prepare(const String& searchStr, bool caseSensitive)
+{
+    ASSERT(!searchStr.empty());
+
+    cancel();
+
+    _searchStr = searchStr;
+    _caseSensitive = caseSensitive;
+
+    // files are searched as raw UTF-8 bytes, case folding is limited to ASCII letters
+
+    _pattern = stringToUtf8(searchStr);
+
+    if (!caseSensitive)
+    {
+        for (int i = 0; i < _pattern.size(); ++i)
+            _pattern[i] = foldByte(_pattern[i]);
+    }
+
+    _numFiles.store(0);
+    _numMatches.store(0);
+}
+
+void FileSearch::cancel()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    Lock lock(_mutex);
+    _matches.clear();
+}
+
+bool FileSearch::takeMatches(Array<SearchMatch>& matches)
+{
+    matches.clear();
+
+    Lock lock(_mutex);
+    swap(matches, _matches);
+
+    return !matches.empty();
+}
+
+bool FileSearch::isBinary(const byte_t* data, int64_t size)
+{
+    ASSERT(data ? size >= 0 : size == 0);
+    return memchr(data, 0, size < BINARY_CHECK_SIZE ? size : BINARY_CHECK_SIZE) != nullptr;
+}
+
+const byte_t* FileSearch::findBytes(const byte_t* start, const byte_t* end,
+                                    const ByteBuffer& pattern, bool caseSensitive)
+{
+    ASSERT(start <= end);
+    ASSERT(!pattern.empty());
+
+    int len = pattern.size();
+    const byte_t* chars = pattern.values();
+
+    if (end - start < len)
+        return nullptr;
+
+    const byte_t* last = end - len + 1;
+
+    if (caseSensitive)
+    {
+        const byte_t* p = start;
+
+        while (p < last)
+        {
+            p = reinterpret_cast<const byte_t*>(memchr(p, chars[0], last - p));
+            if (!p)
+                break;
+
+            if (memcmp(p + 1, chars + 1, len - 1) == 0)
+                return p;
+
+            ++p;
+        }
+    }
+    else
+    {
+        // candidates for the first character are found with memchr for both cases,
+        // the nearest occurrence of each case is remembered to avoid rescanning
+
+        byte_t lower = chars[0];
+        byte_t upper = lower >= 'a' && lower <= 'z' ? lower - ('a' - 'A') : lower;
+
+        const byte_t* p = start;
+        const byte_t* nextLower = reinterpret_cast<const byte_t*>(memchr(p, lower, last - p));
+        const byte_t* nextUpper = lower != upper ? reinterpret_cast<const byte_t*>(memchr(p, upper, last - p)) : nullptr;
+
+        while (p < last)
+        {
+            if (nextLower && nextLower < p)
+                nextLower = reinterpret_cast<const byte_t*>(memchr(p, lower, last - p));
+
+            if (nextUpper && nextUpper < p)
+                nextUpper = reinterpret_cast<const byte_t*>(memchr(p, upper, last - p));
+
+            if (nextLower && nextUpper)
+                p = nextLower < nextUpper ? nextLower : nextUpper;
+            else if (nextLower)
+                p = nextLower;
+            else if (nextUpper)
+                p = nextUpper;
+            else
+                break;
+
+            int i = 1;
+            while (i < len && foldByte(p[i]) == chars[i])
+                ++i;
+
+            if (i == len)
+                return p;
+
+            ++p;
+        }
+    }
+
+    return nullptr;
+}
+
+void FileSearch::searchDirectory(const String& path)
+{
+    Array<DirectoryEntry> entries;
+
+    try
+    {
+        entries = Directory::list(path.empty() ? String(STR(".")) : path);
+    }
+    catch (Exception&)
+    {
+        return;
+    }
+
+    Array<String> filenames;
+
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (_group.cancelled())
+            return;
+
+        const DirectoryEntry& entry = entries[i];
+
+        if (entry.directory)
+        {
+            if (!entry.link && !ignoreDirectory(entry.name, _ignoredDirectories))
+                _threadPool.submit(createUnique<DirectorySearchTask>(*this, joinPath(path, entry.name)), &_group);
+        }
+        else if (entry.size > 0)
+        {
+            filenames.addLast(joinPath(path, entry.name));
+
+            if (filenames.size() == MAX_FILES_PER_TASK)
+            {
+                _threadPool.submit(createUnique<FileSearchTask>(*this, static_cast<Array<String>&&>(filenames)),
+                                   &_group);
+                filenames.clear();
+            }
+        }
+    }
+
+    if (!filenames.empty())
+        _threadPool.submit(createUnique<FileSearchTask>(*this, static_cast<Array<String>&&>(filenames)), &_group);
+}
+
+void FileSearch::searchFiles(const Array<String>& filenames)
+{
+    Array<SearchMatch> matches;
+
+    for (int i = 0; i < filenames.size(); ++i)
+    {
+        if (_group.cancelled())
+            return;
+
+        try
+        {
+            searchFile(filenames[i], matches);
+        }
+        catch (Exception&)
+        {
+        }
+
+        _numFiles.increment();
+
+        if (!matches.empty())
+        {
+            _numMatches.add(matches.size());
+
+            Lock lock(_mutex);
+
+            for (int j = 0; j < matches.size(); ++j)
+                _matches.addLast(static_cast<SearchMatch&&>(matches[j]));
+        }
+
+        matches.clear();
+    }
+}
+
+void FileSearch::searchFile(const String& filename, Array<SearchMatch>& matches)
+{
+    MappedFile file;
+
+    if (!file.open(filename) || file.size() == 0)
+        return;
+
+    const byte_t* data = file.data();
+    const byte_t* end = data + file.size();
+
+    // UTF-16 files are rare enough to be decoded and searched as text
+
+    if (file.size() >= 2 && ((data[0] == 0xfe && data[1] == 0xff) || (data[0] == 0xff && data[1] == 0xfe)))
+    {
+        if (file.size() <= INT_MAX)
+        {
+            TextEncoding encoding;
+            bool bom, crLf;
+
+            searchText(filename, Unicode::bytesToString(file.size(), data, encoding, bom, crLf), matches);
+        }
+
+        return;
+    }
+
+    if (isBinary(data, file.size()))
+        return;
+
+    const byte_t* p = data;
+    const byte_t* lineStart = data;
+    const byte_t* counted = data;
+    int line = 1;
+
+    while (true)
+    {
+        const byte_t* match = findBytes(p, end, _pattern, _caseSensitive);
+        if (!match)
+            break;
+
+        const byte_t* q = counted;
+
+        while ((q = reinterpret_cast<const byte_t*>(memchr(q, '\n', match - q))) != nullptr)
+        {
+            ++line;
+            lineStart = ++q;
+        }
+
+        counted = match;
+
+        const byte_t* lineEnd = reinterpret_cast<const byte_t*>(memchr(match, '\n', end - match));
+        if (!lineEnd)
+            lineEnd = end;
+
+        int column = 1;
+        for (q = lineStart; q < match; ++q)
+            if ((*q & 0xc0) != 0x80)
+                ++column;
+
+        const byte_t* textEnd = lineEnd;
+
+        if (textEnd - lineStart > MAX_MATCH_TEXT_LENGTH)
+        {
+            textEnd = lineStart + MAX_MATCH_TEXT_LENGTH;
+            while (textEnd > lineStart && (*textEnd & 0xc0) == 0x80)
+                --textEnd;
+        }
+
+        TextEncoding encoding;
+        bool bom, crLf;
+
+        SearchMatch searchMatch;
+        searchMatch.filename = filename;
+        searchMatch.line = line;
+        searchMatch.column = column;
+        searchMatch.text = Unicode::bytesToString(textEnd - lineStart, lineStart, encoding, bom, crLf);
+        searchMatch.text.trim();
+
+        matches.addLast(static_cast<SearchMatch&&>(searchMatch));
+
+        if (lineEnd == end || _group.cancelled())
+            break;
+
+        p = lineEnd + 1;
+    }
+}
+
+void FileSearch::searchText(const String& filename, const String& text, Array<SearchMatch>& matches)
+{
+    int p = 0, lineStart = 0, counted = 0, line = 1;
+
+    while ((p = text.find(_searchStr, _caseSensitive, p)) != INVALID_POSITION)
+    {
+        for (int q = counted; q < p; ++q)
+            if (text.chars()[q] == '\n')
+            {
+                ++line;
+                lineStart = q + 1;
+            }
+
+        counted = p;
+
+        int lineEnd = text.find('\n', true, p);
+        if (lineEnd == INVALID_POSITION)
+            lineEnd = text.length();
+
+        int column = 1;
+        for (int q = lineStart; q < p; q = text.charForward(q))
+            ++column;
+
+        SearchMatch searchMatch;
+        searchMatch.filename = filename;
+        searchMatch.line = line;
+        searchMatch.column = column;
+        searchMatch.text = text.substr(lineStart, lineEnd - lineStart);
+        searchMatch.text.trim();
+
+        matches.addLast(static_cast<SearchMatch&&>(searchMatch));
+
+        if (lineEnd == text.length())
+            break;
+
+        p = lineEnd + 1;
+    }
+}
+
+// TextReplace
+
+void TextReplace::start(const Array<const String*>& texts, const String& searchStr, const String& replaceStr,
+                        bool caseSensitive, bool countOnly)
+{
+    ASSERT(!searchStr.empty());
+    ASSERT(pending() == 0);
+
+    _searchStr = searchStr;
+    _replaceStr = replaceStr;
+    _caseSensitive = caseSensitive;
+    _countOnly = countOnly;
+
+    // results are allocated up front because tasks keep references to them
+
+    _results.clear();
+    _results.ensureCapacity(texts.size());
+
+    for (int i = 0; i < texts.size(); ++i)
+        _results.addLast(ReplaceResult());
+
+    for (int i = 0; i < texts.size(); ++i)
+        _threadPool.submit(createUnique<TextReplaceTask>(*this, *texts[i], _results[i]), &_group);
+}
+
+bool TextReplace::wait(int timeout)
+{
+    return _group.wait(timeout);
+}
+
+void TextReplace::replaceAll(const String& text, const String& searchStr, const String& replaceStr,
+                             bool caseSensitive, bool countOnly, ReplaceResult& result)
+{
+    ASSERT(!searchStr.empty());
+
+    result.numMatches = 0;
+    result.line = result.column = 0;
+    result.text.clear();
+
+    int p = 0, start = 0;
+
+    while ((p = text.find(searchStr, caseSensitive, p)) != INVALID_POSITION)
+    {
+        if (result.numMatches++ == 0)
+        {
+            result.line = result.column = 1;
+
+            for (int q = 0; q < p; q = text.charForward(q))
+            {
+                if (text.chars()[q] == '\n')
+                {
+                    ++result.line;
+                    result.column = 1;
+                }
+                else
+                    ++result.column;
+            }
+
+            if (!countOnly)
+                result.text.ensureCapacity(text.length() + 1);
+        }
+
+        if (!countOnly)
+        {
+            result.text.append(text.chars() + start, p - start);
+            result.text.append(replaceStr);
+        }
+
+        p += searchStr.length();
+        start = p;
+
+        if (p >= text.length())
+            break;
+    }
+
+    if (!countOnly && result.numMatches > 0)
+        result.text.append(text.chars() + start, text.length() - start);
+}
+
+// MatchCountTask
+
+class MatchCountTask : public Task
+{
+public:
+    MatchCountTask(MatchCounter& counter) : _counter(counter)
+    {
+    }
+
+    void run() override
+    {
+        _counter.countMatches();
+    }
+
+protected:
+    MatchCounter& _counter;
+};
+
+// MatchCounter
+
+MatchCounter::MatchCounter(ThreadPool& threadPool) :
+    _threadPool(threadPool), _caseSensitive(true), _countedEnd(0), _textLength(-1), _chunkStart(0), _chunkEnd(0),
+    _counting(false)
+{
+}
+
+MatchCounter::~MatchCounter()
+{
+    cancel();
+}
+
+void MatchCounter::start(const String& searchStr, bool caseSensitive)
+{
+    ASSERT(!searchStr.empty());
+
+    cancel();
+
+    _searchStr = searchStr;
+    _caseSensitive = caseSensitive;
+}
+
+void MatchCounter::textChanged(int pos)
+{
+    ASSERT(pos >= 0);
+
+    // matches that end before the changed text stay, counting resumes from there
+
+    stopTask();
+
+    if (pos < _countedEnd)
+        _countedEnd = pos;
+
+    while (!_positions.empty() && _positions.last() + _searchStr.length() > _countedEnd)
+        _positions.removeLast();
+
+    _textLength = -1;
+}
+
+void MatchCounter::count(const String& text)
+{
+    ASSERT(!_searchStr.empty());
+
+    if (_counting)
+    {
+        if (_group.pending() > 0)
+            return;
+
+        _counting = false;
+
+        for (int i = 0; i < _chunkPositions.size(); ++i)
+            _positions.addLast(_chunkStart + _chunkPositions[i]);
+
+        _countedEnd = _chunkEnd;
+    }
+
+    _textLength = text.length();
+
+    if (_countedEnd > _textLength)
+        textChanged(_textLength);
+
+    if (_countedEnd == _textLength)
+        return;
+
+    // the chunk is copied here, between keystrokes, so it is kept small enough to take no noticeable time,
+    // it starts early enough to find the matches that cross the end of the counted text
+
+    int start = _countedEnd - _searchStr.length() + 1 > 0 ? _countedEnd - _searchStr.length() + 1 : 0;
+    int end = _textLength - _countedEnd > MATCH_COUNT_CHUNK_SIZE ? _countedEnd + MATCH_COUNT_CHUNK_SIZE : _textLength;
+
+    _chunk = String(text.chars() + start, end - start);
+    _chunkStart = start;
+    _chunkEnd = end;
+    _counting = true;
+
+    _threadPool.submit(createUnique<MatchCountTask>(*this), &_group);
+}
+
+void MatchCounter::cancel()
+{
+    stopTask();
+
+    _positions.clear();
+    _countedEnd = 0;
+    _textLength = -1;
+}
+
+void MatchCounter::stopTask()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    _counting = false;
+    _chunkPositions.clear();
+}
+
+int MatchCounter::matchIndex(int pos) const
+{
+    ASSERT(done());
+
+    int low = 0, high = _positions.size() - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (_positions[middle] < pos)
+            low = middle + 1;
+        else if (_positions[middle] > pos)
+            high = middle - 1;
+        else
+            return middle;
+    }
+
+    return INVALID_POSITION;
+}
+
+void MatchCounter::findMatches(const String& text, const String& searchStr, bool caseSensitive,
+                               Array<int>& positions, const TaskGroup* group)
+{
+    ASSERT(!searchStr.empty());
+
+    // overlapping matches are counted because find next moves one character forward
+
+    const int CANCEL_CHECK_INTERVAL = 65536;
+
+    positions.clear();
+
+    const char_t* chars = text.chars();
+    const char_t* searchChars = searchStr.chars();
+    int len = searchStr.length();
+
+    char_t first = searchChars[0], firstUpper = first;
+    if (!caseSensitive && first >= 'a' && first <= 'z')
+        firstUpper = first - ('a' - 'A');
+    else if (!caseSensitive && first >= 'A' && first <= 'Z')
+        first += 'a' - 'A';
+
+    bool asciiFirst = static_cast<uint32_t>(first) < 0x80;
+
+    for (int p = 0; p + len <= text.length(); ++p)
+    {
+        if (group && p % CANCEL_CHECK_INTERVAL == 0 && group->cancelled())
+            return;
+
+        if (caseSensitive)
+        {
+            if (chars[p] == first && strCompareLen(chars + p, searchChars, len) == 0)
+                positions.addLast(p);
+        }
+        else if (!asciiFirst || chars[p] == first || chars[p] == firstUpper)
+        {
+            if (strCompareLenNoCase(chars + p, searchChars, len) == 0)
+                positions.addLast(p);
+        }
+    }
+}
+
+void MatchCounter::countMatches()
+{
+    findMatches(_chunk, _searchStr, _caseSensitive, _chunkPositions, &_group);
+}
+
+// IndexHeader
+
+const char INDEX_MAGIC[4] = { 'E', 'V', 'T', 'I' };
+const uint32_t INDEX_VERSION = 1;
+const char_t* INDEX_FILENAME = STR(".evindex");
+const int64_t MAX_INDEXED_FILE_SIZE = 8 * 1024 * 1024;
+
+struct IndexHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numFiles;
+    uint32_t numTrigrams;
+    uint64_t postingsOffset;
+    uint64_t filesOffset;
+};
+
+// IndexTrigram
+
+struct IndexTrigram
+{
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t offset;
+};
+
+static void uniqueSorted(Array<int>& values)
+{
+    int n = 0;
+
+    for (int i = 0; i < values.size(); ++i)
+        if (n == 0 || values[n - 1] != values[i])
+            values[n++] = values[i];
+
+    values.resize(n);
+}
+
+static bool containsTrigram(const Array<uint32_t>& trigrams, uint32_t trigram)
+{
+    int low = 0, high = trigrams.size() - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+
+        if (trigrams[middle] < trigram)
+            low = middle + 1;
+        else if (trigrams[middle] > trigram)
+            high = middle - 1;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+static void appendBytes(Array<byte_t>& buffer, const void* data, int size)
+{
+    for (int i = 0; i < size; ++i)
+        buffer.addLast(reinterpret_cast<const byte_t*>(data)[i]);
+}
+
+// IndexRefreshTask
+
+class IndexRefreshTask : public Task
+{
+public:
+    IndexRefreshTask(TrigramIndex& index) : _index(index)
+    {
+    }
+
+    void run() override
+    {
+        _index.refresh();
+    }
+
+protected:
+    TrigramIndex& _index;
+};
+
+// IndexFilesTask
+
+class IndexFilesTask : public Task
+{
+public:
+    IndexFilesTask(TrigramIndex& index, Array<int>&& ids, Array<String>&& names) :
+        _index(index), _ids(static_cast<Array<int>&&>(ids)), _names(static_cast<Array<String>&&>(names))
+    {
+    }
+
+    void run() override
+    {
+        _index.indexFiles(_ids, _names);
+    }
+
+protected:
+    TrigramIndex& _index;
+    Array<int> _ids;
+    Array<String> _names;
+};
+
+// IndexUpdateTask
+
+class IndexUpdateTask : public Task
+{
+public:
+    IndexUpdateTask(TrigramIndex& index, const String& name) : _index(index), _name(name)
+    {
+    }
+
+    void run() override
+    {
+        _index.updateIndexedFile(_name);
+    }
+
+protected:
+    TrigramIndex& _index;
+    String _name;
+};
+
+// TrigramIndex
+
+TrigramIndex::TrigramIndex(ThreadPool& threadPool) :
+    _threadPool(threadPool), _trigramTable(nullptr), _postings(nullptr), _postingsEnd(nullptr), _numTrigrams(0),
+    _ready(0), _remainingTasks(0)
+{
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    close();
+}
+
+int TrigramIndex::numFiles() const
+{
+    Lock lock(_mutex);
+    int n = 0;
+
+    for (int i = 0; i < _files.size(); ++i)
+        if (!_files[i].removed)
+            ++n;
+
+    return n;
+}
+
+void TrigramIndex::open(const String& directory, const Array<String>& ignoredDirectories)
+{
+    close();
+
+    _directory = directory;
+    _indexFilename = joinPath(directory, INDEX_FILENAME);
+    _ignoredDirectories = ignoredDirectories;
+
+    {
+        Lock lock(_mutex);
+        mapIndex();
+    }
+
+    // the index is used only after it is brought up to date with the directory
+
+    _threadPool.submit(createUnique<IndexRefreshTask>(*this), &_group);
+}
+
+void TrigramIndex::close()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    Lock lock(_mutex);
+
+    if (ready() && !_updatedFiles.empty())
+        writeIndex();
+
+    _ready.store(0);
+    _mappedFile.close();
+    _trigramTable = _postings = _postingsEnd = nullptr;
+    _numTrigrams = 0;
+
+    _files.clear();
+    _fileIds.clear();
+    _newPostings.clear();
+    _updatedFiles.clear();
+}
+
+void TrigramIndex::updateFile(const String& filename)
+{
+    ASSERT(!filename.empty());
+
+    String name = filename;
+    while (name.startsWith(STR("./")))
+        name.erase(0, 2);
+
+    _threadPool.submit(createUnique<IndexUpdateTask>(*this, name), &_group);
+}
+
+bool TrigramIndex::findCandidates(const String& searchStr, Array<String>& filenames)
+{
+    filenames.clear();
+
+    if (!ready())
+        return false;
+
+    ByteBuffer pattern = stringToUtf8(searchStr);
+    Array<uint32_t> trigrams;
+    extractTrigrams(pattern.values(), pattern.size(), trigrams);
+
+    if (trigrams.empty())
+        return false;
+
+    Lock lock(_mutex);
+    Array<int> candidates, ids, common;
+
+    for (int i = 0; i < trigrams.size(); ++i)
+    {
+        diskPostings(trigrams[i], ids);
+
+        // disk postings of changed files are replaced by their updated trigrams
+
+        int n = 0;
+        for (int j = 0; j < ids.size(); ++j)
+            if (ids[j] < _files.size() && !_files[ids[j]].stale && !_files[ids[j]].removed)
+                ids[n++] = ids[j];
+
+        ids.resize(n);
+
+        for (int j = 0; j < _updatedFiles.size(); ++j)
+            if (containsTrigram(_updatedFiles[j].trigrams, trigrams[i]))
+                ids.addLast(_updatedFiles[j].id);
+
+        ids.sort();
+        uniqueSorted(ids);
+
+        if (i == 0)
+            swap(candidates, ids);
+        else
+        {
+            common.clear();
+
+            for (int p = 0, q = 0; p < candidates.size() && q < ids.size();)
+            {
+                if (candidates[p] < ids[q])
+                    ++p;
+                else if (candidates[p] > ids[q])
+                    ++q;
+                else
+                {
+                    common.addLast(candidates[p]);
+                    ++p;
+                    ++q;
+                }
+            }
+
+            swap(candidates, common);
+        }
+
+        if (candidates.empty())
+            break;
+    }
+
+    for (int i = 0; i < candidates.size(); ++i)
+        if (!_files[candidates[i]].removed)
+            filenames.addLast(joinPath(_directory, _files[candidates[i]].name));
+
+    // files too large to be indexed are always searched
+
+    for (int i = 0; i < _files.size(); ++i)
+        if (_files[i].unindexed && !_files[i].removed)
+            filenames.addLast(joinPath(_directory, _files[i].name));
+
+    return true;
+}
+
+void TrigramIndex::extractTrigrams(const byte_t* data, int64_t size, Array<uint32_t>& trigrams)
+{
+    ASSERT(data ? size >= 0 : size == 0);
+
+    // trigrams are case folded so that one index serves both case sensitive and insensitive search
+
+    trigrams.clear();
+
+    for (int64_t i = 0; i + 2 < size; ++i)
+    {
+        byte_t b0 = data[i], b1 = data[i + 1], b2 = data[i + 2];
+
+        if (b0 == '\n' || b1 == '\n' || b2 == '\n')
+            continue;
+
+        trigrams.addLast(static_cast<uint32_t>(foldByte(b0)) << 16 |
+                         static_cast<uint32_t>(foldByte(b1)) << 8 | foldByte(b2));
+    }
+
+    trigrams.sort();
+
+    int n = 0;
+    for (int i = 0; i < trigrams.size(); ++i)
+        if (n == 0 || trigrams[n - 1] != trigrams[i])
+            trigrams[n++] = trigrams[i];
+
+    trigrams.resize(n);
+}
+
+void TrigramIndex::encodePostings(const Array<int>& ids, Array<byte_t>& buffer)
+{
+    // sorted ids are stored as variable length deltas, 7 bits per byte
+
+    int prev = -1;
+
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        ASSERT(ids[i] > prev);
+
+        uint32_t delta = ids[i] - prev;
+        prev = ids[i];
+
+        while (delta >= 0x80)
+        {
+            buffer.addLast(static_cast<byte_t>(delta | 0x80));
+            delta >>= 7;
+        }
+
+        buffer.addLast(static_cast<byte_t>(delta));
+    }
+}
+
+const byte_t* TrigramIndex::decodePostings(const byte_t* data, const byte_t* end, int count, Array<int>& ids)
+{
+    ASSERT(data <= end);
+    ASSERT(count >= 0);
+
+    int prev = -1;
+
+    for (int i = 0; i < count; ++i)
+    {
+        uint32_t delta = 0;
+        int shift = 0;
+
+        while (true)
+        {
+            if (data >= end || shift > 28)
+                return nullptr;
+
+            byte_t b = *data++;
+            delta |= static_cast<uint32_t>(b & 0x7f) << shift;
+            shift += 7;
+
+            if (!(b & 0x80))
+                break;
+        }
+
+        prev += delta;
+        ids.addLast(prev);
+    }
+
+    return data;
+}
+
+bool TrigramIndex::mapIndex()
+{
+    _mappedFile.close();
+    _trigramTable = _postings = _postingsEnd = nullptr;
+    _numTrigrams = 0;
+
+    _files.clear();
+    _fileIds.clear();
+
+    try
+    {
+        if (!_mappedFile.open(_indexFilename))
+            return false;
+    }
+    catch (Exception&)
+    {
+        return false;
+    }
+
+    const byte_t* data = _mappedFile.data();
+    int64_t size = _mappedFile.size();
+    IndexHeader header;
+
+    if (size < static_cast<int64_t>(sizeof(header)))
+    {
+        _mappedFile.close();
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t tableEnd = sizeof(header) + static_cast<uint64_t>(header.numTrigrams) * sizeof(IndexTrigram);
+
+    if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION ||
+        tableEnd > header.postingsOffset || header.postingsOffset > header.filesOffset ||
+        header.filesOffset > static_cast<uint64_t>(size) || header.numFiles > INT_MAX)
+    {
+        _mappedFile.close();
+        return false;
+    }
+
+    const byte_t* p = data + header.filesOffset;
+    const byte_t* end = data + size;
+
+    for (uint32_t i = 0; i < header.numFiles; ++i)
+    {
+        IndexedFile file;
+        uint32_t len;
+
+        if (end - p < 13)
+            break;
+
+        memcpy(&file.modificationTime, p, 8);
+        file.unindexed = p[8] != 0;
+        memcpy(&len, p + 9, 4);
+        p += 13;
+
+        if (static_cast<uint64_t>(end - p) < len)
+            break;
+
+        TextEncoding encoding;
+        bool bom, crLf;
+
+        file.name = Unicode::bytesToString(len, p, encoding, bom, crLf);
+        p += len;
+
+        _fileIds.add(file.name, _files.size());
+        _files.addLast(static_cast<IndexedFile&&>(file));
+    }
+
+    // every posting list has to lie within the postings and take at least a byte per file,
+    // the trigrams have to be sorted to be searched
+
+    uint64_t postingsSize = header.filesOffset - header.postingsOffset;
+    uint32_t prevTrigram = 0;
+    bool valid = _files.size() == static_cast<int>(header.numFiles);
+
+    for (uint32_t i = 0; i < header.numTrigrams && valid; ++i)
+    {
+        IndexTrigram entry;
+        memcpy(&entry, data + sizeof(header) + static_cast<uint64_t>(i) * sizeof(IndexTrigram), sizeof(entry));
+
+        valid = entry.offset <= postingsSize && entry.count <= postingsSize - entry.offset &&
+                entry.count <= header.numFiles && (i == 0 || entry.trigram > prevTrigram);
+        prevTrigram = entry.trigram;
+    }
+
+    if (!valid)
+    {
+        _files.clear();
+        _fileIds.clear();
+        _mappedFile.close();
+        return false;
+    }
+
+    _trigramTable = data + sizeof(header);
+    _postings = data + header.postingsOffset;
+    _postingsEnd = data + header.filesOffset;
+    _numTrigrams = header.numTrigrams;
+
+    return true;
+}
+
+bool TrigramIndex::writeIndex()
+{
+    // removed files are dropped and the remaining ones renumbered
+
+    Array<int> newIds(_files.size());
+    int numFiles = 0;
+
+    for (int i = 0; i < _files.size(); ++i)
+        newIds[i] = _files[i].removed ? -1 : numFiles++;
+
+    Map<uint32_t, Array<int>> postings;
+    Array<int> ids;
+
+    for (int i = 0; i < _numTrigrams; ++i)
+    {
+        IndexTrigram entry;
+        memcpy(&entry, _trigramTable + i * sizeof(IndexTrigram), sizeof(entry));
+
+        ids.clear();
+        if (!decodePostings(_postings + entry.offset, _postingsEnd, entry.count, ids))
+            continue;
+
+        for (int j = 0; j < ids.size(); ++j)
+        {
+            int id = ids[j];
+
+            if (id < _files.size() && !_files[id].stale && newIds[id] >= 0)
+                postings[entry.trigram].addLast(newIds[id]);
+        }
+    }
+
+    auto it = _newPostings.constIterator();
+    while (it.moveNext())
+    {
+        const Array<int>& fileIds = it.value().value;
+
+        for (int j = 0; j < fileIds.size(); ++j)
+            if (newIds[fileIds[j]] >= 0)
+                postings[it.value().key].addLast(newIds[fileIds[j]]);
+    }
+
+    for (int i = 0; i < _updatedFiles.size(); ++i)
+    {
+        int id = newIds[_updatedFiles[i].id];
+
+        if (id >= 0)
+            for (int j = 0; j < _updatedFiles[i].trigrams.size(); ++j)
+                postings[_updatedFiles[i].trigrams[j]].addLast(id);
+    }
+
+    Array<uint32_t> trigrams;
+    trigrams.ensureCapacity(postings.size());
+
+    auto keys = postings.constIterator();
+    while (keys.moveNext())
+        trigrams.addLast(keys.value().key);
+
+    trigrams.sort();
+
+    // header, trigram table sorted by trigram, delta encoded postings and file table
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.numFiles = numFiles;
+    header.numTrigrams = trigrams.size();
+    header.postingsOffset = sizeof(header) + static_cast<uint64_t>(trigrams.size()) * sizeof(IndexTrigram);
+
+    Array<byte_t> table, data;
+    table.ensureCapacity(trigrams.size() * sizeof(IndexTrigram));
+
+    for (int i = 0; i < trigrams.size(); ++i)
+    {
+        Array<int>& fileIds = postings[trigrams[i]];
+        fileIds.sort();
+        uniqueSorted(fileIds);
+
+        IndexTrigram entry;
+        entry.trigram = trigrams[i];
+        entry.count = fileIds.size();
+        entry.offset = data.size();
+        appendBytes(table, &entry, sizeof(entry));
+
+        encodePostings(fileIds, data);
+    }
+
+    header.filesOffset = header.postingsOffset + data.size();
+
+    for (int i = 0; i < _files.size(); ++i)
+    {
+        if (newIds[i] >= 0)
+        {
+            ByteBuffer name = stringToUtf8(_files[i].name);
+            uint32_t len = name.size();
+            byte_t unindexed = _files[i].unindexed;
+
+            appendBytes(data, &_files[i].modificationTime, 8);
+            appendBytes(data, &unindexed, 1);
+            appendBytes(data, &len, 4);
+            appendBytes(data, name.values(), len);
+        }
+    }
+
+    _mappedFile.close();
+    _trigramTable = _postings = _postingsEnd = nullptr;
+    _numTrigrams = 0;
+
+    // the new file takes the place of the old one, so that a write cut short leaves the old index whole,
+    // the mapping is closed first since on Windows a mapped file cannot be replaced, while another session
+    // has it mapped the replace fails there and the old index stays
+
+    String tempFilename = _indexFilename + STR(".tmp");
+
+    try
+    {
+        {
+            File file(tempFilename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            file.write(sizeof(header), &header);
+            file.write(table.size(), table.values());
+            file.write(data.size(), data.values());
+        }
+
+        File::rename(tempFilename, _indexFilename);
+    }
+    catch (Exception&)
+    {
+        try
+        {
+            File::remove(tempFilename);
+        }
+        catch (Exception&)
+        {
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void TrigramIndex::diskPostings(uint32_t trigram, Array<int>& ids) const
+{
+    ids.clear();
+
+    int low = 0, high = _numTrigrams - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        IndexTrigram entry;
+        memcpy(&entry, _trigramTable + middle * sizeof(IndexTrigram), sizeof(entry));
+
+        if (entry.trigram < trigram)
+            low = middle + 1;
+        else if (entry.trigram > trigram)
+            high = middle - 1;
+        else
+        {
+            if (!decodePostings(_postings + entry.offset, _postingsEnd, entry.count, ids))
+                ids.clear();
+
+            return;
+        }
+    }
+}
+
+void TrigramIndex::refresh()
+{
+    Array<DirectoryEntry> found;
+    scanDirectory(String(), found);
+
+    if (_group.cancelled())
+        return;
+
+    Array<int> ids;
+    Array<String> names;
+
+    {
+        Lock lock(_mutex);
+        Array<bool> seen(_files.size(), false);
+
+        for (int i = 0; i < found.size(); ++i)
+        {
+            const DirectoryEntry& entry = found[i];
+            int* id = _fileIds.find(entry.name);
+
+            if (id)
+            {
+                seen[*id] = true;
+
+                if (_files[*id].modificationTime == entry.modificationTime)
+                    continue;
+
+                _files[*id].modificationTime = entry.modificationTime;
+                _files[*id].stale = true;
+                ids.addLast(*id);
+            }
+            else
+            {
+                IndexedFile file;
+                file.name = entry.name;
+                file.modificationTime = entry.modificationTime;
+                file.stale = true;
+
+                ids.addLast(_files.size());
+                _fileIds.add(entry.name, _files.size());
+                _files.addLast(static_cast<IndexedFile&&>(file));
+            }
+
+            names.addLast(entry.name);
+        }
+
+        for (int i = 0; i < seen.size(); ++i)
+            if (!seen[i])
+                _files[i].removed = true;
+    }
+
+    // the refresh task itself holds one count, the last finished task writes the index
+
+    _remainingTasks.store(1);
+
+    for (int i = 0; i < ids.size(); i += MAX_FILES_PER_TASK)
+    {
+        int n = ids.size() - i < MAX_FILES_PER_TASK ? ids.size() - i : MAX_FILES_PER_TASK;
+
+        _remainingTasks.increment();
+        _threadPool.submit(createUnique<IndexFilesTask>(*this, Array<int>(n, ids.values() + i),
+                                                        Array<String>(n, names.values() + i)), &_group);
+    }
+
+    taskDone();
+}
+
+void TrigramIndex::scanDirectory(const String& path, Array<DirectoryEntry>& files)
+{
+    Array<DirectoryEntry> entries;
+
+    try
+    {
+        entries = Directory::list(joinPath(_directory, path.empty() ? String(STR(".")) : path));
+    }
+    catch (Exception&)
+    {
+        return;
+    }
+
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (_group.cancelled())
+            return;
+
+        DirectoryEntry& entry = entries[i];
+
+        if (entry.directory)
+        {
+            if (!entry.link && !ignoreDirectory(entry.name, _ignoredDirectories))
+                scanDirectory(joinPath(path, entry.name), files);
+        }
+        else if (entry.size > 0 && !(path.empty() && entry.name == INDEX_FILENAME))
+        {
+            entry.name = joinPath(path, entry.name);
+            files.addLast(static_cast<DirectoryEntry&&>(entry));
+        }
+    }
+}
+
+void TrigramIndex::indexFiles(const Array<int>& ids, const Array<String>& names)
+{
+    ASSERT(ids.size() == names.size());
+
+    Map<uint32_t, Array<int>> postings;
+    Array<int> unindexed;
+    Array<uint32_t> trigrams;
+
+    for (int i = 0; i < ids.size() && !_group.cancelled(); ++i)
+    {
+        if (!indexFile(names[i], trigrams))
+            unindexed.addLast(ids[i]);
+
+        for (int j = 0; j < trigrams.size(); ++j)
+            postings[trigrams[j]].addLast(ids[i]);
+    }
+
+    {
+        Lock lock(_mutex);
+
+        auto it = postings.constIterator();
+        while (it.moveNext())
+        {
+            Array<int>& fileIds = _newPostings[it.value().key];
+
+            for (int j = 0; j < it.value().value.size(); ++j)
+                fileIds.addLast(it.value().value[j]);
+        }
+
+        for (int i = 0; i < unindexed.size(); ++i)
+            _files[unindexed[i]].unindexed = true;
+    }
+
+    taskDone();
+}
+
+void TrigramIndex::updateIndexedFile(const String& name)
+{
+    Array<uint32_t> trigrams;
+    int64_t modificationTime;
+    bool indexed;
+
+    try
+    {
+        modificationTime = File::modificationTime(joinPath(_directory, name));
+        indexed = indexFile(name, trigrams);
+    }
+    catch (Exception&)
+    {
+        return;
+    }
+
+    Lock lock(_mutex);
+
+    int* id = _fileIds.find(name);
+    int fileId;
+
+    if (id)
+        fileId = *id;
+    else
+    {
+        IndexedFile file;
+        file.name = name;
+
+        fileId = _files.size();
+        _fileIds.add(name, fileId);
+        _files.addLast(static_cast<IndexedFile&&>(file));
+    }
+
+    IndexedFile& file = _files[fileId];
+    file.modificationTime = modificationTime;
+    file.unindexed = !indexed;
+    file.stale = true;
+    file.removed = false;
+
+    for (int i = 0; i < _updatedFiles.size(); ++i)
+    {
+        if (_updatedFiles[i].id == fileId)
+        {
+            swap(_updatedFiles[i].trigrams, trigrams);
+            return;
+        }
+    }
+
+    UpdatedFile updatedFile;
+    updatedFile.id = fileId;
+    swap(updatedFile.trigrams, trigrams);
+    _updatedFiles.addLast(static_cast<UpdatedFile&&>(updatedFile));
+}
+
+bool TrigramIndex::indexFile(const String& name, Array<uint32_t>& trigrams)
+{
+    trigrams.clear();
+
+    MappedFile file;
+
+    if (!file.open(joinPath(_directory, name)) || file.size() == 0)
+        return true;
+
+    if (file.size() > MAX_INDEXED_FILE_SIZE)
+        return false;
+
+    const byte_t* data = file.data();
+
+    if (file.size() >= 2 && ((data[0] == 0xfe && data[1] == 0xff) || (data[0] == 0xff && data[1] == 0xfe)))
+    {
+        TextEncoding encoding;
+        bool bom, crLf;
+
+        ByteBuffer bytes = stringToUtf8(Unicode::bytesToString(file.size(), data, encoding, bom, crLf));
+        extractTrigrams(bytes.values(), bytes.size(), trigrams);
+    }
+    else if (!FileSearch::isBinary(data, file.size()))
+        extractTrigrams(data, file.size(), trigrams);
+
+    return true;
+}
+
+void TrigramIndex::taskDone()
+{
+    if (_remainingTasks.decrement() == 0 && !_group.cancelled())
+    {
+        Lock lock(_mutex);
+        bool changed = !_mappedFile.isOpen() || !_updatedFiles.empty();
+
+        for (int i = 0; i < _files.size() && !changed; ++i)
+            changed = _files[i].stale || _files[i].removed;
+
+        if (changed)
+        {
+            // the new trigrams are searched only in the written index, so when it cannot be written
+            // the index is left not ready and find in files searches all the files
+
+            bool written = writeIndex();
+
+            _newPostings.clear();
+            _updatedFiles.clear();
+
+            if (written && mapIndex())
+                _ready.store(1);
+        }
+        else
+            _ready.store(1);
+    }
+}
+
+// PathScanTask
+
+class PathScanTask : public Task
+{
+public:
+    PathScanTask(PathIndex& index, const String& path, bool full) : _index(index), _path(path), _full(full)
+    {
+    }
+
+    void run() override
+    {
+        _index.scanDirectory(_path, _full);
+    }
+
+protected:
+    PathIndex& _index;
+    String _path;
+    bool _full;
+};
+
+static inline char_t foldPathChar(char_t ch)
+{
+    if (ch >= 'A' && ch <= 'Z')
+        return ch + ('a' - 'A');
+    else if (ch == '\\')
+        return '/';
+    else
+        return ch;
+}
+
+static inline int pathMatchBonus(const char_t* path, int i)
+{
+    if (i == 0 || path[i - 1] == '/' || path[i - 1] == '\\')
+        return PATH_SEPARATOR_BONUS;
+
+    char_t prev = path[i - 1];
+
+    if (prev == '_' || prev == '-' || prev == '.' || prev == ' ' ||
+        (prev >= 'a' && prev <= 'z' && path[i] >= 'A' && path[i] <= 'Z'))
+        return PATH_BOUNDARY_BONUS;
+
+    return 0;
+}
+
+static int scorePathMatch(const char_t* pattern, int patternLength, const char_t* path, int start, int length)
+{
+    ASSERT(patternLength > 0);
+
+    // the first match going forward is narrowed to the shortest one ending at the same place,
+    // which is scored going back
+
+    int p = 0, end = start;
+    char_t ch = foldPathChar(pattern[0]);
+
+    for (int i = start; i < length; ++i)
+    {
+        if (foldPathChar(path[i]) == ch)
+        {
+            end = i;
+            if (++p == patternLength)
+                break;
+
+            ch = foldPathChar(pattern[p]);
+        }
+    }
+
+    if (p < patternLength)
+        return -1;
+
+    int score = 0, next = -1;
+
+    for (int i = end, q = patternLength - 1; q >= 0; --i)
+    {
+        if (foldPathChar(path[i]) == foldPathChar(pattern[q]))
+        {
+            score += PATH_MATCH_SCORE + pathMatchBonus(path, i);
+
+            if (next >= 0)
+            {
+                if (next == i + 1)
+                    score += PATH_CONSECUTIVE_BONUS;
+                else
+                    score -= next - i - 1 < PATH_MAX_GAP_PENALTY ? next - i - 1 : PATH_MAX_GAP_PENALTY;
+            }
+
+            next = i;
+            --q;
+        }
+    }
+
+    return score;
+}
+
+static int scorePath(const char_t* pattern, int patternLength, const char_t* path, int length, int name,
+                     bool matchName = true)
+{
+    // matches within the file name rank above those spread over directories, which are looked for only then
+
+    if (matchName)
+    {
+        int score = scorePathMatch(pattern, patternLength, path, name, length);
+
+        if (score >= 0)
+            return score + PATH_NAME_BONUS;
+    }
+
+    return name > 0 ? scorePathMatch(pattern, patternLength, path, 0, length) : -1;
+}
+
+static inline int pathNameStart(const String& path)
+{
+    int name = path.length();
+
+    while (name > 0 && path.chars()[name - 1] != '/' && path.chars()[name - 1] != '\\')
+        --name;
+
+    return name;
+}
+
+static inline bool betterPathMatch(const PathMatch& left, const PathMatch& right, const Array<String>& paths)
+{
+    if (left.score != right.score)
+        return left.score > right.score;
+
+    const String& leftPath = paths[left.id];
+    const String& rightPath = paths[right.id];
+
+    if (leftPath.length() != rightPath.length())
+        return leftPath.length() < rightPath.length();
+
+    return leftPath < rightPath;
+}
+
+// PathIndex
+
+PathIndex::PathIndex(ThreadPool& threadPool) :
+    _threadPool(threadPool), _generation(0), _version(0), _matchedVersion(-1),
+#ifdef PLATFORM_LINUX
+    _notifyHandle(-1),
+#endif
+    _ready(0), _remainingTasks(0)
+{
+}
+
+PathIndex::~PathIndex()
+{
+    close();
+}
+
+int PathIndex::numPaths() const
+{
+    Lock lock(_mutex);
+    return _paths.size();
+}
+
+int PathIndex::version() const
+{
+    Lock lock(_mutex);
+    return _version;
+}
+
+void PathIndex::open(const String& directory, const Array<String>& ignoredDirectories)
+{
+    close();
+
+    _directory = directory;
+    _ignoredDirectories = ignoredDirectories;
+
+#ifdef PLATFORM_LINUX
+    // directories are watched as they are scanned, so later changes are applied without rescanning
+
+    _notifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    rescan();
+}
+
+void PathIndex::close()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+#ifdef PLATFORM_LINUX
+    if (_notifyHandle >= 0)
+    {
+        ::close(_notifyHandle);
+        _notifyHandle = -1;
+    }
+
+    _watches.clear();
+#endif
+
+    Lock lock(_mutex);
+
+    _paths.clear();
+    _indexedPaths.clear();
+    _pathIds.clear();
+    _matchedIds.clear();
+    _matchedVersion = -1;
+    ++_version;
+
+    _ready.store(0);
+    _remainingTasks.store(0);
+}
+
+void PathIndex::refresh()
+{
+#ifdef PLATFORM_LINUX
+    if (_notifyHandle >= 0)
+    {
+        readEvents();
+        return;
+    }
+#endif
+
+    rescan();
+}
+
+bool PathIndex::wait(int timeout)
+{
+    return _group.wait(timeout);
+}
+
+void PathIndex::findPaths(const String& pattern, int maxPaths, Array<String>& paths)
+{
+    paths.clear();
+
+    // every path matching a subsequence already acts as a wildcard pattern, so explicit wildcards are dropped
+
+    String chars;
+
+    for (int i = 0; i < pattern.length(); ++i)
+        if (pattern.chars()[i] != '*' && pattern.chars()[i] != '?')
+            chars += pattern.chars()[i];
+
+    if (chars.empty() || maxPaths <= 0)
+        return;
+
+    uint64_t mask = charMask(chars.chars(), chars.length());
+    Array<PathMatch> matches;
+    Array<int> matchedIds;
+
+    Lock lock(_mutex);
+
+    // typing more of the pattern narrows down the previous matches, unless paths have changed since
+
+    bool narrowing = _matchedVersion == _version && chars.startsWith(_matchedPattern);
+    int numPaths = narrowing ? _matchedIds.size() : _paths.size();
+
+    for (int k = 0; k < numPaths; ++k)
+    {
+        int i = narrowing ? _matchedIds[k] : k;
+        const IndexedPath& indexedPath = _indexedPaths[i];
+
+        // paths lacking any character of the pattern are rejected without scoring
+
+        if ((indexedPath.mask & mask) != mask)
+            continue;
+
+        PathMatch match;
+        match.id = i;
+        match.score = scorePath(chars.chars(), chars.length(), _paths[i].chars(), _paths[i].length(),
+                                indexedPath.name, (indexedPath.nameMask & mask) == mask);
+
+        if (match.score < 0)
+            continue;
+
+        matchedIds.addLast(i);
+
+        if (matches.size() == maxPaths && !betterPathMatch(match, matches.last(), _paths))
+            continue;
+
+        if (matches.size() == maxPaths)
+            matches.removeLast();
+
+        int j = matches.size();
+        matches.addLast(match);
+
+        for (; j > 0 && betterPathMatch(match, matches[j - 1], _paths); --j)
+            matches[j] = matches[j - 1];
+
+        matches[j] = match;
+    }
+
+    _matchedPattern = chars;
+    swap(_matchedIds, matchedIds);
+    _matchedVersion = _version;
+
+    for (int i = 0; i < matches.size(); ++i)
+        paths.addLast(joinPath(_directory, _paths[matches[i].id]));
+}
+
+uint64_t PathIndex::charMask(const char_t* chars, int length)
+{
+    ASSERT(chars || length == 0);
+
+    uint64_t mask = 0;
+
+    for (int i = 0; i < length; ++i)
+        mask |= static_cast<uint64_t>(1) << (foldPathChar(chars[i]) & 63);
+
+    return mask;
+}
+
+int PathIndex::matchPath(const String& pattern, const String& path)
+{
+    if (pattern.empty())
+        return 0;
+
+    return scorePath(pattern.chars(), pattern.length(), path.chars(), path.length(), pathNameStart(path));
+}
+
+void PathIndex::rescan()
+{
+    // paths not seen again by the time the whole scan is done are removed
+
+    if (_remainingTasks.load() > 0)
+        return;
+
+    {
+        Lock lock(_mutex);
+        ++_generation;
+    }
+
+    _remainingTasks.store(1);
+    _threadPool.submit(createUnique<PathScanTask>(*this, String(), true), &_group);
+}
+
+void PathIndex::scanDirectory(const String& path, bool full)
+{
+    Array<DirectoryEntry> entries;
+    Array<String> names;
+
+#ifdef PLATFORM_LINUX
+    watchDirectory(path);
+#endif
+
+    try
+    {
+        entries = Directory::list(joinPath(_directory, path.empty() ? String(STR(".")) : path));
+    }
+    catch (Exception&)
+    {
+    }
+
+    for (int i = 0; i < entries.size() && !_group.cancelled(); ++i)
+    {
+        const DirectoryEntry& entry = entries[i];
+
+        if (entry.directory)
+        {
+            if (!entry.link && !ignoreDirectory(entry.name, _ignoredDirectories))
+            {
+                if (full)
+                    _remainingTasks.increment();
+
+                _threadPool.submit(createUnique<PathScanTask>(*this, joinPath(path, entry.name), full), &_group);
+            }
+        }
+        else if (!entry.name.startsWith(STR(".")))
+            names.addLast(joinPath(path, entry.name));
+    }
+
+    addPaths(names);
+
+    if (full)
+        scanDone();
+}
+
+void PathIndex::scanDone()
+{
+    if (_remainingTasks.decrement() == 0 && !_group.cancelled())
+    {
+        Lock lock(_mutex);
+
+        for (int i = _paths.size() - 1; i >= 0; --i)
+            if (_indexedPaths[i].generation != _generation)
+                removePathAt(i);
+
+        _ready.store(1);
+    }
+}
+
+void PathIndex::addPaths(const Array<String>& names)
+{
+    Lock lock(_mutex);
+
+    for (int i = 0; i < names.size(); ++i)
+    {
+        const int* id = _pathIds.find(names[i]);
+
+        if (id)
+            _indexedPaths[*id].generation = _generation;
+        else
+        {
+            IndexedPath indexedPath;
+            indexedPath.name = pathNameStart(names[i]);
+            indexedPath.mask = charMask(names[i].chars(), names[i].length());
+            indexedPath.nameMask = charMask(names[i].chars() + indexedPath.name, names[i].length() - indexedPath.name);
+            indexedPath.generation = _generation;
+
+            _pathIds.add(names[i], _paths.size());
+            _paths.addLast(names[i]);
+            _indexedPaths.addLast(indexedPath);
+            ++_version;
+        }
+    }
+}
+
+void PathIndex::removePath(const String& name)
+{
+    Lock lock(_mutex);
+    const int* id = _pathIds.find(name);
+
+    if (id)
+        removePathAt(*id);
+}
+
+void PathIndex::removePathAt(int id)
+{
+    ASSERT(id >= 0 && id < _paths.size());
+
+    // the last path takes the place of the removed one
+
+    int last = _paths.size() - 1;
+    _pathIds.remove(_paths[id]);
+
+    if (id < last)
+    {
+        _pathIds[_paths[last]] = id;
+        swap(_paths[id], _paths[last]);
+        _indexedPaths[id] = _indexedPaths[last];
+    }
+
+    _paths.removeLast();
+    _indexedPaths.removeLast();
+    ++_version;
+}
+
+void PathIndex::removeDirectory(const String& path)
+{
+    String prefix = joinPath(path, String());
+    Lock lock(_mutex);
+
+    for (int i = _paths.size() - 1; i >= 0; --i)
+        if (_paths[i].startsWith(prefix))
+            removePathAt(i);
+
+#ifdef PLATFORM_LINUX
+    Array<int> watches;
+
+    auto it = _watches.constIterator();
+    while (it.moveNext())
+        if (it.value().value == path || it.value().value.startsWith(prefix))
+            watches.addLast(it.value().key);
+
+    for (int i = 0; i < watches.size(); ++i)
+    {
+        inotify_rm_watch(_notifyHandle, watches[i]);
+        _watches.remove(watches[i]);
+    }
+#endif
+}
+
+#ifdef PLATFORM_LINUX
+
+void PathIndex::watchDirectory(const String& path)
+{
+    if (_notifyHandle < 0)
+        return;
+
+    int watch = inotify_add_watch(_notifyHandle, joinPath(_directory, path.empty() ? String(STR(".")) : path).chars(),
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+
+    // directories beyond the system limit on watches are still listed, only their changes are missed
+
+    if (watch >= 0)
+    {
+        Lock lock(_mutex);
+        _watches[watch] = path;
+    }
+}
+
+void PathIndex::readEvents()
+{
+    uint64_t buffer[2048];
+    bool overflow = false;
+    ssize_t size;
+
+    while ((size = ::read(_notifyHandle, buffer, sizeof(buffer))) > 0)
+    {
+        const char* p = reinterpret_cast<const char*>(buffer);
+        const char* end = p + size;
+
+        while (p < end)
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflow = true;
+                continue;
+            }
+
+            String path;
+
+            {
+                Lock lock(_mutex);
+                const String* directory = _watches.find(event->wd);
+
+                if (!directory)
+                    continue;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    _watches.remove(event->wd);
+                    continue;
+                }
+
+                path = *directory;
+            }
+
+            String name = reinterpret_cast<const char_t*>(event->name);
+
+            if (event->len == 0 || name.startsWith(STR(".")))
+                continue;
+
+            path = joinPath(path, name);
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    if (!ignoreDirectory(name, _ignoredDirectories))
+                        _threadPool.submit(createUnique<PathScanTask>(*this, path, false), &_group);
+                }
+                else
+                    removeDirectory(path);
+            }
+            else
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    Array<String> names;
+                    names.addLast(path);
+                    addPaths(names);
+                }
+                else
+                    removePath(path);
+            }
+        }
+    }
+
+    // events lost when the queue overflowed are made up for by scanning everything again
+
+    if (overflow)
+        rescan();
+}
+
+#endif
+
+// DirectoryCache
+
+void DirectoryCache::findCompletions(const String& path, int maxCompletions, Array<String>& completions)
+{
+    completions.clear();
+
+    int p = path.length();
+
+#ifdef PLATFORM_WINDOWS
+    while (p > 0 && path.chars()[p - 1] != '/' && path.chars()[p - 1] != '\\')
+#else
+    while (p > 0 && path.chars()[p - 1] != '/')
+#endif
+        --p;
+
+    String directory = path.substr(0, p);
+    String prefix = path.substr(p);
+
+    const CachedDirectory* cached = listDirectory(directory.empty() ? String(STR(".")) : directory);
+
+    if (!cached)
+        return;
+
+    // names are sorted, so those starting with the prefix follow its lower bound
+
+    const Array<String>& names = cached->names;
+    int low = 0, high = names.size();
+
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+
+        if (names[middle] < prefix)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    for (int i = low; i < names.size() && completions.size() < maxCompletions; ++i)
+    {
+        if (!prefix.empty() && !names[i].startsWith(prefix))
+            break;
+
+        if (!names[i].startsWith(STR(".")) || prefix.startsWith(STR(".")))
+            completions.addLast(directory + names[i]);
+    }
+}
+
+const CachedDirectory* DirectoryCache::listDirectory(const String& directory)
+{
+    // a listing is reused while the directory is not modified, one taken within the second of
+    // the last modification is not trusted as another change in that second would go unnoticed
+
+    int64_t modificationTime;
+
+    try
+    {
+        modificationTime = File::modificationTime(directory);
+    }
+    catch (Exception&)
+    {
+        _directories.remove(directory);
+        return nullptr;
+    }
+
+    CachedDirectory* cached = _directories.find(directory);
+
+    if (cached && cached->modificationTime == modificationTime && !cached->unconfirmed)
+        return cached;
+
+    int64_t listingTime = time(nullptr);
+    Array<DirectoryEntry> entries;
+
+    try
+    {
+        entries = Directory::list(directory);
+    }
+    catch (Exception&)
+    {
+        _directories.remove(directory);
+        return nullptr;
+    }
+
+    CachedDirectory& listing = _directories[directory];
+    listing.modificationTime = modificationTime;
+    listing.unconfirmed = modificationTime >= listingTime;
+    listing.names.clear();
+
+    // directories end with a separator, so a completed one can be followed by names inside it
+
+    for (int i = 0; i < entries.size(); ++i)
+    {
+#ifdef PLATFORM_WINDOWS
+        listing.names.addLast(entries[i].directory ? entries[i].name + STR("\\") : entries[i].name);
+#else
+        listing.names.addLast(entries[i].directory ? entries[i].name + STR("/") : entries[i].name);
+#endif
+    }
+
+    listing.names.sort();
+    return &listing;
+}
+
+// WordCounts
+
+int WordCounts::count(int word) const
+{
+    ASSERT(word >= 0);
+
+    if (_slots.empty())
+        return 0;
+
+    const WordSlot& slot = _slots[findSlot(word)];
+    return slot.word >= 0 ? slot.count : 0;
+}
+
+void WordCounts::addCount(int word, int delta)
+{
+    ASSERT(word >= 0);
+
+    if (delta == 0)
+        return;
+
+    if ((_size + 1) * 2 > _slots.size())
+        rehash(_slots.empty() ? 16 : _slots.size() * 2);
+
+    int slot = findSlot(word);
+
+    if (_slots[slot].word < 0)
+    {
+        _slots[slot].word = word;
+        _slots[slot].count = delta;
+        ++_size;
+    }
+    else if ((_slots[slot].count += delta) == 0)
+    {
+        // the entries following the removed one in its probe sequence are moved back to fill the hole
+
+        int mask = _slots.size() - 1;
+        int hole = slot;
+
+        for (int next = (hole + 1) & mask; _slots[next].word >= 0; next = (next + 1) & mask)
+        {
+            int home = homeSlot(_slots[next].word);
+
+            if (((next - home) & mask) >= ((next - hole) & mask))
+            {
+                _slots[hole] = _slots[next];
+                hole = next;
+            }
+        }
+
+        _slots[hole].word = -1;
+        --_size;
+    }
+}
+
+void WordCounts::clear()
+{
+    _slots.reset();
+    _size = 0;
+}
+
+int WordCounts::findSlot(int word) const
+{
+    int mask = _slots.size() - 1;
+    int slot = homeSlot(word);
+
+    while (_slots[slot].word >= 0 && _slots[slot].word != word)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+void WordCounts::rehash(int numSlots)
+{
+    ASSERT(numSlots > 0 && (numSlots & (numSlots - 1)) == 0);
+
+    Array<WordSlot> slots(numSlots, { -1, 0 });
+    swap(_slots, slots);
+
+    for (int i = 0; i < slots.size(); ++i)
+    {
+        if (slots[i].word >= 0)
+        {
+            int slot = findSlot(slots[i].word);
+            _slots[slot] = slots[i];
+        }
+    }
+}
+
+// SuggestionIndex
+
+SuggestionIndex::SuggestionIndex() : _freeNode(-1), _size(0)
+{
+    _nodes.addLast({ -1, -1, -1, 0, 0, 0, 0, false });
+}
+
+int SuggestionIndex::count(const String& word) const
+{
+    int node = findNode(word);
+    return node > 0 ? _nodes[node].count : 0;
+}
+
+void SuggestionIndex::addCount(const char_t* chars, int len, int delta)
+{
+    ASSERT(chars ? len >= 0 : len == 0);
+
+    int node = 0;
+
+    for (int i = 0; i < len; ++i)
+    {
+        int child = _nodes[node].firstChild;
+
+        while (child >= 0 && _nodes[child].ch != chars[i])
+            child = _nodes[child].next;
+
+        if (child < 0)
+        {
+            if (delta <= 0)
+                return;
+
+            child = addNode(node, chars[i]);
+        }
+
+        node = child;
+    }
+
+    if (node == 0)
+        return;
+
+    SuggestionNode& wordNode = _nodes[node];
+    int count = wordNode.count + delta > 0 ? wordNode.count + delta : 0;
+
+    if (wordNode.count == 0 && count > 0)
+        ++_size;
+    else if (wordNode.count > 0 && count == 0)
+        --_size;
+
+    wordNode.count = count;
+
+    if (count == 0)
+        wordNode.accepted = false;
+
+    updatePath(node);
+}
+
+void SuggestionIndex::accept(const String& word)
+{
+    int node = findNode(word);
+
+    if (node > 0 && _nodes[node].count > 0 && !_nodes[node].accepted)
+    {
+        _nodes[node].accepted = true;
+        updatePath(node);
+    }
+}
+
+bool SuggestionIndex::findSuggestions(const String& prefix, int maxSuggestions,
+                                      Array<AutocompleteSuggestion>& suggestions) const
+{
+    ASSERT(maxSuggestions > 0);
+
+    int start = findNode(prefix);
+
+    if (start <= 0)
+        return false;
+
+    // the heap holds subtrees and words in the order of their best ranks, a popped subtree
+    // adds its own word, its best child and its next sibling, so only the first suggestions are visited
+
+    Array<SuggestionEntry> heap;
+    pushEntry(heap, start, false);
+
+    while (!heap.empty())
+    {
+        if (suggestions.size() == maxSuggestions)
+            return true;
+
+        SuggestionEntry entry = popEntry(heap);
+        const SuggestionNode& node = _nodes[entry.node];
+
+        if (entry.word)
+        {
+            suggestions.addLast(AutocompleteSuggestion(nodeWord(entry.node), rank(entry.node)));
+            continue;
+        }
+
+        if (node.count > 0)
+            pushEntry(heap, entry.node, true);
+
+        if (node.firstChild >= 0)
+            pushEntry(heap, node.firstChild, false);
+
+        if (entry.node != start && node.next >= 0)
+            pushEntry(heap, node.next, false);
+    }
+
+    return false;
+}
+
+void SuggestionIndex::findWords(const String& prefix, Array<AutocompleteSuggestion>& suggestions) const
+{
+    int start = findNode(prefix);
+
+    if (start < 0)
+        return;
+
+    // all words under the prefix in no particular order, for when they are ordered only in part,
+    // an empty prefix gives all the words
+
+    Array<int> stack;
+    stack.addLast(start);
+
+    while (!stack.empty())
+    {
+        int node = stack.last();
+        stack.removeLast();
+
+        if (_nodes[node].count > 0)
+            suggestions.addLast(AutocompleteSuggestion(nodeWord(node), rank(node)));
+
+        for (int child = _nodes[node].firstChild; child >= 0; child = _nodes[child].next)
+            stack.addLast(child);
+    }
+}
+
+String SuggestionIndex::findCommonCompletion(const String& prefix) const
+{
+    int node = findNode(prefix);
+    String completion;
+
+    if (node <= 0)
+        return completion;
+
+    // the common part ends at the first word or where the words branch
+
+    while (_nodes[node].count == 0)
+    {
+        int child = _nodes[node].firstChild;
+
+        if (child < 0 || _nodes[child].next >= 0)
+            break;
+
+        completion.append(&_nodes[child].ch, 1);
+        node = child;
+    }
+
+    // the words are made of code units, so a branch can come in the middle of a character
+
+    int child = _nodes[node].firstChild;
+
+    if (_nodes[node].count == 0 && child >= 0 && continuationUnit(_nodes[child].ch))
+    {
+        int end = completion.length();
+
+        while (end > 0 && continuationUnit(completion.chars()[end - 1]))
+            --end;
+
+        completion.erase(end > 0 ? end - 1 : 0);
+    }
+
+    return completion;
+}
+
+int SuggestionIndex::findNode(const String& word) const
+{
+    const char_t* chars = word.chars();
+    int node = 0;
+
+    for (int i = 0; i < word.length() && node >= 0; ++i)
+    {
+        node = _nodes[node].firstChild;
+
+        while (node >= 0 && _nodes[node].ch != chars[i])
+            node = _nodes[node].next;
+    }
+
+    return node;
+}
+
+int SuggestionIndex::addNode(int parent, char_t ch)
+{
+    int node = _freeNode;
+
+    if (node >= 0)
+        _freeNode = _nodes[node].next;
+    else
+    {
+        node = _nodes.size();
+        _nodes.addLast(SuggestionNode());
+    }
+
+    SuggestionNode& newNode = _nodes[node];
+    newNode.parent = parent;
+    newNode.firstChild = -1;
+    newNode.next = -1;
+    newNode.count = 0;
+    newNode.best = 0;
+    newNode.depth = _nodes[parent].depth + 1;
+    newNode.ch = ch;
+    newNode.accepted = false;
+
+    linkNode(node);
+    return node;
+}
+
+void SuggestionIndex::freeNode(int node)
+{
+    _nodes[node].parent = -1;
+    _nodes[node].next = _freeNode;
+    _freeNode = node;
+}
+
+void SuggestionIndex::unlinkNode(int node)
+{
+    int parent = _nodes[node].parent;
+    int prev = -1, child = _nodes[parent].firstChild;
+
+    while (child != node)
+    {
+        prev = child;
+        child = _nodes[child].next;
+    }
+
+    if (prev >= 0)
+        _nodes[prev].next = _nodes[node].next;
+    else
+        _nodes[parent].firstChild = _nodes[node].next;
+
+    _nodes[node].next = -1;
+}
+
+void SuggestionIndex::linkNode(int node)
+{
+    // siblings go by best rank, then by character in reverse, which is the order of the suggestions
+
+    const SuggestionNode& newNode = _nodes[node];
+    int parent = newNode.parent;
+    int prev = -1, child = _nodes[parent].firstChild;
+
+    while (child >= 0 && (_nodes[child].best > newNode.best ||
+                          (_nodes[child].best == newNode.best &&
+                           unsignedUnit(_nodes[child].ch) > unsignedUnit(newNode.ch))))
+    {
+        prev = child;
+        child = _nodes[child].next;
+    }
+
+    _nodes[node].next = child;
+
+    if (prev >= 0)
+        _nodes[prev].next = node;
+    else
+        _nodes[parent].firstChild = node;
+}
+
+void SuggestionIndex::updatePath(int node)
+{
+    // nodes without words are removed, the others move to their new place among their siblings,
+    // ancestors are unaffected once the best rank of a subtree stays the same
+
+    while (node > 0)
+    {
+        SuggestionNode& pathNode = _nodes[node];
+        int parent = pathNode.parent;
+
+        if (pathNode.count == 0 && pathNode.firstChild < 0)
+        {
+            unlinkNode(node);
+            freeNode(node);
+        }
+        else
+        {
+            int first = pathNode.firstChild;
+            int best = first >= 0 && _nodes[first].best > rank(node) ? _nodes[first].best : rank(node);
+
+            if (best == pathNode.best)
+                break;
+
+            unlinkNode(node);
+            pathNode.best = best;
+            linkNode(node);
+        }
+
+        node = parent;
+    }
+}
+
+bool SuggestionIndex::entryBefore(const SuggestionEntry& left, const SuggestionEntry& right) const
+{
+    int leftRank = left.word ? rank(left.node) : _nodes[left.node].best;
+    int rightRank = right.word ? rank(right.node) : _nodes[right.node].best;
+
+    if (leftRank != rightRank)
+        return leftRank > rightRank;
+
+    // words of the same rank go in reverse order, a subtree stands for its prefix followed by the largest character
+
+    int x = left.node, y = right.node;
+    bool leftDeeper = false, rightDeeper = false;
+
+    while (_nodes[x].depth > _nodes[y].depth)
+    {
+        x = _nodes[x].parent;
+        leftDeeper = true;
+    }
+
+    while (_nodes[y].depth > _nodes[x].depth)
+    {
+        y = _nodes[y].parent;
+        rightDeeper = true;
+    }
+
+    if (x == y)
+        return leftDeeper ? right.word : !left.word && !rightDeeper;
+
+    while (_nodes[x].parent != _nodes[y].parent)
+    {
+        x = _nodes[x].parent;
+        y = _nodes[y].parent;
+    }
+
+    return unsignedUnit(_nodes[x].ch) > unsignedUnit(_nodes[y].ch);
+}
+
+void SuggestionIndex::pushEntry(Array<SuggestionEntry>& heap, int node, bool word) const
+{
+    heap.addLast({ node, word });
+
+    for (int i = heap.size() - 1; i > 0; )
+    {
+        int parent = (i - 1) / 2;
+
+        if (!entryBefore(heap[i], heap[parent]))
+            break;
+
+        swap(heap[i], heap[parent]);
+        i = parent;
+    }
+}
+
+SuggestionEntry SuggestionIndex::popEntry(Array<SuggestionEntry>& heap) const
+{
+    SuggestionEntry top = heap[0];
+    heap[0] = heap.last();
+    heap.removeLast();
+
+    for (int i = 0; ; )
+    {
+        int child = 2 * i + 1;
+
+        if (child >= heap.size())
+            break;
+
+        if (child + 1 < heap.size() && entryBefore(heap[child + 1], heap[child]))
+            ++child;
+
+        if (!entryBefore(heap[child], heap[i]))
+            break;
+
+        swap(heap[i], heap[child]);
+        i = child;
+    }
+
+    return top;
+}
+
+String SuggestionIndex::nodeWord(int node) const
+{
+    int len = _nodes[node].depth;
+    Buffer<char_t> chars(len);
+
+    for (int i = len - 1; i >= 0; --i)
+    {
+        chars[i] = _nodes[node].ch;
+        node = _nodes[node].parent;
+    }
+
+    return String(chars.values(), len);
+}
+
+// WordIndexHeader
+
+const char WORD_INDEX_MAGIC[4] = { 'E', 'V', 'W', 'I' };
+const uint32_t WORD_INDEX_VERSION = 2;
+const char_t* WORD_INDEX_FILENAME = STR(".evwords");
+const int64_t MAX_WORD_INDEXED_FILE_SIZE = 8 * 1024 * 1024;
+const int MAX_FILES_PER_WORD_TASK = 16;
+
+struct WordIndexHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numFiles;
+    uint32_t numWords;
+    uint32_t skippedTypes;
+    uint64_t charsOffset;
+    uint64_t wordsOffset;
+    uint64_t filesOffset;
+};
+
+// IndexWord
+
+struct IndexWord
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t count;
+};
+
+// SortedWord
+
+struct SortedWord
+{
+    String word;
+    int id;
+
+    friend bool operator<(const SortedWord& left, const SortedWord& right)
+    {
+        return left.word < right.word;
+    }
+};
+
+static void appendNumber(Array<byte_t>& buffer, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.addLast(static_cast<byte_t>(value | 0x80));
+        value >>= 7;
+    }
+
+    buffer.addLast(static_cast<byte_t>(value));
+}
+
+static const byte_t* readNumber(const byte_t* data, const byte_t* end, uint32_t& value)
+{
+    value = 0;
+
+    for (int shift = 0; shift <= 28; shift += 7)
+    {
+        if (data >= end)
+            return nullptr;
+
+        byte_t b = *data++;
+        value |= static_cast<uint32_t>(b & 0x7f) << shift;
+
+        if (!(b & 0x80))
+            return data;
+    }
+
+    return nullptr;
+}
+
+// WordIndexRefreshTask
+
+class WordIndexRefreshTask : public Task
+{
+public:
+    WordIndexRefreshTask(ProjectWordIndex& index) : _index(index)
+    {
+    }
+
+    void run() override
+    {
+        _index.refresh();
+    }
+
+protected:
+    ProjectWordIndex& _index;
+};
+
+// WordIndexFilesTask
+
+class WordIndexFilesTask : public Task
+{
+public:
+    WordIndexFilesTask(ProjectWordIndex& index, Array<int>&& ids, Array<String>&& names) :
+        _index(index), _ids(static_cast<Array<int>&&>(ids)), _names(static_cast<Array<String>&&>(names))
+    {
+    }
+
+    void run() override
+    {
+        _index.indexFiles(_ids, _names);
+    }
+
+protected:
+    ProjectWordIndex& _index;
+    Array<int> _ids;
+    Array<String> _names;
+};
+
+// ProjectWordIndex
+
+ProjectWordIndex::ProjectWordIndex(ThreadPool& threadPool) :
+    _threadPool(threadPool), _skippedTypes(0), _wordTable(nullptr), _chars(nullptr), _fileWords(nullptr),
+    _fileWordsEnd(nullptr), _numWords(0), _changed(false), _ready(0), _remainingTasks(0)
+{
+}
+
+ProjectWordIndex::~ProjectWordIndex()
+{
+    close();
+}
+
+void ProjectWordIndex::open(const String& directory, const Array<String>& ignoredDirectories, uint32_t skippedTypes)
+{
+    close();
+
+    _directory = directory;
+    _indexFilename = joinPath(directory, WORD_INDEX_FILENAME);
+    _ignoredDirectories = ignoredDirectories;
+    _skippedTypes = skippedTypes;
+
+    _threadPool.submit(createUnique<WordIndexRefreshTask>(*this), &_group);
+}
+
+void ProjectWordIndex::close()
+{
+    _group.cancel();
+    _group.wait();
+    _group.reset();
+
+    Lock lock(_mutex);
+
+    _ready.store(0);
+    _mappedFile.close();
+    _wordTable = _chars = _fileWords = _fileWordsEnd = nullptr;
+    _numWords = 0;
+
+    _files.clear();
+    _changed = false;
+    _words.clear();
+    _suggestionIndex = SuggestionIndex();
+}
+
+bool ProjectWordIndex::takeWords(SuggestionIndex& words)
+{
+    if (!ready())
+        return false;
+
+    Lock lock(_mutex);
+    words = static_cast<SuggestionIndex&&>(_suggestionIndex);
+    _suggestionIndex = SuggestionIndex();
+
+    return true;
+}
+
+void ProjectWordIndex::encodeWords(const Array<WordCount>& words, Array<byte_t>& buffer)
+{
+    // the number of words, then sorted ids as deltas each followed by its count, 7 bits per byte
+
+    appendNumber(buffer, words.size());
+    uint32_t prev = 0;
+
+    for (int i = 0; i < words.size(); ++i)
+    {
+        ASSERT(i == 0 || words[i].id > prev);
+
+        appendNumber(buffer, words[i].id - prev);
+        appendNumber(buffer, words[i].count);
+        prev = words[i].id;
+    }
+}
+
+const byte_t* ProjectWordIndex::decodeWords(const byte_t* data, const byte_t* end, Array<WordCount>& words)
+{
+    ASSERT(data <= end);
+
+    uint32_t n, id = 0;
+    data = readNumber(data, end, n);
+
+    for (uint32_t i = 0; data && i < n; ++i)
+    {
+        uint32_t delta, count;
+        data = readNumber(data, end, delta);
+
+        if (data)
+            data = readNumber(data, end, count);
+
+        if (data)
+        {
+            id += delta;
+            words.addLast({ id, count });
+        }
+    }
+
+    return data;
+}
+
+bool ProjectWordIndex::mapIndex()
+{
+    _mappedFile.close();
+    _wordTable = _chars = _fileWords = _fileWordsEnd = nullptr;
+    _numWords = 0;
+
+    _files.clear();
+
+    try
+    {
+        if (!_mappedFile.open(_indexFilename))
+            return false;
+    }
+    catch (Exception&)
+    {
+        return false;
+    }
+
+    const byte_t* data = _mappedFile.data();
+    int64_t size = _mappedFile.size();
+    WordIndexHeader header;
+
+    if (size < static_cast<int64_t>(sizeof(header)))
+    {
+        _mappedFile.close();
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t tableEnd = sizeof(header) + static_cast<uint64_t>(header.numWords) * sizeof(IndexWord);
+
+    if (memcmp(header.magic, WORD_INDEX_MAGIC, sizeof(WORD_INDEX_MAGIC)) != 0 ||
+        header.version != WORD_INDEX_VERSION || header.skippedTypes != _skippedTypes || tableEnd > header.charsOffset ||
+        header.charsOffset > header.wordsOffset || header.wordsOffset > header.filesOffset ||
+        header.filesOffset > static_cast<uint64_t>(size) || header.numFiles > INT_MAX || header.numWords > INT_MAX)
+    {
+        _mappedFile.close();
+        return false;
+    }
+
+    const byte_t* p = data + header.filesOffset;
+    const byte_t* end = data + size;
+
+    for (uint32_t i = 0; i < header.numFiles; ++i)
+    {
+        ProjectFile file;
+        uint32_t len;
+
+        if (end - p < 20)
+            break;
+
+        memcpy(&file.modificationTime, p, 8);
+        memcpy(&file.wordsOffset, p + 8, 8);
+        memcpy(&len, p + 16, 4);
+        p += 20;
+
+        if (static_cast<uint64_t>(end - p) < len)
+            break;
+
+        TextEncoding encoding;
+        bool bom, crLf;
+
+        file.name = Unicode::bytesToString(len, p, encoding, bom, crLf);
+        p += len;
+
+        _files.addLast(static_cast<ProjectFile&&>(file));
+    }
+
+    if (_files.size() != static_cast<int>(header.numFiles))
+    {
+        _files.clear();
+        _mappedFile.close();
+        return false;
+    }
+
+    _wordTable = data + sizeof(header);
+    _chars = data + header.charsOffset;
+    _fileWords = data + header.wordsOffset;
+    _fileWordsEnd = data + header.filesOffset;
+    _numWords = header.numWords;
+
+    return true;
+}
+
+void ProjectWordIndex::updateIndex()
+{
+    // the words of unchanged files are read from the mapped index and numbered together with the new ones
+
+    Array<int> diskIds(_numWords, -1);
+    Array<WordCount> words;
+
+    for (int i = 0; i < _files.size(); ++i)
+    {
+        ProjectFile& file = _files[i];
+
+        if (file.stale || file.wordsOffset > static_cast<uint64_t>(_fileWordsEnd - _fileWords))
+            continue;
+
+        words.clear();
+        if (!decodeWords(_fileWords + file.wordsOffset, _fileWordsEnd, words))
+            continue;
+
+        for (int j = 0; j < words.size(); ++j)
+        {
+            uint32_t diskId = words[j].id;
+
+            if (diskId >= static_cast<uint32_t>(_numWords))
+                continue;
+
+            if (diskIds[diskId] < 0)
+            {
+                String word = diskWord(diskId);
+
+                if (word.empty())
+                    continue;
+
+                diskIds[diskId] = _words.add(word);
+            }
+
+            file.words.addLast({ static_cast<uint32_t>(diskIds[diskId]), words[j].count });
+        }
+    }
+
+    Array<uint32_t> totals(_words.size(), 0u);
+
+    for (int i = 0; i < _files.size(); ++i)
+        for (int j = 0; j < _files[i].words.size(); ++j)
+            totals[_files[i].words[j].id] += _files[i].words[j].count;
+
+    Array<SortedWord> sorted;
+    sorted.ensureCapacity(_words.size());
+
+    for (int i = 0; i < _words.size(); ++i)
+        if (totals[i] > 0 && _words.length(i) > 0)
+            sorted.addLast({ _words.str(i), i });
+
+    sorted.sort();
+
+    Array<int> newIds(_words.size(), -1);
+
+    for (int i = 0; i < sorted.size(); ++i)
+    {
+        newIds[sorted[i].id] = i;
+        _suggestionIndex.addCount(sorted[i].word, totals[sorted[i].id] < INT_MAX ? totals[sorted[i].id] : INT_MAX);
+    }
+
+    // header, word table sorted by word, word bytes, word counts of each file and file table
+
+    WordIndexHeader header;
+    memcpy(header.magic, WORD_INDEX_MAGIC, sizeof(WORD_INDEX_MAGIC));
+    header.version = WORD_INDEX_VERSION;
+    header.skippedTypes = _skippedTypes;
+    header.numFiles = _files.size();
+    header.numWords = sorted.size();
+    header.charsOffset = sizeof(header) + static_cast<uint64_t>(sorted.size()) * sizeof(IndexWord);
+
+    Array<byte_t> table, chars, data;
+    table.ensureCapacity(sorted.size() * sizeof(IndexWord));
+
+    for (int i = 0; i < sorted.size(); ++i)
+    {
+        ByteBuffer bytes = stringToUtf8(sorted[i].word);
+
+        IndexWord entry;
+        entry.offset = chars.size();
+        entry.length = bytes.size();
+        entry.count = totals[sorted[i].id];
+        appendBytes(table, &entry, sizeof(entry));
+
+        appendBytes(chars, bytes.values(), bytes.size());
+    }
+
+    Array<uint64_t> offsets(_files.size());
+
+    for (int i = 0; i < _files.size(); ++i)
+    {
+        Array<WordCount>& fileWords = _files[i].words;
+
+        for (int j = 0; j < fileWords.size(); ++j)
+            fileWords[j].id = newIds[fileWords[j].id];
+
+        fileWords.sort();
+
+        offsets[i] = data.size();
+        encodeWords(fileWords, data);
+    }
+
+    header.wordsOffset = header.charsOffset + chars.size();
+    header.filesOffset = header.wordsOffset + data.size();
+
+    for (int i = 0; i < _files.size(); ++i)
+    {
+        ByteBuffer name = stringToUtf8(_files[i].name);
+        uint32_t len = name.size();
+
+        appendBytes(data, &_files[i].modificationTime, 8);
+        appendBytes(data, &offsets[i], 8);
+        appendBytes(data, &len, 4);
+        appendBytes(data, name.values(), len);
+    }
+
+    _mappedFile.close();
+    _wordTable = _chars = _fileWords = _fileWordsEnd = nullptr;
+    _numWords = 0;
+
+    // the new file takes the place of the old one, so that a write cut short leaves the old index whole,
+    // the mapping is closed first since on Windows a mapped file cannot be replaced, while another session
+    // has it mapped the replace fails there and the old index stays
+
+    String tempFilename = _indexFilename + STR(".tmp");
+
+    try
+    {
+        {
+            File file(tempFilename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            file.write(sizeof(header), &header);
+            file.write(table.size(), table.values());
+            file.write(chars.size(), chars.values());
+            file.write(data.size(), data.values());
+        }
+
+        File::rename(tempFilename, _indexFilename);
+    }
+    catch (Exception&)
+    {
+        try
+        {
+            File::remove(tempFilename);
+        }
+        catch (Exception&)
+        {
+        }
+    }
+}
+
+void ProjectWordIndex::loadWords()
+{
+    // nothing changed since the index was written, the suggestions come straight from the word table
+
+    for (int i = 0; i < _numWords && !_group.cancelled(); ++i)
+    {
+        IndexWord entry;
+        memcpy(&entry, _wordTable + i * sizeof(IndexWord), sizeof(entry));
+
+        String word = diskWord(i);
+
+        if (!word.empty() && entry.count > 0)
+            _suggestionIndex.addCount(word, entry.count < INT_MAX ? entry.count : INT_MAX);
+    }
+}
+
+String ProjectWordIndex::diskWord(int id) const
+{
+    ASSERT(id >= 0 && id < _numWords);
+
+    IndexWord entry;
+    memcpy(&entry, _wordTable + id * sizeof(IndexWord), sizeof(entry));
+
+    if (static_cast<uint64_t>(entry.offset) + entry.length > static_cast<uint64_t>(_fileWords - _chars))
+        return String();
+
+    TextEncoding encoding;
+    bool bom, crLf;
+
+    return Unicode::bytesToString(entry.length, _chars + entry.offset, encoding, bom, crLf);
+}
+
+void ProjectWordIndex::refresh()
+{
+    {
+        Lock lock(_mutex);
+        mapIndex();
+    }
+
+    Array<DirectoryEntry> found;
+    scanDirectory(String(), found);
+
+    if (_group.cancelled())
+        return;
+
+    Array<int> ids;
+    Array<String> names;
+
+    {
+        Lock lock(_mutex);
+        Map<String, int> fileIds;
+
+        for (int i = 0; i < _files.size(); ++i)
+            fileIds.add(_files[i].name, i);
+
+        // files with the same modification time keep their words in the mapped index
+
+        Array<ProjectFile> files;
+        files.ensureCapacity(found.size());
+
+        for (int i = 0; i < found.size(); ++i)
+        {
+            ProjectFile file;
+            file.name = found[i].name;
+            file.modificationTime = found[i].modificationTime;
+
+            int* id = fileIds.find(file.name);
+
+            if (id && _files[*id].modificationTime == file.modificationTime)
+                file.wordsOffset = _files[*id].wordsOffset;
+            else
+            {
+                file.stale = true;
+                ids.addLast(files.size());
+                names.addLast(file.name);
+            }
+
+            files.addLast(static_cast<ProjectFile&&>(file));
+        }
+
+        _changed = !_mappedFile.isOpen() || !ids.empty() || files.size() != _files.size();
+        swap(_files, files);
+    }
+
+    // the refresh task itself holds one count, the last finished task updates the index
+
+    _remainingTasks.store(1);
+
+    for (int i = 0; i < ids.size(); i += MAX_FILES_PER_WORD_TASK)
+    {
+        int n = ids.size() - i < MAX_FILES_PER_WORD_TASK ? ids.size() - i : MAX_FILES_PER_WORD_TASK;
+
+        _remainingTasks.increment();
+        _threadPool.submit(createUnique<WordIndexFilesTask>(*this, Array<int>(n, ids.values() + i),
+                                                            Array<String>(n, names.values() + i)), &_group);
+    }
+
+    taskDone();
+}
+
+void ProjectWordIndex::scanDirectory(const String& path, Array<DirectoryEntry>& files)
+{
+    Array<DirectoryEntry> entries;
+
+    try
+    {
+        entries = Directory::list(joinPath(_directory, path.empty() ? String(STR(".")) : path));
+    }
+    catch (Exception&)
+    {
+        return;
+    }
+
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (_group.cancelled())
+            return;
+
+        DirectoryEntry& entry = entries[i];
+
+        if (entry.directory)
+        {
+            if (!entry.link && !ignoreDirectory(entry.name, _ignoredDirectories))
+                scanDirectory(joinPath(path, entry.name), files);
+        }
+        else if (entry.size > 0 && entry.size <= MAX_WORD_INDEXED_FILE_SIZE)
+        {
+            if (indexed(entry.name))
+            {
+                entry.name = joinPath(path, entry.name);
+                files.addLast(static_cast<DirectoryEntry&&>(entry));
+            }
+        }
+    }
+}
+
+void ProjectWordIndex::indexFiles(const Array<int>& ids, const Array<String>& names)
+{
+    ASSERT(ids.size() == names.size());
+
+    Map<String, int> counts;
+
+    for (int i = 0; i < ids.size() && !_group.cancelled(); ++i)
+    {
+        counts.clear();
+        indexFile(names[i], counts);
+
+        Lock lock(_mutex);
+        Array<WordCount>& words = _files[ids[i]].words;
+
+        auto it = counts.constIterator();
+        while (it.moveNext())
+        {
+            int wordId = _words.add(it.value().key);
+            words.addLast({ static_cast<uint32_t>(wordId), static_cast<uint32_t>(it.value().value) });
+        }
+    }
+
+    taskDone();
+}
+
+void ProjectWordIndex::indexFile(const String& name, Map<String, int>& counts)
+{
+    MappedFile file;
+
+    if (!file.open(joinPath(_directory, name)) || file.size() == 0 || file.size() > MAX_WORD_INDEXED_FILE_SIZE)
+        return;
+
+    const byte_t* data = file.data();
+    bool utf16 = file.size() >= 2 && ((data[0] == 0xfe && data[1] == 0xff) || (data[0] == 0xff && data[1] == 0xfe));
+
+    if (!utf16 && FileSearch::isBinary(data, file.size()))
+        return;
+
+    TextEncoding encoding;
+    bool bom, crLf;
+
+    String text = Unicode::bytesToString(file.size(), data, encoding, bom, crLf);
+    countWords(name, text, counts);
+}
+
+void ProjectWordIndex::taskDone()
+{
+    if (_remainingTasks.decrement() == 0 && !_group.cancelled())
+    {
+        Lock lock(_mutex);
+
+        // the index file is written only if files changed, the mapping is dropped once the words are loaded
+
+        if (_changed)
+            updateIndex();
+        else
+            loadWords();
+
+        _mappedFile.close();
+        _wordTable = _chars = _fileWords = _fileWordsEnd = nullptr;
+        _numWords = 0;
+
+        _files.clear();
+        _words.clear();
+
+        _ready.store(1);
+    }
+}
+
+// VocabularyHeader
+
+const char VOCABULARY_MAGIC[4] = { 'E', 'V', 'V', 'O' };
+const uint32_t VOCABULARY_VERSION = 1;
+
+struct VocabularyHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numWords;
+    uint32_t charsSize;
+};
+
+static inline int compareBytes(const byte_t* left, int leftLength, const byte_t* right, int rightLength)
+{
+    int length = leftLength < rightLength ? leftLength : rightLength;
+    int rc = length > 0 ? memcmp(left, right, length) : 0;
+
+    return rc != 0 ? rc : leftLength - rightLength;
+}
+
+// VocabularyWord
+
+struct VocabularyWord
+{
+    ByteBuffer bytes;
+    uint32_t count;
+
+    friend bool operator<(const VocabularyWord& left, const VocabularyWord& right)
+    {
+        return compareBytes(left.bytes.values(), left.bytes.size(), right.bytes.values(), right.bytes.size()) < 0;
+    }
+};
+
+// VocabularyRank
+
+struct VocabularyRank
+{
+    uint32_t count;
+    int index;
+
+    friend bool operator<(const VocabularyRank& left, const VocabularyRank& right)
+    {
+        return left.count > right.count || (left.count == right.count && left.index < right.index);
+    }
+};
+
+// Vocabulary
+
+Vocabulary::Vocabulary() :
+    _wordTable(nullptr), _chars(nullptr), _charsSize(0), _numWords(0)
+{
+}
+
+bool Vocabulary::open(const String& filename)
+{
+    _filename = filename;
+    return mapFile();
+}
+
+void Vocabulary::close()
+{
+    _mappedFile.close();
+    _wordTable = _chars = nullptr;
+    _charsSize = 0;
+    _numWords = 0;
+}
+
+bool Vocabulary::save(const SuggestionIndex& words, int maxWords)
+{
+    ASSERT(maxWords > 0);
+
+    if (_filename.empty())
+        return false;
+
+    Array<AutocompleteSuggestion> newWords;
+    words.findWords(String(), newWords);
+
+    if (newWords.empty())
+        return true;
+
+    Array<VocabularyWord> sorted;
+    sorted.ensureCapacity(newWords.size());
+
+    for (int i = 0; i < newWords.size(); ++i)
+    {
+        // accepted words have the highest rank instead of their counts
+
+        const AutocompleteSuggestion& word = newWords[i];
+        int count = word.rank < INT_MAX ? word.rank : words.count(word.word);
+
+        sorted.addLast({ stringToUtf8(word.word), static_cast<uint32_t>(count) });
+    }
+
+    sorted.sort();
+
+    // the file is mapped again so that the words saved by the sessions that ended
+    // after this one started are kept too, the counts of the same words add up
+
+    mapFile();
+
+    Array<VocabularyWord> merged;
+    merged.ensureCapacity(_numWords + sorted.size());
+
+    int i = 0, j = 0;
+
+    while (i < _numWords || j < sorted.size())
+    {
+        int rc = i == _numWords ? 1 : j == sorted.size() ? -1 : compareWord(i, sorted[j].bytes, false);
+
+        if (rc < 0)
+        {
+            int length;
+            const byte_t* bytes = wordBytes(i, length);
+
+            if (length > 0)
+                merged.addLast({ ByteBuffer(length, bytes), static_cast<uint32_t>(wordCount(i)) });
+
+            ++i;
+        }
+        else
+        {
+            if (rc == 0)
+            {
+                uint64_t count = static_cast<uint64_t>(wordCount(i)) + sorted[j].count;
+                sorted[j].count = count < INT_MAX ? static_cast<uint32_t>(count) : INT_MAX - 1;
+                ++i;
+            }
+
+            merged.addLast(static_cast<VocabularyWord&&>(sorted[j]));
+            ++j;
+        }
+    }
+
+    if (merged.size() > maxWords)
+    {
+        // the counts are halved whenever words have to go, so that the words of the recent sessions
+        // can take the place of the ones that were frequent long ago, the least frequent words go
+
+        Array<VocabularyRank> ranks;
+        ranks.ensureCapacity(merged.size());
+
+        for (int k = 0; k < merged.size(); ++k)
+        {
+            merged[k].count = (merged[k].count + 1) / 2;
+            ranks.addLast({ merged[k].count, k });
+        }
+
+        ranks.select(0, ranks.size(), maxWords);
+
+        Array<bool> keep(merged.size(), false);
+
+        for (int k = 0; k < maxWords; ++k)
+            keep[ranks[k].index] = true;
+
+        int numWords = 0;
+
+        for (int k = 0; k < merged.size(); ++k)
+        {
+            if (keep[k])
+            {
+                if (numWords < k)
+                    merged[numWords] = static_cast<VocabularyWord&&>(merged[k]);
+
+                ++numWords;
+            }
+        }
+
+        while (merged.size() > numWords)
+            merged.removeLast();
+    }
+
+    // header, word table sorted by word bytes and word bytes
+
+    VocabularyHeader header;
+    memcpy(header.magic, VOCABULARY_MAGIC, sizeof(VOCABULARY_MAGIC));
+    header.version = VOCABULARY_VERSION;
+    header.numWords = merged.size();
+
+    Array<byte_t> table, chars;
+    table.ensureCapacity(merged.size() * sizeof(IndexWord));
+
+    for (int k = 0; k < merged.size(); ++k)
+    {
+        IndexWord entry;
+        entry.offset = chars.size();
+        entry.length = merged[k].bytes.size();
+        entry.count = merged[k].count;
+        appendBytes(table, &entry, sizeof(entry));
+
+        appendBytes(chars, merged[k].bytes.values(), merged[k].bytes.size());
+    }
+
+    header.charsSize = chars.size();
+
+    // the new file takes the place of the old one, so that the other sessions that have it mapped keep reading it,
+    // on Windows a mapped file cannot be replaced, so the replace fails while they do and the old file stays
+
+    String tempFilename = _filename + STR(".tmp");
+    close();
+
+    try
+    {
+        {
+            File file(tempFilename, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            file.write(sizeof(header), &header);
+            file.write(table.size(), table.values());
+            file.write(chars.size(), chars.values());
+        }
+
+        File::rename(tempFilename, _filename);
+    }
+    catch (Exception&)
+    {
+        try
+        {
+            File::remove(tempFilename);
+        }
+        catch (Exception&)
+        {
+        }
+
+        mapFile();
+        return false;
+    }
+
+    return mapFile();
+}
+
+int Vocabulary::count(const String& word) const
+{
+    ByteBuffer bytes = stringToUtf8(word);
+    int start, end;
+
+    // the word is the first one of those starting with it
+
+    findRange(bytes, start, end);
+
+    return start < end && compareWord(start, bytes, false) == 0 ? wordCount(start) : 0;
+}
+
+bool Vocabulary::findSuggestions(const String& prefix, int maxSuggestions,
+                                 Array<AutocompleteSuggestion>& suggestions) const
+{
+    ASSERT(maxSuggestions > 0);
+
+    int start, end;
+    findRange(stringToUtf8(prefix), start, end);
+
+    // only the counts are read to find the most frequent words, only those words are decoded
+
+    Array<VocabularyRank> ranks;
+    ranks.ensureCapacity(end - start);
+
+    for (int i = start; i < end; ++i)
+        ranks.addLast({ static_cast<uint32_t>(wordCount(i)), i });
+
+    int numWords = ranks.size();
+    bool more = numWords > maxSuggestions;
+
+    if (more)
+    {
+        ranks.select(0, numWords, maxSuggestions);
+        numWords = maxSuggestions;
+    }
+
+    for (int i = 0; i < numWords; ++i)
+    {
+        String str = word(ranks[i].index);
+
+        if (!str.empty())
+            suggestions.addLast(AutocompleteSuggestion(str, static_cast<int>(ranks[i].count)));
+    }
+
+    return more;
+}
+
+bool Vocabulary::findCommonCompletion(const String& prefix, String& completion) const
+{
+    int start, end;
+    findRange(stringToUtf8(prefix), start, end);
+
+    if (start == end)
+        return false;
+
+    // the first and the last words have the least in common, and the first one is the shortest
+
+    String first = word(start), last = word(end - 1);
+    int p = prefix.length();
+
+    while (p < first.length() && p < last.length() && first.charAt(p) == last.charAt(p))
+        p = first.charForward(p);
+
+    completion = p > prefix.length() ? first.substr(prefix.length(), p - prefix.length()) : String();
+    return true;
+}
+
+bool Vocabulary::mapFile()
+{
+    close();
+
+    try
+    {
+        if (!_mappedFile.open(_filename))
+            return false;
+    }
+    catch (Exception&)
+    {
+        return false;
+    }
+
+    const byte_t* data = _mappedFile.data();
+    int64_t size = _mappedFile.size();
+    VocabularyHeader header;
+
+    if (size < static_cast<int64_t>(sizeof(header)))
+    {
+        close();
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    uint64_t charsOffset = sizeof(header) + static_cast<uint64_t>(header.numWords) * sizeof(IndexWord);
+
+    if (memcmp(header.magic, VOCABULARY_MAGIC, sizeof(VOCABULARY_MAGIC)) != 0 ||
+        header.version != VOCABULARY_VERSION || header.numWords > INT_MAX ||
+        charsOffset + header.charsSize != static_cast<uint64_t>(size))
+    {
+        close();
+        return false;
+    }
+
+    _wordTable = data + sizeof(header);
+    _chars = data + charsOffset;
+    _charsSize = header.charsSize;
+    _numWords = header.numWords;
+
+    return true;
+}
+
+int Vocabulary::compareWord(int index, const ByteBuffer& word, bool prefix) const
+{
+    int length;
+    const byte_t* bytes = wordBytes(index, length);
+
+    if (prefix && length > word.size())
+        length = word.size();
+
+    return compareBytes(bytes, length, word.values(), word.size());
+}
+
+void Vocabulary::findRange(const ByteBuffer& prefix, int& start, int& end) const
+{
+    // the words starting with the prefix follow each other, their first and last ones are searched for
+
+    int low = 0, high = _numWords;
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (compareWord(mid, prefix, true) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    start = low;
+    high = _numWords;
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+
+        if (compareWord(mid, prefix, true) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    end = low;
+}
+
+const byte_t* Vocabulary::wordBytes(int index, int& length) const
+{
+    ASSERT(index >= 0 && index < _numWords);
+
+    IndexWord entry;
+    memcpy(&entry, _wordTable + index * sizeof(IndexWord), sizeof(entry));
+
+    // a damaged entry reads as an empty word
+
+    if (entry.offset > _charsSize || entry.length > _charsSize - entry.offset)
+    {
+        length = 0;
+        return _chars;
+    }
+
+    length = entry.length;
+    return _chars + entry.offset;
+}
+
+int Vocabulary::wordCount(int index) const
+{
+    ASSERT(index >= 0 && index < _numWords);
+
+    IndexWord entry;
+    memcpy(&entry, _wordTable + index * sizeof(IndexWord), sizeof(entry));
+
+    // the highest rank is left for the accepted words
+
+    return entry.count < INT_MAX ? entry.count : INT_MAX - 1;
+}
+
+String Vocabulary::word(int index) const
+{
+    int length;
+    const byte_t* bytes = wordBytes(index, length);
+
+    if (length == 0)
+        return String();
+
+    TextEncoding encoding;
+    bool bom, crLf;
+
+    return Unicode::bytesToString(length, bytes, encoding, bom, crLf);
+}
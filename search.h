@@ -0,0 +1,730 @@
+#ifndef SEARCH_INCLUDED
+#define SEARCH_INCLUDED
+
+#include <foundation.h>
+#include <file.h>
+#include <thread.h>
+
+bool ignoreDirectory(const String& name, const Array<String>& ignoredDirectories);
+String joinPath(const String& path, const String& name);
+ByteBuffer stringToUtf8(const String& str);
+
+// SearchMatch
+
+struct SearchMatch
+{
+    String filename;
+    int line;
+    int column;
+    String text;
+};
+
+// FileSearch
+
+class FileSearch
+{
+public:
+    FileSearch(ThreadPool& threadPool);
+
+    FileSearch(const FileSearch&) = delete;
+    FileSearch& operator=(const FileSearch&) = delete;
+
+    ~FileSearch();
+
+    bool running() const
+    {
+        return _group.pending() > 0;
+    }
+
+    int numFiles() const
+    {
+        return _numFiles.load();
+    }
+
+    int numMatches() const
+    {
+        return _numMatches.load();
+    }
+
+    void start(const String& directory, const String& searchStr, bool caseSensitive,
+               const Array<String>& ignoredDirectories);
+    void start(const Array<String>& filenames, const String& searchStr, bool caseSensitive);
+    void cancel();
+
+    bool takeMatches(Array<SearchMatch>& matches);
+
+    static bool isBinary(const byte_t* data, int64_t size);
+    static const byte_t* findBytes(const byte_t* start, const byte_t* end,
+                                   const ByteBuffer& pattern, bool caseSensitive);
+
+protected:
+    friend class DirectorySearchTask;
+    friend class FileSearchTask;
+
+    void prepare(const String& searchStr, bool caseSensitive);
+
+    void searchDirectory(const String& path);
+    void searchFiles(const Array<String>& filenames);
+    void searchFile(const String& filename, Array<SearchMatch>& matches);
+    void searchText(const String& filename, const String& text, Array<SearchMatch>& matches);
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _searchStr;
+    ByteBuffer _pattern;
+    bool _caseSensitive;
+    Array<String> _ignoredDirectories;
+
+    Mutex _mutex;
+    Array<SearchMatch> _matches;
+
+    Atomic<int> _numFiles;
+    Atomic<int> _numMatches;
+};
+
+// ReplaceResult
+
+struct ReplaceResult
+{
+    int numMatches = 0;
+    int line = 0, column = 0;
+    String text;
+};
+
+// TextReplace
+
+class TextReplace
+{
+public:
+    TextReplace(ThreadPool& threadPool) : _threadPool(threadPool), _caseSensitive(true), _countOnly(false)
+    {
+    }
+
+    TextReplace(const TextReplace&) = delete;
+    TextReplace& operator=(const TextReplace&) = delete;
+
+    int pending() const
+    {
+        return _group.pending();
+    }
+
+    const Array<ReplaceResult>& results() const
+    {
+        return _results;
+    }
+
+    Array<ReplaceResult>& results()
+    {
+        return _results;
+    }
+
+    void start(const Array<const String*>& texts, const String& searchStr, const String& replaceStr,
+               bool caseSensitive, bool countOnly);
+    bool wait(int timeout);
+
+    static void replaceAll(const String& text, const String& searchStr, const String& replaceStr,
+                           bool caseSensitive, bool countOnly, ReplaceResult& result);
+
+protected:
+    friend class TextReplaceTask;
+
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _searchStr, _replaceStr;
+    bool _caseSensitive;
+    bool _countOnly;
+    Array<ReplaceResult> _results;
+};
+
+// MatchCounter
+
+// counts matches in the background, the text is taken a bounded chunk at a time so that no keystroke waits
+// for a whole document to be copied, and after an edit the matches before it are kept
+
+class MatchCounter
+{
+public:
+    MatchCounter(ThreadPool& threadPool);
+
+    MatchCounter(const MatchCounter&) = delete;
+    MatchCounter& operator=(const MatchCounter&) = delete;
+
+    ~MatchCounter();
+
+    bool done() const
+    {
+        return _countedEnd == _textLength;
+    }
+
+    const String& searchStr() const
+    {
+        return _searchStr;
+    }
+
+    bool caseSensitive() const
+    {
+        return _caseSensitive;
+    }
+
+    int numMatches() const
+    {
+        ASSERT(done());
+        return _positions.size();
+    }
+
+    void start(const String& searchStr, bool caseSensitive);
+    void textChanged(int pos);
+    void count(const String& text);
+    void cancel();
+    int matchIndex(int pos) const;
+
+    static void findMatches(const String& text, const String& searchStr, bool caseSensitive,
+                            Array<int>& positions, const TaskGroup* group = nullptr);
+
+protected:
+    friend class MatchCountTask;
+
+    void countMatches();
+    void stopTask();
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _searchStr;
+    bool _caseSensitive;
+
+    Array<int> _positions;
+    int _countedEnd;
+    int _textLength;
+
+    String _chunk;
+    int _chunkStart, _chunkEnd;
+    Array<int> _chunkPositions;
+    bool _counting;
+};
+
+// IndexedFile
+
+struct IndexedFile
+{
+    String name;
+    int64_t modificationTime = 0;
+    bool unindexed = false;
+    bool stale = false;
+    bool removed = false;
+};
+
+// UpdatedFile
+
+struct UpdatedFile
+{
+    int id;
+    Array<uint32_t> trigrams;
+};
+
+// TrigramIndex
+
+class TrigramIndex
+{
+public:
+    TrigramIndex(ThreadPool& threadPool);
+
+    TrigramIndex(const TrigramIndex&) = delete;
+    TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+    ~TrigramIndex();
+
+    bool ready() const
+    {
+        return _ready.load() != 0;
+    }
+
+    int numFiles() const;
+
+    void open(const String& directory, const Array<String>& ignoredDirectories);
+    void close();
+
+    void updateFile(const String& filename);
+    bool findCandidates(const String& searchStr, Array<String>& filenames);
+
+    static void extractTrigrams(const byte_t* data, int64_t size, Array<uint32_t>& trigrams);
+    static void encodePostings(const Array<int>& ids, Array<byte_t>& buffer);
+    static const byte_t* decodePostings(const byte_t* data, const byte_t* end, int count, Array<int>& ids);
+
+protected:
+    friend class IndexRefreshTask;
+    friend class IndexFilesTask;
+    friend class IndexUpdateTask;
+
+    bool mapIndex();
+    bool writeIndex();
+    void diskPostings(uint32_t trigram, Array<int>& ids) const;
+
+    void refresh();
+    void scanDirectory(const String& path, Array<DirectoryEntry>& files);
+    void indexFiles(const Array<int>& ids, const Array<String>& names);
+    void updateIndexedFile(const String& name);
+    bool indexFile(const String& name, Array<uint32_t>& trigrams);
+    void taskDone();
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _directory;
+    String _indexFilename;
+    Array<String> _ignoredDirectories;
+
+    mutable Mutex _mutex;
+    MappedFile _mappedFile;
+    const byte_t* _trigramTable;
+    const byte_t* _postings;
+    const byte_t* _postingsEnd;
+    int _numTrigrams;
+
+    Array<IndexedFile> _files;
+    Map<String, int> _fileIds;
+    Map<uint32_t, Array<int>> _newPostings;
+    Array<UpdatedFile> _updatedFiles;
+
+    Atomic<int> _ready;
+    Atomic<int> _remainingTasks;
+};
+
+// IndexedPath
+
+struct IndexedPath
+{
+    uint64_t mask;
+    uint64_t nameMask;
+    int name;
+    int generation;
+};
+
+// PathMatch
+
+struct PathMatch
+{
+    int id;
+    int score;
+};
+
+// PathIndex
+
+class PathIndex
+{
+public:
+    PathIndex(ThreadPool& threadPool);
+
+    PathIndex(const PathIndex&) = delete;
+    PathIndex& operator=(const PathIndex&) = delete;
+
+    ~PathIndex();
+
+    bool ready() const
+    {
+        return _ready.load() != 0;
+    }
+
+    int numPaths() const;
+    int version() const;
+
+    void open(const String& directory, const Array<String>& ignoredDirectories);
+    void close();
+
+    void refresh();
+    bool wait(int timeout);
+    void findPaths(const String& pattern, int maxPaths, Array<String>& paths);
+
+    static uint64_t charMask(const char_t* chars, int length);
+    static int matchPath(const String& pattern, const String& path);
+
+protected:
+    friend class PathScanTask;
+
+    void rescan();
+    void scanDirectory(const String& path, bool full);
+    void scanDone();
+
+    void addPaths(const Array<String>& names);
+    void removePath(const String& name);
+    void removePathAt(int id);
+    void removeDirectory(const String& path);
+
+#ifdef PLATFORM_LINUX
+    void watchDirectory(const String& path);
+    void readEvents();
+#endif
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _directory;
+    Array<String> _ignoredDirectories;
+
+    mutable Mutex _mutex;
+    Array<String> _paths;
+    Array<IndexedPath> _indexedPaths;
+    Map<String, int> _pathIds;
+    int _generation;
+    int _version;
+
+    String _matchedPattern;
+    Array<int> _matchedIds;
+    int _matchedVersion;
+
+#ifdef PLATFORM_LINUX
+    int _notifyHandle;
+    Map<int, String> _watches;
+#endif
+
+    Atomic<int> _ready;
+    Atomic<int> _remainingTasks;
+};
+
+
+// CachedDirectory
+
+struct CachedDirectory
+{
+    int64_t modificationTime = 0;
+    bool unconfirmed = false;
+    Array<String> names;
+};
+
+// DirectoryCache
+
+class DirectoryCache
+{
+public:
+    DirectoryCache()
+    {
+    }
+
+    DirectoryCache(const DirectoryCache&) = delete;
+    DirectoryCache& operator=(const DirectoryCache&) = delete;
+
+    void clear()
+    {
+        _directories.clear();
+    }
+
+    void findCompletions(const String& path, int maxCompletions, Array<String>& completions);
+
+protected:
+    const CachedDirectory* listDirectory(const String& directory);
+
+protected:
+    Map<String, CachedDirectory> _directories;
+};
+
+// WordSlot
+
+struct WordSlot
+{
+    int word;
+    int count;
+};
+
+// WordCounts
+
+// counts of pooled words by their ids in an open addressed table, a word is removed when its count gets to zero
+
+class WordCounts
+{
+public:
+    WordCounts() : _size(0)
+    {
+    }
+
+    int size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    int numSlots() const
+    {
+        return _slots.size();
+    }
+
+    const WordSlot& slot(int index) const
+    {
+        return _slots[index];
+    }
+
+    int count(int word) const;
+    void addCount(int word, int delta);
+    void clear();
+
+protected:
+    int homeSlot(int word) const
+    {
+        uint32_t h = static_cast<uint32_t>(word) * 2654435769u;
+        return (h ^ h >> 16) & (_slots.size() - 1);
+    }
+
+    int findSlot(int word) const;
+    void rehash(int numSlots);
+
+protected:
+    Array<WordSlot> _slots;
+    int _size;
+};
+
+// AutocompleteSuggestion
+
+struct AutocompleteSuggestion
+{
+    String word;
+    int rank;
+
+    AutocompleteSuggestion(const String& word, int rank) : word(word), rank(rank)
+    {
+    }
+
+    friend void swap(AutocompleteSuggestion& left, AutocompleteSuggestion& right)
+    {
+        swap(left.word, right.word);
+        swap(left.rank, right.rank);
+    }
+
+    friend bool operator<(const AutocompleteSuggestion& left, const AutocompleteSuggestion& right)
+    {
+        if (left.rank > right.rank)
+            return true;
+        else if (left.rank == right.rank)
+            return left.word > right.word;
+        else
+            return false;
+    }
+};
+
+// SuggestionNode
+
+struct SuggestionNode
+{
+    int parent, firstChild, next;
+    int count, best;
+    int depth;
+    char_t ch;
+    bool accepted;
+};
+
+// SuggestionEntry
+
+struct SuggestionEntry
+{
+    int node;
+    bool word;
+};
+
+// SuggestionIndex
+
+// prefix tree of the autocomplete words, children are ordered by the best rank in their subtrees,
+// so that suggestions come out best first and finding the first ones does not visit the rest
+
+class SuggestionIndex
+{
+public:
+    SuggestionIndex();
+
+    int size() const
+    {
+        return _size;
+    }
+
+    int count(const String& word) const;
+    void addCount(const char_t* chars, int len, int delta);
+    void accept(const String& word);
+
+    void addCount(const String& word, int delta)
+    {
+        addCount(word.chars(), word.length(), delta);
+    }
+
+    bool containsPrefix(const String& prefix) const
+    {
+        return findNode(prefix) > 0;
+    }
+
+    bool findSuggestions(const String& prefix, int maxSuggestions, Array<AutocompleteSuggestion>& suggestions) const;
+    void findWords(const String& prefix, Array<AutocompleteSuggestion>& suggestions) const;
+    String findCommonCompletion(const String& prefix) const;
+
+protected:
+    int rank(int node) const
+    {
+        return _nodes[node].accepted ? INT_MAX : _nodes[node].count;
+    }
+
+    int findNode(const String& word) const;
+    int addNode(int parent, char_t ch);
+    void freeNode(int node);
+    void unlinkNode(int node);
+    void linkNode(int node);
+    void updatePath(int node);
+
+    bool entryBefore(const SuggestionEntry& left, const SuggestionEntry& right) const;
+    void pushEntry(Array<SuggestionEntry>& heap, int node, bool word) const;
+    SuggestionEntry popEntry(Array<SuggestionEntry>& heap) const;
+    String nodeWord(int node) const;
+
+protected:
+    Array<SuggestionNode> _nodes;
+    int _freeNode;
+    int _size;
+};
+
+// WordCount
+
+struct WordCount
+{
+    uint32_t id;
+    uint32_t count;
+
+    friend bool operator<(const WordCount& left, const WordCount& right)
+    {
+        return left.id < right.id;
+    }
+};
+
+// ProjectFile
+
+struct ProjectFile
+{
+    String name;
+    int64_t modificationTime = 0;
+    uint64_t wordsOffset = 0;
+    Array<WordCount> words;
+    bool stale = false;
+};
+
+// ProjectWordIndex
+
+// counts of the words in the files under the project directory kept in the .evwords file,
+// the words of each file are kept too so that only the changed files are tokenized again on refresh,
+// subclasses choose the files and split them into words
+
+class ProjectWordIndex
+{
+public:
+    ProjectWordIndex(ThreadPool& threadPool);
+
+    ProjectWordIndex(const ProjectWordIndex&) = delete;
+    ProjectWordIndex& operator=(const ProjectWordIndex&) = delete;
+
+    virtual ~ProjectWordIndex();
+
+    bool ready() const
+    {
+        return _ready.load() != 0;
+    }
+
+    void open(const String& directory, const Array<String>& ignoredDirectories, uint32_t skippedTypes);
+    void close();
+
+    bool takeWords(SuggestionIndex& words);
+
+    static void encodeWords(const Array<WordCount>& words, Array<byte_t>& buffer);
+    static const byte_t* decodeWords(const byte_t* data, const byte_t* end, Array<WordCount>& words);
+
+protected:
+    friend class WordIndexRefreshTask;
+    friend class WordIndexFilesTask;
+
+    // called on the thread pool, so a subclass has to close the index in its destructor
+
+    virtual bool indexed(const String& name) const = 0;
+    virtual void countWords(const String& name, const String& text, Map<String, int>& counts) const = 0;
+
+    bool mapIndex();
+    void updateIndex();
+    void loadWords();
+    String diskWord(int id) const;
+
+    void refresh();
+    void scanDirectory(const String& path, Array<DirectoryEntry>& files);
+    void indexFiles(const Array<int>& ids, const Array<String>& names);
+    void indexFile(const String& name, Map<String, int>& counts);
+    void taskDone();
+
+protected:
+    ThreadPool& _threadPool;
+    TaskGroup _group;
+
+    String _directory;
+    String _indexFilename;
+    Array<String> _ignoredDirectories;
+    uint32_t _skippedTypes;
+
+    Mutex _mutex;
+    MappedFile _mappedFile;
+    const byte_t* _wordTable;
+    const byte_t* _chars;
+    const byte_t* _fileWords;
+    const byte_t* _fileWordsEnd;
+    int _numWords;
+
+    Array<ProjectFile> _files;
+    bool _changed;
+    StringPool _words;
+    SuggestionIndex _suggestionIndex;
+
+    Atomic<int> _ready;
+    Atomic<int> _remainingTasks;
+};
+
+// Vocabulary
+
+// autocomplete words of the past sessions with their counts kept in a file in the user directory,
+// the words are sorted by their UTF-8 bytes so that the mapped file is searched as is
+
+class Vocabulary
+{
+public:
+    Vocabulary();
+
+    Vocabulary(const Vocabulary&) = delete;
+    Vocabulary& operator=(const Vocabulary&) = delete;
+
+    int size() const
+    {
+        return _numWords;
+    }
+
+    bool open(const String& filename);
+    void close();
+    bool save(const SuggestionIndex& words, int maxWords);
+
+    int count(const String& word) const;
+    bool findSuggestions(const String& prefix, int maxSuggestions, Array<AutocompleteSuggestion>& suggestions) const;
+    bool findCommonCompletion(const String& prefix, String& completion) const;
+
+protected:
+    bool mapFile();
+    int compareWord(int index, const ByteBuffer& word, bool prefix) const;
+    void findRange(const ByteBuffer& prefix, int& start, int& end) const;
+    const byte_t* wordBytes(int index, int& length) const;
+    int wordCount(int index) const;
+    String word(int index) const;
+
+protected:
+    String _filename;
+    MappedFile _mappedFile;
+    const byte_t* _wordTable;
+    const byte_t* _chars;
+    uint32_t _charsSize;
+    int _numWords;
+};
+
+#endif
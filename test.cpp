@@ -3767,6 +3767,88 @@ void testArray()
         ASSERT(compareArray(a, 10, sorted));
     }
 
+    // void sort(int start, int end)
+
+    {
+        int elems[] = { 97, 80, 51, 53, 38, 44, 28, 58, 91, 78 };
+        int sorted[] = { 97, 80, 38, 44, 51, 53, 28, 58, 91, 78 };
+
+        Array<int> a(10, elems);
+        a.sort(2, 6);
+        ASSERT(compareArray(a, 10, sorted));
+        a.sort(3, 3);
+        ASSERT(compareArray(a, 10, sorted));
+        ASSERT_EXCEPTION(Exception, a.sort(-1, 2));
+        ASSERT_EXCEPTION(Exception, a.sort(5, 4));
+        ASSERT_EXCEPTION(Exception, a.sort(0, 11));
+    }
+
+    // void select(int start, int end, int n)
+
+    {
+        int elems[] = { 97, 80, 51, 53, 38, 44, 28, 58, 91, 78 };
+
+        Array<int> a(10, elems);
+        a.select(0, 10, 4);
+        ASSERT(a[4] == 53);
+
+        for (int i = 0; i < 4; ++i)
+            ASSERT(a[i] < 53);
+
+        for (int i = 5; i < 10; ++i)
+            ASSERT(a[i] > 53);
+
+        a.select(0, 10, 10);
+        ASSERT(a[4] == 53);
+        ASSERT_EXCEPTION(Exception, a.select(2, 10, 1));
+        ASSERT_EXCEPTION(Exception, a.select(0, 10, 11));
+    }
+
+    {
+        for (int size = 1; size < 200; size += 7)
+        {
+            Array<int> a, sorted;
+
+            for (int i = 0; i < size; ++i)
+                a.addLast(i * 7919 % 101);
+
+            sorted = a;
+            sorted.sort();
+
+            for (int n = 0; n < size; n += 3)
+            {
+                Array<int> b = a;
+                b.select(0, size, n);
+                ASSERT(b[n] == sorted[n]);
+
+                for (int i = 0; i < size; ++i)
+                    ASSERT(i < n ? b[i] <= b[n] : b[i] >= b[n]);
+            }
+
+            Array<int> b = sorted;
+            b.select(0, size, size / 2);
+            ASSERT(b[size / 2] == sorted[size / 2]);
+        }
+    }
+
+    // void partialSort(int n)
+
+    {
+        int elems[] = { 97, 80, 51, 53, 38, 44, 28, 58, 91, 78 };
+
+        Array<int> a(10, elems);
+        a.partialSort(3);
+        ASSERT(a[0] == 28 && a[1] == 38 && a[2] == 44);
+
+        for (int i = 3; i < 10; ++i)
+            ASSERT(a[i] > 44);
+
+        a.partialSort(0);
+        a.partialSort(10);
+        ASSERT(a[0] == 28 && a[9] == 97);
+        ASSERT_EXCEPTION(Exception, a.partialSort(11));
+    }
+
     // void clear()
 
     {
@@ -5312,6 +5394,8 @@ void testSet()
 
     // bool contains(const _Type& value) const
 
+    ASSERT(!Set<int>().contains(1));
+
     {
         Set<int> s;
         s.add(1);
@@ -5371,6 +5455,8 @@ void testSet()
 
     // bool remove(const _Type& value)
 
+    ASSERT(!Set<int>().remove(1));
+
     {
         Set<int> s;
         s.add(1);
@@ -5504,6 +5590,72 @@ void testSetIterator()
     }
 }
 
+void testStringPool()
+{
+    {
+        StringPool p;
+        ASSERT(p.size() == 0);
+        ASSERT(p.empty());
+        ASSERT(p.find(STR("abc")) == -1);
+        ASSERT_EXCEPTION(Exception, p.chars(0));
+        ASSERT_EXCEPTION(Exception, p.str(-1));
+    }
+
+    {
+        StringPool p;
+        ASSERT(p.add(STR("abc")) == 0);
+        ASSERT(p.add(STR("def")) == 1);
+        ASSERT(p.add(STR("abc")) == 0);
+        ASSERT(p.add(STR("ab")) == 2);
+        ASSERT(p.add(STR("")) == 3);
+        ASSERT(p.add(STR("")) == 3);
+        ASSERT(p.size() == 4);
+
+        ASSERT(p.find(STR("def")) == 1);
+        ASSERT(p.find(STR("abcd"), 2) == 2);
+        ASSERT(p.find(STR("a")) == -1);
+        ASSERT(p.find(STR("")) == 3);
+
+        ASSERT(p.str(0) == STR("abc"));
+        ASSERT(p.length(2) == 2);
+        ASSERT(p.length(3) == 0);
+        ASSERT(memcmp(p.chars(1), STR("def"), 3 * sizeof(char_t)) == 0);
+        ASSERT_EXCEPTION(Exception, p.length(4));
+
+        p.clear();
+        ASSERT(p.empty());
+        ASSERT(p.find(STR("abc")) == -1);
+        ASSERT(p.add(STR("def")) == 0);
+    }
+
+    {
+        StringPool p;
+
+        for (int i = 0; i < 100000; ++i)
+        {
+            String str;
+            str.appendFormat(STR("word%d"), i);
+            ASSERT(p.add(str) == i);
+        }
+
+        const char_t* chars = p.chars(0);
+        String longStr('x', 100000);
+        ASSERT(p.add(longStr) == 100000);
+        ASSERT(p.str(100000) == longStr);
+        ASSERT(p.chars(0) == chars);
+
+        for (int i = 0; i < 100000; i += 997)
+        {
+            String str;
+            str.appendFormat(STR("word%d"), i);
+            ASSERT(p.find(str) == i);
+            ASSERT(p.str(i) == str);
+        }
+
+        ASSERT(p.size() == 100001);
+    }
+}
+
 void testFoundation()
 {
     testSwapBytes();
@@ -5521,6 +5673,7 @@ void testFoundation()
     testMapIterator();
     testSet();
     testSetIterator();
+    testStringPool();
 }
 
 void testFileOpenSuccess(bool exists, int openMode)
@@ -5608,6 +5761,23 @@ void testFile()
     }
 #endif
 
+    // static void rename(const String& oldFilename, const String& newFilename)
+
+    {
+        File f(STR("test2.txt"), FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+        f.write(3, "new");
+    }
+
+    ASSERT_NO_EXCEPTION(File::rename(STR("test2.txt"), STR("test.txt")));
+    ASSERT(!File::exists(STR("test2.txt")));
+
+    {
+        File f(STR("test.txt"));
+        ASSERT(f.size() == 3);
+    }
+
+    ASSERT_EXCEPTION(Exception, File::rename(STR("test2.txt"), STR("test.txt")));
+
     // static bool exists(const String& filename)
     // static void remove(const String& filename)
 
@@ -5746,6 +5916,72 @@ void testFile()
         f.write(sizeof(BYTES), BYTES);
         ASSERT(f.size() == 2 * sizeof(BYTES));
     }
+
+    // static int64_t modificationTime(const String& filename)
+
+    ASSERT(File::modificationTime(STR("test.txt")) > 0);
+    ASSERT_EXCEPTION(Exception, File::modificationTime(STR("nonexistent.txt")));
+
+    // MappedFile()
+    // MappedFile(const String& filename)
+    // bool open(const String& filename)
+    // void close()
+    // int64_t size() const
+    // const byte_t* data() const
+
+    {
+        MappedFile f(STR("test.txt"));
+        ASSERT(f.isOpen());
+        ASSERT(f.size() == 2 * sizeof(BYTES));
+        ASSERT(!memcmp(f.data(), BYTES, sizeof(BYTES)));
+        ASSERT(!memcmp(f.data() + sizeof(BYTES), BYTES, sizeof(BYTES)));
+        ASSERT_EXCEPTION(Exception, f.open(STR("test.txt")));
+
+        f.close();
+        ASSERT(!f.isOpen() && f.size() == 0 && !f.data());
+    }
+
+    {
+        MappedFile f;
+        ASSERT(!f.open(STR("nonexistent.txt")));
+        ASSERT(!f.isOpen());
+        ASSERT_EXCEPTION(Exception, MappedFile(STR("nonexistent.txt")));
+    }
+
+    {
+        File f(STR("test.txt"), FILE_MODE_WRITE | FILE_MODE_TRUNCATE);
+    }
+
+    {
+        MappedFile f(STR("test.txt"));
+        ASSERT(f.isOpen() && f.size() == 0 && !f.data());
+    }
+
+    // static bool Directory::exists(const String& path)
+    // static Array<DirectoryEntry> Directory::list(const String& path)
+
+    ASSERT(Directory::exists(STR(".")));
+    ASSERT(!Directory::exists(STR("test.txt")));
+    ASSERT(!Directory::exists(STR("nonexistent")));
+    ASSERT_EXCEPTION(Exception, Directory::list(STR("nonexistent")));
+
+    {
+        Array<DirectoryEntry> entries = Directory::list(STR("."));
+        int found = 0;
+
+        for (int i = 0; i < entries.size(); ++i)
+        {
+            ASSERT(entries[i].name != STR(".") && entries[i].name != STR(".."));
+
+            if (entries[i].name == STR("test.txt"))
+            {
+                ASSERT(!entries[i].directory && entries[i].size == 0);
+                ++found;
+            }
+        }
+
+        ASSERT(found == 1);
+    }
 }
 
 void testConsole()
@@ -6152,11 +6388,1240 @@ void printPlatformInfo()
     Console::writeLineFormatted(STR(" version %d"), COMPILER_VERSION);
 }
 
+void testThread()
+{
+    // Atomic
+
+    {
+        Atomic<int> a;
+        ASSERT(a.load() == 0);
+
+        a.store(1);
+        ASSERT(a.load() == 1);
+        ASSERT(a.increment() == 2);
+        ASSERT(a.decrement() == 1);
+        ASSERT(a.add(5) == 6);
+        ASSERT(a.exchange(3) == 6);
+
+        int expected = 3;
+        ASSERT(a.compareExchange(expected, 4));
+        ASSERT(a.load() == 4);
+        ASSERT(!a.compareExchange(expected, 5));
+        ASSERT(expected == 4 && a.load() == 4);
+    }
+
+    {
+        Atomic<int64_t> a(0x100000000LL);
+        ASSERT(a.increment() == 0x100000001LL);
+        ASSERT(a.add(-2) == 0xffffffffLL);
+    }
+
+    // Mutex
+    // Lock
+
+    {
+        Mutex m;
+        ASSERT(m.tryLock());
+        m.unlock();
+
+        {
+            Lock lock(m);
+        }
+
+        ASSERT(m.tryLock());
+        m.unlock();
+    }
+
+    // ConditionVariable
+
+    {
+        Mutex m;
+        ConditionVariable cond;
+
+        Lock lock(m);
+        ASSERT(!cond.wait(m, 10));
+    }
+
+    // Thread
+
+    {
+        Atomic<int> counter;
+        CounterTask task(counter);
+
+        Thread t;
+        ASSERT(!t.running());
+        ASSERT_EXCEPTION(Exception, t.join());
+
+        t.start(&task);
+        ASSERT(t.running());
+        ASSERT_EXCEPTION(Exception, t.start(&task));
+
+        t.join();
+        ASSERT(!t.running());
+        ASSERT(counter.load() == 1);
+
+        ASSERT(Thread::numProcessors() > 0);
+    }
+
+    // ThreadPool
+
+    {
+        ThreadPool pool;
+        ASSERT(pool.numThreads() == Thread::numProcessors());
+        ASSERT(pool.pending() == 0);
+        pool.wait();
+    }
+
+    {
+        Atomic<int> counter;
+        ThreadPool pool(4);
+        ASSERT(pool.numThreads() == 4);
+
+        for (int i = 0; i < 1000; ++i)
+            pool.submit(createUnique<CounterTask>(counter));
+
+        pool.wait();
+        ASSERT(pool.pending() == 0);
+        ASSERT(counter.load() == 1000);
+    }
+
+    // tasks submitted from worker threads
+
+    {
+        Atomic<int> counter;
+        ThreadPool pool(3);
+        TaskGroup group;
+
+        pool.submit(createUnique<SpawnTask>(pool, group, counter, 5), &group);
+        group.wait();
+
+        ASSERT(group.pending() == 0);
+        ASSERT(counter.load() == 1024);
+    }
+
+    // TaskGroup
+
+    {
+        Atomic<int> counter;
+        ThreadPool pool(2);
+        TaskGroup group1, group2;
+
+        group1.cancel();
+        ASSERT(group1.cancelled());
+
+        for (int i = 0; i < 100; ++i)
+        {
+            pool.submit(createUnique<CounterTask>(counter), &group1);
+            pool.submit(createUnique<CounterTask>(counter), &group2);
+        }
+
+        group1.wait();
+        group2.wait();
+        ASSERT(counter.load() == 100);
+
+        group1.reset();
+        ASSERT(!group1.cancelled());
+
+        pool.submit(createUnique<CounterTask>(counter), &group1);
+        group1.wait();
+        ASSERT(counter.load() == 101);
+
+        ASSERT(group1.wait(0));
+        pool.submit(createUnique<CounterTask>(counter), &group1);
+        while (!group1.wait(10));
+        ASSERT(counter.load() == 102);
+    }
+}
+
+void testSearch()
+{
+    const char* text = "Hello, hello WORLD\nworld";
+    const byte_t* start = reinterpret_cast<const byte_t*>(text);
+    const byte_t* end = start + strlen(text);
+
+    ByteBuffer hello(5, reinterpret_cast<const byte_t*>("hello"));
+    ByteBuffer world(5, reinterpret_cast<const byte_t*>("world"));
+    ByteBuffer missing(6, reinterpret_cast<const byte_t*>("hellox"));
+    ByteBuffer h(1, reinterpret_cast<const byte_t*>("h"));
+
+    // static const byte_t* findBytes(const byte_t* start, const byte_t* end,
+    //     const ByteBuffer& pattern, bool caseSensitive)
+
+    ASSERT(FileSearch::findBytes(start, end, hello, true) == start + 7);
+    ASSERT(FileSearch::findBytes(start, end, hello, false) == start);
+    ASSERT(FileSearch::findBytes(start + 1, end, hello, false) == start + 7);
+    ASSERT(FileSearch::findBytes(start, end, world, true) == start + 19);
+    ASSERT(FileSearch::findBytes(start, end, world, false) == start + 13);
+    ASSERT(FileSearch::findBytes(start + 20, end, world, false) == nullptr);
+    ASSERT(FileSearch::findBytes(start, end, missing, false) == nullptr);
+    ASSERT(FileSearch::findBytes(start, start + 4, hello, false) == nullptr);
+    ASSERT(FileSearch::findBytes(start, start, h, false) == nullptr);
+    ASSERT(FileSearch::findBytes(start + 8, end, h, false) == nullptr);
+    ASSERT(FileSearch::findBytes(start + 17, start + 18, ByteBuffer(1, reinterpret_cast<const byte_t*>("d")), false) ==
+           start + 17);
+
+    // static bool isBinary(const byte_t* data, int64_t size)
+
+    const byte_t binary[] = { 'a', 'b', 0, 'c' };
+
+    ASSERT(!FileSearch::isBinary(start, end - start));
+    ASSERT(FileSearch::isBinary(binary, sizeof(binary)));
+    ASSERT(!FileSearch::isBinary(binary, 2));
+    ASSERT(!FileSearch::isBinary(nullptr, 0));
+
+    // static void replaceAll(const String& text, const String& searchStr, const String& replaceStr,
+    //     bool caseSensitive, bool countOnly, ReplaceResult& result)
+
+    ReplaceResult result;
+
+    TextReplace::replaceAll(STR("abc\nxAbcabc"), STR("abc"), STR("de"), true, false, result);
+    ASSERT(result.numMatches == 2);
+    ASSERT(result.line == 1 && result.column == 1);
+    ASSERT(result.text == STR("de\nxAbcde"));
+
+    TextReplace::replaceAll(STR("abc\nxAbcabc"), STR("ABC"), STR(""), false, false, result);
+    ASSERT(result.numMatches == 3);
+    ASSERT(result.text == STR("\nx"));
+
+    TextReplace::replaceAll(STR("abc\nxAbcabc"), STR("Abc"), STR("de"), true, true, result);
+    ASSERT(result.numMatches == 1);
+    ASSERT(result.line == 2 && result.column == 2);
+    ASSERT(result.text.empty());
+
+    TextReplace::replaceAll(STR("abc"), STR("x"), STR("y"), true, false, result);
+    ASSERT(result.numMatches == 0);
+    ASSERT(result.line == 0 && result.column == 0);
+
+    // static void findMatches(const String& text, const String& searchStr, bool caseSensitive,
+    //     Array<int>& positions, const TaskGroup* group)
+
+    {
+        Array<int> positions;
+
+        MatchCounter::findMatches(STR("aaa Aa"), STR("aa"), true, positions);
+        ASSERT(positions.size() == 2);
+        ASSERT(positions[0] == 0 && positions[1] == 1);
+
+        MatchCounter::findMatches(STR("aaa Aa"), STR("AA"), false, positions);
+        ASSERT(positions.size() == 3);
+        ASSERT(positions[2] == 4);
+
+        MatchCounter::findMatches(STR("a"), STR("aa"), true, positions);
+        ASSERT(positions.empty());
+    }
+
+    // MatchCounter
+
+    {
+        ThreadPool pool(2);
+        MatchCounter counter(pool);
+
+        auto countAll = [&counter](const String& text)
+        {
+            counter.count(text);
+            while (!counter.done())
+            {
+                Timer::sleep(1000);
+                counter.count(text);
+            }
+        };
+
+        String text = STR("one two one two one");
+        counter.start(STR("one"), true);
+        countAll(text);
+
+        ASSERT(counter.numMatches() == 3);
+        ASSERT(counter.matchIndex(8) == 1);
+        ASSERT(counter.matchIndex(9) == INVALID_POSITION);
+
+        text = STR("one two oxe two one");
+        counter.textChanged(9);
+        ASSERT(!counter.done());
+        countAll(text);
+
+        ASSERT(counter.numMatches() == 2);
+        ASSERT(counter.matchIndex(16) == 1);
+
+        text = STR("one");
+        counter.textChanged(1);
+        countAll(text);
+
+        ASSERT(counter.numMatches() == 1);
+
+        // matches across chunks of the text are counted once
+
+        text.clear();
+        for (int i = 0; i < 800000; ++i)
+            text += STR("one two ");
+
+        counter.start(STR("two one"), true);
+        countAll(text);
+
+        ASSERT(counter.numMatches() == 799999);
+        ASSERT(counter.matchIndex(4 * 1024 * 1024 - 4) == 524287);
+
+        counter.start(STR("TWO"), false);
+        counter.count(text);
+        counter.cancel();
+        ASSERT(!counter.done());
+    }
+
+    // static void extractTrigrams(const byte_t* data, int64_t size, Array<uint32_t>& trigrams)
+
+    Array<uint32_t> trigrams;
+
+    TrigramIndex::extractTrigrams(reinterpret_cast<const byte_t*>("AbcaBC\nab"), 9, trigrams);
+    ASSERT(trigrams.size() == 3);
+    ASSERT(trigrams[0] == ('a' << 16 | 'b' << 8 | 'c'));
+    ASSERT(trigrams[1] == ('b' << 16 | 'c' << 8 | 'a'));
+    ASSERT(trigrams[2] == ('c' << 16 | 'a' << 8 | 'b'));
+
+    TrigramIndex::extractTrigrams(reinterpret_cast<const byte_t*>("ab"), 2, trigrams);
+    ASSERT(trigrams.empty());
+
+    TrigramIndex::extractTrigrams(nullptr, 0, trigrams);
+    ASSERT(trigrams.empty());
+
+    // static void encodePostings(const Array<int>& ids, Array<byte_t>& buffer)
+    // static const byte_t* decodePostings(const byte_t* data, const byte_t* end, int count, Array<int>& ids)
+
+    {
+        Array<int> ids, decoded;
+        Array<byte_t> buffer;
+
+        ids.addLast(0);
+        ids.addLast(1);
+        ids.addLast(200);
+        ids.addLast(100000);
+
+        TrigramIndex::encodePostings(ids, buffer);
+        ASSERT(buffer.size() == 7);
+
+        const byte_t* end = buffer.values() + buffer.size();
+        ASSERT(TrigramIndex::decodePostings(buffer.values(), end, 4, decoded) == end);
+        ASSERT(decoded.size() == 4);
+        ASSERT(decoded[0] == 0 && decoded[1] == 1 && decoded[2] == 200 && decoded[3] == 100000);
+
+        decoded.clear();
+        ASSERT(TrigramIndex::decodePostings(buffer.values(), end - 1, 4, decoded) == nullptr);
+    }
+
+    // TrigramIndex
+
+    {
+        {
+            File file(STR("trigram.txt"), FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            file.write(11, "hello world");
+        }
+
+        ThreadPool pool(2);
+        Array<String> filenames;
+
+        {
+            TrigramIndex index(pool);
+            index.open(String(), Array<String>());
+
+            while (!index.ready())
+                Timer::sleep(1000);
+
+            ASSERT(index.findCandidates(STR("hello"), filenames));
+            ASSERT(filenames.find(STR("trigram.txt")) >= 0);
+        }
+
+        // posting lists past the end of the file make the index invalid, it is built again
+
+        {
+            ByteBuffer bytes;
+
+            {
+                File file(STR(".evindex"));
+                bytes = file.read();
+            }
+
+            uint32_t numTrigrams;
+            memcpy(&numTrigrams, bytes.values() + 12, 4);
+
+            for (uint32_t i = 0; i < numTrigrams; ++i)
+                memset(bytes.values() + 32 + i * 16 + 8, 0x7f, 8);
+
+            File file(STR(".evindex"), FILE_MODE_WRITE | FILE_MODE_TRUNCATE);
+            file.write(bytes);
+        }
+
+        {
+            TrigramIndex index(pool);
+            index.open(String(), Array<String>());
+
+            while (!index.ready())
+                Timer::sleep(1000);
+
+            ASSERT(index.findCandidates(STR("hello"), filenames));
+            ASSERT(filenames.find(STR("trigram.txt")) >= 0);
+            ASSERT(index.findCandidates(STR("worlds"), filenames));
+            ASSERT(filenames.find(STR("trigram.txt")) < 0);
+        }
+
+        File::remove(STR("trigram.txt"));
+        File::remove(STR(".evindex"));
+    }
+
+    // static uint64_t charMask(const char_t* chars, int length)
+
+    ASSERT(PathIndex::charMask(STR("Ab"), 2) == PathIndex::charMask(STR("ba"), 2));
+    ASSERT((PathIndex::charMask(STR("src/editor.cpp"), 14) & PathIndex::charMask(STR("ed"), 2)) ==
+           PathIndex::charMask(STR("ed"), 2));
+    ASSERT(PathIndex::charMask(nullptr, 0) == 0);
+
+    // static int matchPath(const String& pattern, const String& path)
+
+    ASSERT(PathIndex::matchPath(STR("edcpp"), STR("src/editor.cpp")) > 0);
+    ASSERT(PathIndex::matchPath(STR("EDC"), STR("src/editor.cpp")) > 0);
+    ASSERT(PathIndex::matchPath(STR("ppe"), STR("src/editor.cpp")) < 0);
+    ASSERT(PathIndex::matchPath(STR("srced"), STR("src/editor.cpp")) > 0);
+    ASSERT(PathIndex::matchPath(STR(""), STR("a")) == 0);
+    ASSERT(PathIndex::matchPath(STR("ed"), STR("editor.cpp")) > PathIndex::matchPath(STR("ed"), STR("xeyd.cpp")));
+    ASSERT(PathIndex::matchPath(STR("main"), STR("src/main.cpp")) > PathIndex::matchPath(STR("main"), STR("main/src.cpp")));
+
+    // DirectoryCache
+
+    {
+        {
+            File f1(STR("completion1.txt"), FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            File f2(STR("completion2.txt"), FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+        }
+
+        DirectoryCache cache;
+        Array<String> completions;
+
+        cache.findCompletions(STR("completion"), 10, completions);
+        ASSERT(completions.size() == 2);
+        ASSERT(completions[0] == STR("completion1.txt") && completions[1] == STR("completion2.txt"));
+
+        cache.findCompletions(STR("./completion2"), 10, completions);
+        ASSERT(completions.size() == 1 && completions[0] == STR("./completion2.txt"));
+
+        cache.findCompletions(STR("completion"), 1, completions);
+        ASSERT(completions.size() == 1);
+
+        cache.findCompletions(STR("completionx"), 10, completions);
+        ASSERT(completions.empty());
+
+        cache.findCompletions(STR("nonexistent/x"), 10, completions);
+        ASSERT(completions.empty());
+
+        File::remove(STR("completion1.txt"));
+        File::remove(STR("completion2.txt"));
+    }
+
+    // WordCounts
+
+    {
+        WordCounts counts;
+        ASSERT(counts.empty() && counts.count(7) == 0);
+
+        counts.addCount(7, 2);
+        counts.addCount(7, 1);
+        counts.addCount(0, 1);
+        ASSERT(counts.size() == 2 && counts.count(7) == 3 && counts.count(0) == 1);
+
+        counts.addCount(7, -3);
+        ASSERT(counts.size() == 1 && counts.count(7) == 0 && counts.count(0) == 1);
+
+        // removals in the middle of probe sequences leave the rest of the words findable
+
+        const int numWords = 1000;
+        Array<int> expected(numWords, 0);
+        expected[0] = 1;
+
+        for (int i = 0; i < 5000; ++i)
+        {
+            int word = (i * 7919) % numWords;
+            int delta = i % 3 == 2 && expected[word] > 0 ? -expected[word] : 1;
+            counts.addCount(word, delta);
+            expected[word] += delta;
+        }
+
+        int size = 0;
+
+        for (int word = 0; word < numWords; ++word)
+        {
+            ASSERT(counts.count(word) == expected[word]);
+
+            if (expected[word] > 0)
+                ++size;
+        }
+
+        ASSERT(counts.size() == size);
+
+        int slotted = 0;
+
+        for (int i = 0; i < counts.numSlots(); ++i)
+            if (counts.slot(i).word >= 0)
+                ++slotted;
+
+        ASSERT(slotted == size);
+
+        counts.clear();
+        ASSERT(counts.empty() && counts.count(7) == 0);
+    }
+
+    // SuggestionIndex
+
+    {
+        SuggestionIndex index;
+        index.addCount(STR("total"), 3);
+        index.addCount(STR("tot"), 1);
+        index.addCount(STR("tomato"), 3);
+        index.addCount(STR("table"), 5);
+        index.addCount(STR("other"), 9);
+
+        ASSERT(index.size() == 5);
+        ASSERT(index.count(STR("total")) == 3 && index.count(STR("to")) == 0);
+        ASSERT(index.containsPrefix(STR("tot")) && !index.containsPrefix(STR("tx")));
+
+        Array<AutocompleteSuggestion> suggestions;
+        ASSERT(!index.findSuggestions(STR("t"), 10, suggestions));
+        ASSERT(suggestions.size() == 4);
+        ASSERT(suggestions[0].word == STR("table") && suggestions[0].rank == 5);
+        ASSERT(suggestions[1].word == STR("total") && suggestions[2].word == STR("tomato"));
+        ASSERT(suggestions[3].word == STR("tot"));
+
+        suggestions.clear();
+        ASSERT(index.findSuggestions(STR("t"), 2, suggestions));
+        ASSERT(suggestions.size() == 2 && suggestions[1].word == STR("total"));
+
+        index.accept(STR("tot"));
+        suggestions.clear();
+        index.findSuggestions(STR("to"), 10, suggestions);
+        ASSERT(suggestions.size() == 3 && suggestions[0].word == STR("tot") && suggestions[0].rank == INT_MAX);
+
+        index.addCount(STR("tot"), -1);
+        ASSERT(index.size() == 4 && index.containsPrefix(STR("tot")));
+        ASSERT(index.count(STR("tot")) == 0);
+
+        ASSERT(index.findCommonCompletion(STR("to")) == STR(""));
+        ASSERT(index.findCommonCompletion(STR("tot")) == STR("al"));
+        ASSERT(index.findCommonCompletion(STR("ta")) == STR("ble"));
+        ASSERT(index.findCommonCompletion(STR("table")) == STR(""));
+        ASSERT(index.findCommonCompletion(STR("x")) == STR(""));
+
+        index.addCount(STR("total"), -3);
+        ASSERT(!index.containsPrefix(STR("tot")));
+        ASSERT(index.findCommonCompletion(STR("to")) == STR("mato"));
+    }
+
+    {
+        // suggestions and common completions against sorted lists of the words, with characters of
+        // one to four bytes, so that the words branch in the middle of characters too
+
+        const unichar_t chars[] = { 'a', 'z', 0xe8, 0xe9, 0xff, 0x4e2d, 0x4e2e, 0x10348 };
+        const int numChars = sizeof(chars) / sizeof(chars[0]);
+
+        SuggestionIndex index;
+        Array<String> words;
+        Array<int> counts;
+        uint32_t seed = 1;
+
+        auto next = [&seed](int range)
+        {
+            seed = seed * 1103515245 + 12345;
+            return static_cast<int>((seed >> 16) % range);
+        };
+
+        for (int i = 0; i < 3000; ++i)
+        {
+            String word;
+            int len = 1 + next(4);
+
+            for (int j = 0; j < len; ++j)
+                word.append(chars[next(numChars)]);
+
+            int delta = next(4) == 0 ? -1 - next(3) : 1 + next(3);
+            index.addCount(word, delta);
+
+            int w = words.find(word);
+
+            if (w < 0)
+            {
+                w = words.size();
+                words.addLast(word);
+                counts.addLast(0);
+            }
+
+            counts[w] = counts[w] + delta > 0 ? counts[w] + delta : 0;
+        }
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            String prefix;
+            int len = 1 + next(3);
+
+            for (int j = 0; j < len; ++j)
+                prefix.append(chars[next(numChars)]);
+
+            Array<AutocompleteSuggestion> expected;
+
+            for (int w = 0; w < words.size(); ++w)
+                if (counts[w] > 0 && words[w].startsWith(prefix))
+                    expected.addLast(AutocompleteSuggestion(words[w], counts[w]));
+
+            expected.sort();
+
+            Array<AutocompleteSuggestion> suggestions;
+            index.findSuggestions(prefix, 1000, suggestions);
+
+            ASSERT(suggestions.size() == expected.size());
+
+            for (int j = 0; j < suggestions.size() && j < expected.size(); ++j)
+                ASSERT(suggestions[j].word == expected[j].word && suggestions[j].rank == expected[j].rank);
+
+            // the common completion is the common prefix of the longer words in whole characters,
+            // unless the prefix is a word itself
+
+            String common;
+
+            if (!expected.empty() && index.count(prefix) == 0)
+            {
+                const String& first = expected[0].word;
+                int end = first.length();
+
+                for (int j = 1; j < expected.size(); ++j)
+                {
+                    int pos = prefix.length();
+
+                    while (pos < end)
+                    {
+                        int nextPos = first.charForward(pos);
+
+                        if (expected[j].word.length() < nextPos ||
+                                expected[j].word.substr(pos, nextPos - pos) != first.substr(pos, nextPos - pos))
+                            break;
+
+                        pos = nextPos;
+                    }
+
+                    end = pos;
+                }
+
+                common = first.substr(prefix.length(), end - prefix.length());
+            }
+
+            ASSERT(index.findCommonCompletion(prefix) == common);
+        }
+    }
+
+    // static void encodeWords(const Array<WordCount>& words, Array<byte_t>& buffer)
+    // static const byte_t* decodeWords(const byte_t* data, const byte_t* end, Array<WordCount>& words)
+
+    {
+        Array<WordCount> words;
+        words.addLast({ 0, 1 });
+        words.addLast({ 5, 300 });
+        words.addLast({ 100000, 2 });
+
+        Array<byte_t> buffer;
+        ProjectWordIndex::encodeWords(words, buffer);
+
+        Array<WordCount> decoded;
+        const byte_t* end = buffer.values() + buffer.size();
+        ASSERT(ProjectWordIndex::decodeWords(buffer.values(), end, decoded) == end);
+        ASSERT(decoded.size() == 3);
+        ASSERT(decoded[0].id == 0 && decoded[0].count == 1 && decoded[1].id == 5 && decoded[1].count == 300);
+        ASSERT(decoded[2].id == 100000 && decoded[2].count == 2);
+
+        decoded.clear();
+        ASSERT(ProjectWordIndex::decodeWords(buffer.values(), end - 1, decoded) == nullptr);
+    }
+
+    // ProjectWordIndex
+
+    {
+        auto writeFile = [](const char_t* name, const char* text)
+        {
+            File file(name, FILE_MODE_WRITE | FILE_MODE_CREATE | FILE_MODE_TRUNCATE);
+            file.write(strlen(text), text);
+        };
+
+        ThreadPool pool(2);
+        SuggestionIndex words;
+
+        writeFile(STR("index1.words"), "alpha beta beta");
+        writeFile(STR("index2.words"), "beta gamma");
+
+        {
+            TestWordIndex index(pool);
+            index.open(String(), Array<String>(), 0);
+
+            while (!index.takeWords(words))
+                Timer::sleep(1000);
+
+            ASSERT(index.filesCounted.load() == 2);
+            ASSERT(words.size() == 3);
+            ASSERT(words.count(STR("alpha")) == 1 && words.count(STR("beta")) == 3 && words.count(STR("gamma")) == 1);
+            ASSERT(File::exists(STR(".evwords")));
+        }
+
+        // the words of the unchanged file come from the index written before
+
+        File::remove(STR("index2.words"));
+        writeFile(STR("index3.words"), "delta alpha");
+
+        {
+            TestWordIndex index(pool);
+            index.open(String(), Array<String>(), 0);
+
+            while (!index.takeWords(words))
+                Timer::sleep(1000);
+
+            ASSERT(index.filesCounted.load() == 1);
+            ASSERT(words.size() == 3);
+            ASSERT(words.count(STR("alpha")) == 2 && words.count(STR("beta")) == 2 && words.count(STR("delta")) == 1);
+            ASSERT(words.count(STR("gamma")) == 0);
+        }
+
+        // with nothing changed all the words come from the index, with other skipped types none do
+
+        {
+            TestWordIndex index(pool);
+            index.open(String(), Array<String>(), 0);
+
+            while (!index.takeWords(words))
+                Timer::sleep(1000);
+
+            ASSERT(index.filesCounted.load() == 0);
+            ASSERT(words.size() == 3 && words.count(STR("alpha")) == 2 && words.count(STR("delta")) == 1);
+
+            index.open(String(), Array<String>(), 1);
+
+            while (!index.takeWords(words))
+                Timer::sleep(1000);
+
+            ASSERT(index.filesCounted.load() == 2);
+            ASSERT(words.size() == 3 && words.count(STR("beta")) == 2);
+        }
+
+        File::remove(STR("index1.words"));
+        File::remove(STR("index3.words"));
+        File::remove(STR(".evwords"));
+    }
+
+    // Vocabulary
+
+    {
+        Vocabulary vocabulary;
+        ASSERT(!vocabulary.open(STR("vocabulary.test")));
+
+        SuggestionIndex words;
+        words.addCount(STR("table"), 10);
+        words.addCount(STR("tablet"), 1);
+        words.addCount(STR("tabloid"), 4);
+        words.addCount(STR("caféa"), 3);
+        words.addCount(STR("caféb"), 3);
+
+        ASSERT(vocabulary.save(words, 10));
+        ASSERT(vocabulary.size() == 5);
+        ASSERT(vocabulary.count(STR("table")) == 10 && vocabulary.count(STR("tab")) == 0);
+        ASSERT(vocabulary.count(STR("caféb")) == 3);
+
+        Array<AutocompleteSuggestion> suggestions;
+        ASSERT(!vocabulary.findSuggestions(STR("tab"), 3, suggestions));
+        ASSERT(suggestions.size() == 3);
+
+        suggestions.clear();
+        ASSERT(vocabulary.findSuggestions(STR("tab"), 2, suggestions));
+        suggestions.sort();
+        ASSERT(suggestions.size() == 2 && suggestions[0].word == STR("table") && suggestions[1].word == STR("tabloid"));
+
+        String completion;
+        ASSERT(vocabulary.findCommonCompletion(STR("ta"), completion) && completion == STR("bl"));
+        ASSERT(vocabulary.findCommonCompletion(STR("c"), completion) && completion == STR("afé"));
+        ASSERT(vocabulary.findCommonCompletion(STR("table"), completion) && completion == STR(""));
+        ASSERT(!vocabulary.findCommonCompletion(STR("x"), completion));
+
+        // the counts of a new session add up with the saved ones, accepted words keep their counts
+
+        SuggestionIndex newWords;
+        newWords.addCount(STR("table"), 2);
+        newWords.addCount(STR("zebra"), 5);
+        newWords.accept(STR("zebra"));
+
+        Vocabulary other;
+        ASSERT(other.open(STR("vocabulary.test")) && other.size() == 5);
+        ASSERT(other.save(newWords, 10));
+        ASSERT(other.size() == 6 && other.count(STR("table")) == 12 && other.count(STR("zebra")) == 5);
+
+        // over the limit the counts are halved and the least frequent words go, the first ones win the ties
+
+        ASSERT(other.save(SuggestionIndex(), 3));
+        ASSERT(other.size() == 6);
+
+        newWords = SuggestionIndex();
+        newWords.addCount(STR("tablet"), 1);
+        ASSERT(other.save(newWords, 3));
+        ASSERT(other.size() == 3);
+        ASSERT(other.count(STR("table")) == 6 && other.count(STR("zebra")) == 3 && other.count(STR("caféa")) == 2);
+        ASSERT(other.count(STR("tablet")) == 0 && other.count(STR("tabloid")) == 0);
+
+        vocabulary.close();
+        other.close();
+        File::remove(STR("vocabulary.test"));
+    }
+
+    // TextReplace
+
+    {
+        ThreadPool pool(2);
+        TextReplace replace(pool);
+
+        String text1 = STR("one two one"), text2 = STR("two"), text3 = STR("three");
+        Array<const String*> texts;
+        texts.addLast(&text1);
+        texts.addLast(&text2);
+        texts.addLast(&text3);
+
+        replace.start(texts, STR("two"), STR("2"), true, false);
+        while (!replace.wait(10));
+
+        ASSERT(replace.pending() == 0);
+        ASSERT(replace.results().size() == 3);
+        ASSERT(replace.results()[0].numMatches == 1 && replace.results()[0].text == STR("one 2 one"));
+        ASSERT(replace.results()[1].numMatches == 1 && replace.results()[1].text == STR("2"));
+        ASSERT(replace.results()[2].numMatches == 0);
+    }
+}
+
+void testEditor()
+{
+    Array<String> args;
+    TestEditor editor(args);
+
+    // void SyntaxHighlighter::highlightChar(const String& text, int pos, HighlightingState& state) const
+    // void SyntaxHighlighter::highlightRange(const String& text, int begin, int end, HighlightingState& state,
+    //     Array<HighlightSpan>& spans) const
+
+    {
+        // texts made of pieces that start and end tokens are lexed in ranges split at random
+        // and char by char, both give the same spans and end in the same state
+
+        const char_t* pieces[] = {
+            STR("\""), STR("'"), STR("\\"), STR("\n"), STR(" "), STR("\t"), STR("/"), STR("*"), STR("#"), STR("$"),
+            STR("{"), STR("}"), STR("<"), STR(">"), STR("!"), STR("-"), STR("="), STR("?"), STR("_"), STR("@"),
+            STR("."), STR("if"), STR("else"), STR("int"), STR("x"), STR("abc_1"), STR("12"), STR("0x1f"),
+            STR("e+"), STR("include"), STR("define"), STR("for"), STR("done"), STR("a="), STR("é"), STR("中"),
+            STR("<!--"), STR("-->"), STR("/*"), STR("*/"), STR("//"), STR("${"), STR("$x")
+        };
+
+        const int numPieces = sizeof(pieces) / sizeof(pieces[0]);
+        DocumentType documentTypes[] = { DOCUMENT_TYPE_CPP, DOCUMENT_TYPE_SHELL, DOCUMENT_TYPE_XML };
+        uint32_t seed = 1;
+
+        auto random = [&seed](int n)
+        {
+            seed = seed * 1103515245 + 12345;
+            return static_cast<int>((seed >> 16) % n);
+        };
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            String text;
+            int length = random(40);
+
+            for (int j = 0; j < length; ++j)
+                text += pieces[random(numPieces)];
+
+            for (DocumentType documentType : documentTypes)
+            {
+                const SyntaxHighlighter* syntaxHighlighter = editor.syntaxHighlighter(documentType);
+                ASSERT(syntaxHighlighter && syntaxHighlighter->documentType() == documentType);
+
+                HighlightingState charState;
+                Array<HighlightSpan> charSpans;
+
+                for (int p = 0; p < text.length(); p = text.charForward(p))
+                {
+                    syntaxHighlighter->highlightChar(text, p, charState);
+                    int q = text.charForward(p);
+
+                    if (!charSpans.empty() && charSpans.last().highlightingType == charState.highlightingType)
+                        charSpans.last().length += q - p;
+                    else
+                        charSpans.addLast({ q - p, charState.highlightingType });
+                }
+
+                HighlightingState rangeState;
+                Array<HighlightSpan> rangeSpans;
+
+                for (int p = 0, q = 0; p < text.length(); p = q)
+                {
+                    for (int k = random(6); k >= 0 && q < text.length(); --k)
+                        q = text.charForward(q);
+
+                    if (random(3) == 0)
+                        q = text.length();
+
+                    syntaxHighlighter->highlightRange(text, p, q, rangeState, rangeSpans);
+                }
+
+                ASSERT(rangeState == charState);
+                ASSERT(rangeSpans.size() == charSpans.size());
+
+                for (int j = 0; j < charSpans.size(); ++j)
+                {
+                    ASSERT(rangeSpans[j].length == charSpans[j].length);
+                    ASSERT(rangeSpans[j].highlightingType == charSpans[j].highlightingType);
+                }
+            }
+        }
+    }
+
+    // void Document::startHighlighting(BackgroundHighlighter& highlighter)
+    // void Document::finishHighlighting(BackgroundHighlighter& highlighter)
+
+    {
+        // the checkpoints after an edit that opens or closes a comment are those of the text lexed anew
+
+        BackgroundHighlighter highlighter(editor.threadPool());
+        String text;
+
+        for (int i = 0; i < 3000; ++i)
+            text += STR("int x = 1; // line\n");
+
+        auto highlightedCheckpoints = [&editor, &highlighter](const String& text)
+        {
+            TestDocument doc(&editor);
+            doc.filename(STR("checkpoints.cpp"));
+            doc.pasteText(text);
+            doc.highlight(highlighter);
+            return doc.checkpoints();
+        };
+
+        auto sameCheckpoints = [](const Array<HighlightingCheckpoint>& checkpoints1,
+                                  const Array<HighlightingCheckpoint>& checkpoints2)
+        {
+            if (checkpoints1.size() != checkpoints2.size())
+                return false;
+
+            for (int i = 0; i < checkpoints1.size(); ++i)
+                if (checkpoints1[i].position != checkpoints2[i].position ||
+                    !(checkpoints1[i].state == checkpoints2[i].state))
+                    return false;
+
+            return true;
+        };
+
+        Array<HighlightingCheckpoint> plain = highlightedCheckpoints(text);
+        Array<HighlightingCheckpoint> commented = highlightedCheckpoints(String(STR("/*")) + text);
+        ASSERT(plain.size() == 3000 / 512);
+        ASSERT(commented.size() == plain.size());
+        ASSERT(commented.last().state.highlightingType == HIGHLIGHTING_TYPE_MULTILINE_COMMENT);
+
+        TestDocument doc(&editor);
+        doc.filename(STR("checkpoints.cpp"));
+        doc.pasteText(text);
+        doc.highlight(highlighter);
+        ASSERT(sameCheckpoints(doc.checkpoints(), plain));
+
+        // the comment is opened and closed with the top lines shown, then the checkpoints are used from the end
+
+        doc.moveToStart();
+        doc.highlight(highlighter);
+
+        doc.insertChar('/');
+        doc.insertChar('*');
+        doc.highlight(highlighter);
+        doc.moveToEnd();
+        doc.highlight(highlighter);
+        ASSERT(sameCheckpoints(doc.checkpoints(), commented));
+
+        doc.moveToStart();
+        doc.highlight(highlighter);
+        doc.deleteCharForward();
+        doc.deleteCharForward();
+        doc.highlight(highlighter);
+        doc.moveToEnd();
+        doc.highlight(highlighter);
+        ASSERT(sameCheckpoints(doc.checkpoints(), plain));
+    }
+
+    // BracketIndex
+
+    {
+        BracketScanner scanner(editor.threadPool());
+
+        auto countBrackets = [](TestDocument& doc)
+        {
+            int numBrackets = 0;
+            doc.moveToStart();
+
+            while (doc.moveToNextBracket())
+            {
+                unichar_t ch = doc.text().charAt(doc.position());
+                ASSERT(ch == '(' || ch == ')' || ch == '[' || ch == ']' || ch == '{' || ch == '}');
+                ++numBrackets;
+            }
+
+            return numBrackets;
+        };
+
+        TestDocument doc(&editor);
+        doc.filename(STR("brackets.cpp"));
+        doc.pasteText(STR("void f(int a[2])\n{\n    g(\"(\", ')'); // (\n    /* { */ h(a[0]);\n}"));
+        doc.scanBrackets(scanner);
+
+        // brackets in strings, characters and comments are left out
+
+        const String& text = doc.text();
+        int brace = text.find(STR("{"));
+        ASSERT(countBrackets(doc) == 12);
+
+        doc.moveToPosition(text.find(STR("(")));
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.find(STR(")\n")));
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.find(STR("(")));
+
+        doc.moveToPosition(brace);
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.length() - 1);
+
+        doc.moveToPosition(text.find(STR("0]")));
+        ASSERT(doc.moveToEnclosingBracket() && doc.position() == text.find(STR("[0")));
+        ASSERT(doc.moveToEnclosingBracket() && doc.position() == text.find(STR("h(")) + 1);
+        ASSERT(doc.moveToEnclosingBracket() && doc.position() == brace);
+
+        // a comment opened before the brace hides the brackets up to the end of the next one
+
+        doc.moveToPosition(brace);
+        doc.insertChar('/');
+        doc.insertChar('*');
+        doc.scanBrackets(scanner);
+        ASSERT(countBrackets(doc) == 9);
+
+        doc.moveToPosition(text.length() - 1);
+        ASSERT(!doc.moveToMatchingBracket());
+
+        doc.moveToPosition(brace);
+        doc.deleteCharForward();
+        doc.deleteCharForward();
+        doc.scanBrackets(scanner);
+        ASSERT(countBrackets(doc) == 12);
+
+        doc.moveToPosition(brace);
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.length() - 1);
+
+        // edits far from the start of a long text are rescanned from the sync point before them,
+        // brackets after them are moved or, after a comment is opened, dropped
+
+        String body;
+
+        for (int i = 0; i < 2000; ++i)
+            body += STR("    g(a[i]);\n");
+
+        doc.clear();
+        doc.filename(STR("brackets.cpp"));
+        doc.pasteText(String(STR("void f()\n{\n")) + body + STR("}\n"));
+        doc.scanBrackets(scanner);
+        ASSERT(countBrackets(doc) == 4 + 4 * 2000);
+
+        int middle = text.find(STR("    g"), true, text.length() / 2);
+        doc.moveToPosition(middle);
+        doc.insertChar('x');
+        doc.scanBrackets(scanner);
+        ASSERT(countBrackets(doc) == 4 + 4 * 2000);
+
+        doc.moveToPosition(text.find(STR("{")));
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.length() - 2);
+
+        doc.moveToPosition(middle);
+        doc.insertChar('/');
+        doc.insertChar('*');
+        doc.scanBrackets(scanner);
+
+        doc.moveToPosition(text.find(STR("{")));
+        ASSERT(!doc.moveToMatchingBracket());
+        ASSERT(countBrackets(doc) < 4 + 4 * 2000);
+
+        doc.moveToPosition(middle);
+        doc.deleteCharForward();
+        doc.deleteCharForward();
+        doc.scanBrackets(scanner);
+        ASSERT(countBrackets(doc) == 4 + 4 * 2000);
+
+        doc.moveToPosition(text.find(STR("{")));
+        ASSERT(doc.moveToMatchingBracket() && doc.position() == text.length() - 2);
+    }
+
+    // bool Document::moveToNextFunction()
+    // bool Document::moveToPrevFunction()
+    // bool Document::moveToSymbol(const String& name)
+
+    {
+        BracketScanner scanner(editor.threadPool());
+        TestDocument doc(&editor);
+        doc.filename(STR("symbols.cpp"));
+        doc.pasteText(STR("namespace ns\n{\nclass Widget\n{\npublic:\n    void draw() const\n    {\n    }\n};\n\n"
+                          "int Widget::size()\n{\n    if (empty()) { return 0; }\n    return g(1);\n}\n}\n"));
+        doc.scanBrackets(scanner);
+
+        // symbols are found by name or by the last part of a qualified name, the cursor moves to the name
+
+        const String& text = doc.text();
+        doc.moveToStart();
+
+        ASSERT(doc.moveToSymbol(STR("Widget")) && doc.position() == text.find(STR("Widget\n")));
+        ASSERT(doc.moveToSymbol(STR("size")) && doc.position() == text.find(STR("Widget::size")));
+        ASSERT(doc.moveToSymbol(STR("Widget::size")) && doc.position() == text.find(STR("Widget::size")));
+        ASSERT(doc.moveToSymbol(STR("ns")) && doc.position() == text.find(STR("ns\n")));
+        ASSERT(doc.moveToSymbol(STR("draw")) && doc.position() == text.find(STR("draw")));
+        ASSERT(!doc.moveToSymbol(STR("ize")) && !doc.moveToSymbol(STR("empty")));
+
+        // functions are the bodies after a parameter list, not blocks of statements or classes
+
+        doc.moveToStart();
+        ASSERT(doc.moveToNextFunction() && doc.position() == text.find(STR("draw")));
+        ASSERT(doc.moveToNextFunction() && doc.position() == text.find(STR("Widget::size")));
+        ASSERT(!doc.moveToNextFunction());
+
+        doc.moveToEnd();
+        ASSERT(doc.moveToPrevFunction() && doc.position() == text.find(STR("Widget::size")));
+        ASSERT(doc.moveToPrevFunction() && doc.position() == text.find(STR("draw")));
+        ASSERT(!doc.moveToPrevFunction());
+
+        // a function in a comment is no symbol, once the comment is closed it is found again
+
+        doc.moveToPosition(text.find(STR("int Widget")));
+        doc.insertChar('/');
+        doc.insertChar('*');
+        doc.moveToPosition(text.length() - 2);
+        doc.insertChar('*');
+        doc.insertChar('/');
+        doc.scanBrackets(scanner);
+
+        ASSERT(!doc.moveToSymbol(STR("size")));
+        doc.moveToStart();
+        ASSERT(doc.moveToNextFunction() && doc.position() == text.find(STR("draw")));
+        ASSERT(!doc.moveToNextFunction());
+
+        doc.moveToPosition(text.find(STR("/*int")));
+        doc.deleteCharForward();
+        doc.deleteCharForward();
+        doc.scanBrackets(scanner);
+
+        ASSERT(doc.moveToSymbol(STR("size")) && doc.position() == text.find(STR("Widget::size")));
+    }
+
+    // void Document::textChanging(int pos, int end)
+    // void Document::textChanged(int pos, int end = -1)
+
+    {
+        // the words of an edit are lexed from the checkpoint before it, the checkpoints made when the text
+        // is counted are moved by an edit before them, so an edit at the end of a long text lexes a little of it
+
+        const int maxCharsLexed = 2 * 64 * 1024;
+        const CountingSyntaxHighlighter& syntaxHighlighter = editor.countCharsLexed(DOCUMENT_TYPE_CPP);
+
+        auto checkStates = [&syntaxHighlighter](const TestDocument& doc)
+        {
+            const String& text = doc.text();
+            const Array<HighlightingCheckpoint>& checkpoints = doc.wordsCheckpoints();
+            HighlightingState state;
+            int i = 0;
+
+            for (int p = 0; p < text.length() && i < checkpoints.size(); p = text.charForward(p))
+            {
+                if (checkpoints[i].position == p)
+                {
+                    ASSERT(checkpoints[i].state == state && state.charsRemaining == 0);
+                    ++i;
+                }
+
+                syntaxHighlighter.highlightChar(text, p, state);
+            }
+
+            ASSERT(i == checkpoints.size());
+        };
+
+        auto sameCounts = [](const WordCounts& counts1, const WordCounts& counts2)
+        {
+            if (counts1.size() != counts2.size())
+                return false;
+
+            for (int i = 0; i < counts1.numSlots(); ++i)
+            {
+                const WordSlot& slot = counts1.slot(i);
+
+                if (slot.word >= 0 && counts2.count(slot.word) != slot.count)
+                    return false;
+            }
+
+            return true;
+        };
+
+        String text;
+
+        for (int i = 0; i < 40000; ++i)
+            text += STR("int value = 1; // a comment line\n");
+
+        TestDocument doc(&editor);
+        doc.filename(STR("words.cpp"));
+        doc.pasteText(text);
+        doc.save();
+
+        doc.open(STR("words.cpp"));
+        ASSERT(doc.wordsCheckpoints().size() > text.length() / maxCharsLexed);
+        checkStates(doc);
+
+        syntaxHighlighter.charsLexed = 0;
+        doc.moveToStart();
+        doc.insertChar('x');
+        doc.moveToEnd();
+        doc.insertChar('y');
+        ASSERT(syntaxHighlighter.charsLexed < maxCharsLexed);
+        checkStates(doc);
+
+        // a comment opened at the start changes the states of all the checkpoints, they are kept in the new state
+
+        doc.moveToStart();
+        doc.insertChar('/');
+        doc.insertChar('*');
+        checkStates(doc);
+
+        syntaxHighlighter.charsLexed = 0;
+        doc.moveToEnd();
+        doc.insertChar('z');
+        ASSERT(syntaxHighlighter.charsLexed < maxCharsLexed);
+        checkStates(doc);
+
+        // a long text pasted between checkpoints gets checkpoints of its own the first time it is lexed
+
+        doc.moveToStart();
+        doc.deleteCharForward();
+        doc.deleteCharForward();
+        doc.moveLines(100);
+        doc.pasteText(text);
+        doc.moveLines(-100);
+        doc.insertChar('w');
+
+        syntaxHighlighter.charsLexed = 0;
+        doc.moveLines(-20000);
+        doc.insertChar('v');
+        ASSERT(syntaxHighlighter.charsLexed < maxCharsLexed);
+        checkStates(doc);
+
+        doc.save();
+        TestDocument other(&editor);
+        other.open(STR("words.cpp"));
+        ASSERT(sameCounts(doc.wordCounts(), other.wordCounts()));
+
+        File::remove(STR("words.cpp"));
+    }
+}
+
 void runTests()
 {
     printPlatformInfo();
     testSupport();
     testFoundation();
+    testThread();
+    testSearch();
+    testEditor();
 }
 
 void run(const Array<String>& args)
@@ -4,6 +4,9 @@
 #include <foundation.h>
 #include <console.h>
 #include <file.h>
+#include <thread.h>
+#include <search.h>
+#include <editor.h>
 
 // Test
 
@@ -100,4 +103,201 @@ struct Derived : public Base
     }
 };
 
+// CounterTask
+
+struct CounterTask : public Task
+{
+    Atomic<int>& counter;
+
+    CounterTask(Atomic<int>& counter) : counter(counter)
+    {
+    }
+
+    void run() override
+    {
+        counter.increment();
+    }
+};
+
+// SpawnTask
+
+struct SpawnTask : public Task
+{
+    ThreadPool& pool;
+    TaskGroup& group;
+    Atomic<int>& counter;
+    int depth;
+
+    SpawnTask(ThreadPool& pool, TaskGroup& group, Atomic<int>& counter, int depth) :
+        pool(pool), group(group), counter(counter), depth(depth)
+    {
+    }
+
+    void run() override
+    {
+        if (depth > 0)
+        {
+            for (int i = 0; i < 4; ++i)
+                pool.submit(createUnique<SpawnTask>(pool, group, counter, depth - 1), &group);
+        }
+        else
+            counter.increment();
+    }
+};
+
+// TestWordIndex
+
+class TestWordIndex : public ProjectWordIndex
+{
+public:
+    TestWordIndex(ThreadPool& threadPool) : ProjectWordIndex(threadPool), filesCounted(0)
+    {
+    }
+
+    ~TestWordIndex()
+    {
+        close();
+    }
+
+    mutable Atomic<int> filesCounted;
+
+protected:
+    bool indexed(const String& name) const override
+    {
+        return name.endsWith(STR(".words"));
+    }
+
+    void countWords(const String& name, const String& text, Map<String, int>& counts) const override
+    {
+        filesCounted.increment();
+
+        for (int p = 0, q = 0; p < text.length(); p = q + 1)
+        {
+            q = text.find(STR(" "), true, p);
+
+            if (q < 0)
+                q = text.length();
+
+            if (q > p)
+                counts[text.substr(p, q - p)] += 1;
+        }
+    }
+};
+
+// CountingSyntaxHighlighter
+
+class CountingSyntaxHighlighter : public SyntaxHighlighter
+{
+public:
+    CountingSyntaxHighlighter(Unique<SyntaxHighlighter>&& syntaxHighlighter) :
+        SyntaxHighlighter(syntaxHighlighter->documentType()), charsLexed(0),
+        _syntaxHighlighter(static_cast<Unique<SyntaxHighlighter>&&>(syntaxHighlighter))
+    {
+    }
+
+    mutable int charsLexed;
+
+    void highlightChar(const String& text, int pos, HighlightingState& state) const override
+    {
+        ++charsLexed;
+        _syntaxHighlighter->highlightChar(text, pos, state);
+    }
+
+    void highlightRange(const String& text, int begin, int end, HighlightingState& state,
+                        Array<HighlightSpan>& spans) const override
+    {
+        charsLexed += end - begin;
+        _syntaxHighlighter->highlightRange(text, begin, end, state, spans);
+    }
+
+protected:
+    Unique<SyntaxHighlighter> _syntaxHighlighter;
+};
+
+// TestEditor
+
+class TestEditor : public Editor
+{
+public:
+    TestEditor(const Array<String>& args) : Editor(args)
+    {
+    }
+
+    const CountingSyntaxHighlighter& countCharsLexed(DocumentType documentType)
+    {
+        // the highlighter of the type is wrapped in one that counts the characters it lexes
+
+        syntaxHighlighter(documentType);
+
+        for (auto node = _syntaxHighlighters.first(); node; node = node->next)
+            if (node->value->documentType() == documentType)
+                node->value = createUnique<CountingSyntaxHighlighter>(
+                    static_cast<Unique<SyntaxHighlighter>&&>(node->value));
+
+        return static_cast<const CountingSyntaxHighlighter&>(*syntaxHighlighter(documentType));
+    }
+};
+
+// TestDocument
+
+class TestDocument : public Document
+{
+public:
+    TestDocument(Editor* editor) : Document(editor)
+    {
+        setDimensions(1, 1, 80, 24);
+    }
+
+    const Array<HighlightingCheckpoint>& checkpoints() const
+    {
+        return _checkpoints;
+    }
+
+    const Array<HighlightingCheckpoint>& wordsCheckpoints() const
+    {
+        return _wordsCheckpoints;
+    }
+
+    void moveToPosition(int pos)
+    {
+        setPositionLineColumn(pos);
+    }
+
+    void highlight(BackgroundHighlighter& highlighter)
+    {
+        // the text is drawn and lexed in turns until the drawn lines need nothing more, as between keys
+
+        Buffer<ScreenCell> screen(width() * height());
+
+        for (;;)
+        {
+            draw(width(), screen, false);
+
+            if (!highlightingNeeded())
+                break;
+
+            startHighlighting(highlighter);
+
+            while (!highlighter.wait(1000))
+                ;
+
+            finishHighlighting(highlighter);
+        }
+    }
+
+    void scanBrackets(BracketScanner& scanner)
+    {
+        // scans are run until the index has caught up with the last edit, as before a bracket command
+
+        indexBrackets();
+
+        while (bracketScanNeeded())
+        {
+            startBracketScan(scanner, _editor->syntaxHighlighter(_documentType));
+            scanner.wait();
+            finishBracketScan(scanner);
+        }
+    }
+};
+
 #endif
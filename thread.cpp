@@ -0,0 +1,421 @@
+#include <thread.h>
+
+// Mutex
+
+Mutex::Mutex()
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeCriticalSection(&_mutex);
+#else
+    int rc = pthread_mutex_init(&_mutex, nullptr);
+    ASSERT(rc == 0);
+#endif
+}
+
+Mutex::~Mutex()
+{
+#ifdef PLATFORM_WINDOWS
+    DeleteCriticalSection(&_mutex);
+#else
+    pthread_mutex_destroy(&_mutex);
+#endif
+}
+
+void Mutex::lock()
+{
+#ifdef PLATFORM_WINDOWS
+    EnterCriticalSection(&_mutex);
+#else
+    int rc = pthread_mutex_lock(&_mutex);
+    ASSERT(rc == 0);
+#endif
+}
+
+bool Mutex::tryLock()
+{
+#ifdef PLATFORM_WINDOWS
+    return TryEnterCriticalSection(&_mutex) != 0;
+#else
+    return pthread_mutex_trylock(&_mutex) == 0;
+#endif
+}
+
+void Mutex::unlock()
+{
+#ifdef PLATFORM_WINDOWS
+    LeaveCriticalSection(&_mutex);
+#else
+    int rc = pthread_mutex_unlock(&_mutex);
+    ASSERT(rc == 0);
+#endif
+}
+
+// ConditionVariable
+
+ConditionVariable::ConditionVariable()
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeConditionVariable(&_cond);
+#else
+    int rc = pthread_cond_init(&_cond, nullptr);
+    ASSERT(rc == 0);
+#endif
+}
+
+ConditionVariable::~ConditionVariable()
+{
+#ifndef PLATFORM_WINDOWS
+    pthread_cond_destroy(&_cond);
+#endif
+}
+
+void ConditionVariable::wait(Mutex& mutex)
+{
+#ifdef PLATFORM_WINDOWS
+    BOOL rc = SleepConditionVariableCS(&_cond, &mutex._mutex, INFINITE);
+    ASSERT(rc);
+#else
+    int rc = pthread_cond_wait(&_cond, &mutex._mutex);
+    ASSERT(rc == 0);
+#endif
+}
+
+bool ConditionVariable::wait(Mutex& mutex, int timeout)
+{
+    ASSERT(timeout >= 0);
+
+#ifdef PLATFORM_WINDOWS
+    return SleepConditionVariableCS(&_cond, &mutex._mutex, timeout) != 0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (timeout % 1000) * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_cond_timedwait(&_cond, &mutex._mutex, &ts) == 0;
+#endif
+}
+
+void ConditionVariable::notify()
+{
+#ifdef PLATFORM_WINDOWS
+    WakeConditionVariable(&_cond);
+#else
+    int rc = pthread_cond_signal(&_cond);
+    ASSERT(rc == 0);
+#endif
+}
+
+void ConditionVariable::notifyAll()
+{
+#ifdef PLATFORM_WINDOWS
+    WakeAllConditionVariable(&_cond);
+#else
+    int rc = pthread_cond_broadcast(&_cond);
+    ASSERT(rc == 0);
+#endif
+}
+
+// Thread
+
+Thread::Thread() : _running(false)
+{
+}
+
+Thread::~Thread()
+{
+    if (_running)
+        join();
+}
+
+void Thread::start(Task* task)
+{
+    ASSERT(task);
+
+    if (_running)
+        throw Exception(STR("thread already running"));
+
+#ifdef PLATFORM_WINDOWS
+    _thread = CreateThread(nullptr, 0, threadProc, task, 0, nullptr);
+    if (!_thread)
+#else
+    if (pthread_create(&_thread, nullptr, threadProc, task) != 0)
+#endif
+        throw Exception(STR("failed to create thread"));
+
+    _running = true;
+}
+
+void Thread::join()
+{
+    if (!_running)
+        throw Exception(STR("thread not running"));
+
+#ifdef PLATFORM_WINDOWS
+    DWORD rc = WaitForSingleObject(_thread, INFINITE);
+    ASSERT(rc == WAIT_OBJECT_0);
+    CloseHandle(_thread);
+#else
+    int rc = pthread_join(_thread, nullptr);
+    ASSERT(rc == 0);
+#endif
+
+    _running = false;
+}
+
+int Thread::numProcessors()
+{
+#ifdef PLATFORM_WINDOWS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = info.dwNumberOfProcessors;
+#else
+    int n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return n > 0 ? n : 1;
+}
+
+#ifdef PLATFORM_WINDOWS
+DWORD WINAPI Thread::threadProc(void* arg)
+#else
+void* Thread::threadProc(void* arg)
+#endif
+{
+    Task* task = reinterpret_cast<Task*>(arg);
+
+    try
+    {
+        task->run();
+    }
+    catch (Exception& ex)
+    {
+        reportError(ex.message());
+    }
+    catch (...)
+    {
+        reportError(STR("unknown error"));
+    }
+
+#ifdef PLATFORM_WINDOWS
+    return 0;
+#else
+    return nullptr;
+#endif
+}
+
+// TaskGroup
+
+void TaskGroup::wait()
+{
+    Lock lock(_mutex);
+
+    while (_pending.load() > 0)
+        _done.wait(_mutex);
+}
+
+bool TaskGroup::wait(int timeout)
+{
+    ASSERT(timeout >= 0);
+
+    Lock lock(_mutex);
+
+    if (_pending.load() > 0)
+        _done.wait(_mutex, timeout);
+
+    return _pending.load() == 0;
+}
+
+void TaskGroup::taskDone()
+{
+    // the count goes to zero under the lock, otherwise a waiter could see it, return and destroy the group
+    // before it is notified
+
+    Lock lock(_mutex);
+
+    if (_pending.decrement() == 0)
+        _done.notifyAll();
+}
+
+// ThreadPool
+
+thread_local ThreadPool::Worker* ThreadPool::_currentWorker = nullptr;
+
+ThreadPool::ThreadPool(int numThreads) :
+    _numThreads(numThreads > 0 ? numThreads : Thread::numProcessors()),
+    _stop(false)
+{
+    start();
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        Lock lock(_mutex);
+        _stop = true;
+        _taskAvailable.notifyAll();
+    }
+
+    for (int i = 0; i < _workers.size(); ++i)
+    {
+        Worker& worker = *_workers[i];
+
+        if (worker.thread.running())
+            worker.thread.join();
+
+        for (ListNode<QueuedTask>* node = worker.tasks.first(); node; node = node->next)
+        {
+            if (node->value.group)
+                node->value.group->taskDone();
+
+            Memory::destroy(node->value.task);
+        }
+    }
+}
+
+void ThreadPool::start()
+{
+    for (int i = 0; i < _numThreads; ++i)
+    {
+        Unique<Worker> worker = createUnique<Worker>();
+        worker->pool = this;
+        worker->index = i;
+        _workers.addLast(static_cast<Unique<Worker>&&>(worker));
+    }
+
+    for (int i = 0; i < _numThreads; ++i)
+        _workers[i]->thread.start(_workers[i].ptr());
+}
+
+void ThreadPool::submit(Unique<Task>&& task, TaskGroup* group)
+{
+    ASSERT(!task.empty());
+
+    QueuedTask queuedTask;
+    queuedTask.task = task.release();
+    queuedTask.group = group;
+
+    if (group)
+        group->taskAdded();
+
+    _pending.increment();
+
+    // tasks spawned by a worker go to its own deque, others are distributed round robin
+
+    Worker* worker = _currentWorker && _currentWorker->pool == this ? _currentWorker :
+        _workers[static_cast<unsigned>(_nextWorker.increment()) % _numThreads].ptr();
+
+    {
+        Lock lock(worker->mutex);
+        worker->tasks.addLast(queuedTask);
+    }
+
+    _queued.increment();
+
+    Lock lock(_mutex);
+    _taskAvailable.notify();
+}
+
+void ThreadPool::wait()
+{
+    ASSERT(!_currentWorker || _currentWorker->pool != this);
+
+    Lock lock(_mutex);
+
+    while (_pending.load() > 0)
+        _idle.wait(_mutex);
+}
+
+bool ThreadPool::takeTask(int index, QueuedTask& queuedTask)
+{
+    // own tasks are taken LIFO for locality, other workers' tasks are stolen FIFO
+
+    {
+        Worker& worker = *_workers[index];
+        Lock lock(worker.mutex);
+
+        if (!worker.tasks.empty())
+        {
+            queuedTask = worker.tasks.last()->value;
+            worker.tasks.removeLast();
+            _queued.decrement();
+            return true;
+        }
+    }
+
+    for (int i = 1; i < _numThreads; ++i)
+    {
+        Worker& victim = *_workers[(index + i) % _numThreads];
+        Lock lock(victim.mutex);
+
+        if (!victim.tasks.empty())
+        {
+            queuedTask = victim.tasks.first()->value;
+            victim.tasks.removeFirst();
+            _queued.decrement();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::runTask(QueuedTask& queuedTask)
+{
+    if (!queuedTask.group || !queuedTask.group->cancelled())
+    {
+        try
+        {
+            queuedTask.task->run();
+        }
+        catch (Exception& ex)
+        {
+            reportError(ex.message());
+        }
+        catch (...)
+        {
+            reportError(STR("unknown error"));
+        }
+    }
+
+    Memory::destroy(queuedTask.task);
+
+    if (queuedTask.group)
+        queuedTask.group->taskDone();
+
+    if (_pending.decrement() == 0)
+    {
+        Lock lock(_mutex);
+        _idle.notifyAll();
+    }
+}
+
+void ThreadPool::Worker::run()
+{
+    _currentWorker = this;
+    QueuedTask queuedTask;
+
+    while (true)
+    {
+        if (pool->takeTask(index, queuedTask))
+        {
+            pool->runTask(queuedTask);
+            continue;
+        }
+
+        Lock lock(pool->_mutex);
+
+        while (!pool->_stop && pool->_queued.load() <= 0)
+            pool->_taskAvailable.wait(pool->_mutex);
+
+        if (pool->_stop)
+            break;
+    }
+}
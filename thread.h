@@ -0,0 +1,361 @@
+#ifndef THREAD_INCLUDED
+#define THREAD_INCLUDED
+
+#include <foundation.h>
+
+#ifndef PLATFORM_WINDOWS
+#include <pthread.h>
+#endif
+
+// Atomic
+
+template<typename _Type>
+class Atomic
+{
+    static_assert(sizeof(_Type) == 4 || sizeof(_Type) == 8, "unsupported atomic type");
+
+public:
+    Atomic() : _value()
+    {
+    }
+
+    Atomic(_Type value) : _value(value)
+    {
+    }
+
+    Atomic(const Atomic<_Type>&) = delete;
+    Atomic<_Type>& operator=(const Atomic<_Type>&) = delete;
+
+#ifdef COMPILER_VISUAL_CPP
+
+    _Type load() const
+    {
+        _Type value = _value;
+        MemoryBarrier();
+        return value;
+    }
+
+    void store(_Type value)
+    {
+        exchange(value);
+    }
+
+    _Type exchange(_Type value)
+    {
+        _Type expected = _value;
+        while (!compareExchange(expected, value));
+        return expected;
+    }
+
+    bool compareExchange(_Type& expected, _Type desired)
+    {
+        _Type prev;
+
+        if (sizeof(_Type) == 4)
+        {
+            LONG val = InterlockedCompareExchange(reinterpret_cast<volatile LONG*>(&_value),
+                *reinterpret_cast<LONG*>(&desired), *reinterpret_cast<LONG*>(&expected));
+            prev = *reinterpret_cast<_Type*>(&val);
+        }
+        else
+        {
+            LONG64 val = InterlockedCompareExchange64(reinterpret_cast<volatile LONG64*>(&_value),
+                *reinterpret_cast<LONG64*>(&desired), *reinterpret_cast<LONG64*>(&expected));
+            prev = *reinterpret_cast<_Type*>(&val);
+        }
+
+        if (prev == expected)
+            return true;
+
+        expected = prev;
+        return false;
+    }
+
+    _Type add(_Type value)
+    {
+        _Type expected = _value;
+        while (!compareExchange(expected, expected + value));
+        return expected + value;
+    }
+
+#else
+
+    _Type load() const
+    {
+        return __atomic_load_n(&_value, __ATOMIC_SEQ_CST);
+    }
+
+    void store(_Type value)
+    {
+        __atomic_store_n(&_value, value, __ATOMIC_SEQ_CST);
+    }
+
+    _Type exchange(_Type value)
+    {
+        return __atomic_exchange_n(&_value, value, __ATOMIC_SEQ_CST);
+    }
+
+    bool compareExchange(_Type& expected, _Type desired)
+    {
+        return __atomic_compare_exchange_n(&_value, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+
+    _Type add(_Type value)
+    {
+        return __atomic_add_fetch(&_value, value, __ATOMIC_SEQ_CST);
+    }
+
+#endif
+
+    _Type increment()
+    {
+        return add(1);
+    }
+
+    _Type decrement()
+    {
+        return add(-1);
+    }
+
+protected:
+    volatile _Type _value;
+};
+
+// Mutex
+
+class ConditionVariable;
+
+class Mutex
+{
+public:
+    friend class ConditionVariable;
+
+public:
+    Mutex();
+    Mutex(const Mutex&) = delete;
+    Mutex& operator=(const Mutex&) = delete;
+    ~Mutex();
+
+    void lock();
+    bool tryLock();
+    void unlock();
+
+protected:
+#ifdef PLATFORM_WINDOWS
+    CRITICAL_SECTION _mutex;
+#else
+    pthread_mutex_t _mutex;
+#endif
+};
+
+// Lock
+
+class Lock
+{
+public:
+    Lock(Mutex& mutex) : _mutex(mutex)
+    {
+        _mutex.lock();
+    }
+
+    Lock(const Lock&) = delete;
+    Lock& operator=(const Lock&) = delete;
+
+    ~Lock()
+    {
+        _mutex.unlock();
+    }
+
+protected:
+    Mutex& _mutex;
+};
+
+// ConditionVariable
+
+class ConditionVariable
+{
+public:
+    ConditionVariable();
+    ConditionVariable(const ConditionVariable&) = delete;
+    ConditionVariable& operator=(const ConditionVariable&) = delete;
+    ~ConditionVariable();
+
+    void wait(Mutex& mutex);
+    bool wait(Mutex& mutex, int timeout);
+
+    void notify();
+    void notifyAll();
+
+protected:
+#ifdef PLATFORM_WINDOWS
+    CONDITION_VARIABLE _cond;
+#else
+    pthread_cond_t _cond;
+#endif
+};
+
+// Task
+
+class Task
+{
+public:
+    virtual ~Task()
+    {
+    }
+
+    virtual void run() = 0;
+};
+
+// Thread
+
+class Thread
+{
+public:
+    Thread();
+    Thread(const Thread&) = delete;
+    Thread& operator=(const Thread&) = delete;
+    ~Thread();
+
+    bool running() const
+    {
+        return _running;
+    }
+
+    void start(Task* task);
+    void join();
+
+    static int numProcessors();
+
+protected:
+#ifdef PLATFORM_WINDOWS
+    static DWORD WINAPI threadProc(void* arg);
+#else
+    static void* threadProc(void* arg);
+#endif
+
+protected:
+    bool _running;
+#ifdef PLATFORM_WINDOWS
+    HANDLE _thread;
+#else
+    pthread_t _thread;
+#endif
+};
+
+// TaskGroup
+
+class TaskGroup
+{
+public:
+    TaskGroup() : _pending(0), _cancelled(false)
+    {
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup()
+    {
+        cancel();
+        wait();
+    }
+
+    int pending() const
+    {
+        return _pending.load();
+    }
+
+    bool cancelled() const
+    {
+        return _cancelled.load() != 0;
+    }
+
+    void cancel()
+    {
+        _cancelled.store(1);
+    }
+
+    void reset()
+    {
+        ASSERT(pending() == 0);
+        _cancelled.store(0);
+    }
+
+    void wait();
+    bool wait(int timeout);
+
+    void taskAdded()
+    {
+        _pending.increment();
+    }
+
+    void taskDone();
+
+protected:
+    Atomic<int> _pending;
+    Atomic<int> _cancelled;
+    Mutex _mutex;
+    ConditionVariable _done;
+};
+
+// ThreadPool
+
+class ThreadPool
+{
+public:
+    ThreadPool(int numThreads = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int numThreads() const
+    {
+        return _numThreads;
+    }
+
+    int pending() const
+    {
+        return _pending.load();
+    }
+
+    void submit(Unique<Task>&& task, TaskGroup* group = nullptr);
+    void wait();
+
+protected:
+    struct QueuedTask
+    {
+        Task* task;
+        TaskGroup* group;
+    };
+
+    struct Worker : public Task
+    {
+        ThreadPool* pool;
+        int index;
+        Thread thread;
+        Mutex mutex;
+        List<QueuedTask> tasks;
+
+        void run() override;
+    };
+
+    void start();
+    bool takeTask(int index, QueuedTask& queuedTask);
+    void runTask(QueuedTask& queuedTask);
+
+protected:
+    int _numThreads;
+    Array<Unique<Worker>> _workers;
+    Atomic<int> _pending;
+    Atomic<int> _queued;
+    Atomic<int> _nextWorker;
+    bool _stop;
+
+    Mutex _mutex;
+    ConditionVariable _taskAvailable;
+    ConditionVariable _idle;
+
+    static thread_local Worker* _currentWorker;
+};
+
+#endif